@@ -0,0 +1,51 @@
+#!/bin/bash
+# crawlbench.sh -- crawler throughput against the stub server, from
+# one thread up to maxthreads
+#
+# usage: crawlbench.sh [npages] [maxthreads] [stubserver options...]
+#
+# Serves a generated site of npages pages (default 1000) and crawls
+# all of it with 1, 2, 4, ... maxthreads threads (default 16). Prints
+# one result per line: crawl threads=<n> <pages/s> pages/s, with the
+# pages saved and the speedup over one thread. Set PORT to serve on
+# another port than 8090.
+#
+# Tian Xia (tian.xia.ug@dartmouth.edu) - December 4, 2021
+
+set -e
+cd "$(dirname "$0")"
+NPAGES=${1:-1000}
+MAXTHREADS=${2:-16}
+shift $(( $# < 2 ? $# : 2 ))
+PORT=${PORT:-8090}
+
+make -s stubserver crawler
+WORK=$(mktemp -d)
+./stubserver --port "$PORT" --pages "$NPAGES" "$@" > "$WORK/server.log" &
+SERVER=$!
+trap 'kill $SERVER 2>/dev/null; wait $SERVER 2>/dev/null; rm -rf "$WORK"' EXIT
+
+# Wait for the server to listen
+for i in $(seq 50); do
+    grep -q Serving "$WORK/server.log" && break
+    kill -0 $SERVER 2>/dev/null || { cat "$WORK/server.log"; exit 1; }
+    sleep 0.1
+done
+
+now() { date +%s%N; }
+echo "# stage      parameter               value unit"
+base=
+for (( threads = 1; threads <= MAXTHREADS; threads *= 2 )); do
+    rm -rf "$WORK/pages"
+    start=$(now)
+    TSE_LOG=error ./crawler "http://127.0.0.1:$PORT/p1.html" "$WORK/pages" \
+        "$NPAGES" "$threads" > /dev/null
+    end=$(now)
+    pages=$(ls "$WORK/pages" | grep -c '^[0-9]*$' || true)
+    rate=$(awk -v n="$pages" -v ns=$(( end - start )) \
+           'BEGIN { printf "%.1f", n / (ns / 1e9) }')
+    base=${base:-$rate}
+    printf "%-12s %-16s %12s %-8s pages=%d speedup=%.2f\n" crawl \
+           "threads=$threads" "$rate" pages/s "$pages" \
+           "$(awk -v r="$rate" -v b="$base" 'BEGIN { print r / b }')"
+done
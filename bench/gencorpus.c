@@ -0,0 +1,240 @@
+/****************************************************************
+ * file   gencorpus.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   December 3, 2021
+ *
+ * Generates a synthetic crawl: a pagedir of pages in the pagesave()
+ * format, as the crawler would have saved them, and optionally a
+ * query log in the format of querier/tests/good-queries.txt.
+ *
+ * Page words are drawn with Zipf frequencies from a vocabulary of
+ * synthetic words. The pages form a link graph: every page but the
+ * first is linked from an earlier page, which makes its depth one
+ * more than that page's, and has more links to pages drawn with
+ * Zipf frequencies, so that a few pages are linked from many. The
+ * same options and seed always give the same corpus.
+ *
+ * usage: gencorpus [--vocab <n>] [--skew <s>] [--words <n>]
+ *                  [--links <n>] [--seed <n>] [--prefix <url>]
+ *                  <pagedir> <npages> [<queryfile> <nqueries>]
+ *
+****************************************************************/
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include<sys/types.h>
+#include<sys/stat.h>
+#include"webpage.h"
+#include"pageio.h"
+#include"zipf.h"
+
+
+/****************************************************************
+ * Define macro, structs, globals and helper functions
+****************************************************************/
+#define __MAXWORD 32
+#define __MAXURL 512
+#define __QUERYWORDS 3              // Most words in a query
+#define USAGE "usage: gencorpus [--vocab <n>] [--skew <s>] [--words <n>] " \
+              "[--links <n>] [--seed <n>] [--prefix <url>]\n" \
+              "                 <pagedir> <npages> [<queryfile> <nqueries>]\n"
+
+// Command line options, with their defaults
+struct {
+    int vocab;                      // Distinct words
+    double skew;                    // Zipf skew of words and links
+    int words;                      // Mean words per page
+    int links;                      // Links per page besides the tree
+    uint64_t seed;
+    char *prefix;                   // Page i is <prefix>/p<i>.html
+    char *pagedir;
+    int npages;
+    char *queryfile;
+    int nqueries;
+} opts = {20000, 1.0, 300, 4, 1, "http://127.0.0.1:8080/corpus", NULL, 0,
+          NULL, 0};
+
+// A growable string
+typedef struct buf {
+    char *s;
+    size_t len, cap;
+} buf_t;
+
+static void append(buf_t *b, const char *s) {
+    size_t n = strlen(s);
+    if(b->len + n + 1 > b->cap) {
+        while(b->len + n + 1 > b->cap) b->cap = b->cap ? 2 * b->cap : 4096;
+        b->s = (char*)realloc(b->s, b->cap);
+    }
+    memcpy(b->s + b->len, s, n + 1);
+    b->len += n;
+}
+
+static void pageurl(int id, char *url) {
+    snprintf(url, __MAXURL, "%s/p%d.html", opts.prefix, id);
+}
+
+
+/****************************************************************
+ * checkinput - parses the options and arguments into opts
+ * \return          0 if sucess and non-zero if otherwise
+****************************************************************/
+int checkinput(int argc, char *argv[]) {
+
+    int argi = 1;
+    for(; argi + 1 < argc && !strncmp(argv[argi], "--", 2); argi += 2) {
+        char *opt = argv[argi], *val = argv[argi + 1];
+        if(!strcmp(opt, "--vocab")) opts.vocab = atoi(val);
+        else if(!strcmp(opt, "--skew")) opts.skew = atof(val);
+        else if(!strcmp(opt, "--words")) opts.words = atoi(val);
+        else if(!strcmp(opt, "--links")) opts.links = atoi(val);
+        else if(!strcmp(opt, "--seed")) opts.seed = strtoull(val, NULL, 10);
+        else if(!strcmp(opt, "--prefix")) opts.prefix = val;
+        else {
+            printf("Error: unknown option %s\n", opt);
+            return 1;
+        }
+    }
+    if(argc - argi != 2 && argc - argi != 4) {
+        printf("%s", USAGE);
+        return 1;
+    }
+    opts.pagedir = argv[argi];
+    opts.npages = atoi(argv[argi + 1]);
+    if(argc - argi == 4) {
+        opts.queryfile = argv[argi + 2];
+        opts.nqueries = atoi(argv[argi + 3]);
+    }
+    if(opts.npages < 1 || opts.vocab < 1 || opts.skew < 0 || opts.words < 1 ||
+       opts.links < 0 || (opts.queryfile && opts.nqueries < 1)) {
+        printf("Error: counts must be positive and skew non-negative\n");
+        return 1;
+    }
+    return 0;
+}
+
+
+/****************************************************************
+ * genpages - writes the pages; page 1 is the seed
+ * \return          0 if sucess and non-zero if otherwise
+****************************************************************/
+int genpages(void) {
+
+    zipf_t *words = zfopen(opts.vocab, opts.skew, opts.seed);
+    zipf_t *links = zfopen(opts.npages, opts.skew, opts.seed + 1);
+    int *depth = (int*)calloc(opts.npages + 1, sizeof(int));
+    int *parent = (int*)calloc(opts.npages + 1, sizeof(int));
+    int *child = (int*)calloc(opts.npages + 1, sizeof(int));
+    int *sibling = (int*)calloc(opts.npages + 1, sizeof(int));
+    if(words == NULL || links == NULL || depth == NULL || parent == NULL ||
+       child == NULL || sibling == NULL) {
+        printf("Error: malloc failed generating corpus\n");
+        return 1;
+    }
+
+    // Link every page from a random earlier one
+    for(int id = 2; id <= opts.npages; id++) {
+        parent[id] = 1 + zfrand(links) % (id - 1);
+        depth[id] = depth[parent[id]] + 1;
+    }
+    for(int id = opts.npages; id >= 2; id--) {
+        sibling[id] = child[parent[id]];
+        child[parent[id]] = id;
+    }
+
+    buf_t html = {0};
+    char word[__MAXWORD], url[__MAXURL], line[__MAXURL + 64];
+    int errors = 0;
+    for(int id = 1; id <= opts.npages && !errors; id++) {
+        html.len = 0;
+        append(&html, "<html>\n<head>\n<title>");
+        zfword(zfnext(words), word, sizeof(word));
+        append(&html, word);
+        append(&html, "</title>\n</head>\n<body>\n<p>");
+
+        int n = opts.words / 2 + zfrand(words) % opts.words;
+        for(int i = 0; i < n; i++) {
+            zfword(zfnext(words), word, sizeof(word));
+            append(&html, word);
+            append(&html, i % 16 == 15 ? "\n" : " ");
+        }
+        append(&html, "</p>\n");
+
+        // The pages this one is the tree parent of, then Zipf links
+        for(int c = child[id]; c != 0; c = sibling[c]) {
+            pageurl(c, url);
+            snprintf(line, sizeof(line), "<a href=\"%s\">p%d</a>\n", url, c);
+            append(&html, line);
+        }
+        for(int i = 0; i < opts.links; i++) {
+            int target = 1 + zfnext(links);
+            pageurl(target, url);
+            snprintf(line, sizeof(line), "<a href=\"%s\">p%d</a>\n", url, target);
+            append(&html, line);
+        }
+        append(&html, "</body>\n</html>\n");
+
+        pageurl(id, url);
+        char *copy = (char*)malloc(html.len + 1);
+        memcpy(copy, html.s, html.len + 1);
+        webpage_t *page = webpage_new(url, depth[id], copy);
+        if(pagesave(page, id, opts.pagedir) != 0) {
+            printf("Error: failed to save page %d\n", id);
+            errors++;
+        }
+        webpage_delete(page);
+    }
+
+    free(html.s);
+    free(depth);
+    free(parent);
+    free(child);
+    free(sibling);
+    zfclose(words);
+    zfclose(links);
+    return errors;
+}
+
+
+/****************************************************************
+ * genqueries - writes a query log of one to __QUERYWORDS words
+ * drawn as the page words are, joined by "and", "or" or nothing
+ * \return          0 if sucess and non-zero if otherwise
+****************************************************************/
+int genqueries(void) {
+
+    FILE *fp = fopen(opts.queryfile, "w");
+    zipf_t *words = zfopen(opts.vocab, opts.skew, opts.seed + 2);
+    if(fp == NULL || words == NULL) {
+        printf("Error: failed to write %s\n", opts.queryfile);
+        if(fp) fclose(fp);
+        zfclose(words);
+        return 1;
+    }
+    static const char *joins[] = {" ", " and ", " or "};
+    char word[__MAXWORD];
+    for(int q = 0; q < opts.nqueries; q++) {
+        int n = 1 + zfrand(words) % __QUERYWORDS;
+        for(int i = 0; i < n; i++) {
+            if(i > 0) fputs(joins[zfrand(words) % 3], fp);
+            zfword(zfnext(words), word, sizeof(word));
+            fputs(word, fp);
+        }
+        fputc('\n', fp);
+    }
+    zfclose(words);
+    return fclose(fp) == 0 ? 0 : 1;
+}
+
+
+int main(int argc, char *argv[]) {
+
+    if(checkinput(argc, argv) != 0) exit(EXIT_FAILURE);
+    mkdir(opts.pagedir, 0777);
+    if(genpages() != 0) exit(EXIT_FAILURE);
+    if(opts.queryfile != NULL && genqueries() != 0) exit(EXIT_FAILURE);
+    exit(EXIT_SUCCESS);
+}
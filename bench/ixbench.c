@@ -0,0 +1,53 @@
+/****************************************************************
+ * file   ixbench.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   December 3, 2021
+ *
+ * Times loading an index file with indexload() and saving it again
+ * with indexsave(), best of a few runs, as run.sh reports them.
+ *
+ * usage: ixbench <indexnm>
+ *
+****************************************************************/
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include"hash.h"
+#include"queue.h"
+#include"indexio.h"
+#include"metrics.h"
+
+
+/****************************************************************
+ * Define macro, structs, globals and helper functions
+****************************************************************/
+#define __REPS 3
+#define __SAVED "ixbench.index"     // Saved copy, removed afterwards
+
+
+int main(int argc, char *argv[]) {
+
+    if(argc != 2) {
+        printf("usage: ixbench <indexnm>\n");
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t load = UINT64_MAX, save = UINT64_MAX;
+    for(int rep = 0; rep < __REPS; rep++) {
+        uint64_t start = mtnow();
+        hashtable_t *index = indexload(".", argv[1]);
+        uint64_t loaded = mtnow();
+        if(index == NULL) exit(EXIT_FAILURE);
+        if(indexsave(index, ".", __SAVED) != 0) exit(EXIT_FAILURE);
+        uint64_t saved = mtnow();
+        if(loaded - start < load) load = loaded - start;
+        if(saved - loaded < save) save = saved - loaded;
+        indexclose(index);
+    }
+    remove(__SAVED);
+    printf("indexload %.1f\nindexsave %.1f\n", load / 1e6, save / 1e6);
+    exit(EXIT_SUCCESS);
+}
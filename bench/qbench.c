@@ -0,0 +1,181 @@
+/****************************************************************
+ * file   qbench.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   December 9, 2021
+ *
+ * Load generator for the querier in server mode. Clients connect at
+ * once, each sending every query of a file in turn, from a different
+ * place in it, and waiting for its results before the next. Prints
+ * the queries answered per second and the p50 and p99 latencies, in
+ * microseconds, on one line.
+ *
+ * usage: qbench <socket|port> <queryfile> [clients] [rounds]
+ *
+****************************************************************/
+
+#define _POSIX_C_SOURCE 200809L     // fdopen
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include<pthread.h>
+#include<stdatomic.h>
+#include<unistd.h>
+#include<sys/types.h>
+#include<sys/socket.h>
+#include<sys/un.h>
+#include<netinet/in.h>
+#include<arpa/inet.h>
+#include"metrics.h"
+
+
+/****************************************************************
+ * Define macro, structs, globals and helper functions
+****************************************************************/
+#define __MAXLINE 512
+#define USAGE "usage: qbench <socket|port> <queryfile> [clients] [rounds]\n"
+
+static char *addr;
+static char **queries;
+static int nqueries = 0, rounds = 1;
+static metrics_t *metrics;
+static int latency;
+static atomic_int failed = 0;       // Clients that could not finish
+
+static int connectto(char *addr) {
+    bool tcp = strspn(addr, "0123456789") == strlen(addr);
+    int fd = socket(tcp ? AF_INET : AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0) return -1;
+
+    int error = -1;
+    if(tcp) {
+        struct sockaddr_in in = {0};
+        in.sin_family = AF_INET;
+        in.sin_port = htons(atoi(addr));
+        in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        error = connect(fd, (struct sockaddr*)&in, sizeof(in));
+    }
+    else if(strlen(addr) < sizeof(((struct sockaddr_un*)0)->sun_path)) {
+        struct sockaddr_un un = {0};
+        un.sun_family = AF_UNIX;
+        strcpy(un.sun_path, addr);
+        error = connect(fd, (struct sockaddr*)&un, sizeof(un));
+    }
+    if(error != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+/****************************************************************
+ * client - one connection, sending its share of the queries; the
+ * results of a query end with an empty line
+****************************************************************/
+static void *client(void *arg) {
+    int first = (int)(intptr_t)arg, fd = connectto(addr), wfd = fd >= 0 ? dup(fd) : -1;
+    FILE *in = fd >= 0 ? fdopen(fd, "r") : NULL;
+    FILE *out = wfd >= 0 ? fdopen(wfd, "w") : NULL;
+    bool ok = in != NULL && out != NULL;
+
+    char line[__MAXLINE];
+    for(int i = 0; ok && i < rounds * nqueries; i++) {
+        uint64_t start = mtnow();
+        fputs(queries[(first + i) % nqueries], out);
+        ok = fflush(out) == 0;
+        while(ok && (ok = fgets(line, sizeof(line), in) != NULL) && line[0] != '\n');
+        if(ok) mtsince(metrics, latency, start);
+    }
+
+    if(!ok) atomic_fetch_add(&failed, 1);
+    if(in != NULL) fclose(in);
+    else if(fd >= 0) close(fd);
+    if(out != NULL) fclose(out);
+    else if(wfd >= 0) close(wfd);
+    return NULL;
+}
+
+
+/****************************************************************
+ * Private helper function: a field of a metrics snapshot line
+****************************************************************/
+static double field(const char *snap, const char *name) {
+    char key[64];
+    snprintf(key, sizeof(key), "\"%s\":", name);
+    const char *p = strstr(snap, key);
+    return p != NULL ? atof(p + strlen(key)) : 0;
+}
+
+
+int main(int argc, char *argv[]) {
+
+    if(argc < 3 || argc > 5) {
+        printf(USAGE);
+        exit(EXIT_FAILURE);
+    }
+    addr = argv[1];
+    int nclients = argc > 3 ? atoi(argv[3]) : 1;
+    rounds = argc > 4 ? atoi(argv[4]) : 1;
+    if(nclients < 1 || rounds < 1) {
+        printf(USAGE);
+        exit(EXIT_FAILURE);
+    }
+
+    // Queries are sent as they are in the file, empty lines left out
+    FILE *f = fopen(argv[2], "r");
+    if(f == NULL) {
+        printf("Error: cannot read %s\n", argv[2]);
+        exit(EXIT_FAILURE);
+    }
+    char line[__MAXLINE];
+    int cap = 0;
+    while(fgets(line, sizeof(line), f) != NULL) {
+        if(line[0] == '\n' || strchr(line, '\n') == NULL) continue;
+        if(nqueries == cap) {
+            cap = cap ? 2 * cap : 1024;
+            queries = (char**)realloc(queries, cap * sizeof(char*));
+        }
+        queries[nqueries] = (char*)malloc(strlen(line) + 1);
+        strcpy(queries[nqueries++], line);
+    }
+    fclose(f);
+    if(nqueries == 0) {
+        printf("Error: no queries in %s\n", argv[2]);
+        exit(EXIT_FAILURE);
+    }
+
+    metrics = mtopen();
+    latency = mthistogram(metrics, "query");
+    pthread_t *threads = (pthread_t*)malloc(nclients * sizeof(pthread_t));
+    uint64_t start = mtnow();
+    for(int i = 0; i < nclients; i++) {
+        pthread_create(&threads[i], NULL, client,
+                       (void*)(intptr_t)((long)i * nqueries / nclients));
+    }
+    for(int i = 0; i < nclients; i++) pthread_join(threads[i], NULL);
+    uint64_t ns = mtnow() - start;
+
+    // Percentiles are read back from a snapshot
+    char *snap = NULL;
+    size_t size = 0;
+    FILE *mf = open_memstream(&snap, &size);
+    mtdump(metrics, mf);
+    fclose(mf);
+    double count = field(snap, "count");
+    printf("%.1f %.1f %.1f\n", count / (ns / 1e9), field(snap, "p50") / 1000,
+           field(snap, "p99") / 1000);
+
+    free(snap);
+    mtclose(metrics);
+    free(threads);
+    for(int i = 0; i < nqueries; i++) free(queries[i]);
+    free(queries);
+    if(failed) {
+        fprintf(stderr, "Error: %d clients could not finish\n", (int)failed);
+        exit(EXIT_FAILURE);
+    }
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,71 @@
+#!/bin/bash
+# run.sh -- end-to-end benchmark of the indexer and querier on a
+# synthetic corpus, offline and reproducibly
+#
+# usage: run.sh [npages] [nqueries] [gencorpus options...]
+#
+# Generates a corpus of npages pages (default 2000) and a log of
+# nqueries queries (default 1000), then times building the index,
+# loading and saving it, and answering the queries. Prints one
+# result per line: <stage> <parameter> <value> <unit>. Options for
+# the indexer, e.g. INDEXFLAGS="-d 0.5", and for the querier, e.g.
+# QUERYFLAGS="-r bm25 -k 10", are taken from the environment.
+#
+# Tian Xia (tian.xia.ug@dartmouth.edu) - December 3, 2021
+
+set -e
+cd "$(dirname "$0")"
+NPAGES=${1:-2000}
+NQUERIES=${2:-1000}
+shift $(( $# < 2 ? $# : 2 ))
+
+BIN=$(cd ../bin && pwd)
+if [ ! -x "$BIN/indexer" ] || [ ! -x "$BIN/querier" ]; then
+    echo "Error: build the indexer and querier first (make all)"
+    exit 1
+fi
+make -s all
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+now() { date +%s%N; }
+ms() { awk -v ns=$(( $2 - $1 )) 'BEGIN { printf "%.1f", ns / 1e6 }'; }
+result() { printf "%-12s %-16s %12s %s\n" "$@"; }
+
+echo "# stage      parameter               value unit"
+start=$(now)
+./gencorpus "$@" "$WORK/pages" "$NPAGES" "$WORK/queries" "$NQUERIES"
+result gencorpus "pages=$NPAGES" "$(ms "$start" "$(now)")" ms
+
+cd "$WORK"
+start=$(now)
+TSE_LOG=error "$BIN/indexer" pages index $INDEXFLAGS
+result indexer "pages=$NPAGES" "$(ms "$start" "$(now)")" ms
+result index "pages=$NPAGES" "$(wc -c < index)" bytes
+if [ -f index.hot ]; then
+    result hot "pages=$NPAGES" "$(wc -c < index.hot)" bytes
+fi
+"$OLDPWD/ixbench" index | while read -r stage value; do
+    result "$stage" "pages=$NPAGES" "$value" ms
+done
+
+start=$(now)
+TSE_LOG=error "$BIN/querier" pages index -q queries results -t latency $QUERYFLAGS
+end=$(now)
+result querier "queries=$NQUERIES" \
+    "$(awk -v n="$NQUERIES" -v ns=$(( end - start )) \
+       'BEGIN { printf "%.1f", n / (ns / 1e9) }')" queries/s
+
+# Latency percentiles, in microseconds
+sort -n latency | awk '
+    { ns[NR] = $1 }
+    END {
+        split("50 90 99 100", ps)
+        for(i = 1; i <= 4; i++) {
+            k = int(ps[i] * NR / 100)
+            if(k < ps[i] * NR / 100) k++
+            if(k < 1) k = 1
+            printf "%-12s %-16s %12.1f us\n", "query",
+                   ps[i] == 100 ? "max" : "p" ps[i], ns[k] / 1000
+        }
+    }'
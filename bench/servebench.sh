@@ -0,0 +1,60 @@
+#!/bin/bash
+# servebench.sh -- querier throughput in server mode, from one worker
+# up to maxworkers
+#
+# usage: servebench.sh [npages] [nqueries] [maxworkers] [gencorpus options...]
+#
+# Generates a corpus of npages pages (default 2000) and a log of
+# nqueries queries (default 1000), indexes it, then serves the index
+# with 1, 2, 4, ... maxworkers workers (default 16), as many clients
+# sending the queries at once. Prints one result per line: serve
+# workers=<n> <queries/s> queries/s, with the p50 and p99 latencies in
+# microseconds and the speedup over one worker. Options for the
+# querier, e.g. QUERYFLAGS="-r bm25 -k 10", are taken from the
+# environment.
+#
+# Tian Xia (tian.xia.ug@dartmouth.edu) - December 9, 2021
+
+set -e
+cd "$(dirname "$0")"
+NPAGES=${1:-2000}
+NQUERIES=${2:-1000}
+MAXWORKERS=${3:-16}
+shift $(( $# < 3 ? $# : 3 ))
+
+BIN=$(cd ../bin && pwd)
+if [ ! -x "$BIN/indexer" ] || [ ! -x "$BIN/querier" ]; then
+    echo "Error: build the indexer and querier first (make all)"
+    exit 1
+fi
+make -s gencorpus qbench
+WORK=$(mktemp -d)
+SERVER=
+trap 'kill $SERVER 2>/dev/null; wait $SERVER 2>/dev/null; rm -rf "$WORK"' EXIT
+
+./gencorpus "$@" "$WORK/pages" "$NPAGES" "$WORK/queries" "$NQUERIES"
+(cd "$WORK" && TSE_LOG=error "$BIN/indexer" pages index)
+
+echo "# stage      parameter               value unit"
+base=
+for (( workers = 1; workers <= MAXWORKERS; workers *= 2 )); do
+    (cd "$WORK" && exec "$BIN/querier" pages index -s querier.sock \
+        -j "$workers" $QUERYFLAGS 2> server.log) &
+    SERVER=$!
+
+    # Wait for the server to listen
+    for i in $(seq 100); do
+        grep -q Serving "$WORK/server.log" 2>/dev/null && break
+        kill -0 $SERVER 2>/dev/null || { cat "$WORK/server.log"; exit 1; }
+        sleep 0.1
+    done
+
+    read -r rate p50 p99 < <(./qbench "$WORK/querier.sock" "$WORK/queries" "$workers")
+    kill $SERVER
+    wait $SERVER 2>/dev/null || true
+    rm -f "$WORK/server.log"
+    base=${base:-$rate}
+    printf "%-12s %-16s %12s %-9s p50=%sus p99=%sus speedup=%.2f\n" serve \
+           "workers=$workers" "$rate" queries/s "$p50" "$p99" \
+           "$(awk -v r="$rate" -v b="$base" 'BEGIN { print r / b }')"
+done
@@ -0,0 +1,410 @@
+/****************************************************************
+ * file   stubserver.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   December 4, 2021
+ *
+ * A small HTTP/1.1 server that stands in for a real site, so the
+ * crawler can be benchmarked offline. It serves a site it generates
+ * in memory, pages /p1.html to /p<n>.html linked into a graph as
+ * gencorpus links them, or the pages of a pagedir under the paths
+ * of their URLs. Every response can be delayed, throttled or turned
+ * into an error, to model a slow or unreliable server.
+ *
+ * usage: stubserver [--port <n>] [--pages <n>] [--size <bytes>]
+ *                   [--links <n>] [--latency <ms>] [--bandwidth <KB/s>]
+ *                   [--errors <rate>] [--seed <n>] [--pagedir <dir>]
+ *
+****************************************************************/
+
+#define _POSIX_C_SOURCE 200809L     // nanosleep, sigaction
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include<ctype.h>
+#include<errno.h>
+#include<signal.h>
+#include<time.h>
+#include<pthread.h>
+#include<stdatomic.h>
+#include<unistd.h>
+#include<sys/types.h>
+#include<sys/socket.h>
+#include<sys/time.h>
+#include<netinet/in.h>
+#include<arpa/inet.h>
+#include"hash.h"
+#include"webpage.h"
+#include"pageio.h"
+#include"zipf.h"
+#include"metrics.h"
+
+
+/****************************************************************
+ * Define macro, structs, globals and helper functions
+****************************************************************/
+#define __VOCAB 20000               // Words of the generated pages
+#define __MAXWORD 32
+#define __MAXREQ 8192               // Longest request head
+#define __CHUNK 4096                // Bytes written at a time
+#define __IDLE 5                    // Seconds an idle connection is kept
+#define USAGE "usage: stubserver [--port <n>] [--pages <n>] [--size <bytes>]\n" \
+              "                  [--links <n>] [--latency <ms>] [--bandwidth <KB/s>]\n" \
+              "                  [--errors <rate>] [--seed <n>] [--pagedir <dir>]\n"
+
+// Command line options, with their defaults
+struct {
+    int port;
+    int pages;                      // Pages of the generated site
+    int size;                       // Mean bytes per generated page
+    int links;                      // Links per page besides the tree
+    int latency;                    // Milliseconds before each response
+    int bandwidth;                  // KB/s per connection, 0 for no limit
+    double errors;                  // Fraction of requests answered 503
+    uint64_t seed;
+    char *pagedir;                  // Serve these pages instead
+} opts = {8090, 1000, 4096, 4, 0, 0, 0, 1, NULL};
+
+// A page served under a path
+typedef struct doc {
+    char *path;
+    char *body;
+    size_t len;
+} doc_t;
+
+static hashtable_t *site;           // Read-only once serving starts
+static int ndocs = 0;
+static atomic_long requests = 0, failures = 0, bytes = 0;
+static atomic_uint connections = 0;
+static volatile sig_atomic_t stop = 0;
+
+static bool pathmatch(void *elementp, const void *keyp) {
+    return !strcmp(((doc_t*)elementp)->path, (const char*)keyp);
+}
+
+// A growable string
+typedef struct buf {
+    char *s;
+    size_t len, cap;
+} buf_t;
+
+static void append(buf_t *b, const char *s) {
+    size_t n = strlen(s);
+    if(b->len + n + 1 > b->cap) {
+        while(b->len + n + 1 > b->cap) b->cap = b->cap ? 2 * b->cap : 4096;
+        b->s = (char*)realloc(b->s, b->cap);
+    }
+    memcpy(b->s + b->len, s, n + 1);
+    b->len += n;
+}
+
+static void addoc(const char *path, char *body, size_t len) {
+    doc_t *d = (doc_t*)malloc(sizeof(doc_t));
+    d->path = strdup(path);
+    d->body = body;
+    d->len = len;
+    hput(site, d, d->path, strlen(d->path));
+    ndocs++;
+}
+
+static void onsignal(int sig) {
+    stop = 1;
+}
+
+static void waitns(uint64_t ns) {
+    nanosleep(&(struct timespec){ns / 1000000000, ns % 1000000000}, NULL);
+}
+
+
+/****************************************************************
+ * checkinput - parses the options into opts
+ * \return          0 if sucess and non-zero if otherwise
+****************************************************************/
+int checkinput(int argc, char *argv[]) {
+
+    int argi = 1;
+    for(; argi + 1 < argc && !strncmp(argv[argi], "--", 2); argi += 2) {
+        char *opt = argv[argi], *val = argv[argi + 1];
+        if(!strcmp(opt, "--port")) opts.port = atoi(val);
+        else if(!strcmp(opt, "--pages")) opts.pages = atoi(val);
+        else if(!strcmp(opt, "--size")) opts.size = atoi(val);
+        else if(!strcmp(opt, "--links")) opts.links = atoi(val);
+        else if(!strcmp(opt, "--latency")) opts.latency = atoi(val);
+        else if(!strcmp(opt, "--bandwidth")) opts.bandwidth = atoi(val);
+        else if(!strcmp(opt, "--errors")) opts.errors = atof(val);
+        else if(!strcmp(opt, "--seed")) opts.seed = strtoull(val, NULL, 10);
+        else if(!strcmp(opt, "--pagedir")) opts.pagedir = val;
+        else {
+            printf("Error: unknown option %s\n", opt);
+            return 1;
+        }
+    }
+    if(argi != argc) {
+        printf("%s", USAGE);
+        return 1;
+    }
+    if(opts.port < 1 || opts.port > 65535 || opts.pages < 1 || opts.size < 1 ||
+       opts.links < 0 || opts.latency < 0 || opts.bandwidth < 0 ||
+       opts.errors < 0 || opts.errors > 1) {
+        printf("Error: counts must be positive and the error rate in [0, 1]\n");
+        return 1;
+    }
+    return 0;
+}
+
+
+/****************************************************************
+ * gensite - generates the pages of the site. Page i links to the
+ * pages it is the tree parent of, so every page can be reached
+ * from /p1.html, and to opts.links pages drawn with Zipf
+ * frequencies; its text is Zipf words up to its size.
+****************************************************************/
+void gensite(void) {
+
+    zipf_t *words = zfopen(__VOCAB, 1.0, opts.seed);
+    zipf_t *links = zfopen(opts.pages, 1.0, opts.seed + 1);
+    int *child = (int*)calloc(opts.pages + 1, sizeof(int));
+    int *sibling = (int*)calloc(opts.pages + 1, sizeof(int));
+    for(int id = opts.pages; id >= 2; id--) {
+        int parent = 1 + zfrand(links) % (id - 1);
+        sibling[id] = child[parent];
+        child[parent] = id;
+    }
+
+    char word[__MAXWORD], path[64], line[128];
+    for(int id = 1; id <= opts.pages; id++) {
+        buf_t html = {0};
+        size_t want = opts.size / 2 + zfrand(words) % opts.size;
+        snprintf(line, sizeof(line), "<html>\n<head>\n<title>p%d</title>\n"
+                 "</head>\n<body>\n", id);
+        append(&html, line);
+
+        // Links first, so a small page still has all of them
+        for(int c = child[id]; c != 0; c = sibling[c]) {
+            snprintf(line, sizeof(line), "<a href=\"p%d.html\">p%d</a>\n", c, c);
+            append(&html, line);
+        }
+        for(int i = 0; i < opts.links; i++) {
+            int target = 1 + zfnext(links);
+            snprintf(line, sizeof(line), "<a href=\"p%d.html\">p%d</a>\n", target,
+                     target);
+            append(&html, line);
+        }
+        append(&html, "<p>");
+        while(html.len < want) {
+            zfword(zfnext(words), word, sizeof(word));
+            append(&html, word);
+            append(&html, " ");
+        }
+        append(&html, "</p>\n</body>\n</html>\n");
+        sprintf(path, "/p%d.html", id);
+        addoc(path, html.s, html.len);
+    }
+
+    free(child);
+    free(sibling);
+    zfclose(words);
+    zfclose(links);
+}
+
+
+/****************************************************************
+ * loadsite - loads the pages of opts.pagedir under the paths of
+ * their URLs
+ * \return          0 if sucess and non-zero if otherwise
+****************************************************************/
+int loadsite(void) {
+
+    webpage_t *page;
+    for(int id = 1; (page = pageload(id, opts.pagedir)) != NULL; id++) {
+        char *url = webpage_getURL(page), *path = strstr(url, "://");
+        path = path ? strchr(path + 3, '/') : NULL;
+        size_t len = webpage_getHTMLlen(page);
+        char *body = (char*)malloc(len + 1);
+        memcpy(body, webpage_getHTML(page), len + 1);
+        addoc(path ? path : "/", body, len);
+        webpage_delete(page);
+    }
+    if(ndocs == 0) {
+        printf("Error: no pages in %s\n", opts.pagedir);
+        return 1;
+    }
+    return 0;
+}
+
+
+/****************************************************************
+ * Private helper function: write all of buf, at no more than
+ * opts.bandwidth KB/s when it is set
+ * \return          0 if sucess and non-zero if otherwise
+****************************************************************/
+static int sendall(int fd, const char *buf, size_t len, bool throttle) {
+
+    uint64_t start = mtnow();
+    for(size_t sent = 0; sent < len; ) {
+        size_t n = len - sent < __CHUNK ? len - sent : __CHUNK;
+        ssize_t w = write(fd, buf + sent, n);
+        if(w < 0 && errno == EINTR) continue;
+        if(w <= 0) return 1;
+        sent += w;
+        atomic_fetch_add(&bytes, w);
+        if(throttle && opts.bandwidth > 0) {
+            uint64_t due = start + sent * 1000000ULL / opts.bandwidth;
+            uint64_t now = mtnow();
+            if(due > now) waitns(due - now);
+        }
+    }
+    return 0;
+}
+
+
+/****************************************************************
+ * Private helper function: answer one request head
+ * \return          true if the connection is kept open
+****************************************************************/
+static bool respond(int fd, char *head, zipf_t *rng) {
+
+    char method[16], path[2048], version[16], reply[512];
+    if(sscanf(head, "%15s %2047s %15s", method, path, version) != 3) {
+        const char *bad = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n"
+                          "Connection: close\r\n\r\n";
+        sendall(fd, bad, strlen(bad), false);
+        return false;
+    }
+
+    // HTTP/1.1 keeps the connection unless told otherwise, 1.0 closes it
+    for(char *c = head; *c; c++) *c = tolower(*c);
+    bool keep = strcmp(version, "HTTP/1.0") != 0;
+    if(strstr(head, "\nconnection: close")) keep = false;
+    if(strstr(head, "\nconnection: keep-alive")) keep = true;
+    const char *conn = keep ? "keep-alive" : "close";
+
+    atomic_fetch_add(&requests, 1);
+    if(opts.latency > 0) waitns(opts.latency * 1000000ULL);
+
+    char *query = strchr(path, '?');
+    if(query) *query = '\0';
+    doc_t *d = (doc_t*)hsearch(site, pathmatch, path, strlen(path));
+    int status = 200;
+    const char *reason = "OK";
+    if(strcmp(method, "GET") && strcmp(method, "HEAD")) {
+        status = 405;
+        reason = "Method Not Allowed";
+    }
+    else if(opts.errors > 0 &&
+            (zfrand(rng) >> 11) * (1.0 / (1ULL << 53)) < opts.errors) {
+        status = 503;
+        reason = "Service Unavailable";
+    }
+    else if(d == NULL) {
+        status = 404;
+        reason = "Not Found";
+    }
+    if(status != 200) {
+        atomic_fetch_add(&failures, 1);
+        d = NULL;
+    }
+
+    size_t len = d ? d->len : 0;
+    int n = snprintf(reply, sizeof(reply), "HTTP/1.1 %d %s\r\n"
+                     "Content-Type: text/html\r\nContent-Length: %zu\r\n"
+                     "Connection: %s\r\n\r\n", status, reason, len, conn);
+    if(sendall(fd, reply, n, false) != 0) return false;
+    if(d && strcmp(method, "HEAD") && sendall(fd, d->body, len, true) != 0)
+        return false;
+    return keep;
+}
+
+
+/****************************************************************
+ * serve - answers the requests of one connection until it closes
+ * or stays idle for __IDLE seconds
+****************************************************************/
+void *serve(void *arg) {
+
+    int fd = (int)(intptr_t)arg;
+    struct timeval idle = {__IDLE, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &idle, sizeof(idle));
+    zipf_t *rng = zfopen(1, 0, opts.seed + atomic_fetch_add(&connections, 1));
+
+    // Requests may be pipelined; the bytes after a head are kept
+    char buf[__MAXREQ + 1];
+    size_t len = 0;
+    bool keep = true;
+    while(keep && !stop) {
+        char *end;
+        buf[len] = '\0';
+        while((end = strstr(buf, "\r\n\r\n")) == NULL) {
+            if(len == __MAXREQ) goto done;
+            ssize_t r = read(fd, buf + len, __MAXREQ - len);
+            if(r < 0 && errno == EINTR) continue;
+            if(r <= 0) goto done;
+            len += r;
+            buf[len] = '\0';
+        }
+        size_t headlen = end + 4 - buf;
+        end[2] = '\0';
+        keep = respond(fd, buf, rng);
+        memmove(buf, buf + headlen, len - headlen);
+        len -= headlen;
+    }
+done:
+    zfclose(rng);
+    close(fd);
+    return NULL;
+}
+
+
+int main(int argc, char *argv[]) {
+
+    if(checkinput(argc, argv) != 0) exit(EXIT_FAILURE);
+    site = hopen(opts.pagedir ? 4096 : opts.pages);
+    if(opts.pagedir) {
+        if(loadsite() != 0) exit(EXIT_FAILURE);
+    }
+    else gensite();
+
+    // A signal ends the accept loop, so the totals are printed
+    struct sigaction sa = {0};
+    sa.sa_handler = onsignal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    int one = 1, lfd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(opts.port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if(lfd < 0 || bind(lfd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+       listen(lfd, 128) != 0) {
+        printf("Error: cannot listen on port %d\n", opts.port);
+        exit(EXIT_FAILURE);
+    }
+    printf("Serving %d pages on http://127.0.0.1:%d/\n", ndocs, opts.port);
+    fflush(stdout);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    while(!stop) {
+        int fd = accept(lfd, NULL, NULL);
+        if(fd < 0) continue;
+        pthread_t thread;
+        if(pthread_create(&thread, &attr, serve, (void*)(intptr_t)fd) != 0) {
+            printf("Error: cannot start a connection thread\n");
+            close(fd);
+        }
+    }
+    close(lfd);
+    printf("Served %ld requests, %ld errors, %ld bytes\n", atomic_load(&requests),
+           atomic_load(&failures), atomic_load(&bytes));
+
+    // Connection threads may still be reading the site; it is left
+    // for the process exit to free
+    pthread_attr_destroy(&attr);
+    exit(EXIT_SUCCESS);
+}
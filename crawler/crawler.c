@@ -4,9 +4,11 @@
  * date   October 16, 2021          
  * 
  * Implementation of a concurrent crawerl in c.
- * Last updated: November 13, 2021
+ * Last updated: November 28, 2021
 ****************************************************************/
 
+#define _POSIX_C_SOURCE 200809L     // nanosleep
+
 #include<stdio.h>
 #include<math.h>
 #include<stdlib.h>
@@ -15,31 +17,137 @@
 #include<string.h>
 #include<sys/types.h>
 #include<sys/stat.h>
+#include<sys/mman.h>
 #include<pthread.h>
 #include<unistd.h>
 #include<errno.h>
+#include<fcntl.h>
+#include<stdatomic.h>
+#include<stdarg.h>
+#include<inttypes.h>
 #include"webpage.h"
 #include"lhash.h"
+#include"bloom.h"
+#include"diskset.h"
 #include"lqueue.h"
+#include"bqueue.h"
+#include"pageaio.h"
+#include"pageio.h"
+#include"hash.h"
+#include"simhash.h"
+#include"scope.h"
+#include"metrics.h"
+#include"log.h"
 
 
 /****************************************************************
  * Define macro, globals and helper functions
 ****************************************************************/
-#define eprintf(format, ...) do {                 \
-    if (verbose)                                  \
-        fprintf(stderr, format, ##__VA_ARGS__);   \
-} while(0)
-#define verbose 0
-
 #define __MAXB 50
 #define __MAXCHAR 128
+#define __CHANNEL 64                // Fetched pages waiting to be saved
+#define __WBATCH 16                 // Pages saved per writer batch
+#define __SEENBYTES (4 << 20)       // Memory budget of the seen-URL filter
+#define __SEENHASHES 6
+#define __JOURNAL ".journal"        // Crawl journal, in the page directory
+#define __SNAPSHOT ".snapshot"      // Last snapshot of the crawl state
+#define __SEEN ".seen"              // The seen filter, as of the snapshot
+#define __DONE ".done"              // The done URLs, one per line
+#define __SNAPEVERY 1000            // Pages done between snapshots
+#define __META ".meta"              // Validators and fingerprint per page
+#define __CHANGED ".changed"        // Pages saved since the last index update
+#define __DUPS ".dups"              // Near-duplicate pages that were dropped
+#define __METRICSEVERY 1000         // Milliseconds between metrics snapshots
+#define __IDLENS 1000000            // Wait of an idle thread for more pages
 struct stat st = {0};
 
-// Define global queue and hashtable
+// A visited URL. A page is done once it has been saved or failed to
+// fetch; visited pages that are not done make up the frontier, and
+// only those are kept.
+typedef struct visit {
+    int depth;
+    char url[];
+} visit_t;
+
+// Define global queue and hashtable. Every URL is added to the seen
+// filter; a URL it has not seen is new, and one it has seen is only
+// dropped if it is pending in vis or listed in done. vis holds the
+// frontier only, and done keeps the finished URLs in a file, with an
+// index of 8 to 16 bytes per URL in memory, so the memory of a long
+// crawl grows slowly and the file is only read for filter positives.
 lqueue_t *u_queue;
 lhashtable_t *vis;
-int id = 0;
+bloom_t *seen;
+diskset_t *done;
+
+// The URLs the crawl may follow; INTERNAL_URL_PREFIX unless --scope
+// names a scope file
+scope_t *scope;
+
+// Fetched pages are handed to the writer thread through this channel.
+// Page ids are only handed out by the writer, so they stay dense.
+// The writer's pageaio context is opened before any thread starts, so
+// the writer is always there to drain the channel.
+bqueue_t *w_chan;
+pageaio_t *w_aio;
+atomic_int id = 0;
+atomic_bool failed = false;
+
+// Crawl journal. Every change to vis is appended as one line, with a
+// single write(), while holding statelock:
+//   D <depth> <url>    the URL was discovered
+//   C <id> <url>       the URL is done, saved as page id (0 if not saved)
+// A snapshot holds the seen filter, in its own file, and the frontier
+// as "S <lastid>" followed by one "D" line per pending URL; after it
+// is in place the journal is truncated. Loading the filter and then
+// replaying the snapshot and the journal rebuilds vis.
+int journal = -1;
+pthread_mutex_t statelock = PTHREAD_MUTEX_INITIALIZER;
+FILE *statefp = NULL;
+
+// What is known about a saved page, from this crawl or an earlier one.
+// Every update is also appended to the .meta file as a line
+//   <id> <fingerprint> <simhash> <lastmod> <etag or -> <url>
+// and the table is only used while holding statelock.
+typedef struct pagemeta {
+    int id;                         // Page file id
+    uint64_t fp;                    // Content fingerprint, hash64 of html
+    uint64_t sim;                   // SimHash of its words
+    long lastmod;                   // Last-Modified, 0 if unknown
+    char *etag;                     // ETag, NULL if none
+    char url[];
+} pagemeta_t;
+hashtable_t *saved;
+int metafd = -1;
+
+// Ids of saved pages are appended to .changed for indexer -u
+FILE *changed = NULL;
+
+// SimHashes of the saved pages, used by the writer thread only. A new
+// page within SH_MAXDIST bits of a saved one is not saved; it is
+// listed in .dups as "<canonical id> <url>" instead.
+simindex_t *sims;
+int dupfd = -1;
+
+// A fetched page on its way to the writer
+typedef struct fetched {
+    webpage_t *page;
+    uint64_t fp;                    // Its fingerprint
+    uint64_t sim;                   // Its SimHash
+    int id;                         // Id to save it as, 0 for a new page
+} fetched_t;
+
+// Crawl metrics, NULL unless --metrics is given. The histograms time
+// fetching a page, scanning it for links, checking a link against the
+// visited URLs, and saving a batch of pages.
+metrics_t *metrics = NULL;
+struct {
+    int fetched, failed, notmodified, unchanged, bytes;
+    int links, queued, duplicates, saved;
+    int fetch, parse, dedupe, save;
+} mh;
+atomic_int frontier = 0;            // Pages queued or being crawled
+atomic_int nvisited = 0;            // URLs visited, as discovered
 
 // Define pthread args
 typedef struct args {
@@ -48,12 +156,25 @@ typedef struct args {
     int maxdepth;
 } args_t;
 
+// Command line options, given before the positional arguments
+typedef struct opts {
+    bool resume;                    // --resume: continue the crawl in pagedir
+    bool recrawl;                   // --recrawl: refresh the pages in pagedir
+    char *scopefile;                // --scope <file>: rules of the crawl scope
+    char *metricsdest;              // --metrics <dest>: where snapshots go
+    char *seedurl;                  // NULL when resuming or recrawling
+    char *pagedir;
+    char *maxdepth;
+    char *threadnum;
+} opts_t;
+opts_t opts = {0};
+
 
 /****************************************************************
  * Search function for hashtable to match url string
 ****************************************************************/
 bool searchfn(void *p, const void *s) {
-    char *p_url = (char*)p ;
+    char *p_url = ((visit_t*)p)->url;
     char *s_url = (char*)s;
     return !strcmp(p_url, s_url);
 }
@@ -88,66 +209,540 @@ static uint32_t convert_uint(const char *s) {
 
 
 /****************************************************************
- * Pagesave - saves a html page to local directory
- * \param pagep     The page to be saved
- * \param id        The assigned id of the page
- * \param dirname   The directory to store the page in
+ * Private helper function: append a formatted line to a file with a
+ * single write(), so lines from several threads never interleave
+ * \param fd        The file, opened with O_APPEND
+ * \param format    printf() format of the line
+****************************************************************/
+static void appendline(int fd, const char *format, ...) {
+    if(fd < 0) return;
+    va_list ap;
+    va_start(ap, format);
+    int len = vsnprintf(NULL, 0, format, ap);
+    va_end(ap);
+    char *line = (char*)malloc(len + 1);
+    if(line == NULL) return;
+    va_start(ap, format);
+    vsnprintf(line, len + 1, format, ap);
+    va_end(ap);
+    if(write(fd, line, len) != len) {
+        logmsg(LOG_ERROR, "Error: failed to write crawl state\n");
+    }
+    free(line);
+}
+
+
+/****************************************************************
+ * Private helper function: append a line to the crawl journal.
+ * The caller holds statelock.
+ * \param type      The line type, 'D' or 'C'
+ * \param n         The depth ('D') or page id ('C')
+ * \param url       The URL
+****************************************************************/
+static void jlog(char type, int n, const char *url) {
+    appendline(journal, "%c %d %s\n", type, n, url);
+}
+
+
+/****************************************************************
+ * Private helper function: add a pending URL to the visited table
+ * \param url       The URL
+ * \param len       The length of the URL
+ * \param depth     The depth of the URL's page
+ * \return          The new entry, or NULL if out of memory
+****************************************************************/
+static visit_t *addvisit(const char *url, int len, int depth) {
+    visit_t *v = (visit_t*)malloc(sizeof(visit_t) + len + 1);
+    if(v == NULL) return NULL;
+    v->depth = depth;
+    memcpy(v->url, url, len);
+    v->url[len] = '\0';
+    lhput(vis, v, v->url, len);
+    atomic_fetch_add(&nvisited, 1);
+    return v;
+}
+
+
+/****************************************************************
+ * visit - records a newly discovered URL, unless it is pending or,
+ * when the seen filter has it, done. The URL is always checked
+ * against the frontier: a thread that has just added it to the filter
+ * may not have recorded it yet.
+ * \param url       The URL, normalized by sccheck()
+ * \param depth     The depth of the URL's page
+ * \param maybe     Whether the seen filter reported the URL as seen
+ * 
+ * \return          true if the URL was recorded; false if it was
+ *                  seen before
+****************************************************************/
+bool visit(char *url, int depth, bool maybe) {
+    int len = strlen(url);
+    pthread_mutex_lock(&statelock);
+    bool dup = lhsearch(vis, &searchfn, url, len) != NULL ||
+               (maybe && dshas(done, url, len));
+    if(!dup) {
+        addvisit(url, len, depth);
+        jlog('D', depth, url);
+    }
+    pthread_mutex_unlock(&statelock);
+    if(maybe && !dup) {
+        logmsg(LOG_DEBUG, "Info: seen filter false positive %s\n", url);
+    }
+    return !dup;
+}
+
+
+/****************************************************************
+ * complete - records that a URL is done; it moves from the frontier
+ * to the done URLs
+ * \param url       The URL
+ * \param pageid    The page id it was saved as, 0 if it was not
+****************************************************************/
+void complete(char *url, int pageid) {
+    pthread_mutex_lock(&statelock);
+    int len = strlen(url);
+    free(lhremove(vis, &searchfn, url, len));
+    dsadd(done, url, len);
+    jlog('C', pageid, url);
+    pthread_mutex_unlock(&statelock);
+}
+
+
+/****************************************************************
+ * Search function for hashtable to match pagemeta urls
+****************************************************************/
+bool metasearchfn(void *p, const void *s) {
+    return !strcmp(((pagemeta_t*)p)->url, (char*)s);
+}
+
+
+/****************************************************************
+ * Private helper function: update what is known about a saved page.
+ * The caller holds statelock.
+ * \param url       The URL of the page
+ * \param len       The length of the URL
+ * \param pageid    The page id it is saved as
+ * \param fp        The fingerprint of its html
+ * \param sim       The SimHash of its words
+ * \param etag      Its ETag, or NULL
+ * \param lastmod   Its Last-Modified time, or 0
+ * \return          The updated entry, or NULL if out of memory
+****************************************************************/
+static pagemeta_t *setmeta(const char *url, int len, int pageid, uint64_t fp,
+                           uint64_t sim, const char *etag, long lastmod) {
+    pagemeta_t *m = (pagemeta_t*)hsearch(saved, &metasearchfn, url, len);
+    if(m == NULL) {
+        if(!(m = (pagemeta_t*)malloc(sizeof(pagemeta_t) + len + 1))) {
+            return NULL;
+        }
+        memcpy(m->url, url, len);
+        m->url[len] = '\0';
+        m->etag = NULL;
+        hput(saved, m, m->url, len);
+    }
+    if(m->etag != etag) {
+        free(m->etag);
+        m->etag = etag ? (char*)malloc(strlen(etag) + 1) : NULL;
+        if(m->etag != NULL) strcpy(m->etag, etag);
+    }
+    m->id = pageid;
+    m->fp = fp;
+    m->sim = sim;
+    m->lastmod = lastmod;
+    return m;
+}
+
+
+/****************************************************************
+ * remember - records the id, fingerprint and validators of a page
+ * \param page      The page, as fetched
+ * \param pageid    The page id it is saved as
+ * \param fp        The fingerprint of its html
+ * \param sim       The SimHash of its words
+****************************************************************/
+void remember(webpage_t *page, int pageid, uint64_t fp, uint64_t sim) {
+    char *url = webpage_getURL(page);
+    char *etag = webpage_getETag(page);
+    long lastmod = webpage_getLastModified(page);
+    pthread_mutex_lock(&statelock);
+    setmeta(url, strlen(url), pageid, fp, sim, etag, lastmod);
+    appendline(metafd, "%d %016" PRIx64 " %016" PRIx64 " %ld %s %s\n", pageid,
+               fp, sim, lastmod, etag ? etag : "-", url);
+    pthread_mutex_unlock(&statelock);
+}
+
+
+/****************************************************************
+ * lookup - finds what an earlier crawl saved for a page. When
+ * recrawling, the page's next fetch is made conditional on it.
+ * \param page      The page to be fetched
+ * \param fp        Set to the fingerprint of the saved copy
+ * \param sim       Set to the SimHash of the saved copy
+ * \return          The id of the saved copy, 0 if there is none
+****************************************************************/
+int lookup(webpage_t *page, uint64_t *fp, uint64_t *sim) {
+    char *url = webpage_getURL(page);
+    int pageid = 0;
+    pthread_mutex_lock(&statelock);
+    pagemeta_t *m = (pagemeta_t*)hsearch(saved, &metasearchfn, url, strlen(url));
+    if(m != NULL) {
+        pageid = m->id;
+        *fp = m->fp;
+        *sim = m->sim;
+        if(opts.recrawl) webpage_setValidators(page, m->etag, m->lastmod);
+    }
+    pthread_mutex_unlock(&statelock);
+    return pageid;
+}
+
+
+/****************************************************************
+ * Private helper function: write one pending URL to the snapshot
+****************************************************************/
+static void snapline(void *ep) {
+    visit_t *v = (visit_t*)ep;
+    fprintf(statefp, "D %d %s\n", v->depth, v->url);
+}
+
+
+/****************************************************************
+ * Private helper functions: write one page to the .meta file, and
+ * free one pagemeta entry's ETag
+****************************************************************/
+static void metaline(void *ep) {
+    pagemeta_t *m = (pagemeta_t*)ep;
+    fprintf(statefp, "%d %016" PRIx64 " %016" PRIx64 " %ld %s %s\n", m->id,
+            m->fp, m->sim, m->lastmod, m->etag ? m->etag : "-", m->url);
+}
+
+static void freemeta(void *ep) {
+    free(((pagemeta_t*)ep)->etag);
+}
+
+
+/****************************************************************
+ * snapshot - writes the crawl state to the snapshot file and starts
+ * an empty journal. The new snapshot replaces the old one with a
+ * rename, so a crash leaves either one in place. The seen filter is
+ * replaced first: it only gains URLs, so a newer filter with an older
+ * snapshot and journal loses nothing. The caller holds statelock.
+ * \param pagedir   The page directory
+ * \param lastid    The last page id handed out
  * 
  * \return          0 if sucess and non-zero if otherwise
 ****************************************************************/
-int32_t pagesave(webpage_t *pagep, int id, char *dirname) {
-    
-    // Extract information to save
-    char* html  = webpage_getHTML(pagep);
-    int   len   = webpage_getHTMLlen(pagep);
-    char* url   = webpage_getURL(pagep);
-    int   depth = webpage_getDepth(pagep);
+int snapshot(char *pagedir, int lastid) {
+
+    char tmp[__MAXCHAR + 32], path[__MAXCHAR + 32];
+    sprintf(tmp, "%s/%s.tmp", pagedir, __SEEN);
+    sprintf(path, "%s/%s", pagedir, __SEEN);
+    if(bfsave(seen, tmp) != 0 || rename(tmp, path) != 0) {
+        logmsg(LOG_ERROR, "Error: failed to write %s\n", path);
+        return 1;
+    }
+    logmsg(LOG_DEBUG, "Info: %d URLs seen, false positive rate %.5f\n",
+           atomic_load(&nvisited), bfrate(seen));
 
-    // Populate filename
-    char *filename = malloc(sizeof(char)*strlen(dirname) + sizeof(char) * 16);
-    sprintf(filename, "%s/%d", dirname, id);
+    sprintf(tmp, "%s/%s.tmp", pagedir, __SNAPSHOT);
+    sprintf(path, "%s/%s", pagedir, __SNAPSHOT);
+    if(!(statefp = fopen(tmp, "w"))) {
+        logmsg(LOG_ERROR, "Error: failed to open %s\n", tmp);
+        return 1;
+    }
+    fprintf(statefp, "S %d\n", lastid);
+    lhapply(vis, snapline);
+    bool ok = fflush(statefp) == 0 && fsync(fileno(statefp)) == 0;
+    ok = fclose(statefp) == 0 && ok;
+    statefp = NULL;
+    if(!ok || rename(tmp, path) != 0) {
+        logmsg(LOG_ERROR, "Error: failed to write %s\n", path);
+        return 1;
+    }
 
-    // Make directory if does not exist
-    if(stat(dirname, &st) == -1) mkdir(dirname, 0777);
-    if(access(dirname, W_OK)) chmod(dirname, W_OK);
+    // Make the rename durable before the journal is dropped
+    int dirfd = open(pagedir, O_RDONLY);
+    if(dirfd >= 0) {
+        fsync(dirfd);
+        close(dirfd);
+    }
+    if(journal >= 0 && ftruncate(journal, 0) != 0) {
+        logmsg(LOG_ERROR, "Error: failed to truncate crawl journal\n");
+        return 1;
+    }
+    return 0;
+}
+
+
+/****************************************************************
+ * Private helper function: map a whole file read-only
+ * \param path      The file
+ * \param size      Set to the size of the file
+ * \return          The mapping, NULL if the file is missing or empty
+****************************************************************/
+static char *mapfile(const char *path, size_t *size) {
+    *size = 0;
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) return NULL;
+    struct stat fst;
+    char *buf = NULL;
+    if(fstat(fd, &fst) == 0 && fst.st_size > 0) {
+        buf = (char*)mmap(NULL, fst.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(buf == MAP_FAILED) buf = NULL;
+        else *size = fst.st_size;
+    }
+    close(fd);
+    return buf;
+}
+
+
+/****************************************************************
+ * Private helper function: replay snapshot or journal lines into
+ * the seen filter, the visited table, which only keeps the URLs not
+ * done, and the done URLs, which have most of them already. "V"
+ * lines, of done URLs, are in snapshots of earlier crawls. Replaying a line twice changes nothing, and a last line
+ * without a newline (a torn write) is ignored.
+ * \param buf       The lines
+ * \param size      The length of buf
+ * \param lastid    Raised to the highest page id seen
+ * \return          The number of lines replayed
+****************************************************************/
+static int replay(const char *buf, size_t size, int *lastid) {
+
+    int lines = 0;
+    const char *end = buf + size;
+    while(buf < end) {
+        const char *nl = memchr(buf, '\n', end - buf);
+        if(nl == NULL) break;
+
+        // "S <lastid>" or "<type> <number> <url>"
+        char type = *buf;
+        char *p;
+        long n = strtol(buf + 1, &p, 10);
+        const char *url = p + 1;
+        int len = nl - url;
+        if(p == buf + 1 || (type == 'S' ? p != nl : *p != ' ' || len < 0)) {
+            logmsg(LOG_WARN, "Warning: skipping bad journal line\n");
+            buf = nl + 1;
+            continue;
+        }
+
+        if(type == 'S') {
+            if(n > *lastid) *lastid = n;
+        }
+        else {
+            char key[len + 1];
+            memcpy(key, url, len);
+            key[len] = '\0';
+            bfadd(seen, key, len);
+            if(type != 'D') {
+                free(lhremove(vis, &searchfn, key, len));
+                if(!dshas(done, key, len)) dsadd(done, key, len);
+            }
+            else if(lhsearch(vis, &searchfn, key, len) == NULL) {
+                addvisit(key, len, n);
+            }
+            if(type == 'C' && n > *lastid) *lastid = n;
+        }
+        lines++;
+        buf = nl + 1;
+    }
+    return lines;
+}
+
+
+/****************************************************************
+ * Private helper function: queue a page for every pending URL
+****************************************************************/
+static void requeue(void *ep) {
+    visit_t *v = (visit_t*)ep;
+    lqput(u_queue, webpage_new(v->url, v->depth, NULL));
+    atomic_fetch_add(&frontier, 1);
+}
+
+
+/****************************************************************
+ * resume - rebuilds the crawl state from the snapshot and journal
+ * in pagedir and queues the pages that are not done
+ * \param pagedir   The page directory
+ * 
+ * \return          The last page id saved, or -1 if there is no
+ *                  crawl to resume
+****************************************************************/
+int resume(char *pagedir) {
+
+    char path[__MAXCHAR + 32];
+    int lastid = 0, lines = 0;
+    size_t size;
+    char *buf;
 
-    // Make page file
-    FILE *outputf = fopen(filename, "w");
-    if(outputf == NULL) {
-        eprintf("Error: create page file failed for %s\n", filename);
-        eprintf("Error %d \n", errno);
+    // Missing before the first snapshot, or after a crawl of an
+    // earlier version, whose snapshot lists the done URLs instead
+    sprintf(path, "%s/%s", pagedir, __SEEN);
+    if(access(path, F_OK) == 0 && bfload(seen, path) != 0) {
+        logmsg(LOG_ERROR, "Error: failed to read %s\n", path);
         return -1;
     }
-    fprintf(outputf, "%s\n%d\n%d\n%s\n", url, depth, len, html);
-    fclose(outputf);
+    sprintf(path, "%s/%s", pagedir, __SNAPSHOT);
+    if((buf = mapfile(path, &size)) != NULL) {
+        lines += replay(buf, size, &lastid);
+        munmap(buf, size);
+    }
+    sprintf(path, "%s/%s", pagedir, __JOURNAL);
+    if((buf = mapfile(path, &size)) != NULL) {
+        lines += replay(buf, size, &lastid);
+        munmap(buf, size);
+    }
+    if(lines == 0) return -1;
+
+    lhapply(vis, requeue);
+    return lastid;
+}
 
-    // Deallocate the filename string
-    free(filename);
+
+/****************************************************************
+ * metaload - loads what earlier crawls saved in pagedir; later
+ * lines of the .meta file override earlier ones. The SimHash of
+ * every page is filed in sims.
+ * \param pagedir   The page directory
+ *
+ * \return          The highest page id saved
+****************************************************************/
+int metaload(char *pagedir) {
+
+    char path[__MAXCHAR + 32];
+    sprintf(path, "%s/%s", pagedir, __META);
+    size_t size;
+    char *buf = mapfile(path, &size);
+    if(buf == NULL) return 0;
+
+    int maxid = 0;
+    const char *p = buf, *end = buf + size;
+    while(p < end) {
+        const char *nl = memchr(p, '\n', end - p);
+        if(nl == NULL) break;
+        int len = nl - p;
+        char line[len + 1], etag[len + 1];
+        memcpy(line, p, len);
+        line[len] = '\0';
+        p = nl + 1;
+
+        // "<id> <fingerprint> <simhash> <lastmod> <etag or -> <url>"
+        int pageid, urlpos = -1;
+        uint64_t fp, sim;
+        long lastmod;
+        if(sscanf(line, "%d %" SCNx64 " %" SCNx64 " %ld %s %n", &pageid, &fp,
+                  &sim, &lastmod, etag, &urlpos) != 5 || urlpos < 0 || pageid < 1) {
+            logmsg(LOG_WARN, "Warning: skipping bad line in %s\n", path);
+            continue;
+        }
+        setmeta(line + urlpos, len - urlpos, pageid, fp, sim,
+                strcmp(etag, "-") ? etag : NULL, lastmod);
+        if(sim != 0) shadd(sims, sim, pageid);
+        if(pageid > maxid) maxid = pageid;
+    }
+    munmap(buf, size);
+    return maxid;
+}
+
+
+/****************************************************************
+ * metasave - rewrites the .meta file with one line per page. The
+ * caller holds statelock.
+ * \param pagedir   The page directory
+ *
+ * \return          0 if sucess and non-zero if otherwise
+****************************************************************/
+int metasave(char *pagedir) {
+
+    char tmp[__MAXCHAR + 32], path[__MAXCHAR + 32];
+    sprintf(tmp, "%s/%s.tmp", pagedir, __META);
+    sprintf(path, "%s/%s", pagedir, __META);
+    if(!(statefp = fopen(tmp, "w"))) {
+        logmsg(LOG_ERROR, "Error: failed to open %s\n", tmp);
+        return 1;
+    }
+    happly(saved, metaline);
+    bool ok = fflush(statefp) == 0 && fsync(fileno(statefp)) == 0;
+    ok = fclose(statefp) == 0 && ok;
+    statefp = NULL;
+    if(!ok || rename(tmp, path) != 0) {
+        logmsg(LOG_ERROR, "Error: failed to write %s\n", path);
+        return 1;
+    }
     return 0;
 }
 
 
 /****************************************************************
- * cpage - checks validity of URL and creates a webpage
- * \param h         The indexing hashtable 
+ * Private helper functions: the gauges of the crawl metrics
+****************************************************************/
+static long frontiersize(void) {
+    return atomic_load(&frontier);
+}
+
+static long visitedsize(void) {
+    return atomic_load(&nvisited);
+}
+
+static long channelsize(void) {
+    return bqsize(w_chan);
+}
+
+
+/****************************************************************
+ * Private helper function: register the crawl metrics and start
+ * dumping them to dest
+ * \param dest      A file, or "unix:<socket path>"
+ * \return          0 if sucess and non-zero if otherwise
+****************************************************************/
+static int startmetrics(const char *dest) {
+    if(!(metrics = mtopen())) return 1;
+    mh.fetched = mtcounter(metrics, "fetched");
+    mh.failed = mtcounter(metrics, "failed");
+    mh.notmodified = mtcounter(metrics, "notmodified");
+    mh.unchanged = mtcounter(metrics, "unchanged");
+    mh.bytes = mtcounter(metrics, "bytes");
+    mh.links = mtcounter(metrics, "links");
+    mh.queued = mtcounter(metrics, "queued");
+    mh.duplicates = mtcounter(metrics, "duplicates");
+    mh.saved = mtcounter(metrics, "saved");
+    mh.fetch = mthistogram(metrics, "fetch");
+    mh.parse = mthistogram(metrics, "parse");
+    mh.dedupe = mthistogram(metrics, "dedupe");
+    mh.save = mthistogram(metrics, "save");
+    mtgauge(metrics, "frontier", frontiersize);
+    mtgauge(metrics, "visited", visitedsize);
+    mtgauge(metrics, "channel", channelsize);
+    return mtstart(metrics, dest, __METRICSEVERY);
+}
+
+
+/****************************************************************
+ * cpage - checks validity of URL, records it as visited if it is new
+ * and creates a webpage
  * \param depth     The depth of the page to be created
  * \param url       The URL of the page to be created
  * 
  * \return          0 if sucess and non-zero if otherwise
 ****************************************************************/
-webpage_t *cpage(lhashtable_t *h, int depth, char *url) {
-    if(!(NormalizeURL(url) && IsInternalURL(url))) {
-        eprintf("Panic: bad link %s\n", url);
+webpage_t *cpage(int depth, char *url) {
+    if(!sccheck(scope, url)) {          // Normalizes url as well
+        logmsg(LOG_DEBUG, "Panic: bad link %s\n", url);
         return NULL;
     }
-    if(lhsearch(h, &searchfn, url, strlen(url)) != NULL) {
-        eprintf("Panic: duplicate URL %s\n", url);
+    int len = strlen(url);
+    uint64_t start = metrics ? mtnow() : 0;
+    bool fresh = visit(url, depth + 1, bfadd(seen, url, len));
+    mtsince(metrics, mh.dedupe, start);
+    if(!fresh) {
+        logmsg(LOG_DEBUG, "Panic: duplicate URL %s\n", url);
         return NULL;
     }
     
     webpage_t *page = webpage_new(url, depth + 1, NULL);
     if(page == NULL) {
-        eprintf("Failed to create page: %s", url);
+        logmsg(LOG_DEBUG, "Failed to create page: %s\n", url);
+        complete(url, 0);
         return NULL;
     }
 
@@ -155,6 +750,143 @@ webpage_t *cpage(lhashtable_t *h, int depth, char *url) {
 }
 
 
+/****************************************************************
+ * cpcopy - copies a fetched page for the writer thread
+ * \param p         The fetched page
+ * 
+ * \return          A new page owning a copy of the html
+****************************************************************/
+webpage_t *cpcopy(webpage_t *p) {
+    char *html = webpage_getHTML(p);
+    size_t len = strlen(html);
+    char *copy = (char*)malloc(len + 1);
+    memcpy(copy, html, len + 1);
+    webpage_t *page = webpage_new(webpage_getURL(p), webpage_getDepth(p), copy);
+    webpage_setValidators(page, webpage_getETag(p), webpage_getLastModified(p));
+    return page;
+}
+
+
+/****************************************************************
+ * Private helper function: drop a new page that is a near-duplicate
+ * of a saved one. It is listed in .dups and journaled as done
+ * without a page file.
+ * \param page      The page to drop
+ * \param canonid   The id of the saved page it duplicates
+****************************************************************/
+static void duplicate(webpage_t *page, int canonid) {
+    char *url = webpage_getURL(page);
+    logmsg(LOG_DEBUG, "Info: %s duplicates page %d\n", url, canonid);
+    pthread_mutex_lock(&statelock);
+    appendline(dupfd, "%d %s\n", canonid, url);
+    pthread_mutex_unlock(&statelock);
+    complete(url, 0);
+}
+
+
+/****************************************************************
+ * Writer - saves the pages queued by the crawler threads. Pages
+ * are taken off the channel in batches, numbered, written and
+ * fsync()ed together through pageaio; the directory itself is 
+ * fsync()ed once per batch so the new names are durable too. Saved
+ * pages are then listed in .changed, remembered in .meta and
+ * journaled as done, in that order, and every __SNAPEVERY pages the
+ * crawl state is snapshotted. A page seen by an earlier crawl keeps
+ * its id; a new page whose SimHash is within SH_MAXDIST bits of a
+ * saved page's is dropped as a near-duplicate before it gets one.
+ * \param input     The crawler arguments (args_t)
+ * 
+ * \return          NULL
+****************************************************************/
+void *writer(void *input) {
+
+    args_t *info = (args_t*)input;
+    pageaio_t *pa = w_aio;
+    int dirfd = open(info->pagedir, O_RDONLY);
+
+    fetched_t *batch[__WBATCH];
+    webpage_t *pages[__WBATCH];
+    int ids[__WBATCH];
+    int32_t status[__WBATCH];
+    int n, done = 0;
+    while((n = bqgetn(w_chan, (void**)batch, __WBATCH)) > 0) {
+
+        // Drop near-duplicates and number the new pages in the batch;
+        // only this thread hands out ids
+        int kept = 0;
+        for(int i = 0; i < n; i++) {
+            fetched_t *f = batch[i];
+            int canonid = (f->id == 0 && f->sim != 0) ?
+                shfind(sims, f->sim, SH_MAXDIST) : 0;
+            if(canonid > 0) {
+                mtadd(metrics, mh.duplicates, 1);
+                duplicate(f->page, canonid);
+                webpage_delete(f->page);
+                free(f);
+                continue;
+            }
+            batch[kept] = f;
+            pages[kept] = f->page;
+            ids[kept] = f->id ? f->id : atomic_fetch_add(&id, 1) + 1;
+            if(f->sim != 0) shadd(sims, f->sim, ids[kept]);
+            kept++;
+        }
+        if((n = kept) == 0) continue;
+
+        uint64_t start = metrics ? mtnow() : 0;
+        if(!atomic_load(&failed) &&
+           pasave(pa, pages, ids, n, info->pagedir, true, status) != 0) {
+            // Retry once before giving up, so that ids stay dense
+            for(int i = 0; i < n; i++) {
+                if(status[i] == 0) continue;
+                if(pasave(pa, &pages[i], &ids[i], 1, info->pagedir, 
+                          true, NULL) != 0) {
+                    logmsg(LOG_ERROR, "Error: failed to save page %s\n",
+                           webpage_getURL(pages[i]));
+                    atomic_store(&failed, true);
+                }
+            }
+        }
+        if(dirfd >= 0) fsync(dirfd);
+        mtsince(metrics, mh.save, start);
+
+        // Record the batch once it is durable
+        if(!atomic_load(&failed)) {
+            for(int i = 0; i < n; i++) fprintf(changed, "%d\n", ids[i]);
+            fflush(changed);
+            mtadd(metrics, mh.saved, n);
+            for(int i = 0; i < n; i++) {
+                remember(pages[i], ids[i], batch[i]->fp, batch[i]->sim);
+                complete(webpage_getURL(pages[i]), ids[i]);
+            }
+            if((done += n) >= __SNAPEVERY) {
+                pthread_mutex_lock(&statelock);
+                snapshot(info->pagedir, atomic_load(&id));
+                pthread_mutex_unlock(&statelock);
+                done = 0;
+            }
+        }
+
+        for(int i = 0; i < n; i++) {
+            webpage_delete(pages[i]);
+            free(batch[i]);
+        }
+    }
+
+    // Leave a compact snapshot and .meta behind a crawl that ran to
+    // the end
+    if(!atomic_load(&failed)) {
+        pthread_mutex_lock(&statelock);
+        snapshot(info->pagedir, atomic_load(&id));
+        metasave(info->pagedir);
+        pthread_mutex_unlock(&statelock);
+    }
+
+    if(dirfd >= 0) close(dirfd);
+    return NULL;
+}
+
+
 /****************************************************************
  * Crawler - starts a BFS of a designated URL
  * \param seedURL   The starting URL for crawling 
@@ -170,42 +902,101 @@ void *crawler(void *input) {
     // Start BFS of the current seed webpage
     int depth = 0;
     webpage_t *p;
-    while((p = (webpage_t*)lqget(u_queue)) != NULL) {
-        
+    while(true) {
+        // An empty queue is not the end of the crawl while other
+        // threads still have pages whose links are not queued yet
+        if((p = (webpage_t*)lqget(u_queue)) == NULL) {
+            if(atomic_load(&frontier) == 0 || atomic_load(&failed)) break;
+            nanosleep(&(struct timespec){0, __IDLENS}, NULL);
+            continue;
+        }
+
         depth = webpage_getDepth(p);        // The depth of the current page
         int pos = 0;                        // Position of the crawling cursor
         char *url = NULL;                   // New pointer to the fectched URL
 
-        if(webpage_fetch(p)) {
+        if(atomic_load(&failed)) {
+            webpage_delete(p);
+            break;
+        }
+
+        // A page saved by an earlier crawl is only saved again if it
+        // changed; when recrawling, it is fetched conditionally
+        uint64_t oldfp = 0, oldsim = 0;
+        int oldid = lookup(p, &oldfp, &oldsim);
+        webpage_t *old = NULL;
+        uint64_t start = metrics ? mtnow() : 0;
+        bool fetched = webpage_fetch(p);
+        if(fetched && webpage_isNotModified(p) &&
+           (old = pageload(oldid, info->pagedir)) == NULL) {
+            // The saved copy is gone; fetch the page in full
+            webpage_setValidators(p, NULL, 0);
+            fetched = webpage_fetch(p);
+        }
+        start = mtsince(metrics, mh.fetch, start);
+
+        if(fetched) {
+            mtadd(metrics, mh.fetched, 1);
+            mtadd(metrics, mh.notmodified, old != NULL);
+            mtadd(metrics, mh.bytes, webpage_getHTMLlen(p));
             
-            // Save the current html page
-            if(pagesave(p, ++id, info->pagedir) == -1) {
-                eprintf("Error: failed to save page %s\n", webpage_getURL(p));
-                return NULL;
-            }
+            // Copy a changed page for the writer first; the link scan
+            // below strips whitespace from the html in place
+            webpage_t *src = old ? old : p;
+            uint64_t fp = old ? oldfp : hash64(webpage_getHTML(p), webpage_getHTMLlen(p));
+            bool unchanged = oldid > 0 && fp == oldfp;
+            webpage_t *copy = unchanged ? NULL : cpcopy(p);
+            uint64_t sim = unchanged ? oldsim : simhash(copy);
 
-            printf("Level %d -- Scanning %s\n", depth, webpage_getURL(p));
+            logmsg(LOG_INFO, "Level %d -- Scanning %s\n", depth, webpage_getURL(p));
             if(depth < info->maxdepth) {
-                while((pos = webpage_getNextURL(p, pos, &url)) > 0) {
+                while((pos = webpage_getNextURL(src, pos, &url)) > 0) {
                     
-                    printf("Info: found URL %s\n", url);
-                    webpage_t *newpage = cpage(vis, depth, url);
+                    logmsg(LOG_DEBUG, "Info: found URL %s\n", url);
+                    mtadd(metrics, mh.links, 1);
+                    webpage_t *newpage = cpage(depth, url);
                     if(newpage != NULL) {
-                        lhput(vis, url, url, strlen(url));
+                        atomic_fetch_add(&frontier, 1);
                         lqput(u_queue, newpage);
+                        mtadd(metrics, mh.queued, 1);
                     }
-                    else {
-                        free(url);
-                    }
+                    free(url);
+                }
+            }
+            mtsince(metrics, mh.parse, start);
+
+            // Only hand the page over once its links are journaled, so
+            // a page is never done before its children are known
+            if(unchanged) {
+                mtadd(metrics, mh.unchanged, 1);
+                remember(p, oldid, fp, sim);
+                complete(webpage_getURL(p), oldid);
+            }
+            else {
+                fetched_t *f = (fetched_t*)malloc(sizeof(fetched_t));
+                if(f != NULL) *f = (fetched_t){copy, fp, sim, oldid};
+                if(f == NULL || bqput(w_chan, f) != 0) {
+                    logmsg(LOG_ERROR, "Error: failed to queue page %s\n",
+                           webpage_getURL(p));
+                    free(f);
+                    webpage_delete(copy);
+                    webpage_delete(old);
+                    webpage_delete(p);
+                    atomic_fetch_sub(&frontier, 1);
+                    return NULL;
                 }
             }
+            webpage_delete(old);
         }
         else {
-            eprintf("Failed to create page: %s", url);
+            logmsg(LOG_DEBUG, "Failed to create page: %s\n", url);
+            mtadd(metrics, mh.failed, 1);
+            complete(webpage_getURL(p), 0);
         }
 
-        // Pop the element
+        // Pop the element; its links are queued, so it leaves the frontier
         webpage_delete(p);
+        atomic_fetch_sub(&frontier, 1);
     }
 
     return NULL;
@@ -214,37 +1005,71 @@ void *crawler(void *input) {
 
 
 /****************************************************************
- * checkinput - checks the cmd input provided by the user
+ * checkinput - checks the cmd input provided by the user and fills
+ * in the global options
  * \return error code:
  *              0: parsing success
  *              1: wrong number of arguments
+ *              2: unknown option
  *              3. non uint_32 integer depth
  *              4. negative depth value 
  *              5. non uint_32 thread number
  *              6. negative thread number
+ *              7. no page directory to resume or recrawl
 ****************************************************************/
 int checkinput(int argc, char* argv[]) {
     
+    // Parse the leading options
+    int argi = 1;
+    for(; argi < argc && !strncmp(argv[argi], "--", 2); argi++) {
+        if(!strcmp(argv[argi], "--resume")) {
+            opts.resume = true;
+        }
+        else if(!strcmp(argv[argi], "--recrawl")) {
+            opts.recrawl = true;
+        }
+        else if(!strcmp(argv[argi], "--scope") && argi + 1 < argc) {
+            opts.scopefile = argv[++argi];
+        }
+        else if(!strcmp(argv[argi], "--metrics") && argi + 1 < argc) {
+            opts.metricsdest = argv[++argi];
+        }
+        else {
+            printf("Error: unknown option %s\n", argv[argi]);
+            return 2;
+        }
+    }
+
     // Parse the cmdline inputs
-    if(argc != 5) {
-        printf("usage: crawler <seedurl> <pagedir> <maxdepth> <threadnum>\n");
+    bool again = opts.resume || opts.recrawl;
+    if(argc - argi != (again ? 3 : 4)) {
+        printf("usage: crawler [--scope <file>] [--metrics <dest>] <seedurl> <pagedir> <maxdepth> <threadnum>\n"
+               "       crawler [--scope <file>] [--metrics <dest>] [--resume] [--recrawl] <pagedir> <maxdepth> <threadnum>\n");
         return 1;
     }
+    opts.seedurl = again ? NULL : argv[argi++];
+    opts.pagedir = argv[argi++];
+    opts.maxdepth = argv[argi++];
+    opts.threadnum = argv[argi++];
 
     // Make sure that directory is valid
-    char *dirname = argv[2];
+    char *dirname = opts.pagedir;
+    if(again && stat(dirname, &st) == -1) {
+        printf("Error: no crawl in %s\n", dirname);
+        return 7;
+    }
     if(stat(dirname, &st) == -1) mkdir(dirname, 0777);
     if(access(dirname, W_OK)) chmod(dirname, W_OK);
 
     // Sanity check, make sure maxdepth is an integer
     int maxdepth = -1;
-    if(!valid_uint(argv[3])) {
+    if(!valid_uint(opts.maxdepth)) {
         printf("Error: invalid maximum depth\n");
         return 3;
     }
 
     // Make sure depth is an non-negative integer
-    maxdepth = convert_uint(argv[3]);
+    maxdepth = convert_uint(opts.maxdepth);
     if(maxdepth < 0) {
         printf("Error: maxdepth must be an non-negative integer\n");
         return 4;
@@ -252,13 +1077,13 @@ int checkinput(int argc, char* argv[]) {
 
     // Sanity check, make sure thread number is an
     int threadnum = -1;
-    if(!valid_uint(argv[4])) {
+    if(!valid_uint(opts.threadnum)) {
         printf("Error: invalid thread number\n");
         return 5;
     }
 
     // Make sure depth is an non-negative integer
-    threadnum = convert_uint(argv[4]);
+    threadnum = convert_uint(opts.threadnum);
     if(threadnum < 0) {
         printf("Error: threadnum must be an non-negative integer\n");
         return 6;
@@ -270,23 +1095,24 @@ int checkinput(int argc, char* argv[]) {
 
 /****************************************************************
  * Crawler - starts a BFS of a designated URL
- * usage: crawler <seedurl> <pagedir> <maxdepth>
+ * usage: crawler [--scope <file>] [--metrics <dest>] <seedurl> <pagedir> <maxdepth> <threadnum>
+ *        crawler [--scope <file>] [--metrics <dest>] [--resume] [--recrawl] <pagedir> <maxdepth> <threadnum>
 ****************************************************************/
 int main(int argc, char *argv[]) {
 
     int error = checkinput(argc, argv);
     if(error != 0) {
-        eprintf("Error parsing arguments: %d\n", error);
+        logmsg(LOG_DEBUG, "Error parsing arguments: %d\n", error);
         exit(EXIT_FAILURE);
     }
 
-    int maxdepth = convert_uint(argv[3]);
-    int threadnum = convert_uint(argv[4]);
+    int maxdepth = convert_uint(opts.maxdepth);
+    int threadnum = convert_uint(opts.threadnum);
 
     // Initialize queue for list of URLs
     u_queue = lqopen();
     if(u_queue == NULL) {
-        printf("Error: Failed to initialize queue\n");
+        logmsg(LOG_ERROR, "Error: Failed to initialize queue\n");
         return -1;
     }
 
@@ -294,57 +1120,184 @@ int main(int argc, char *argv[]) {
     // maximum breadth as defined by the global parameter maxbreadth.
     vis = lhopen((maxdepth + 1) * __MAXB);
     if(vis == NULL) {
-        printf("Error: Failed to initalize hashtable\n");
+        logmsg(LOG_ERROR, "Error: Failed to initalize hashtable\n");
+        return -1;
+    }
+    seen = bfopen(__SEENBYTES, __SEENHASHES);
+    if(seen == NULL) {
+        logmsg(LOG_ERROR, "Error: Failed to initalize URL filter\n");
         return -1;
     }
 
-    // Fetch the seed page. Exit failure if the seed page is invalid or if 
-    // creating local page failed.
-    webpage_t *seed = webpage_new(argv[1], 0, NULL);
-    if(seed == NULL || !IsInternalURL(webpage_getURL(seed))) {
-        eprintf("Error: Failed to fetch seed page %s\n", argv[1]);
+    // Load the crawl scope
+    if(opts.scopefile != NULL) {
+        scope = scload(opts.scopefile);
+    }
+    else if((scope = scopen()) != NULL) {
+        scadd(scope, true, SC_PREFIX, INTERNAL_URL_PREFIX);
+    }
+    if(scope == NULL) {
+        logmsg(LOG_ERROR, "Error: Failed to load crawl scope\n");
+        return -1;
+    }
+
+    // Load what earlier crawls saved, so that pages keep their ids and
+    // unchanged pages are not saved again
+    saved = hopen((maxdepth + 1) * __MAXB);
+    sims = shopen();
+    if(saved == NULL || sims == NULL) {
+        logmsg(LOG_ERROR, "Error: Failed to initalize hashtable\n");
+        return -1;
+    }
+    int maxid = (opts.resume || opts.recrawl) ? metaload(opts.pagedir) : 0;
+
+    // The done URLs of a new crawl or a recrawl start out empty
+    char path[__MAXCHAR + 32];
+    sprintf(path, "%s/%s", opts.pagedir, __DONE);
+    if((done = dsopen(path, opts.resume)) == NULL) {
+        logmsg(LOG_ERROR, "Error: Failed to open %s\n", path);
+        return -1;
+    }
+
+    sprintf(path, "%s/%s", opts.pagedir, __JOURNAL);
+    if(opts.resume) {
+        // Rebuild the visited table and frontier, and carry on
+        // numbering pages after the last one saved
+        int lastid = resume(opts.pagedir);
+        if(lastid < 0) {
+            logmsg(LOG_ERROR, "Error: no crawl to resume in %s\n", opts.pagedir);
+            exit(EXIT_FAILURE);
+        }
+        if(maxid > lastid) lastid = maxid;
+        atomic_store(&id, lastid);
+        journal = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        logmsg(LOG_INFO, "Crawler resuming in %s after page %d...\n",
+               opts.pagedir, lastid);
+    }
+    else {
+        // Start a new journal; an old snapshot no longer applies
+        journal = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+        sprintf(path, "%s/%s", opts.pagedir, __SNAPSHOT);
+        unlink(path);
+        sprintf(path, "%s/%s", opts.pagedir, __SEEN);
+        unlink(path);
+
+        // A recrawl starts over from the seed of the saved crawl, page 1,
+        // and numbers new pages after the saved ones
+        if(opts.recrawl) {
+            webpage_t *first = maxid > 0 ? pageload(1, opts.pagedir) : NULL;
+            if(first == NULL) {
+                logmsg(LOG_ERROR, "Error: no crawl to recrawl in %s\n", opts.pagedir);
+                exit(EXIT_FAILURE);
+            }
+            opts.seedurl = (char*)malloc(strlen(webpage_getURL(first)) + 1);
+            strcpy(opts.seedurl, webpage_getURL(first));
+            webpage_delete(first);
+            atomic_store(&id, maxid);
+            appendline(journal, "S %d\n", maxid);
+        }
+
+        // Fetch the seed page. Exit failure if the seed page is invalid
+        // or if creating local page failed.
+        webpage_t *seed = webpage_new(opts.seedurl, 0, NULL);
+        if(seed == NULL || !sccheck(scope, webpage_getURL(seed))) {
+            logmsg(LOG_ERROR, "Error: Failed to fetch seed page %s\n", opts.seedurl);
+            return -1;
+        }
+        lqput(u_queue, seed);
+        atomic_fetch_add(&frontier, 1);
+        bfadd(seen, opts.seedurl, strlen(opts.seedurl));
+        visit(opts.seedurl, 0, false);
+    }
+
+    // A new crawl starts a new .meta, .changed and .dups; otherwise
+    // they are appended to
+    int trunc = (opts.resume || opts.recrawl) ? 0 : O_TRUNC;
+    sprintf(path, "%s/%s", opts.pagedir, __META);
+    metafd = open(path, O_WRONLY | O_CREAT | O_APPEND | trunc, 0644);
+    sprintf(path, "%s/%s", opts.pagedir, __CHANGED);
+    changed = fopen(path, trunc ? "w" : "a");
+    sprintf(path, "%s/%s", opts.pagedir, __DUPS);
+    dupfd = open(path, O_WRONLY | O_CREAT | O_APPEND | trunc, 0644);
+    if(journal < 0 || metafd < 0 || changed == NULL || dupfd < 0) {
+        logmsg(LOG_ERROR, "Error: Failed to open crawl journal\n");
         return -1;
     }
-    lqput(u_queue, seed);
-    char* seedcopy = (char*)calloc(strlen(argv[1]) + 1, sizeof(char));
-    strcpy(seedcopy, argv[1]);
-    lhput(vis, seedcopy, seedcopy, strlen(seedcopy));
 
     // Create thread pool and call the crawler function
-    printf("Crawler working with %s and depth %d...\n", argv[1], maxdepth);
+    if(!opts.resume) {
+        logmsg(LOG_INFO, "Crawler working with %s and depth %d...\n",
+               opts.seedurl, maxdepth);
+    }
     args_t *args = (args_t*)malloc(sizeof(args_t));
-    strcpy(args->seedURL, argv[1]);
-    strcpy(args->pagedir, argv[2]);
+    strcpy(args->seedURL, opts.seedurl ? opts.seedurl : "");
+    strcpy(args->pagedir, opts.pagedir);
     args->maxdepth = maxdepth;
     
+    // Start dumping metrics, if asked to
+    if(opts.metricsdest != NULL && startmetrics(opts.metricsdest) != 0) {
+        logmsg(LOG_ERROR, "Error: Failed to start metrics\n");
+        return -1;
+    }
+
+    // Start the writer before any page can be fetched
+    w_chan = bqopen(__CHANNEL);
+    if((w_aio = paopen(__WBATCH, PA_AUTO)) == NULL) {
+        logmsg(LOG_ERROR, "Error: Failed to initialize page writer\n");
+        return -1;
+    }
+    pthread_t wthread;
+    if(w_chan == NULL || pthread_create(&wthread, NULL, writer, args) != 0) {
+        logmsg(LOG_ERROR, "Error: Failed to start page writer\n");
+        return -1;
+    }
+
     pthread_t threads[threadnum];
     for(int i = 0; i < threadnum; i++) {
         if(pthread_create(&threads[i], NULL, crawler, (void*)args) != 0) {
-            eprintf("Error: thread %d create failed\n", i);
+            logmsg(LOG_ERROR, "Error: thread %d create failed\n", i);
             exit(EXIT_FAILURE);
         }
         else {
-            eprintf("Info: thread %d create success\n", i);
-            sleep(2); // Allow time for the first thread to crawl some pages
+            logmsg(LOG_DEBUG, "Info: thread %d create success\n", i);
         }
     }
 
     // Destroy threads
     for(int i = 0; i < threadnum; i++) {
         if(pthread_join(threads[i], NULL) != 0) {
-            eprintf("Error: destroying thread %d failed\n", i);
+            logmsg(LOG_ERROR, "Error: destroying thread %d failed\n", i);
             exit(EXIT_FAILURE);
         }
         else{
-            eprintf("Info: destroying thread %d success\n", i);
+            logmsg(LOG_DEBUG, "Info: destroying thread %d success\n", i);
         }
     }
 
+    // Let the writer drain the channel
+    bqshut(w_chan);
+    pthread_join(wthread, NULL);
+    paclose(w_aio);
+    mtclose(metrics);                   // Dumps a last snapshot
+    bqclose(w_chan);
+    close(journal);
+    close(metafd);
+    fclose(changed);
+    close(dupfd);
+
     // Cleanup
     free(args);
 
     // Close lqueue and lhash
     lqclose(u_queue);
     lhclose(vis);
+    bfclose(seen);
+    dsclose(done);
+    scclose(scope);
+    happly(saved, freemeta);
+    hclose(saved);
+    shclose(sims);
+    if(opts.recrawl && !opts.resume) free(opts.seedurl);
+    if(atomic_load(&failed)) exit(EXIT_FAILURE);
     exit(EXIT_SUCCESS);
 }
@@ -25,36 +25,44 @@
 #include"queue.h"
 #include"pageio.h"
 #include"indexio.h"
+#include"pagepipe.h"
+#include"log.h"
+#include"rank.h"
+#include"postings.h"
+#include"posio.h"
+#include"tier.h"
 
 
 /****************************************************************
  * Define macro, structs, globals and helper functions
 ****************************************************************/
-#define eprintf(format, ...) do {                 \
-    if (verbose)                                  \
-        fprintf(stderr, format, ##__VA_ARGS__);   \
-} while(0)
-#define verbose 1
-
-// This struct associates a list of crawled documents with each crawled word
-typedef struct {
-    char *word;         // The indexed word
-    queue_t *doclist;   // List of associated documents
-} word_t;
-
-// This struct defines doclist elements
-typedef struct {
-    int id;             // Id of the crawled page
-    int freq;           // Frequency of word in page
-} doc_t;
-
-// Frees queue and word in hashtable
-void freeWord(void* word) {free(((word_t*)word)->word); }
-void freeDoc(void *word) {word_t *w = ((word_t*)word); qclose(w->doclist); }
+// Pages held in the read-ahead ring and threads loading them
+#define __PREFETCH 16
+#define __READERS 2
 
 // Sum of word occurrences
 int sum = 0;
 
+// Pages in pagedir/.changed, sorted, when updating an index
+#define __CHANGED ".changed"
+int *changed = NULL;
+int nchanged = 0;
+
+// Set by -n: positions of words are not recorded
+bool nopos = false;
+
+// Set by -s and -r: the index is split into shards, by ranges of page
+// ids rather than by a hash of them
+#define __MAXSHARDS 256
+int nshards = 1;
+bool byrange = false;
+bool reindex = false;
+
+// Set by -w and -d: the words of a stopword list, and those in more
+// than a share of the pages, are saved to a hot tier of their own
+hashtable_t *stops = NULL;
+double share = 1;
+
 
 /****************************************************************
  * Private Helper Functions: hash and queue search function to 
@@ -94,6 +102,79 @@ void hsumfn(void *p) {
 }
 
 
+/****************************************************************
+ * Private Helper Functions: drop the documents listed in changed
+ * from a word's doclist, keeping the others in order, and sort a
+ * doclist by id again once changed documents were added back
+****************************************************************/
+static int cmpid(const void *a, const void *b) {
+    return *(const int*)a - *(const int*)b;
+}
+
+void hdropfn(void *p) {
+    word_t *p_word = (word_t*)p;
+    queue_t *kept = qopen();
+    doc_t *d;
+    while((d = (doc_t*)qget(p_word->doclist)) != NULL) {
+        if(bsearch(&d->id, changed, nchanged, sizeof(int), cmpid)) {
+            free(d->pos);
+            free(d);
+        }
+        else qput(kept, d);
+    }
+    qconcat(p_word->doclist, kept);
+}
+
+static int cmpdoc(const void *a, const void *b) {
+    return (*(doc_t* const*)a)->id - (*(doc_t* const*)b)->id;
+}
+
+void hsortfn(void *p) {
+    word_t *p_word = (word_t*)p;
+    int n = 0, cap = 16;
+    doc_t **docs = (doc_t**)malloc(cap * sizeof(doc_t*));
+    doc_t *d;
+    while((d = (doc_t*)qget(p_word->doclist)) != NULL) {
+        if(n == cap) docs = (doc_t**)realloc(docs, (cap *= 2) * sizeof(doc_t*));
+        docs[n++] = d;
+    }
+    qsort(docs, n, sizeof(doc_t*), cmpdoc);
+    for(int i = 0; i < n; i++) qput(p_word->doclist, docs[i]);
+    free(docs);
+}
+
+
+/****************************************************************
+ * loadchanged - reads the ids of the pages saved since the index
+ * was last updated into changed, sorted and without duplicates
+ * \param dirname   The page directory
+ * \return          The number of ids, or -1 if there is no list
+****************************************************************/
+int loadchanged(char *dirname) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", dirname, __CHANGED);
+    FILE *f = fopen(path, "r");
+    if(f == NULL) return -1;
+
+    int id, cap = 0;
+    while(fscanf(f, "%d", &id) == 1) {
+        if(nchanged == cap) {
+            cap = cap ? 2 * cap : 64;
+            changed = (int*)realloc(changed, cap * sizeof(int));
+        }
+        changed[nchanged++] = id;
+    }
+    fclose(f);
+
+    qsort(changed, nchanged, sizeof(int), cmpid);
+    int n = 0;
+    for(int i = 0; i < nchanged; i++) {
+        if(n == 0 || changed[i] != changed[n - 1]) changed[n++] = changed[i];
+    }
+    return nchanged = n;
+}
+
+
 /****************************************************************
  * NormalizeWord - converts words to lowercase and discard words
  * that are contains non-alphabets and words that has a length
@@ -143,10 +224,41 @@ doc_t *cdoc(int id, int freq) {
     doc_t *d = (doc_t*)malloc(sizeof(doc_t));
     d->id = id;
     d->freq = freq;
+    d->pos = NULL;
     return d;
 }
 
 
+/****************************************************************
+ * addpos - records the position of the last occurrence of a word
+ * in a page, unless positions are not recorded
+ * \param d         The doc, its freq already counting the occurrence
+ * \param at        Number of the word among the words of the page
+****************************************************************/
+void addpos(doc_t *d, int at) {
+    if(nopos) return;
+    // Room doubles when freq reaches a power of two
+    if((d->freq & (d->freq - 1)) == 0) {
+        d->pos = (int*)realloc(d->pos, 2 * d->freq * sizeof(int));
+    }
+    d->pos[d->freq - 1] = at;
+}
+
+
+/****************************************************************
+ * droppos - removes the positions saved with an index, once they
+ * no longer match it
+ * \param indexnm   Name of index file
+****************************************************************/
+void droppos(char *indexnm) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s.pos", indexnm);
+    if(remove(path) != 0 && errno != ENOENT) {
+        logmsg(LOG_WARN, "Warning: failed to remove %s\n", path);
+    }
+}
+
+
 /****************************************************************
  * Indexer - indexes pages by words
  * \param index     Hashtable to store index info
@@ -158,10 +270,13 @@ doc_t *cdoc(int id, int freq) {
 ****************************************************************/
 void indexer(hashtable_t *index, webpage_t *page, int id, char *indexnm){
 
-    int pos = 0;
+    // Every word counts towards positions, even those not indexed, so
+    // that words next to each other are at consecutive positions
+    int pos = 0, at = -1;
     char *word = NULL;
     while((pos = webpage_getNextWord(page, pos, &word)) > 0) {
         
+        at++;
         NormalizeWord(word);
         if(strlen(word) > 0) {
 
@@ -170,6 +285,7 @@ void indexer(hashtable_t *index, webpage_t *page, int id, char *indexnm){
             if((w = hsearch(index, &hsearchfn, word, strlen(word))) == NULL) {
                 w = cword(word);
                 doc_t *d = cdoc(id, 1);
+                addpos(d, at);
                 qput(w->doclist, d);
                 hput(index, w, w->word, strlen(w->word));
             }
@@ -177,12 +293,13 @@ void indexer(hashtable_t *index, webpage_t *page, int id, char *indexnm){
                 doc_t *d;
                 // Insert doc into queue if doc does not exist
                 if((d = qsearch(w->doclist, &qsearchfn, &id)) == NULL) {
-                    doc_t *d = cdoc(id, 1);
+                    d = cdoc(id, 1);
                     qput(w->doclist, d);
                 }
                 else {
                     d->freq++;
                 }
+                addpos(d, at);
                 free(word);
             }
 
@@ -205,14 +322,53 @@ void indexer(hashtable_t *index, webpage_t *page, int id, char *indexnm){
  *              0: parsing success
  *              1: invalid number of arguments
  *              2: invaild pagedir
+ *              3: invalid flag
+ *              4: invalid number of shards
+ *              5: invalid stopword list
+ *              6: invalid share of pages
 ****************************************************************/
 int checkinput(int argc, char* argv[]) {
     
     // Parse the cmdline inputs
-    if(argc != 3) {
-        printf("usage: indexer <pagedir> <indexnm>\n");
+    if(argc < 3) {
+        printf("usage: indexer <pagedir> <indexnm> [-u] [-n] [-s <shards> [-r]]\n"
+               "               [-w <stopwords>] [-d <share>]\n");
         return 1;
     }
+    for(int i = 3; i < argc; i++) {
+        if(!strcmp(argv[i], "-u")) reindex = true;
+        else if(!strcmp(argv[i], "-n")) nopos = true;
+        else if(!strcmp(argv[i], "-r")) byrange = true;
+        else if(!strcmp(argv[i], "-s") && i + 1 < argc) {
+            nshards = atoi(argv[++i]);
+            if(nshards < 1 || nshards > __MAXSHARDS) {
+                printf("Error: invalid number of shards %s\n", argv[i]);
+                return 4;
+            }
+        }
+        else if(!strcmp(argv[i], "-w") && i + 1 < argc) {
+            hclose(stops);
+            if((stops = tistops(argv[++i])) == NULL) {
+                printf("Error: invalid stopword list %s\n", argv[i]);
+                return 5;
+            }
+        }
+        else if(!strcmp(argv[i], "-d") && i + 1 < argc) {
+            share = atof(argv[++i]);
+            if(share <= 0 || share > 1) {
+                printf("Error: invalid share of pages %s\n", argv[i]);
+                return 6;
+            }
+        }
+        else {
+            printf("Error: invalid flag %s\n", argv[i]);
+            return 3;
+        }
+    }
+    if(reindex && nshards > 1) {
+        printf("Error: shards cannot be updated, only built again\n");
+        return 3;
+    }
 
     // Make sure that directory is valid
     struct stat st = {0};
@@ -226,35 +382,234 @@ int checkinput(int argc, char* argv[]) {
 }
 
 
+/****************************************************************
+ * Sharding: with -s, pages are indexed into one of several indexes,
+ * saved as <indexnm>.0, <indexnm>.1 and so on, each with the files
+ * of an index of its own, that a querier can serve apart. A page
+ * goes to a shard by a hash of its id, which spreads pages crawled
+ * together, or with -r by ranges of consecutive ids, which keeps
+ * them together. Shards are weighed as the whole collection: their
+ * statistics files hold its totals, and the number of its documents
+ * each word is in.
+****************************************************************/
+int npages = 0;
+
+/****************************************************************
+ * countpages - counts the pages of pagedir, numbered from 1
+ * \param dirname   The page directory
+ * \return          The number of pages
+****************************************************************/
+int countpages(char *dirname) {
+    char path[256];
+    struct stat st;
+    int n = 0;
+    do snprintf(path, sizeof(path), "%s/%d", dirname, ++n);
+    while(stat(path, &st) == 0);
+    return n - 1;
+}
+
+/****************************************************************
+ * shardof - the shard a page is indexed into
+ * \param id        ID of the page
+ * \return          The number of the shard
+****************************************************************/
+int shardof(int id) {
+    if(nshards == 1) return 0;
+    if(byrange) {
+        int size = (npages + nshards - 1) / nshards;
+        int s = size > 0 ? (id - 1) / size : 0;
+        return s < nshards ? s : nshards - 1;
+    }
+    return (int)((uint32_t)id * 2654435761u % (uint32_t)nshards);
+}
+
+/****************************************************************
+ * savetiers - saves the index file of each shard, the words of its
+ * hot tier apart; the other files cover both tiers, so they are
+ * saved first
+ * \param shards    The index of each shard, left without its hot tier
+ * \param names     Name of each shard
+ * \param n         Number of shards
+ * \return          0 if sucess and non-zero if otherwise
+****************************************************************/
+int savetiers(hashtable_t **shards, char **names, int n) {
+    hashtable_t **hots = (hashtable_t**)malloc(n * sizeof(hashtable_t*));
+    int moved = tisplit(shards, hots, n, stops, share);
+    if(moved > 0) logmsg(LOG_INFO, "Saving %d lists to the hot tier...\n", moved);
+
+    int error = 0;
+    for(int i = 0; i < n; i++) {
+        if(error == 0) error = indexsave(shards[i], ".", names[i]);
+        if(error == 0) error = tisave(hots[i], ".", names[i]);
+        indexclose(hots[i]);
+    }
+    free(hots);
+    return error;
+}
+
+/****************************************************************
+ * saveindex - saves an index that is not sharded
+ * \param index     The index, left without its hot tier
+ * \param indexnm   Name of index file
+ * \return          0 if sucess and non-zero if otherwise
+****************************************************************/
+int saveindex(hashtable_t *index, char *indexnm) {
+    int error = rksave(index, ".", indexnm);
+    if(error == 0) error = plsavedf(&index, 1, ".", &indexnm);
+    if(error == 0) error = plsave(index, ".", indexnm);
+    if(error == 0 && !nopos) error = possave(index, ".", indexnm);
+    else if(error == 0) droppos(indexnm);
+    if(error == 0) error = savetiers(&index, &indexnm, 1);
+    return error;
+}
+
+/****************************************************************
+ * saveshards - saves each shard as an index of its own, weighed as
+ * the whole collection
+ * \param shards    The index of each shard
+ * \param indexnm   Name of the sharded index
+ * \return          0 if sucess and non-zero if otherwise
+****************************************************************/
+int saveshards(hashtable_t **shards, char *indexnm) {
+    char **names = (char**)malloc(nshards * sizeof(char*));
+    for(int i = 0; i < nshards; i++) {
+        names[i] = (char*)malloc(strlen(indexnm) + 16);
+        sprintf(names[i], "%s.%d", indexnm, i);
+    }
+
+    int error = rksaveshards(shards, nshards, ".", names);
+    if(error == 0) error = plsavedf(shards, nshards, ".", names);
+    for(int i = 0; i < nshards && error == 0; i++) {
+        error = plsave(shards[i], ".", names[i]);
+        if(error == 0 && !nopos) error = possave(shards[i], ".", names[i]);
+        else if(error == 0) droppos(names[i]);
+    }
+    if(error == 0) error = savetiers(shards, names, nshards);
+
+    for(int i = 0; i < nshards; i++) free(names[i]);
+    free(names);
+    return error;
+}
+
+
+/****************************************************************
+ * keepstop - adds a word of the hot tier of an index to the
+ * stopwords, so that it stays in the tier
+ * \param p         The word
+****************************************************************/
+void keepstop(void *p) {
+    char *word = (char*)p;
+    if(tihas(stops, word)) return;
+    char *copy = (char*)malloc(strlen(word) + 1);
+    strcpy(copy, word);
+    hput(stops, copy, copy, strlen(copy));
+}
+
+
+/****************************************************************
+ * update - brings an index up to date with the pages the crawler
+ * saved since it was built, as listed in pagedir/.changed: their
+ * old postings are dropped and the pages indexed again. Doclists
+ * stay sorted by id, as in a full index. The list is emptied once
+ * the index is saved. Positions are kept up to date if the index
+ * has them, and dropped with -n.
+ * \param dirname   The page directory
+ * \param indexnm   The index file, updated in place
+ * \return          0 if sucess and non-zero if otherwise
+****************************************************************/
+int update(char *dirname, char *indexnm) {
+
+    if(loadchanged(dirname) < 0) {
+        logmsg(LOG_ERROR, "Error: no %s list in %s\n", __CHANGED, dirname);
+        return 1;
+    }
+    hashtable_t *index = indexload(".", indexnm);
+    if(index == NULL) {
+        logmsg(LOG_ERROR, "Error: Failed to load index %s\n", indexnm);
+        free(changed);
+        return 1;
+    }
+
+    // Words of the hot tier are updated with the others, and stay hot
+    hashtable_t *hot = tiload(index, ".", indexnm);
+    if(stops == NULL) stops = hot;
+    else if(hot != NULL) {
+        happly(hot, keepstop);
+        hclose(hot);
+    }
+    if(nopos || posload(index, ".", indexnm) < 0) nopos = true;
+
+    happly(index, hdropfn);
+    for(int i = 0; i < nchanged; i++) {
+        webpage_t *page = pageload(changed[i], dirname);
+        if(page == NULL) continue;
+        logmsg(LOG_INFO, "Indexing page %d...\n", changed[i]);
+        indexer(index, page, changed[i], indexnm);
+    }
+    happly(index, hsortfn);
+
+    logmsg(LOG_INFO, "Updated %d pages...saving index to local...\n", nchanged);
+    int error = saveindex(index, indexnm);
+    if(error == 0) {
+        char path[256];
+        snprintf(path, sizeof(path), "%s/%s", dirname, __CHANGED);
+        fclose(fopen(path, "w"));
+    }
+
+    indexclose(index);
+    hclose(stops);
+    free(changed);
+    return error;
+}
+
+
 /****************************************************************
  * Indexer - indexes pages by words
- * usage: indexer <pagedir> <indexnm>
+ * usage: indexer <pagedir> <indexnm> [-u] [-n] [-s <shards> [-r]]
+ *                [-w <stopwords>] [-d <share>]
 ****************************************************************/
 int main(int argc, char *argv[]){
     
     int error = checkinput(argc, argv);
     if(error != 0) {
-        eprintf("Error parsing arguments: %d\n", error);
+        logmsg(LOG_ERROR, "Error parsing arguments: %d\n", error);
         exit(EXIT_FAILURE);
     }
 
-    // Index all the pages in argv[1]
-    hashtable_t *index = hopen(1000);
-    int id = 1;
-    webpage_t *page = pageload(id, argv[1]);
-    while(page != NULL) {
-        printf("Indexing page %d...\n", id);
-        indexer(index, page, id, argv[2]);
-        id++;
-        page = pageload(id, argv[1]);
+    // Only reindex the pages that changed
+    if(reindex) {
+        exit(update(argv[1], argv[2]) ? EXIT_FAILURE : EXIT_SUCCESS);
     }
 
-    printf("Indexing compete...saving index to local...\n");
-    indexsave(index, ".", argv[2]);
+    // Index all the pages in argv[1], each into its shard. Pages are
+    // prefetched by reader threads so disk reads overlap with
+    // tokenizing the current page.
+    if(byrange) npages = countpages(argv[1]);
+    hashtable_t **shards = (hashtable_t**)malloc(nshards * sizeof(hashtable_t*));
+    for(int i = 0; i < nshards; i++) shards[i] = hopen(1000);
+    pagepipe_t *pipe = ppopen(argv[1], 1, __PREFETCH, __READERS);
+    if(pipe == NULL) {
+        logmsg(LOG_ERROR, "Error: Failed to start page reader\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int id;
+    webpage_t *page;
+    while((page = ppget(pipe, &id)) != NULL) {
+        logmsg(LOG_INFO, "Indexing page %d...\n", id);
+        indexer(shards[shardof(id)], page, id, argv[2]);
+    }
+    ppclose(pipe);
+
+    logmsg(LOG_INFO, "Indexing compete...saving index to local...\n");
+    if(nshards > 1) error = saveshards(shards, argv[2]);
+    else error = saveindex(shards[0], argv[2]);
 
     // Clean up
-    happly(index, freeWord);
-    happly(index, freeDoc);
-    hclose(index);
-    return 0;
+    for(int i = 0; i < nshards; i++) {
+        indexclose(shards[i]);
+    }
+    free(shards);
+    hclose(stops);
+    return error ? EXIT_FAILURE : EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -7,11 +7,14 @@
  * 
 ****************************************************************/
 
+#define _POSIX_C_SOURCE 200809L     // sigaction, fdopen, open_memstream
+
 #include<stdio.h>
 #include<math.h>
 #include<stdlib.h>
 #include<stdbool.h>
 #include<stdint.h>
+#include<inttypes.h>
 #include<string.h>
 #include<sys/types.h>
 #include<sys/stat.h>
@@ -19,234 +22,218 @@
 #include<errno.h>
 #include<string.h>
 #include<ctype.h>
+#include<signal.h>
+#include<pthread.h>
+#include<sys/socket.h>
+#include<sys/time.h>
+#include<sys/un.h>
+#include<netinet/in.h>
+#include<arpa/inet.h>
 
 #include"webpage.h"
 #include"hash.h"
 #include"queue.h"
 #include"pageio.h"
 #include"indexio.h"
+#include"log.h"
+#include"metrics.h"
+#include"rank.h"
+#include"postings.h"
+#include"topk.h"
+#include"qparse.h"
+#include"posio.h"
+#include"tpool.h"
+#include"qcache.h"
+#include"tier.h"
 
 
 /****************************************************************
  * Define macro, structs, globals and helper functions
 ****************************************************************/
-#define eprintf(format, ...) do {                 \
-    if (verbose)                                  \
-        fprintf(stderr, format, ##__VA_ARGS__);   \
-} while(0)
-#define verbose 1
-
 #define BUFSIZE 128
+#define USAGE "usage: query <pageDirectory> <indexFile> " \
+              "[-q <queryFile> <outputFile> [-j <n> [-g]]] [-t <latencyFile>]\n" \
+              "             [-r legacy|bm25|tfidf] [-k <n>] [-c <MB>] [-p <n>] [-a]\n" \
+              "             [-s <socket|port> [-j <n>] [-x]] [-b <socket|port>,...]\n"
 const int32_t maxchar = 128;
 
 // This struct defines the queue of documents ranked
 typedef struct {
     int id;
-    int rank;
+    int rank;           // Legacy rank
+    double score;       // Score under the ranking model
 } query_t;
 
-// This struct associates a list of crawled documents with each crawled word
-typedef struct {
-    char *word;         // The indexed word
-    queue_t *doclist;   // List of associated documents
-} word_t;
-
-// This struct defines doclist elements
-typedef struct {
-    int id;             // Id of the crawled page
-    int freq;           // Frequency of word in page
-} doc_t;
-
-// Frees queue and word in hashtable
-void freeWord(void* word) {free(((word_t*)word)->word); }
-void freeDoc(void *word) {word_t *w = ((word_t*)word); qclose(w->doclist); }
-
-// Global hashtable for index
-hashtable_t *index;
-
 // Global flag for quiet printing
 bool quiet = false;
 FILE *qoutf;
 char pagedir[512];
 
+// Files named on the command line
+char *queryfile = NULL, *outputfile = NULL, *latencyfile = NULL;
 
-/****************************************************************
- * normalizeWord - converts words to lowercase and discard words
- * that are contains non-alphabets and words that has a length
- * less than 3. Word is deleted if it does not fit criteria.
- * \param buffer    The buffer to be normalized
- * \return          Normalized buffer or NULL string
-****************************************************************/
-void normalizeWord(char *word){
-    int pointer = 0;
-    while(word[pointer]){
-        
-        // Convert words to lower case
-        if(isalpha(word[pointer])) {
-            word[pointer] = tolower(word[pointer]);
-            pointer++;
-        }
-        else{
-            *word = '\0'; // Make the word a NULL character
-            return;
-        }
-    }
-    return;
-}
+// Ranking model and the document statistics it scores with
+int model = RK_LEGACY;
+ranker_t *ranker;
 
+// Posting lists queries run on, and how many results to print. A
+// reload swaps the lists under the write lock, between queries.
+char *indexnm;
+postings_t *postings;
+pthread_rwlock_t indexlock = PTHREAD_RWLOCK_INITIALIZER;
+int topk = 0;
 
-/****************************************************************
- * Query input checkers: checkLogic() checks to see if the query
- * has correct logical connections. checkAlpha() makes sure that
- * the query only contains alphabetical queries. 10 is line 
- * break. 9 is horizontal tab. 32 is horizontal space.
-****************************************************************/
-bool checkLogic(char *prev, char *buffer){
-    
-    char curr[64];
-    strcpy(curr, buffer);
-    if(strcmp(curr, "and") == 0 || strcmp(curr, "or") == 0) {
-        if(strcmp(prev, "and") == 0 || strcmp(prev, "or") == 0 || 
-                                            strcmp(prev, "") == 0) {
-            return false;
-        }
-    }
+// Pool heavy queries are split over, and into how many ranges at most
+tpool_t *rangepool = NULL;
+int nranges = 1;
 
-    return true;
-}
+// Results of the queries, and the ANDs, asked for before
+#define __CACHEMB 64
+qcache_t *cache = NULL;
+int cachemb = __CACHEMB;
 
-bool checkAlpha(char *buffer) {
-    char *curr = buffer;
-    while((int)(*curr) != 10) {
-        if(!isalpha(*curr) && !(((int)(*curr) == 9) || ((int)(*curr) == 32))) {
-            return false;
-        }
-        curr++;
-    }
-    return true;
-}
+// Server mode: where to listen, and how many clients to serve at once;
+// quiet mode: how many queries to run at once, and whether grouped
+char *serveaddr = NULL;
+int nworkers = 0;
+bool grouped = false;
+
+// Results are printed for a broker, and brokered from shard servers
+bool exchange = false;
+char **shardaddrs = NULL;
+int nshards = 0;
+
+// Set by -a: words of the hot tier are not left out of ANDs
+bool allwords = false;
 
 
 /****************************************************************
- * Hash and queue search functions
+ * Queue search function
 ****************************************************************/
-bool fwd(void *indexw, const void *target) {
-  return strcmp(((word_t*)indexw)->word, (char*)target) == 0;
-}
 bool frk(void *doc, const void *rank) {
     return ((query_t*)doc)->rank == *((int*)rank);
 }
-bool fid(void *doc, const void *id) {
-    return ((doc_t*)doc)->id == *((int*)id);
-}
 
 
 /****************************************************************
- * Printing functions: pstd() prints ranking results to terminal.
- * pfile() prints ranking results to designated output file.
+ * Printing functions: presults() prints the first k ranking
+ * results to f: the designated output file in quiet mode, a client
+ * in server mode and the terminal otherwise. Scores replace the
+ * legacy ranks when ranking with a model. With -x, results are
+ * printed for a broker: the id, rank and exact score of each.
 ****************************************************************/
-void pstd(void *docs) {
-    query_t *d = (query_t*)docs;
-    webpage_t *page = pageload(d->id, pagedir);
-    printf("rank: %d doc: %d URL: %s\n", d->rank, d->id, webpage_getURL(page));
-    webpage_delete(page);
-    return;
+static void presult(FILE *f, query_t *d) {
+    if(exchange) {
+        fprintf(f, "%d %d %.17g\n", d->id, d->rank, d->score);
+        return;
+    }
+    pageview_t view;
+    if(pageload_view(d->id, pagedir, &view) != 0) return;
+    if(model == RK_LEGACY) {
+        fprintf(f, "rank: %d doc: %d URL: %.*s\n", d->rank, d->id,
+                (int)view.urllen, view.url);
+    }
+    else {
+        fprintf(f, "score: %.4f doc: %d URL: %.*s\n", d->score, d->id,
+                (int)view.urllen, view.url);
+    }
+    pageview_release(&view);
 }
 
-void pfile(void* doc) {
-    query_t* d = (query_t*)doc;
-    webpage_t* page = pageload(d->id, pagedir);
-    fprintf(qoutf, "rank: %d doc: %d URL: %s\n", 
-                    d->rank, d->id, webpage_getURL(page));
-    webpage_delete(page);
+void presults(queue_t *results, FILE *f) {
+    query_t *d;
+    for(int n = 0; (d = (query_t*)qget(results)) != NULL; n++) {
+        if(topk == 0 || n < topk) presult(f, d);
+        free(d);
+    }
 }
 
 
-
 /****************************************************************
- * gdoc - Takes a queue of words and hands back a queue of
- * query_t for documents that contains all of the words that
- * are getting queried.
- * \param words     queue of words to be included
- * \return docs     queue_t of query_t for documents that
- *                  includes all of the words 
+ * glegacy - The documents of the 'or' of clauses, with their legacy
+ * ranks, listed as they would be if each clause was evaluated in
+ * turn: by the first clause they match, then by id
+ * \param its       iterator of each clause, closed after
+ * \param n         number of clauses
+ * \return          queue of query_t in that order
 ****************************************************************/
-queue_t *gdoc(queue_t *words){
-
-    queue_t *ranklist = qopen();
-    bool flag = false;
-
-    // Set seed documents to loop through
-    char *currword;
-    if ((currword = (char *)qget(words)) != NULL){
-
-        word_t *entry = hsearch(index, fwd, currword, strlen(currword));
-
-        if (entry != NULL){
-
-            // If word found in the index hashtable, copy over
-            queue_t *copy = qopen();
-            doc_t *currdoc;
-
-            while ((currdoc = (doc_t *)qget(entry->doclist)) != NULL){
-                if (currdoc->freq > 0){
-                    query_t *docrank = malloc(sizeof(query_t));
-                    docrank->id = currdoc->id;
-                    docrank->rank = currdoc->freq;
-                    qput(ranklist, docrank);
-                }
-                qput(copy, currdoc);
-            }
-
-            qclose(entry->doclist);
-            entry->doclist = copy;
-        }
-        else {
-            flag = true;
-        }
-        free(currword);
-    }
-
-    // Eliminate documents without the current word
-    while ((currword = (char *)(qget(words))) != NULL && flag == false){
-        word_t *entry = hsearch(index, fwd, currword, strlen(currword));
-        if (entry != NULL){
-            query_t *currrank;
-            queue_t *copy = qopen();
-            while ((currrank = (query_t *)(qget(ranklist))) != NULL){
-                doc_t *currdoc; int freq = 0;
-                if ((currdoc = (((doc_t*)qsearch(entry->doclist, fid,
-                                                 &(currrank->id))))) != NULL){
-                    freq = currdoc ->freq;
-                    if (freq > 0){
-                        if (freq < currrank->rank) currrank->rank = freq;
-                        qput(copy, currrank);
-                    }
-                    else{
-                        free(currrank);
-                    }
-                }
+queue_t *glegacy(it_t **its, int n) {
+
+    queue_t *results = qopen();
+    queue_t **firsts = (queue_t**)malloc(n * sizeof(queue_t*));
+    for(int i = 0; i < n; i++) firsts[i] = qopen();
+
+    while(true) {
+        int d = IT_END, first = 0;
+        for(int i = 0; i < n; i++) {
+            if(its[i]->doc < d) {
+                d = its[i]->doc;
+                first = i;
             }
-            qclose(ranklist);
-            ranklist = copy;
         }
-        else{
-            flag = true;
+        if(d == IT_END) break;
+
+        // Ranks of the clauses add up, as in an 'or'
+        query_t *q = (query_t*)malloc(sizeof(query_t));
+        q->id = d;
+        // The clause a document is listed under, for a broker to list
+        // documents of several shards in the same order
+        q->rank = 0;
+        q->score = first;
+        for(int i = first; i < n; i++) {
+            if(its[i]->doc != d) continue;
+            q->rank += (int)its[i]->score(its[i]);
+            its[i]->next(its[i], d + 1);
         }
-        free(currword);
+        qput(firsts[first], q);
     }
 
-    // Return an empty list if words do not match
-    if (flag == true)
-    {
-        free(currword);
-        qclose(ranklist);
-        ranklist = qopen();
+    for(int i = 0; i < n; i++) {
+        qconcat(results, firsts[i]);
+        itclose(its[i]);
     }
+    free(firsts);
+    return results;
+}
+
+
+/****************************************************************
+ * hitqueue - Hits as a queue of query_t, in the same order
+ * \param hits      hits, freed after
+ * \param n         number of hits
+ * \return          queue of query_t
+****************************************************************/
+queue_t *hitqueue(hit_t *hits, int n) {
+    queue_t *results = qopen();
+    for(int i = 0; i < n; i++) {
+        query_t *q = (query_t*)malloc(sizeof(query_t));
+        q->id = hits[i].id;
+        q->rank = 0;
+        q->score = hits[i].score;
+        qput(results, q);
+    }
+    free(hits);
+    return results;
+}
+
 
-    return ranklist;
+/****************************************************************
+ * gtopk - The best documents of the 'or' of clauses, found with
+ * Block-Max WAND
+ * \param its       iterator of each clause, closed after
+ * \param n         number of clauses
+ * \return          queue of query_t sorted by decreasing score
+****************************************************************/
+queue_t *gtopk(it_t **its, int n) {
+    hit_t *hits;
+    long scored = 0;
+    int nhits = tktopk(its, n, topk, &hits, &scored);
+    logmsg(LOG_DEBUG, "Scored %ld documents for %d results\n", scored, nhits);
+    for(int i = 0; i < n; i++) itclose(its[i]);
+    return hitqueue(hits, nhits);
 }
 
+
 /****************************************************************
  * sdoc - Sort query_t structure by decreasing rank
  * \param docs      The query_t structure to be sorted
@@ -279,48 +266,26 @@ void sdoc(queue_t *docs) {
 }
 
 
-/****************************************************************
- * CombineRank - Combine the rankings of documents given an 'or'
- * statement
- * \param result    The queue of query_t structure to be returned
- *                  to the user
- * \param new       A queue of quert_t used to adjust rankings
- *                  of the query results
- * \return          Updated queue of query_t
-****************************************************************/
-void mergeRank(queue_t *result, queue_t *new) {
-    query_t *buffer;
-    while((buffer = (query_t*)qget(new)) != NULL) {
-        query_t *q;
-
-        // Insert into result if current query does not exits
-        if((q = qsearch(result, fid, &(buffer->id))) == NULL) {
-            qput(result, buffer);
-        }
-        else {
-            // Update ranking with 'or' logic
-            q->rank += buffer->rank;
-            free(buffer);
-        }
-    }
-}
-
-
 /****************************************************************
  * checkinput - checks the cmd input provided by the user
  * \return error code:
  *              0: parsing success
  *              1: invalid number of arguments
  *              2: invaild pagedir
- *              3: invalid index
+ *              3: invalid index or flag
  *              4: invalid number of args for quiet mode
  *              5: invalid input query file
+ *              6: unknown ranking model
+ *              7: invalid number of results
+ *              8: invalid number of workers
+ *              9: invalid cache size
+ *              10: invalid number of ranges
 ****************************************************************/
 int checkinput(int argc, char* argv[]) {
     
     // Parse the cmdline inputs
-    if(argc < 3 || argc >6) {
-        printf("usage: query <pageDirectory> <indexFile> [-q]\n");
+    if(argc < 3) {
+        printf("%s", USAGE);
         return 1;
     }
 
@@ -332,171 +297,905 @@ int checkinput(int argc, char* argv[]) {
         return 2;
     }
 
+    // Normal query mode, unless queries are read from a file
+    quiet = false;
+    for(int i = 3; i < argc; i++) {
+        if(strcmp(argv[i], "-q") == 0) {
+            if(i + 2 >= argc) {
+                printf("%s", USAGE);
+                return 4;
+            }
+            queryfile = argv[++i];
+            outputfile = argv[++i];
+            if(access(queryfile, R_OK) != 0) {
+                printf("Error: invalid input\n");
+                return 5;
+            }
+            quiet = true;
+        }
+        else if(strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            latencyfile = argv[++i];
+        }
+        else if(strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            if((model = rkmodel(argv[++i])) < 0) {
+                printf("Error: unknown ranking model %s\n", argv[i]);
+                return 6;
+            }
+        }
+        else if(strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            if((topk = atoi(argv[++i])) < 1) {
+                printf("Error: invalid number of results %s\n", argv[i]);
+                return 7;
+            }
+        }
+        else if(strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            char *end;
+            cachemb = (int)strtol(argv[++i], &end, 10);
+            if(*end != '\0' || cachemb < 0) {
+                printf("Error: invalid cache size %s\n", argv[i]);
+                return 9;
+            }
+        }
+        else if(strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            if((nranges = atoi(argv[++i])) < 1) {
+                printf("Error: invalid number of ranges %s\n", argv[i]);
+                return 10;
+            }
+        }
+        else if(strcmp(argv[i], "-g") == 0) {
+            grouped = true;
+        }
+        else if(strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            serveaddr = argv[++i];
+        }
+        else if(strcmp(argv[i], "-x") == 0) {
+            exchange = true;
+        }
+        else if(strcmp(argv[i], "-a") == 0) {
+            allwords = true;
+        }
+        else if(strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            // Shard addresses are split in place, between commas
+            for(char *addr = strtok(argv[++i], ","); addr != NULL; addr = strtok(NULL, ",")) {
+                shardaddrs = (char**)realloc(shardaddrs, (nshards + 1) * sizeof(char*));
+                shardaddrs[nshards++] = addr;
+            }
+            if(nshards == 0) {
+                printf("%s", USAGE);
+                return 3;
+            }
+        }
+        else if(strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            if((nworkers = atoi(argv[++i])) < 1) {
+                printf("Error: invalid number of workers %s\n", argv[i]);
+                return 8;
+            }
+        }
+        else {
+            printf("%s", USAGE);
+            return 3;
+        }
+    }
+
+    // A broker has no index of its own to load
     char *indexname = argv[2];
-    if(access(indexname, R_OK) != 0) {
+    if(nshards == 0 && access(indexname, R_OK) != 0) {
         printf("Error: invalid index\n");
         return 2;
     }
+    return 0;
+}
 
-    if(argc > 3) {
 
-        // If to query from file 
-        char *flag = argv[3];
-        if(strcmp(flag, "-q") != 0) {
-            printf("usage: query <pageDirectory> <indexFile> [-q]\n");
-            return 3;
-        }
-        else {
-            
-            if(argc != 6) {
-                printf("usage: query <pageDirectory> <indexFile> [-q]\n");
-                return 4;
-            }
+/****************************************************************
+ * loadindex - loads the posting lists of an index, those of its hot
+ * tier too, and the positions of their words if the index has them,
+ * for phrases
+ * \param indexnm   index file, in the working directory
+ * \param rk        set to the ranker the lists score with
+ * \return          the lists, or NULL on failure
+****************************************************************/
+postings_t *loadindex(char *indexnm, ranker_t **rk) {
+    hashtable_t *index = indexload(".", indexnm);
+    if(index == NULL || (*rk = rkopen(model, ".", indexnm)) == NULL) {
+        if(index != NULL) hclose(index);
+        return NULL;
+    }
 
-            char *inputnm = argv[4];
-            if(access(inputnm, R_OK) != 0) {
-                printf("Error: invalid input\n");
-                return 5;
-            }
+    // The hot tier is merged back; with -a its words are left unmarked
+    hashtable_t *hot = tiload(index, ".", indexnm);
+    if(allwords) {
+        hclose(hot);
+        hot = NULL;
+    }
+    posload(index, ".", indexnm);
+    postings_t *pl = plopen(index, hot, *rk, model, ".", indexnm);
+    hclose(hot);
+    indexclose(index);
+    if(pl == NULL) rkclose(*rk);
+    return pl;
+}
 
-            quiet = true;
-            return 0;
+
+/****************************************************************
+ * compileall - Compiles each 'or' clause of a planned query into an
+ * iterator of its own; clauses no document matches are left out
+ * \param q         the query
+ * \param clauses   set to a new array of the iterators
+ * \return          number of iterators
+****************************************************************/
+int compileall(qnode_t *q, it_t ***clauses) {
+    int n = q->type == QP_OR ? q->n : 1, nclauses = 0;
+    *clauses = (it_t**)malloc(n * sizeof(it_t*));
+    for(int i = 0; i < n; i++) {
+        qnode_t *clause = q->type == QP_OR ? q->kids[i] : q;
+        it_t *it = qpcompile(clause, postings, model == RK_LEGACY, cache);
+        // Legacy results are listed by clause, so clauses keep their
+        // places: those of a shard index match those of the others
+        if(it == NULL && model == RK_LEGACY) it = itlist(NULL, 0);
+        if(it != NULL) (*clauses)[nclauses++] = it;
+    }
+    return nclauses;
+}
+
+
+/****************************************************************
+ * startpool - Starts a pool of workers that leave the signals the
+ * server handles to the main thread, so they do not interrupt them
+ * \param n         number of workers
+ * \return          the pool, or NULL on failure
+****************************************************************/
+tpool_t *startpool(int n) {
+    sigset_t mask, old;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &mask, &old);
+    tpool_t *tp = tpopen(n);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return tp;
+}
+
+
+/****************************************************************
+ * Intra-query parallelism: with -p, a scored query whose longest
+ * posting list spans many blocks is split into ranges of document
+ * ids, which start at blocks of that list so they hold about as many
+ * of its postings each. Ranges are searched at once, each on its own
+ * iterators as iterators are not thread safe, by a worker of a pool
+ * all queries share and by the thread of the query itself; their top
+ * k are then merged. Ranges do not share their thresholds, so that a
+ * document of a range cannot push out an earlier one of equal score.
+****************************************************************/
+#define __SPLIT 8                   // Blocks of the longest list per range
+
+typedef struct {
+    qnode_t *q;
+    int lo, hi;
+    hit_t *hits;
+    int nhits;
+    long scored;
+    int *pending;                   // Ranges not searched yet
+    pthread_mutex_t *lock;
+    pthread_cond_t *done;
+} range_t;
+
+/****************************************************************
+ * longest - The longest posting list of a word of a query, not
+ * counting those under a NOT, or NULL if there is none
+****************************************************************/
+plist_t *longest(qnode_t *q) {
+    if(q->type == QP_WORD) return plfind(postings, q->word);
+    if(q->type == QP_NOT) return NULL;
+    plist_t *best = NULL;
+    for(int i = 0; i < q->n; i++) {
+        plist_t *l = longest(q->kids[i]);
+        if(l != NULL && (best == NULL || l->n > best->n)) best = l;
+    }
+    return best;
+}
+
+/****************************************************************
+ * srange - Searches a range for its top k
+ * \param arg       the range
+****************************************************************/
+void srange(void *arg) {
+    range_t *r = (range_t*)arg;
+    it_t **its;
+    int n = compileall(r->q, &its);
+    r->nhits = tkrange(its, n, topk, r->lo, r->hi, &r->hits, &r->scored);
+    for(int i = 0; i < n; i++) itclose(its[i]);
+    free(its);
+
+    pthread_mutex_lock(r->lock);
+    if(--*r->pending == 0) pthread_cond_signal(r->done);
+    pthread_mutex_unlock(r->lock);
+}
+
+/****************************************************************
+ * gsplit - The best documents of a query, searched by ranges
+ * \param q         the query
+ * \return          queue of query_t sorted by decreasing score, or
+ *                  NULL if the query is not worth splitting
+****************************************************************/
+queue_t *gsplit(qnode_t *q) {
+    plist_t *l = rangepool != NULL ? longest(q) : NULL;
+    int n = l != NULL ? l->nblocks / __SPLIT : 0;
+    if(n > nranges) n = nranges;
+    if(n < 2) return NULL;
+
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t done = PTHREAD_COND_INITIALIZER;
+    int pending = n;
+    range_t *ranges = (range_t*)calloc(n, sizeof(range_t));
+    for(int i = 0; i < n; i++) {
+        ranges[i] = (range_t){q, i > 0 ? ranges[i - 1].hi : 0, IT_END, NULL, 0, 0,
+                              &pending, &lock, &done};
+        if(i + 1 < n) ranges[i].hi = l->ids[(long)(i + 1) * l->nblocks / n * PL_BLOCK];
+    }
+
+    // The first range is searched here; any not queued as well
+    for(int i = 1; i < n; i++) {
+        if(tpsubmit(rangepool, srange, &ranges[i]) != 0) srange(&ranges[i]);
+    }
+    srange(&ranges[0]);
+    pthread_mutex_lock(&lock);
+    while(pending > 0) pthread_cond_wait(&done, &lock);
+    pthread_mutex_unlock(&lock);
+
+    hit_t **parts = (hit_t**)malloc(n * sizeof(hit_t*));
+    int *counts = (int*)malloc(n * sizeof(int));
+    long scored = 0;
+    for(int i = 0; i < n; i++) {
+        parts[i] = ranges[i].hits;
+        counts[i] = ranges[i].nhits;
+        scored += ranges[i].scored;
+    }
+    hit_t *hits;
+    int nhits = tkmerge(parts, counts, n, topk, &hits);
+    logmsg(LOG_DEBUG, "Scored %ld documents in %d ranges for %d results\n",
+           scored, n, nhits);
+
+    free(parts);
+    free(counts);
+    free(ranges);
+    return hitqueue(hits, nhits);
+}
+
+
+/****************************************************************
+ * gresults - The results of a planned query: each of its 'or'
+ * clauses is compiled into an iterator, and scored models only
+ * score the documents that can make the top k
+ * \param q         the query
+ * \return          queue of query_t in the order they are printed
+****************************************************************/
+queue_t *gresults(qnode_t *q) {
+
+    queue_t *results;
+    if(model != RK_LEGACY && (results = gsplit(q)) != NULL) return results;
+
+    it_t **clauses;
+    int nclauses = compileall(q, &clauses);
+    if(model == RK_LEGACY) {
+        results = glegacy(clauses, nclauses);
+        sdoc(results);
+    }
+    else {
+        results = gtopk(clauses, nclauses);
+    }
+    free(clauses);
+    return results;
+}
+
+
+/****************************************************************
+ * Broker mode: with -b, queries are answered by querier servers of
+ * the shards of an index, started with -x, rather than from an index
+ * loaded here. A query is sent to every shard at once, over a
+ * connection of its own, and the results of each are read back and
+ * merged: by score for the models, as tkmerge() does, and for legacy
+ * ranks by the clause and id glegacy() lists them by, then sorted
+ * again as gresults() does. Each shard finds its own top k, so the
+ * shards need the same -r as the broker, and a -k at least as large;
+ * for legacy ranks, whose ties are not broken by id, none at all. A
+ * shard that cannot be reached is left out, with a warning.
+****************************************************************/
+#define __MAXLINE 512
+
+/****************************************************************
+ * connectto - a socket connected to a Unix socket path, or to a port
+ * of localhost if addr is a number
+ * \param addr      path or port
+ * \return          the socket, or -1 on failure
+****************************************************************/
+int connectto(char *addr) {
+    bool tcp = strspn(addr, "0123456789") == strlen(addr);
+    int fd = socket(tcp ? AF_INET : AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0) return -1;
+
+    int error = -1;
+    if(tcp) {
+        struct sockaddr_in in = {0};
+        in.sin_family = AF_INET;
+        in.sin_port = htons(atoi(addr));
+        in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        error = connect(fd, (struct sockaddr*)&in, sizeof(in));
+    }
+    else if(strlen(addr) < sizeof(((struct sockaddr_un*)0)->sun_path)) {
+        struct sockaddr_un un = {0};
+        un.sun_family = AF_UNIX;
+        strcpy(un.sun_path, addr);
+        error = connect(fd, (struct sockaddr*)&un, sizeof(un));
+    }
+    if(error != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int cmplegacy(const void *a, const void *b) {
+    const query_t *x = *(query_t* const*)a, *y = *(query_t* const*)b;
+    if(x->score != y->score) return x->score < y->score ? -1 : 1;
+    return x->id - y->id;
+}
+
+/****************************************************************
+ * gshards - The results of a query, gathered from the shards
+ * \param input     the query, as it was input
+ * \return          queue of query_t in the order they are printed
+****************************************************************/
+queue_t *gshards(char *input) {
+
+    // Sent to every shard before any is read from, so they all work
+    // on it at once; closing the writing end tells a shard it is all
+    int *fds = (int*)malloc(nshards * sizeof(int));
+    size_t len = strlen(input);
+    for(int i = 0; i < nshards; i++) {
+        fds[i] = connectto(shardaddrs[i]);
+        if(fds[i] >= 0 && (write(fds[i], input, len) != (ssize_t)len ||
+                           (input[len - 1] != '\n' && write(fds[i], "\n", 1) != 1))) {
+            close(fds[i]);
+            fds[i] = -1;
         }
+        if(fds[i] >= 0) shutdown(fds[i], SHUT_WR);
+        else logmsg(LOG_WARN, "Warning: shard %s is unavailable\n", shardaddrs[i]);
+    }
 
+    hit_t **parts = (hit_t**)calloc(nshards, sizeof(hit_t*));
+    int *counts = (int*)calloc(nshards, sizeof(int));
+    query_t **docs = NULL;
+    int ndocs = 0, cap = 0;
+    char line[__MAXLINE];
+    for(int i = 0; i < nshards; i++) {
+        FILE *f = fds[i] >= 0 ? fdopen(fds[i], "r") : NULL;
+        if(f == NULL) {
+            if(fds[i] >= 0) close(fds[i]);
+            continue;
+        }
+        int pcap = 0;
+        query_t d;
+        while(fgets(line, sizeof(line), f) != NULL && line[0] != '\n') {
+            if(sscanf(line, "%d %d %lg", &d.id, &d.rank, &d.score) != 3) continue;
+            if(model != RK_LEGACY) {
+                if(counts[i] == pcap) {
+                    pcap = pcap ? 2 * pcap : 64;
+                    parts[i] = (hit_t*)realloc(parts[i], pcap * sizeof(hit_t));
+                }
+                parts[i][counts[i]++] = (hit_t){d.id, d.score};
+                continue;
+            }
+            if(ndocs == cap) {
+                cap = cap ? 2 * cap : 64;
+                docs = (query_t**)realloc(docs, cap * sizeof(query_t*));
+            }
+            docs[ndocs] = (query_t*)malloc(sizeof(query_t));
+            *docs[ndocs++] = d;
+        }
+        fclose(f);
     }
+    free(fds);
 
-    // Normal query mode
-    quiet = false;
-    return 0;
+    queue_t *results;
+    if(model != RK_LEGACY) {
+        hit_t *hits;
+        int nhits = tkmerge(parts, counts, nshards, topk, &hits);
+        results = hitqueue(hits, nhits);
+    }
+    else {
+        for(int i = 0; i < nshards; i++) free(parts[i]);
+        if(ndocs > 0) qsort(docs, ndocs, sizeof(query_t*), cmplegacy);
+        results = qopen();
+        for(int i = 0; i < ndocs; i++) qput(results, docs[i]);
+        sdoc(results);
+    }
+    free(parts);
+    free(counts);
+    free(docs);
+    return results;
 }
 
 
 /****************************************************************
  * query - Given input, prints a queue of query_t structures
- * sorted by rankings
+ * sorted by rankings. The query is parsed and planned; results
+ * already in the cache under its normal form are printed as they
+ * are, and others put there once printed. Only reads the shared
+ * posting lists, so queries can run in parallel.
  * \param input        query input
+ * \param out          where results are printed
+ * \param msgf         where an invalid query is reported
  * \return 
 ****************************************************************/
-void query(char *input) {
-    
-    char buffer[64] = ""; char prev[64] = "";
-    bool valid = true;
+void query(char *input, FILE *out, FILE *msgf) {
 
     // Ignore empty input
     if((int)(*input) == 10) {
         return;
     }
 
-    // Ignore invalid non-alphabetical characters
-    if(!checkAlpha(input)) {
-        printf("[invalid query]\n");
+    qnode_t *q = qpparse(input);
+    if(q == NULL) {
+        fprintf(msgf, "[invalid query]\n");
+        return;
+    }
+    if(nshards > 0) {
+        queue_t *results = gshards(input);
+        presults(results, out);
+        qclose(results);
+        qpfree(q);
         return;
     }
 
-    char *curr = input;
-    queue_t *words = qopen();       // Bag of words to be iterated through
-    queue_t *results = qopen();     // Ranking results
+    pthread_rwlock_rdlock(&indexlock);
+    qpplan(q, postings);
+    char key[512];
+    bool cached = qpstring(q, key, sizeof(key)) < (int)sizeof(key) && cache != NULL;
+    logmsg(LOG_DEBUG, "Plan: %s\n", key);
+
+    size_t len = 0;
+    char *text = cached ? (char*)qcget(cache, plgen(postings), key, &len) : NULL;
+    FILE *f;
+    if(text == NULL) {
+        queue_t *results = gresults(q);
+        if(cached && (f = open_memstream(&text, &len)) != NULL) {
+            presults(results, f);
+            fclose(f);
+            qcput(cache, plgen(postings), key, text, len);
+        }
+        else presults(results, out);
+        qclose(results);
+    }
+    pthread_rwlock_unlock(&indexlock);
 
-	while(true){
-            
-        // Skip tabs and white spaces
-        while(((int)(*curr)) == 9 || ((int)(*curr)) == 32){	
-			curr++;
-		}
+    if(text != NULL) fwrite(text, 1, len, out);
+    free(text);
+    qpfree(q);
+}
 
-		if(sscanf(curr, "%s", buffer) == 1){
-            curr += strlen(buffer);
-			normalizeWord(buffer);
 
-            // Check for invalid logic
-            if(!checkLogic(prev, buffer)) {
-                valid = false;
-                printf("[invalid query]\n");
-                break;
-            }
-                
-            // Extract valid word from index and put into queue 
-            if(strcmp(buffer, "and") != 0) {
-
-                if(strcmp(buffer, "or") != 0 || strlen(buffer) > 3) {
-                    char *w = (char*)malloc(sizeof(char*) * 128);
-                    strcpy(w, buffer);
-                    qput(words, w);
-                }
-                else if(strcmp(buffer, "or") == 0) {
+/****************************************************************
+ * timedquery - runs a query, and writes how long it took, in
+ * nanoseconds, as a line of latf if there is one
+ * \param input        query input
+ * \param out          where results are printed
+ * \param latf         latency file or NULL
+****************************************************************/
+void timedquery(char *input, FILE *out, FILE *latf) {
+    uint64_t start = mtnow();
+    query(input, out, stdout);
+    if(latf != NULL) fprintf(latf, "%" PRIu64 "\n", mtnow() - start);
+}
 
-                    // If the current word is 'or', pack the current
-                    // rankings for future uses.
-                    queue_t *docs = gdoc(words);
-                    mergeRank(results, docs);
-                    qclose(docs);
-                }
-            }
-		}
-		else{
-			break;
-		}
 
-        // Remember previous word to check for logic
-        strcpy(prev, buffer);		
+/****************************************************************
+ * Batch mode: with -j in quiet mode, the query file is read a batch
+ * at a time, and the queries of a batch are split between a pool of
+ * workers in runs of consecutive queries, all sharing the posting
+ * lists. The results of each query go to a slot of its own, and slots
+ * are written out in the order of the file as soon as the ones before
+ * them are, like a reorder buffer, so the output is that of running
+ * the queries one by one.
+ *
+ * With -g, the queries of a batch are run in the order of their plans
+ * instead, so that queries starting from the same rarest word run one
+ * after the other, mostly by the same worker, while the blocks of its
+ * list are still in the caches; ANDs that queries of a batch share
+ * are cached and intersected once.
+****************************************************************/
+#define __BATCH 4096                // Queries read at once
+#define __RUN 16                    // Queries a worker takes at once
+#define __MAXINPUT 100              // As queries are read one by one
+
+typedef struct {
+    char input[__MAXINPUT];
+    char plan[2 * __MAXINPUT];      // Normal form, with -g
+    char *out, *msg;                // Results, and invalid query notes
+    size_t outlen, msglen;
+    uint64_t ns;
+    bool done;
+} slot_t;
+
+typedef struct {
+    slot_t *slots;
+    int *order;
+    int first, n;
+} run_t;
+
+static pthread_mutex_t batchlock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t batchdone = PTHREAD_COND_INITIALIZER;
+static slot_t *sorting;             // Batch being sorted by plan
+
+static int byplan(const void *a, const void *b) {
+    slot_t *x = &sorting[*(const int*)a], *y = &sorting[*(const int*)b];
+    int c = strcmp(x->plan, y->plan);
+    return c != 0 ? c : *(const int*)a - *(const int*)b;
+}
+
+/****************************************************************
+ * runqueries - runs a run of queries of a batch, each into its slot
+ * \param arg       the run, freed after
+****************************************************************/
+void runqueries(void *arg) {
+    run_t *run = (run_t*)arg;
+    for(int i = run->first; i < run->first + run->n; i++) {
+        slot_t *s = &run->slots[run->order[i]];
+        FILE *out = open_memstream(&s->out, &s->outlen);
+        FILE *msgf = open_memstream(&s->msg, &s->msglen);
+        uint64_t start = mtnow();
+        if(out != NULL && msgf != NULL) query(s->input, out, msgf);
+        s->ns = mtnow() - start;
+        if(out != NULL) fclose(out);
+        if(msgf != NULL) fclose(msgf);
+
+        pthread_mutex_lock(&batchlock);
+        s->done = true;
+        pthread_cond_broadcast(&batchdone);
+        pthread_mutex_unlock(&batchlock);
     }
+    free(run);
+}
 
-    // Consider trailing query
-    if(!checkLogic(buffer, "or") && valid) {
-        printf("[invalid query]\n");
-        valid = false;
+/****************************************************************
+ * plan - the normal form of the plan of a query, to group it by, or
+ * an empty string if it is invalid; only its start matters
+****************************************************************/
+void plan(slot_t *s) {
+    s->plan[0] = '\0';
+    qnode_t *q = qpparse(s->input);
+    if(q != NULL) qpstring(nshards > 0 ? q : qpplan(q, postings), s->plan, sizeof(s->plan));
+    qpfree(q);
+}
+
+/****************************************************************
+ * batchquery - runs the queries of a file by batches, as in quiet
+ * mode, on a pool of workers
+ * \param queryf    queries, one a line
+ * \param out       where queries and their results are printed
+ * \param latf      latency file or NULL
+ * \return          0 if success and non-zero if otherwise
+****************************************************************/
+int batchquery(FILE *queryf, FILE *out, FILE *latf) {
+    tpool_t *tp = tpopen(nworkers);
+    slot_t *slots = (slot_t*)calloc(__BATCH, sizeof(slot_t));
+    int *order = (int*)malloc(__BATCH * sizeof(int));
+    if(tp == NULL || slots == NULL || order == NULL) {
+        logmsg(LOG_ERROR, "Error: failed to start workers\n");
+        if(tp != NULL) tpclose(tp);
+        free(slots);
+        free(order);
+        return 1;
     }
 
-    // Upadate ranking results one last time 
-    if(valid) {
-        queue_t *docs = gdoc(words);
-        mergeRank(results, docs);
-        qclose(docs);
-        sdoc(results);
-            
-        if(quiet) {
-            qapply(results, pfile);
+    int n;
+    do {
+        for(n = 0; n < __BATCH && fgets(slots[n].input, __MAXINPUT, queryf) != NULL; n++) {
+            slots[n].done = false;
+            order[n] = n;
+            if(grouped) plan(&slots[n]);
         }
-        else {
-            qapply(results, pstd);
+        if(grouped) {
+            sorting = slots;
+            qsort(order, n, sizeof(int), byplan);
+        }
+
+        // A run that cannot be queued is run here
+        for(int first = 0; first < n; first += __RUN) {
+            run_t *run = (run_t*)malloc(sizeof(run_t));
+            *run = (run_t){slots, order, first, n - first < __RUN ? n - first : __RUN};
+            if(tpsubmit(tp, runqueries, run) != 0) runqueries(run);
+        }
+
+        // Slots are written out in order as they are done
+        for(int i = 0; i < n; i++) {
+            slot_t *s = &slots[i];
+            pthread_mutex_lock(&batchlock);
+            while(!s->done) pthread_cond_wait(&batchdone, &batchlock);
+            pthread_mutex_unlock(&batchlock);
+
+            fprintf(out, "%s", s->input);
+            if(s->msg != NULL) fwrite(s->msg, 1, s->msglen, stdout);
+            if(s->out != NULL) fwrite(s->out, 1, s->outlen, out);
+            if(latf != NULL) fprintf(latf, "%" PRIu64 "\n", s->ns);
+            free(s->out);
+            free(s->msg);
+            s->out = s->msg = NULL;
+        }
+        tpwait(tp);
+    } while(n == __BATCH);
+
+    tpclose(tp);
+    free(slots);
+    free(order);
+    return 0;
+}
+
+
+/****************************************************************
+ * Server mode: clients connect to a Unix socket, or to a port of
+ * localhost, and send queries one a line. The results of each are
+ * sent back as in quiet mode, followed by an empty line. Each client
+ * is served by a worker of a pool, all of them sharing the posting
+ * lists, which are only read once loaded; the results of a query are
+ * written to the worker's own buffer, and sent at once.
+ *
+ * SIGHUP reloads the index file, which may have been rebuilt since:
+ * the new lists replace the old ones between queries, and cached
+ * results are dropped with them, as they belong to another generation.
+****************************************************************/
+#define __BACKLOG 128
+#define __IDLE 10                   // Seconds an idle client is kept
+#define __SCRATCH (64 * 1024)       // Results buffered per worker
+
+static _Thread_local char scratch[__SCRATCH];
+static volatile sig_atomic_t stopping = 0, reloading = 0;
+
+static void onsignal(int sig) {
+    if(sig == SIGHUP) reloading = 1;
+    else stopping = 1;
+}
+
+/****************************************************************
+ * reload - swaps in the posting lists of the index file as it is
+ * now; the old lists are kept if it cannot be loaded
+****************************************************************/
+void reload(void) {
+    ranker_t *rk;
+    postings_t *pl = loadindex(indexnm, &rk);
+    if(pl == NULL) {
+        logmsg(LOG_WARN, "Warning: failed to reload index %s\n", indexnm);
+        return;
+    }
+
+    pthread_rwlock_wrlock(&indexlock);
+    postings_t *oldpl = postings;
+    ranker_t *oldrk = ranker;
+    postings = pl;
+    ranker = rk;
+    pthread_rwlock_unlock(&indexlock);
+    plclose(oldpl);
+    rkclose(oldrk);
+    logmsg(LOG_INFO, "Reloaded index %s\n", indexnm);
+}
+
+/****************************************************************
+ * serve - answers the queries of a client until it leaves, or is
+ * idle for too long
+ * \param arg       socket of the client, closed after
+****************************************************************/
+void serve(void *arg) {
+    int fd = (int)(intptr_t)arg;
+    struct timeval idle = {__IDLE, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &idle, sizeof(idle));
+
+    // Reading and writing through separate streams of the socket
+    int wfd = dup(fd);
+    FILE *in = fdopen(fd, "r"), *out = wfd >= 0 ? fdopen(wfd, "w") : NULL;
+    if(in == NULL || out == NULL) {
+        logmsg(LOG_WARN, "Warning: failed to serve a client\n");
+        if(in != NULL) fclose(in);
+        else close(fd);
+        if(wfd >= 0) close(wfd);
+        return;
+    }
+    setvbuf(out, scratch, _IOFBF, sizeof(scratch));
+
+    char input[512];
+    while(!stopping && fgets(input, sizeof(input), in) != NULL) {
+        query(input, out, out);
+        fputc('\n', out);
+        if(fflush(out) != 0) break;
+    }
+    fclose(out);
+    fclose(in);
+}
+
+/****************************************************************
+ * listenon - a socket listening on a Unix socket path, or on a port
+ * of localhost if addr is a number. A socket left at the path by an
+ * earlier server is replaced.
+ * \param addr      path or port
+ * \return          the socket, or -1 on failure
+****************************************************************/
+int listenon(char *addr) {
+    bool tcp = strspn(addr, "0123456789") == strlen(addr);
+    int fd = socket(tcp ? AF_INET : AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0) return -1;
+
+    bool bound = false;
+    if(tcp) {
+        int one = 1;
+        struct sockaddr_in in = {0};
+        in.sin_family = AF_INET;
+        in.sin_port = htons(atoi(addr));
+        in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        bound = bind(fd, (struct sockaddr*)&in, sizeof(in)) == 0;
+    }
+    else {
+        struct stat st;
+        struct sockaddr_un un = {0};
+        un.sun_family = AF_UNIX;
+        if(strlen(addr) < sizeof(un.sun_path)) {
+            strcpy(un.sun_path, addr);
+            if(stat(addr, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(addr);
+            bound = bind(fd, (struct sockaddr*)&un, sizeof(un)) == 0;
+        }
+    }
+    if(!bound || listen(fd, __BACKLOG) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/****************************************************************
+ * serveon - serves clients until a signal stops the server; clients
+ * being served are finished first
+ * \param addr      path or port
+ * \return          0 if success and non-zero if otherwise
+****************************************************************/
+int serveon(char *addr) {
+
+    // A signal ends the accept loop, or reloads the index; a client
+    // that left is not one
+    struct sigaction sa = {0};
+    sa.sa_handler = onsignal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    int lfd = listenon(addr);
+    if(lfd < 0) {
+        logmsg(LOG_ERROR, "Error: cannot listen on %s\n", addr);
+        return 1;
+    }
+    if(nworkers == 0) nworkers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    tpool_t *tp = startpool(nworkers > 0 ? nworkers : 1);
+    if(tp == NULL) {
+        logmsg(LOG_ERROR, "Error: failed to start workers\n");
+        close(lfd);
+        return 1;
+    }
+    logmsg(LOG_INFO, "Serving on %s with %d workers\n", addr, tpsize(tp));
+
+    while(!stopping) {
+        if(reloading) {
+            reloading = 0;
+            if(nshards == 0) reload();
+        }
+        int fd = accept(lfd, NULL, NULL);
+        if(fd < 0) {
+            if(errno != EINTR) logmsg(LOG_WARN, "Warning: accept failed\n");
+            continue;
         }
+        if(tpsubmit(tp, serve, (void*)(intptr_t)fd) != 0) close(fd);
+    }
+
+    close(lfd);
+    tpclose(tp);
+    if(strspn(addr, "0123456789") != strlen(addr)) unlink(addr);
+    logmsg(LOG_INFO, "Server stopped\n");
+    return 0;
+}
+
+
+/****************************************************************
+ * closeall - frees the index and the cache, logging how well the
+ * cache did
+****************************************************************/
+void closeall(void) {
+    long hits = 0, misses = 0;
+    size_t bytes = 0;
+    qcstats(cache, &hits, &misses, &bytes);
+    if(cache != NULL) {
+        logmsg(LOG_DEBUG, "Cache: %ld hits, %ld misses, %zu bytes\n", hits, misses, bytes);
     }
-        
-    // Cleanup
-    qclose(words);
-    qclose(results);
+    qcclose(cache);
+    if(rangepool != NULL) tpclose(rangepool);
+    plclose(postings);
+    rkclose(ranker);
+    free(shardaddrs);
 }
 
 
 /****************************************************************
  * Querier - queries pages and returns search rankings
- * usage: query <pageDirectory> <indexFile> [-q]
+ * usage: query <pageDirectory> <indexFile> [-q <queryFile> <outputFile>]
+ *              [-t <latencyFile>] [-r legacy|bm25|tfidf] [-k <n>]
+ *              [-c <MB>] [-p <n>] [-a] [-j <n> [-g]] [-s <socket|port> [-x]]
+ *              [-b <socket|port>,...]
  * 
  * examples: 
  * ./querier ../pages index.file
  * ./querier ../pages index.file -q good-queries.txt ranking
  * ./querier ../pages index.file -q bad-queries ranking
+ * ./querier ../pages index.file -q good-queries.txt ranking -t latency
+ * ./querier ../pages index.file -q good-queries.txt ranking -j 8 -g
+ * ./querier ../pages index.file -r bm25
+ * ./querier ../pages index.file -r bm25 -k 10
+ * ./querier ../pages index.file -r bm25 -k 10 -c 0
+ * ./querier ../pages index.file -r bm25 -k 10 -p 4
+ * ./querier ../pages index.file -r bm25 -k 10 -a
+ * ./querier ../pages index.file -r bm25 -k 10 -s querier.sock -j 8
+ * ./querier ../pages index.file.0 -r bm25 -k 10 -s index.file.0.sock -x
+ * ./querier ../pages index.file -r bm25 -k 10 -b index.file.0.sock,index.file.1.sock
 ****************************************************************/
 int main(int argc, char *argv[]){
 
+    // Keep log messages out of the query results
+    loginit(stderr);
     int error = checkinput(argc, argv);
     if(error != 0) {
-        eprintf("Error parsing arguments: %d\n", error);
+        logmsg(LOG_ERROR, "Error parsing arguments: %d\n", error);
         exit(EXIT_FAILURE);
     }
 
     strcpy(pagedir, argv[1]);
-    index = indexload(".", argv[2]);
+    indexnm = argv[2];
+    if(nshards > 0) {
+        logmsg(LOG_INFO, "Brokering queries to %d shards\n", nshards);
+    }
+    else if((postings = loadindex(indexnm, &ranker)) == NULL) {
+        logmsg(LOG_ERROR, "Error: failed to load index %s\n", indexnm);
+        exit(EXIT_FAILURE);
+    }
+    if(cachemb > 0 && nshards == 0 && (cache = qcopen((size_t)cachemb << 20)) == NULL) {
+        logmsg(LOG_WARN, "Warning: failed to open the result cache\n");
+    }
+    if(nranges > 1 && nshards == 0 && (rangepool = startpool(nranges - 1)) == NULL) {
+        logmsg(LOG_WARN, "Warning: failed to start workers for ranges\n");
+    }
+
+    // Serve clients instead, if asked to
+    if(serveaddr != NULL) {
+        error = serveon(serveaddr);
+        closeall();
+        exit(error ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+    // Time every query, if asked to
+    FILE *latf = NULL;
+    if(latencyfile != NULL && (latf = fopen(latencyfile, "w")) == NULL) {
+        logmsg(LOG_ERROR, "Error: failed to open %s\n", latencyfile);
+    }
 
     char input[512];
-    if(argc > 3) {
+    if(quiet) {
         // Quiet query mode
-        FILE *queryf = fopen(argv[4], "r");
-        qoutf = fopen(argv[5], "w");
+        FILE *queryf = fopen(queryfile, "r");
+        qoutf = fopen(outputfile, "w");
 
-        while(fgets(input, 100, queryf) != NULL) {
+        // In batches on a pool of workers, if asked to
+        if(nworkers > 0) {
+            error = batchquery(queryf, qoutf, latf);
+        }
+        else while(fgets(input, 100, queryf) != NULL) {
             fprintf(qoutf, "%s", input);
-            query(input);
+            timedquery(input, qoutf, latf);
         }
 
         fclose(queryf);
@@ -506,15 +1205,13 @@ int main(int argc, char *argv[]){
         // CMD query mode
         printf("> ");
         while(fgets(input, 100, stdin) != NULL) {
-            query(input);
+            timedquery(input, stdout, latf);
             printf("> ");
         }
         printf("\n");
     }
+    if(latf != NULL) fclose(latf);
 
-
-    happly(index, freeWord);
-    happly(index, freeDoc);
-    hclose(index);
-    return 0;
+    closeall();
+    return error ? EXIT_FAILURE : EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -44,22 +44,6 @@ typedef struct {
     int rank;
 } query_t;
 
-// This struct associates a list of crawled documents with each crawled word
-typedef struct {
-    char *word;         // The indexed word
-    queue_t *doclist;   // List of associated documents
-} word_t;
-
-// This struct defines doclist elements
-typedef struct {
-    int id;             // Id of the crawled page
-    int freq;           // Frequency of word in page
-} doc_t;
-
-// Frees queue and word in hashtable
-void freeWord(void* word) {free(((word_t*)word)->word); }
-void freeDoc(void *word) {word_t *w = ((word_t*)word); qclose(w->doclist); }
-
 // Global hashtable for index
 hashtable_t *index;
 
@@ -403,8 +387,6 @@ int main(int argc, char *argv[]){
         free(input);
     }
 
-    happly(index, freeWord);
-    happly(index, freeDoc);
-    hclose(index);
+    indexclose(index);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,398 @@
+/****************************************************************
+ * file   bench.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   December 2, 2021
+ *
+ * Microbenchmarks of the utils data structures over Zipf-skewed
+ * synthetic words and URLs: the queue, the hashtable at several
+ * load factors, the locked queue and hashtable from 1 to maxthreads
+ * threads, and SuperFastHash against other string hashes.
+ *
+ * usage: bench [maxthreads]
+ *
+ * Every result is one line of whitespace separated columns,
+ *   <benchmark> <workload> <parameter> <threads> <ns/op> <extra>
+ * where extra is key=value (the speedup over one thread, or how
+ * evenly a hash spreads keys) or "-". Each result is the best of
+ * __REPS runs. The first four columns name a result, so two runs
+ * can be compared line by line with compare.sh.
+ *
+****************************************************************/
+
+#define _POSIX_C_SOURCE 200809L     // clock_gettime, pthread_barrier
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include<time.h>
+#include<pthread.h>
+#include"queue.h"
+#include"hash.h"
+#include"lqueue.h"
+#include"lhash.h"
+#include"zipf.h"
+
+/****************************************************************
+ * Define macro, globals and helper functions
+****************************************************************/
+#define __REPS 3                    // Runs per result, best one kept
+#define __SKEW 1.0                  // Zipf skew of the key streams
+#define __SEED 2021
+#define __MAXKEY 96
+#define __KEYS 100000               // Distinct words and URLs
+#define __DRAWS 1000000             // Keys in a Zipf stream
+#define __BUCKETS 4096
+#define __QOPS 2000000              // Queue operations, over all threads
+#define __LHOPS 400000              // Hashtable searches, over all threads
+
+static char *words[__KEYS], *urls[__KEYS];
+static int draws[__DRAWS];          // Zipf ranks, drawn once
+static volatile uint64_t sink;      // Keeps results from being optimized out
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void result(const char *bench, const char *workload, const char *param,
+                   int threads, double ns, const char *extra) {
+    printf("%-12s %-6s %-10s %3d %10.1f %s\n", bench, workload, param,
+           threads, ns, extra ? extra : "-");
+    fflush(stdout);
+}
+
+static bool streq(void *elementp, const void *keyp) {
+    return !strcmp((const char*)elementp, (const char*)keyp);
+}
+
+static char *copy(const char *s) {
+    char *c = (char*)malloc(strlen(s) + 1);
+    strcpy(c, s);
+    return c;
+}
+
+
+/****************************************************************
+ * Hashes to compare against SuperFastHash (hash32) and hash64
+****************************************************************/
+static uint64_t superfast(const char *key, int len) {
+    return hash32(key, len);
+}
+
+static uint64_t fnv1a32(const char *key, int len) {
+    uint32_t h = 2166136261u;
+    for(int i = 0; i < len; i++) h = (h ^ (unsigned char)key[i]) * 16777619u;
+    return h;
+}
+
+static uint64_t djb2(const char *key, int len) {
+    uint32_t h = 5381;
+    for(int i = 0; i < len; i++) h = h * 33 + (unsigned char)key[i];
+    return h;
+}
+
+static uint64_t murmur3(const char *key, int len) {
+    uint32_t h = 0, k;
+    int i = 0;
+    for(; i + 4 <= len; i += 4) {
+        memcpy(&k, key + i, 4);
+        k *= 0xcc9e2d51u;
+        k = (k << 15) | (k >> 17);
+        h ^= k * 0x1b873593u;
+        h = (h << 13) | (h >> 19);
+        h = h * 5 + 0xe6546b64u;
+    }
+    k = 0;
+    for(int j = len - 1; j >= i; j--) k = (k << 8) | (unsigned char)key[j];
+    if(len > i) {
+        k *= 0xcc9e2d51u;
+        k = (k << 15) | (k >> 17);
+        h ^= k * 0x1b873593u;
+    }
+    h ^= len;
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    return h ^ (h >> 16);
+}
+
+static uint64_t fnv1a64(const char *key, int len) {
+    return hash64(key, len);
+}
+
+typedef struct hashfn {
+    const char *name;
+    uint64_t (*fn)(const char*, int);
+} hashfn_t;
+
+static const hashfn_t hashfns[] = {
+    {"superfast", superfast}, {"hash64", fnv1a64}, {"fnv1a32", fnv1a32},
+    {"djb2", djb2}, {"murmur3", murmur3},
+};
+
+
+/****************************************************************
+ * Private helper function: run fn(index, threads) on threads
+ * threads, each with its own index, and time them from a common start
+ * returns the wall time in nanoseconds
+****************************************************************/
+typedef struct job {
+    void (*fn)(int, int);
+    int index, threads;
+    pthread_barrier_t *start;
+} job_t;
+
+static void *runjob(void *arg) {
+    job_t *j = (job_t*)arg;
+    pthread_barrier_wait(j->start);
+    j->fn(j->index, j->threads);
+    return NULL;
+}
+
+static double parallel(void (*fn)(int, int), int threads) {
+    pthread_t tids[threads];
+    job_t jobs[threads];
+    pthread_barrier_t start;
+    pthread_barrier_init(&start, NULL, threads + 1);
+    for(int i = 0; i < threads; i++) {
+        jobs[i] = (job_t){fn, i, threads, &start};
+        pthread_create(&tids[i], NULL, runjob, &jobs[i]);
+    }
+    pthread_barrier_wait(&start);
+    double t = now();
+    for(int i = 0; i < threads; i++) pthread_join(tids[i], NULL);
+    t = now() - t;
+    pthread_barrier_destroy(&start);
+    return t;
+}
+
+
+/****************************************************************
+ * queue: FIFO throughput, and qsearch for Zipf-popular keys near
+ * the front of queues of several lengths
+****************************************************************/
+static void benchqueue(void) {
+
+    int n = __QOPS / 2;
+    double best = 1e300;
+    for(int rep = 0; rep < __REPS; rep++) {
+        queue_t *q = qopen();
+        double t = now();
+        for(int i = 0; i < n; i++) qput(q, words[i % __KEYS]);
+        for(int i = 0; i < n; i++) sink += (uintptr_t)qget(q);
+        t = now() - t;
+        if(t < best) best = t;
+        qclose(q);
+    }
+    char param[32];
+    sprintf(param, "n=%d", n);
+    result("qput+qget", "seq", param, 1, best / (2 * n), NULL);
+
+    int lengths[] = {16, 256, 4096};
+    for(int l = 0; l < 3; l++) {
+        int len = lengths[l], searches = 4000000 / len;
+        queue_t *q = qopen();
+        for(int i = 0; i < len; i++) qput(q, copy(words[i]));
+        zipf_t *zf = zfopen(len, __SKEW, __SEED);
+        int *keys = (int*)malloc(searches * sizeof(int));
+        for(int i = 0; i < searches; i++) keys[i] = zfnext(zf);
+        zfclose(zf);
+
+        best = 1e300;
+        for(int rep = 0; rep < __REPS; rep++) {
+            double t = now();
+            for(int i = 0; i < searches; i++) {
+                sink += (uintptr_t)qsearch(q, streq, words[keys[i]]);
+            }
+            t = now() - t;
+            if(t < best) best = t;
+        }
+        sprintf(param, "len=%d", len);
+        result("qsearch", "zipf", param, 1, best / searches, NULL);
+        free(keys);
+        qclose(q);
+    }
+}
+
+
+/****************************************************************
+ * hash: hput and Zipf hsearch with 1/4 to 16 keys per bucket
+****************************************************************/
+static void benchhash(void) {
+
+    double loads[] = {0.25, 1, 4, 16};
+    for(int l = 0; l < 4; l++) {
+        int n = loads[l] * __BUCKETS;
+        char **keys = (char**)malloc(n * sizeof(char*));
+        double put = 1e300, search = 1e300;
+        for(int rep = 0; rep < __REPS; rep++) {
+            for(int i = 0; i < n; i++) keys[i] = copy(words[i]);
+            hashtable_t *h = hopen(__BUCKETS);
+            double t = now();
+            for(int i = 0; i < n; i++) {
+                hput(h, keys[i], keys[i], strlen(keys[i]));
+            }
+            t = now() - t;
+            if(t < put) put = t;
+
+            // Keys past n are drawn again among the first n
+            t = now();
+            for(int i = 0; i < __DRAWS; i++) {
+                const char *k = words[draws[i] % n];
+                sink += (uintptr_t)hsearch(h, streq, k, strlen(k));
+            }
+            t = now() - t;
+            if(t < search) search = t;
+            hclose(h);
+        }
+        char param[32];
+        sprintf(param, "load=%g", loads[l]);
+        result("hput", "words", param, 1, put / n, NULL);
+        result("hsearch", "zipf", param, 1, search / __DRAWS, NULL);
+        free(keys);
+    }
+}
+
+
+/****************************************************************
+ * lqueue: every thread puts and gets its share of __QOPS
+****************************************************************/
+static lqueue_t *lq;
+
+static void lqwork(int index, int threads) {
+    int n = __QOPS / 2 / threads;
+    for(int i = 0; i < n; i++) {
+        lqput(lq, words[(index + i) % __KEYS]);
+        sink += (uintptr_t)lqget(lq);
+    }
+}
+
+
+/****************************************************************
+ * lhash: every thread searches for its share of __LHOPS Zipf URLs
+****************************************************************/
+static lhashtable_t *lh;
+
+static void lhwork(int index, int threads) {
+    int n = __LHOPS / threads;
+    for(int i = 0; i < n; i++) {
+        const char *k = urls[draws[(index * n + i) % __DRAWS]];
+        sink += (uintptr_t)lhsearch(lh, streq, k, strlen(k));
+    }
+}
+
+
+/****************************************************************
+ * Private helper function: time fn from 1 to maxthreads threads,
+ * doubling, with the speedup over one thread
+****************************************************************/
+static void scaling(const char *bench, const char *workload, int ops,
+                    void (*fn)(int, int), int maxthreads) {
+    double single = 0;
+    for(int threads = 1; threads <= maxthreads; threads *= 2) {
+        double best = 1e300;
+        for(int rep = 0; rep < __REPS; rep++) {
+            double t = parallel(fn, threads);
+            if(t < best) best = t;
+        }
+        if(threads == 1) single = best;
+        char param[32], extra[32];
+        sprintf(param, "ops=%d", ops);
+        sprintf(extra, "speedup=%.2f", single / best);
+        result(bench, workload, param, threads, best / ops, extra);
+    }
+}
+
+
+/****************************************************************
+ * hash functions: time over a Zipf stream, and spread of distinct
+ * keys over __BUCKETS buckets, as the sum over buckets of b(b+1)/2
+ * against what a random hash would give; 1.00 is as good as random
+****************************************************************/
+static void benchhashfns(void) {
+    char *(*sets[2])[__KEYS] = {&words, &urls};
+    const char *names[2] = {"words", "urls"};
+    int *lens = (int*)malloc(__KEYS * sizeof(int));
+    for(int s = 0; s < 2; s++) {
+        char **keys = *sets[s];
+        for(int i = 0; i < __KEYS; i++) lens[i] = strlen(keys[i]);
+        for(int f = 0; f < (int)(sizeof(hashfns) / sizeof(hashfns[0])); f++) {
+            uint64_t (*fn)(const char*, int) = hashfns[f].fn;
+            double best = 1e300;
+            for(int rep = 0; rep < __REPS; rep++) {
+                uint64_t acc = 0;
+                double t = now();
+                for(int i = 0; i < __DRAWS; i++) {
+                    acc += fn(keys[draws[i]], lens[draws[i]]);
+                }
+                t = now() - t;
+                sink += acc;
+                if(t < best) best = t;
+            }
+
+            static int buckets[__BUCKETS];
+            memset(buckets, 0, sizeof(buckets));
+            for(int i = 0; i < __KEYS; i++) {
+                buckets[fn(keys[i], lens[i]) % __BUCKETS]++;
+            }
+            double sum = 0, n = __KEYS, m = __BUCKETS;
+            for(int b = 0; b < __BUCKETS; b++) {
+                sum += buckets[b] * (buckets[b] + 1.0) / 2;
+            }
+            char extra[32];
+            sprintf(extra, "uniformity=%.3f",
+                    sum / (n / (2 * m) * (n + 2 * m - 1)));
+            result(hashfns[f].name, names[s], "zipf", 1, best / __DRAWS, extra);
+        }
+    }
+    free(lens);
+}
+
+
+int main(int argc, char *argv[]) {
+
+    int maxthreads = argc > 1 ? atoi(argv[1]) : 64;
+    if(argc > 2 || maxthreads < 1) {
+        printf("usage: bench [maxthreads]\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Keys, and one Zipf stream of ranks that every benchmark replays
+    char key[__MAXKEY];
+    for(int i = 0; i < __KEYS; i++) {
+        zfword(i, key, sizeof(key));
+        words[i] = copy(key);
+        zfurl(i, key, sizeof(key));
+        urls[i] = copy(key);
+    }
+    zipf_t *zf = zfopen(__KEYS, __SKEW, __SEED);
+    for(int i = 0; i < __DRAWS; i++) draws[i] = zfnext(zf);
+    zfclose(zf);
+
+    printf("# benchmark  workload parameter threads ns/op extra\n");
+    benchqueue();
+    benchhash();
+
+    lq = lqopen();
+    scaling("lqput+lqget", "seq", __QOPS, lqwork, maxthreads);
+    lqclose(lq);
+
+    lh = lhopen(__BUCKETS);
+    for(int i = 0; i < __KEYS; i++) {
+        lhput(lh, copy(urls[i]), urls[i], strlen(urls[i]));
+    }
+    scaling("lhsearch", "zipf", __LHOPS, lhwork, maxthreads);
+    lhclose(lh);
+
+    benchhashfns();
+
+    for(int i = 0; i < __KEYS; i++) {
+        free(words[i]);
+        free(urls[i]);
+    }
+    exit(EXIT_SUCCESS);
+}
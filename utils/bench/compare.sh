@@ -0,0 +1,25 @@
+#!/bin/bash
+# compare.sh -- compare two bench runs result by result
+#
+# usage: compare.sh <old> <new> [percent]
+#
+# Prints every result with its change in ns/op, marking those more
+# than percent (default 10) slower; exits 1 if there are any.
+if [ $# -lt 2 ] || [ $# -gt 3 ]; then
+    echo "usage: compare.sh <old> <new> [percent]"
+    exit 2
+fi
+awk -v pct="${3:-10}" '
+    /^#/ { next }
+    { key = $1 " " $2 " " $3 " " $4 }
+    FNR == NR { old[key] = $5; next }
+    !(key in old) { printf "%-44s %10s %10.1f   new\n", key, "-", $5; next }
+    {
+        change = old[key] > 0 ? 100 * ($5 - old[key]) / old[key] : 0
+        slower = change > pct
+        if(slower) regressions++
+        printf "%-44s %10.1f %10.1f %+6.1f%%%s\n", key, old[key], $5, change,
+               slower ? "  SLOWER" : ""
+    }
+    END { exit regressions > 0 }
+' "$1" "$2"
@@ -0,0 +1,201 @@
+/****************************************************************
+ * file   bloom.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   November 26, 2021
+ *
+ * Implementation of a lock-free register-blocked Bloom filter. The
+ * low bits of a key's hash pick a word; the bit positions inside
+ * the word are taken 6 bits at a time from a second mix of the hash.
+ *
+****************************************************************/
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<stdatomic.h>
+#include"hash.h"
+#include"bloom.h"
+
+
+/****************************************************************
+ * Define filter data structure
+****************************************************************/
+typedef struct bloom {
+    _Atomic uint64_t *words;
+    uint64_t mask;              // Number of words - 1 (a power of 2)
+    int nhashes;
+} bf_t;
+
+
+/****************************************************************
+ * Private helper function: the bits a key sets in its word
+ * \param bf        The filter
+ * \param key       The key
+ * \param keylen    The length of the key
+ * \param word      Set to the index of the key's word
+ * \return          The mask of the key's bits
+****************************************************************/
+static uint64_t keybits(bf_t *bf, const char *key, int keylen,
+                        uint64_t *word) {
+
+    uint64_t h = hash64(key, keylen);
+    *word = h & bf->mask;
+
+    // Positions come from bits the word index does not use
+    uint64_t g = (h >> 32 | h << 32) * 0x9e3779b97f4a7c15ULL;
+    uint64_t bits = 0;
+    for(int i = 0; i < bf->nhashes; i++) {
+        bits |= 1ULL << (g >> (58 - 6 * (i % 10)) & 63);
+        if(i % 10 == 9) g = g * 0x9e3779b97f4a7c15ULL + 1;
+    }
+    return bits;
+}
+
+
+/****************************************************************
+ * bfopen -- open an empty filter within a memory budget
+****************************************************************/
+bloom_t *bfopen(size_t nbytes, int nhashes) {
+
+    if(nbytes < sizeof(uint64_t) || nhashes < 1 || nhashes > 16) {
+        return NULL;
+    }
+
+    // Round the word count down to a power of 2
+    size_t nwords = 1;
+    while(nwords * 2 * sizeof(uint64_t) <= nbytes) nwords *= 2;
+
+    bf_t *bf;
+    if(!(bf = (bf_t*)malloc(sizeof(bf_t)))) {
+        printf("Error: malloc failed allocating filter\n");
+        return NULL;
+    }
+    if(!(bf->words = (_Atomic uint64_t*)calloc(nwords, sizeof(uint64_t)))) {
+        printf("Error: malloc failed allocating filter\n");
+        free(bf);
+        return NULL;
+    }
+    bf->mask = nwords - 1;
+    bf->nhashes = nhashes;
+    return (bloom_t*)bf;
+}
+
+
+/****************************************************************
+ * bfclose -- free a filter
+****************************************************************/
+void bfclose(bloom_t *bfp) {
+
+    if(bfp == NULL) return;
+    bf_t *bf = (bf_t*)bfp;
+    free((void*)bf->words);
+    free(bf);
+}
+
+
+/****************************************************************
+ * bfadd -- add a key; one atomic fetch-or sets all of its bits
+****************************************************************/
+bool bfadd(bloom_t *bfp, const char *key, int keylen) {
+
+    if(bfp == NULL || key == NULL) return false;
+    bf_t *bf = (bf_t*)bfp;
+    uint64_t word;
+    uint64_t bits = keybits(bf, key, keylen, &word);
+
+    // Skip the write when every bit is set already, so that lookups
+    // of old keys leave the cache line shared
+    uint64_t old = atomic_load_explicit(&bf->words[word], memory_order_relaxed);
+    if((old & bits) == bits) return true;
+    old = atomic_fetch_or_explicit(&bf->words[word], bits, memory_order_relaxed);
+    return (old & bits) == bits;
+}
+
+
+/****************************************************************
+ * bfcheck -- check for a key without adding it
+****************************************************************/
+bool bfcheck(bloom_t *bfp, const char *key, int keylen) {
+
+    if(bfp == NULL || key == NULL) return false;
+    bf_t *bf = (bf_t*)bfp;
+    uint64_t word;
+    uint64_t bits = keybits(bf, key, keylen, &word);
+    uint64_t old = atomic_load_explicit(&bf->words[word], memory_order_relaxed);
+    return (old & bits) == bits;
+}
+
+
+/****************************************************************
+ * bfbytes -- the memory actually used by the filter
+****************************************************************/
+size_t bfbytes(bloom_t *bfp) {
+
+    if(bfp == NULL) return 0;
+    bf_t *bf = (bf_t*)bfp;
+    return (bf->mask + 1) * sizeof(uint64_t);
+}
+
+
+/****************************************************************
+ * bfrate -- a new key's bits are set with chance (c/64)^nhashes in
+ * a word with c bits set; the rate is the mean over all words
+****************************************************************/
+double bfrate(bloom_t *bfp) {
+
+    if(bfp == NULL) return 0;
+    bf_t *bf = (bf_t*)bfp;
+    double sum = 0;
+    for(uint64_t i = 0; i <= bf->mask; i++) {
+        uint64_t w = atomic_load_explicit(&bf->words[i], memory_order_relaxed);
+        double p = 1, c = __builtin_popcountll(w) / 64.0;
+        for(int k = 0; k < bf->nhashes; k++) p *= c;
+        sum += p;
+    }
+    return sum / (bf->mask + 1);
+}
+
+
+/****************************************************************
+ * bfsave -- the word count, then the words
+****************************************************************/
+int32_t bfsave(bloom_t *bfp, char *path) {
+
+    if(bfp == NULL || path == NULL) return 1;
+    bf_t *bf = (bf_t*)bfp;
+    FILE *f = fopen(path, "wb");
+    if(f == NULL) return 1;
+
+    uint64_t nwords = bf->mask + 1;
+    bool ok = fwrite(&nwords, sizeof(uint64_t), 1, f) == 1;
+    for(uint64_t i = 0; ok && i < nwords; i++) {
+        uint64_t w = atomic_load_explicit(&bf->words[i], memory_order_relaxed);
+        ok = fwrite(&w, sizeof(uint64_t), 1, f) == 1;
+    }
+    ok = fflush(f) == 0 && ok;
+    return (fclose(f) == 0 && ok) ? 0 : 1;
+}
+
+
+/****************************************************************
+ * bfload -- or the saved words into the filter
+****************************************************************/
+int32_t bfload(bloom_t *bfp, char *path) {
+
+    if(bfp == NULL || path == NULL) return 1;
+    bf_t *bf = (bf_t*)bfp;
+    FILE *f = fopen(path, "rb");
+    if(f == NULL) return 1;
+
+    uint64_t nwords, w;
+    bool ok = fread(&nwords, sizeof(uint64_t), 1, f) == 1 &&
+              nwords == bf->mask + 1;
+    for(uint64_t i = 0; ok && i < nwords; i++) {
+        if((ok = fread(&w, sizeof(uint64_t), 1, f) == 1)) {
+            atomic_fetch_or_explicit(&bf->words[i], w, memory_order_relaxed);
+        }
+    }
+    fclose(f);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,61 @@
+#pragma once
+/*
+ * bloom.h -- a lock-free, fixed size filter of seen keys
+ *
+ * A register-blocked Bloom filter: every key maps to a single 64-bit
+ * word and sets nhashes bits in it, so a lookup touches one cache
+ * line and an insert is one atomic fetch-or. Because the whole
+ * insert is one atomic operation, of several threads adding the same
+ * new key at once exactly one is told that the key is new.
+ *
+ * The filter has no false negatives. A false positive (a new key
+ * reported as seen) happens with a probability that depends on the
+ * memory budget per key; callers that need exact answers confirm
+ * positives against an exact set.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* the filter representation is hidden from users of the module */
+typedef void bloom_t;
+
+/* bfopen -- open an empty filter using at most nbytes of memory and
+ * setting nhashes (1 to 16) bits per key
+ * returns NULL on failure
+ */
+bloom_t *bfopen(size_t nbytes, int nhashes);
+
+/* bfclose -- free a filter */
+void bfclose(bloom_t *bf);
+
+/* bfadd -- add a key of keylen bytes to the filter
+ * returns true if the key may have been added before; false if it
+ * certainly was not
+ */
+bool bfadd(bloom_t *bf, const char *key, int keylen);
+
+/* bfcheck -- check for a key without adding it
+ * returns true if the key may have been added; false if not
+ */
+bool bfcheck(bloom_t *bf, const char *key, int keylen);
+
+/* bfbytes -- the memory actually used by the filter */
+size_t bfbytes(bloom_t *bf);
+
+/* bfrate -- the chance that a new key is reported as seen, estimated
+ * from the bits set so far; it grows as keys are added
+ */
+double bfrate(bloom_t *bf);
+
+/* bfsave -- save the filter to a file, as a snapshot of the keys
+ * added so far; keys may be added while it is saved
+ * returns 0 if success and non-zero otherwise
+ */
+int32_t bfsave(bloom_t *bf, char *path);
+
+/* bfload -- add the keys of a filter saved by bfsave(), which must
+ * have been opened with the same nbytes and nhashes as bf
+ * returns 0 if success and non-zero otherwise
+ */
+int32_t bfload(bloom_t *bf, char *path);
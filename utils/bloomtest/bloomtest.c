@@ -0,0 +1,157 @@
+/****************************************************************
+ * file   bloomtest.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   November 26, 2021
+ * 
+ * Tests that the bloom.h module has no false negatives, keeps its
+ * false positive rate within budget and estimates it, saves and
+ * loads its keys, and tells exactly one of several racing threads
+ * that a key is new
+ * 
+****************************************************************/
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include<stdatomic.h>
+#include<pthread.h>
+#include"bloom.h"
+
+/****************************************************************
+ * Define macro, globals and helper functions
+****************************************************************/
+#define eprintf(format, ...) do {                 \
+    if (verbose)                                  \
+        fprintf(stderr, format, ##__VA_ARGS__);   \
+} while(0)
+#define verbose 1
+
+#define __KEYS 100000
+#define __BYTES (__KEYS * 2)        // 16 bits per key
+#define __NHASHES 6
+#define __MAXFP 0.02
+#define __THREADS 4
+#define __SAVED "bloomtest.saved"
+
+bloom_t *bf;
+atomic_int news[__KEYS];
+
+
+/****************************************************************
+ * Keys look like crawler URLs
+****************************************************************/
+static int mkkey(char *buf, int i) {
+    return sprintf(buf, "http://example.org/site/page%d.html", i);
+}
+
+
+/****************************************************************
+ * Racing threads add the same keys and count "new" answers
+****************************************************************/
+void *adder(void *arg) {
+    char key[64];
+    for(int i = 0; i < __KEYS; i++) {
+        int len = mkkey(key, i);
+        if(!bfadd(bf, key, len)) atomic_fetch_add(&news[i], 1);
+    }
+    return NULL;
+}
+
+
+int main(void) {
+
+    int errors = 0;
+    char key[64];
+
+    // Every added key must be found again
+    bf = bfopen(__BYTES, __NHASHES);
+    if(bf == NULL) {
+        eprintf("bfopen(%d, %d) failed\n", __BYTES, __NHASHES);
+        exit(EXIT_FAILURE);
+    }
+    for(int i = 0; i < __KEYS; i++) bfadd(bf, key, mkkey(key, i));
+    for(int i = 0; i < __KEYS; i++) {
+        int len = mkkey(key, i);
+        if(!bfcheck(bf, key, len) || !bfadd(bf, key, len)) {
+            eprintf("false negative for %s\n", key);
+            errors++;
+        }
+    }
+
+    // Keys never added are mostly reported new
+    int fp = 0;
+    for(int i = __KEYS; i < 2 * __KEYS; i++) {
+        if(bfcheck(bf, key, mkkey(key, i))) fp++;
+    }
+    double rate = (double)fp / __KEYS;
+    eprintf("%zu bytes, false positive rate %.4f\n", bfbytes(bf), rate);
+    if(rate > __MAXFP) {
+        eprintf("false positive rate above %.4f\n", __MAXFP);
+        errors++;
+    }
+
+    // The estimate is close to the measured rate
+    double est = bfrate(bf);
+    eprintf("estimated false positive rate %.4f\n", est);
+    if(est < rate / 2 || est > 2 * rate + 0.001) {
+        eprintf("estimate %.4f far from %.4f\n", est, rate);
+        errors++;
+    }
+
+    // A saved filter loads with every key, into a filter of its size
+    bloom_t *back = bfopen(__BYTES, __NHASHES);
+    bloom_t *small = bfopen(__BYTES / 2, __NHASHES);
+    if(bfsave(bf, __SAVED) != 0 || bfload(back, __SAVED) != 0 ||
+       bfload(small, __SAVED) == 0 || bfload(back, "missing.bloom") == 0) {
+        eprintf("%s\n", "bfsave/bfload failed");
+        errors++;
+    }
+    for(int i = 0; i < __KEYS; i++) {
+        if(!bfcheck(back, key, mkkey(key, i))) {
+            eprintf("loaded filter misses %s\n", key);
+            errors++;
+            break;
+        }
+    }
+    remove(__SAVED);
+    bfclose(back);
+    bfclose(small);
+    bfclose(bf);
+
+    // Of several threads adding a key, at most one sees it as new
+    bf = bfopen(__BYTES, __NHASHES);
+    pthread_t threads[__THREADS];
+    for(int i = 0; i < __THREADS; i++) {
+        pthread_create(&threads[i], NULL, adder, NULL);
+    }
+    for(int i = 0; i < __THREADS; i++) pthread_join(threads[i], NULL);
+    int claimed = 0;
+    for(int i = 0; i < __KEYS; i++) {
+        int n = atomic_load(&news[i]);
+        if(n > 1) {
+            eprintf("key %d reported new %d times\n", i, n);
+            errors++;
+        }
+        claimed += n;
+    }
+    if(claimed < (1.0 - __MAXFP) * __KEYS) {
+        eprintf("only %d of %d keys reported new\n", claimed, __KEYS);
+        errors++;
+    }
+    bfclose(bf);
+
+    // Bad arguments
+    if(bfopen(0, __NHASHES) != NULL || bfopen(__BYTES, 0) != NULL) {
+        eprintf("bfopen accepted %s\n", "bad arguments");
+        errors++;
+    }
+
+    if(errors) {
+        eprintf("%d errors\n", errors);
+        exit(EXIT_FAILURE);
+    }
+    eprintf("%s passed\n", "bloom");
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,155 @@
+/****************************************************************
+ * file   bqueue.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   November 24, 2021
+ *
+ * Implementation of a bounded blocking queue on a ring buffer
+ *
+****************************************************************/
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<pthread.h>
+#include"bqueue.h"
+
+
+/****************************************************************
+ * Define queue data structure
+****************************************************************/
+typedef struct bqueue {
+    void **ring;                // Elements, oldest at front
+    int capacity;
+    int front;                  // Index of the oldest element
+    int count;                  // Number of elements in the ring
+    bool shut;                  // Set by bqshut()
+    pthread_mutex_t lock;
+    pthread_cond_t notempty;
+    pthread_cond_t notfull;
+} bq_t;
+
+
+/****************************************************************
+ * bqopen -- create an empty queue of a given capacity
+****************************************************************/
+bqueue_t *bqopen(int capacity) {
+
+    if(capacity < 1) return NULL;
+    bq_t *q;
+    if(!(q = (bq_t*)calloc(1, sizeof(bq_t)))) {
+        printf("Error: malloc failed allocating new queue\n");
+        return NULL;
+    }
+    if(!(q->ring = (void**)calloc(capacity, sizeof(void*)))) {
+        printf("Error: malloc failed allocating new queue\n");
+        free(q);
+        return NULL;
+    }
+    q->capacity = capacity;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->notempty, NULL);
+    pthread_cond_init(&q->notfull, NULL);
+    return (bqueue_t*)q;
+}
+
+
+/****************************************************************
+ * bqclose -- deallocate a queue
+****************************************************************/
+void bqclose(bqueue_t *bqp) {
+
+    if(bqp == NULL) return;
+    bq_t *q = (bq_t*)bqp;
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->notempty);
+    pthread_cond_destroy(&q->notfull);
+    free(q->ring);
+    free(q);
+}
+
+
+/****************************************************************
+ * bqput -- put element at the end of the queue, waiting for room
+****************************************************************/
+int32_t bqput(bqueue_t *bqp, void *elementp) {
+
+    if(bqp == NULL || elementp == NULL) return 1;
+    bq_t *q = (bq_t*)bqp;
+
+    pthread_mutex_lock(&q->lock);
+    while(q->count == q->capacity && !q->shut) {
+        pthread_cond_wait(&q->notfull, &q->lock);
+    }
+    if(q->shut) {
+        pthread_mutex_unlock(&q->lock);
+        return 1;
+    }
+    q->ring[(q->front + q->count) % q->capacity] = elementp;
+    q->count++;
+    pthread_cond_signal(&q->notempty);
+    pthread_mutex_unlock(&q->lock);
+    return 0;
+}
+
+
+/****************************************************************
+ * bqgetn -- get up to max elements, waiting for at least one
+****************************************************************/
+int bqgetn(bqueue_t *bqp, void **out, int max) {
+
+    if(bqp == NULL || out == NULL || max < 1) return 0;
+    bq_t *q = (bq_t*)bqp;
+
+    pthread_mutex_lock(&q->lock);
+    while(q->count == 0 && !q->shut) {
+        pthread_cond_wait(&q->notempty, &q->lock);
+    }
+    int n = 0;
+    while(n < max && q->count > 0) {
+        out[n++] = q->ring[q->front];
+        q->front = (q->front + 1) % q->capacity;
+        q->count--;
+    }
+    if(n > 0) pthread_cond_broadcast(&q->notfull);
+    pthread_mutex_unlock(&q->lock);
+    return n;
+}
+
+
+/****************************************************************
+ * bqget -- get the first element, waiting for one to arrive
+****************************************************************/
+void *bqget(bqueue_t *bqp) {
+    void *elementp = NULL;
+    return bqgetn(bqp, &elementp, 1) == 1 ? elementp : NULL;
+}
+
+
+/****************************************************************
+ * bqsize -- the number of elements currently in the queue
+****************************************************************/
+int bqsize(bqueue_t *bqp) {
+
+    if(bqp == NULL) return 0;
+    bq_t *q = (bq_t*)bqp;
+    pthread_mutex_lock(&q->lock);
+    int n = q->count;
+    pthread_mutex_unlock(&q->lock);
+    return n;
+}
+
+
+/****************************************************************
+ * bqshut -- refuse further puts and wake up all waiting threads
+****************************************************************/
+void bqshut(bqueue_t *bqp) {
+
+    if(bqp == NULL) return;
+    bq_t *q = (bq_t*)bqp;
+    pthread_mutex_lock(&q->lock);
+    q->shut = true;
+    pthread_cond_broadcast(&q->notempty);
+    pthread_cond_broadcast(&q->notfull);
+    pthread_mutex_unlock(&q->lock);
+}
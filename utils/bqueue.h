@@ -0,0 +1,41 @@
+#pragma once
+/*
+ * bqueue.h -- a bounded, blocking, thread safe queue
+ *
+ * Producers block in bqput() while the queue is full and consumers
+ * block in bqget() while it is empty. bqshut() ends the stream: puts
+ * fail from then on and gets return NULL once the queue is drained.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* the queue representation is hidden from users of the module */
+typedef void bqueue_t;
+
+/* bqopen -- create an empty queue holding at most capacity elements */
+bqueue_t *bqopen(int capacity);
+
+/* bqclose -- deallocate a queue; elements still in it are not freed */
+void bqclose(bqueue_t *bqp);
+
+/* bqput -- put element at the end of the queue, waiting for room
+ * returns 0 if successful; nonzero if the queue has been shut
+ */
+int32_t bqput(bqueue_t *bqp, void *elementp);
+
+/* bqget -- get the first element, waiting for one to arrive
+ * returns NULL once the queue has been shut and drained
+ */
+void *bqget(bqueue_t *bqp);
+
+/* bqgetn -- get up to max elements into out[], waiting for at least
+ * one to arrive
+ * returns the number of elements taken; 0 once shut and drained
+ */
+int bqgetn(bqueue_t *bqp, void **out, int max);
+
+/* bqsize -- the number of elements currently in the queue */
+int bqsize(bqueue_t *bqp);
+
+/* bqshut -- refuse further puts and wake up all waiting threads */
+void bqshut(bqueue_t *bqp);
@@ -0,0 +1,90 @@
+/****************************************************************
+ * file   bqueuetest.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   November 24, 2021
+ * 
+ * Tests if the bqueue.h module passes every element from several
+ * producers to several consumers exactly once
+ * 
+****************************************************************/
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<pthread.h>
+#include"bqueue.h"
+
+/****************************************************************
+ * Define macro, globals and helper functions
+****************************************************************/
+#define eprintf(format, ...) do {                 \
+    if (verbose)                                  \
+        fprintf(stderr, format, ##__VA_ARGS__);   \
+} while(0)
+#define verbose 1
+
+#define __PRODUCERS 4
+#define __CONSUMERS 3
+#define __ITEMS 10000
+
+bqueue_t *q;
+int seen[__PRODUCERS * __ITEMS];
+pthread_mutex_t seenlock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/****************************************************************
+ * Producers put __ITEMS numbered elements each; consumers take
+ * them off in batches and count them
+****************************************************************/
+void *producer(void *arg) {
+    int base = *(int*)arg * __ITEMS;
+    for(int i = 0; i < __ITEMS; i++) {
+        int *x = (int*)malloc(sizeof(int));
+        *x = base + i;
+        if(bqput(q, x) != 0) free(x);
+    }
+    return NULL;
+}
+
+void *consumer(void *arg) {
+    void *batch[8];
+    int n;
+    while((n = bqgetn(q, batch, 8)) > 0) {
+        pthread_mutex_lock(&seenlock);
+        for(int i = 0; i < n; i++) {
+            seen[*(int*)batch[i]]++;
+            free(batch[i]);
+        }
+        pthread_mutex_unlock(&seenlock);
+    }
+    return NULL;
+}
+
+
+int main() {
+
+    q = bqopen(16);
+    pthread_t p[__PRODUCERS], c[__CONSUMERS];
+    int who[__PRODUCERS];
+    for(int i = 0; i < __CONSUMERS; i++) {
+        pthread_create(&c[i], NULL, consumer, NULL);
+    }
+    for(int i = 0; i < __PRODUCERS; i++) {
+        who[i] = i;
+        pthread_create(&p[i], NULL, producer, &who[i]);
+    }
+    for(int i = 0; i < __PRODUCERS; i++) pthread_join(p[i], NULL);
+
+    // Consumers must drain what is left after the queue is shut
+    bqshut(q);
+    for(int i = 0; i < __CONSUMERS; i++) pthread_join(c[i], NULL);
+
+    int bad = 0;
+    for(int i = 0; i < __PRODUCERS * __ITEMS; i++) bad += (seen[i] != 1);
+    eprintf("elements lost or duplicated: %d\n", bad);
+    eprintf("put after shut: %d\n", bqput(q, &bad) != 0 ? 0 : 1);
+    eprintf("get after shut: %d\n", bqget(q) == NULL ? 0 : 1);
+    bqclose(q);
+    return bad != 0;
+}
@@ -0,0 +1,233 @@
+/****************************************************************
+ * file   diskset.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   December 12, 2021
+ *
+ * Implementation of an exact set of keys kept in a file. The index
+ * is an open addressing table with linear probing; a slot holds the
+ * top 24 bits of the key's hash and 1 + the offset of the key's line
+ * (so 0 is a free slot). The hashes themselves are not kept, so the
+ * table grows by reading the file again.
+ *
+****************************************************************/
+
+#define _POSIX_C_SOURCE 200809L     // getline, pread
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/types.h>
+#include<sys/stat.h>
+#include<sys/uio.h>
+#include"hash.h"
+#include"log.h"
+#include"diskset.h"
+
+
+/****************************************************************
+ * Define set data structure
+****************************************************************/
+#define __OFFBITS 40                            // Files up to 1 TB
+#define __OFFMASK ((1ULL << __OFFBITS) - 1)
+#define __MINSLOTS 1024
+#define __KEYBUF 2048                           // Keys read on the stack
+
+typedef struct diskset {
+    int fd;                     // Opened for appending
+    uint64_t *slots;
+    uint64_t mask;              // Number of slots - 1 (a power of 2)
+    uint64_t n;                 // Keys in the file
+    uint64_t end;               // Bytes in the file
+} ds_t;
+
+
+/****************************************************************
+ * Private helper function: file the line at off under hash h
+****************************************************************/
+static void insert(uint64_t *slots, uint64_t mask, uint64_t h, uint64_t off) {
+
+    uint64_t i = h & mask;
+    while(slots[i] != 0) i = (i + 1) & mask;
+    slots[i] = (h >> __OFFBITS) << __OFFBITS | (off + 1);
+}
+
+
+/****************************************************************
+ * Private helper function: read the lines of the file from the start
+ * \param ds        The set
+ * \param slots     The table to file the lines in, or NULL to only
+ *                  count them
+ * \param mask      The number of slots - 1
+ * \param n         Set to the number of whole lines
+ * \param end       Set to the offset after the last whole line
+ * \return          0 if success and non-zero otherwise
+****************************************************************/
+static int32_t scan(ds_t *ds, uint64_t *slots, uint64_t mask,
+                    uint64_t *n, uint64_t *end) {
+
+    int fd = dup(ds->fd);
+    FILE *f = fd < 0 ? NULL : fdopen(fd, "r");
+    if(f == NULL) {
+        if(fd >= 0) close(fd);
+        return 1;
+    }
+    fseek(f, 0, SEEK_SET);
+
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    *n = *end = 0;
+    while((len = getline(&line, &cap, f)) > 0 && line[len - 1] == '\n') {
+        if(slots != NULL) insert(slots, mask, hash64(line, len - 1), *end);
+        (*n)++;
+        *end += len;
+    }
+    bool ok = !ferror(f);
+    free(line);
+    fclose(f);
+    return ok ? 0 : 1;
+}
+
+
+/****************************************************************
+ * Private helper function: file the lines of the file in a new table
+ * of at least twice as many slots as lines
+****************************************************************/
+static int32_t rebuild(ds_t *ds, uint64_t n) {
+
+    uint64_t nslots = __MINSLOTS;
+    while(nslots < 2 * (n + 1)) nslots *= 2;
+    uint64_t *slots = (uint64_t*)calloc(nslots, sizeof(uint64_t));
+    if(slots == NULL) {
+        logmsg(LOG_ERROR, "Error: malloc failed allocating set index\n");
+        return 1;
+    }
+    if(scan(ds, slots, nslots - 1, &ds->n, &ds->end) != 0) {
+        free(slots);
+        return 1;
+    }
+    free(ds->slots);
+    ds->slots = slots;
+    ds->mask = nslots - 1;
+    return 0;
+}
+
+
+/****************************************************************
+ * dsopen -- open a set, reading the keys already in its file
+****************************************************************/
+diskset_t *dsopen(char *path, bool keep) {
+
+    if(path == NULL) return NULL;
+    ds_t *ds;
+    if(!(ds = (ds_t*)calloc(1, sizeof(ds_t)))) {
+        logmsg(LOG_ERROR, "Error: malloc failed allocating set\n");
+        return NULL;
+    }
+    int flags = O_RDWR | O_CREAT | O_APPEND | (keep ? 0 : O_TRUNC);
+    if((ds->fd = open(path, flags, 0644)) < 0) {
+        logmsg(LOG_ERROR, "Error: cannot open set file %s\n", path);
+        free(ds);
+        return NULL;
+    }
+
+    // Count the lines first, so the table is filled in one pass, and
+    // cut off a last line without its newline
+    uint64_t n, end;
+    struct stat st;
+    if(scan(ds, NULL, 0, &n, &end) != 0 || fstat(ds->fd, &st) != 0 ||
+       ((uint64_t)st.st_size > end && ftruncate(ds->fd, end) != 0) ||
+       rebuild(ds, n) != 0) {
+        logmsg(LOG_ERROR, "Error: cannot read set file %s\n", path);
+        dsclose(ds);
+        return NULL;
+    }
+    return (diskset_t*)ds;
+}
+
+
+/****************************************************************
+ * dsclose -- close a set
+****************************************************************/
+void dsclose(diskset_t *dsp) {
+
+    if(dsp == NULL) return;
+    ds_t *ds = (ds_t*)dsp;
+    close(ds->fd);
+    free(ds->slots);
+    free(ds);
+}
+
+
+/****************************************************************
+ * dsadd -- append a key and file it
+****************************************************************/
+int32_t dsadd(diskset_t *dsp, const char *key, int keylen) {
+
+    if(dsp == NULL || key == NULL || keylen < 0) return 1;
+    ds_t *ds = (ds_t*)dsp;
+    if(memchr(key, '\n', keylen) != NULL ||
+       ds->end > __OFFMASK - keylen - 1) {
+        return 1;
+    }
+    if((ds->n + 1) * 2 > ds->mask + 1 && rebuild(ds, 2 * ds->n) != 0) {
+        return 1;
+    }
+
+    struct iovec iov[2] = {
+        { .iov_base = (void*)key, .iov_len = keylen },
+        { .iov_base = "\n", .iov_len = 1 }
+    };
+    if(writev(ds->fd, iov, 2) != keylen + 1) {
+        logmsg(LOG_ERROR, "Error: cannot write set file\n");
+        // Drop a partial line, so the file stays one key per line
+        if(ftruncate(ds->fd, ds->end) != 0) ds->end = UINT64_MAX;
+        return 1;
+    }
+    insert(ds->slots, ds->mask, hash64(key, keylen), ds->end);
+    ds->n++;
+    ds->end += keylen + 1;
+    return 0;
+}
+
+
+/****************************************************************
+ * dshas -- probe the slots of the key's hash; a slot whose tag
+ * matches is compared with the line in the file
+****************************************************************/
+bool dshas(diskset_t *dsp, const char *key, int keylen) {
+
+    if(dsp == NULL || key == NULL || keylen < 0) return false;
+    ds_t *ds = (ds_t*)dsp;
+    uint64_t h = hash64(key, keylen);
+    uint64_t tag = h >> __OFFBITS;
+
+    char stack[__KEYBUF];
+    char *buf = keylen + 1 <= __KEYBUF ? stack : (char*)malloc(keylen + 1);
+    if(buf == NULL) return false;
+
+    bool found = false;
+    for(uint64_t i = h & ds->mask; !found && ds->slots[i] != 0;
+        i = (i + 1) & ds->mask) {
+        if(ds->slots[i] >> __OFFBITS != tag) continue;
+        uint64_t off = (ds->slots[i] & __OFFMASK) - 1;
+        found = pread(ds->fd, buf, keylen + 1, off) == keylen + 1 &&
+                buf[keylen] == '\n' && memcmp(buf, key, keylen) == 0;
+    }
+    if(buf != stack) free(buf);
+    return found;
+}
+
+
+/****************************************************************
+ * dssize -- the number of keys added
+****************************************************************/
+uint64_t dssize(diskset_t *dsp) {
+
+    if(dsp == NULL) return 0;
+    return ((ds_t*)dsp)->n;
+}
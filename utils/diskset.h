@@ -0,0 +1,41 @@
+#pragma once
+/*
+ * diskset.h -- an exact set of keys kept in a file
+ *
+ * The keys are appended to a file, one per line, and only a small
+ * index stays in memory: 8 bytes per slot, holding a 24-bit tag of
+ * the key's hash and the key's offset in the file, with at most half
+ * of the slots in use. A lookup reads from the file only the keys
+ * whose slot and tag match, so a key that is absent rarely costs a
+ * read. Keys must not contain a newline. A diskset is not thread
+ * safe.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* the set representation is hidden from users of the module */
+typedef void diskset_t;
+
+/* dsopen -- open a set kept in a file; with keep, the keys already
+ * in the file are kept (a last line cut short by a crash is
+ * dropped), otherwise the file is emptied
+ * returns NULL on failure
+ */
+diskset_t *dsopen(char *path, bool keep);
+
+/* dsclose -- close a set, leaving its file in place */
+void dsclose(diskset_t *ds);
+
+/* dsadd -- add a key of keylen bytes; adding a key twice keeps two
+ * copies in the file
+ * returns 0 if success and non-zero otherwise
+ */
+int32_t dsadd(diskset_t *ds, const char *key, int keylen);
+
+/* dshas -- check for a key
+ * returns true if the key was added; false if not
+ */
+bool dshas(diskset_t *ds, const char *key, int keylen);
+
+/* dssize -- the number of keys added, counting copies */
+uint64_t dssize(diskset_t *ds);
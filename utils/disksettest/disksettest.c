@@ -0,0 +1,138 @@
+/****************************************************************
+ * file   disksettest.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   December 12, 2021
+ *
+ * Tests that the diskset.h module finds every added key and no
+ * other, across the growth of its index, and keeps its keys when
+ * reopened, dropping a last line cut short
+ *
+****************************************************************/
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include"diskset.h"
+
+/****************************************************************
+ * Define macro, globals and helper functions
+****************************************************************/
+#define eprintf(format, ...) do {                 \
+    if (verbose)                                  \
+        fprintf(stderr, format, ##__VA_ARGS__);   \
+} while(0)
+#define verbose 1
+
+#define __KEYS 20000
+#define __LONG 5000                 // Longer than the stack buffer
+#define __FILE "disksettest.set"
+
+
+/****************************************************************
+ * Keys look like crawler URLs
+****************************************************************/
+static int mkkey(char *buf, int i) {
+    return sprintf(buf, "http://example.org/site/page%d.html", i);
+}
+
+
+/****************************************************************
+ * Count the added keys missing from the set, and the others in it
+****************************************************************/
+static int check(diskset_t *ds, int nkeys) {
+    char key[64];
+    int errors = 0;
+    for(int i = 0; i < 2 * __KEYS; i++) {
+        int len = mkkey(key, i);
+        if(dshas(ds, key, len) != (i < nkeys)) {
+            eprintf("%s wrongly %s\n", key, i < nkeys ? "missing" : "found");
+            if(++errors > 10) break;
+        }
+    }
+    if(dssize(ds) != (uint64_t)nkeys) {
+        eprintf("size %lu, expected %d\n", (unsigned long)dssize(ds), nkeys);
+        errors++;
+    }
+    return errors;
+}
+
+
+int main(void) {
+
+    int errors = 0;
+    char key[64];
+
+    // Every added key is found, and no other, while the index grows
+    diskset_t *ds = dsopen(__FILE, false);
+    if(ds == NULL) {
+        eprintf("dsopen(%s) failed\n", __FILE);
+        exit(EXIT_FAILURE);
+    }
+    for(int i = 0; i < __KEYS; i++) {
+        if(dsadd(ds, key, mkkey(key, i)) != 0) {
+            eprintf("dsadd(%s) failed\n", key);
+            errors++;
+        }
+    }
+    errors += check(ds, __KEYS);
+
+    // Keys longer than the stack buffer, and keys with a newline
+    char *big = malloc(__LONG);
+    memset(big, 'x', __LONG);
+    if(dsadd(ds, big, __LONG) != 0 || !dshas(ds, big, __LONG) ||
+       dshas(ds, big, __LONG - 1) || dsadd(ds, "a\nb", 3) == 0) {
+        eprintf("%s\n", "long or bad keys mishandled");
+        errors++;
+    }
+    dsclose(ds);
+
+    // Reopened, the set has the same keys, without a last line that
+    // was cut short
+    FILE *f = fopen(__FILE, "a");
+    fputs("http://example.org/torn", f);
+    fclose(f);
+    ds = dsopen(__FILE, true);
+    if(ds == NULL) {
+        eprintf("dsopen(%s) failed on reopen\n", __FILE);
+        exit(EXIT_FAILURE);
+    }
+    if(!dshas(ds, big, __LONG) || dshas(ds, "http://example.org/torn", 23)) {
+        eprintf("%s\n", "reopened set lost a key or kept a torn one");
+        errors++;
+    }
+    for(int i = __KEYS; i < 2 * __KEYS; i++) dsadd(ds, key, mkkey(key, i));
+    for(int i = 0; i < 2 * __KEYS; i++) {
+        int len = mkkey(key, i);
+        if(!dshas(ds, key, len)) {
+            eprintf("%s missing after reopen\n", key);
+            errors++;
+            break;
+        }
+    }
+    if(dssize(ds) != 2 * __KEYS + 1) {
+        eprintf("size %lu after reopen\n", (unsigned long)dssize(ds));
+        errors++;
+    }
+    dsclose(ds);
+    free(big);
+
+    // Without keep, the set starts empty
+    ds = dsopen(__FILE, false);
+    errors += check(ds, 0);
+    dsclose(ds);
+    remove(__FILE);
+
+    if(dsopen("missing/dir/set", false) != NULL) {
+        eprintf("dsopen accepted %s\n", "a bad path");
+        errors++;
+    }
+
+    if(errors) {
+        eprintf("%d errors\n", errors);
+        exit(EXIT_FAILURE);
+    }
+    eprintf("%s passed\n", "diskset");
+    exit(EXIT_SUCCESS);
+}
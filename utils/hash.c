@@ -25,7 +25,7 @@ typedef struct hashtable {
 } h_t;
 
 /****************************************************************
- * SuperFastHash() -- produces a number between 0 and the tablesize-1.
+ * hash32 -- Paul Hsieh's SuperFastHash.
  * 
  * The following (rather complicated) code, has been taken from Paul
  * Hsieh's website under the terms of the BSD license. It's a hash
@@ -34,7 +34,7 @@ typedef struct hashtable {
 ****************************************************************/
 #define get16bits(d) (*((const uint16_t *) (d)))
 
-static uint32_t SuperFastHash (const char *data,int len,uint32_t tablesize) {
+uint32_t hash32 (const char *data,int len) {
 	uint32_t hash = len, tmp;
 	int rem;
 	
@@ -72,7 +72,32 @@ static uint32_t SuperFastHash (const char *data,int len,uint32_t tablesize) {
 	hash += hash >> 17;
 	hash ^= hash << 25;
 	hash += hash >> 6;
-	return hash % tablesize;
+	return hash;
+}
+
+/****************************************************************
+ * SuperFastHash() -- produces a number between 0 and the tablesize-1.
+****************************************************************/
+static uint32_t SuperFastHash (const char *data,int len,uint32_t tablesize) {
+	return hash32(data, len) % tablesize;
+}
+
+/****************************************************************
+ * hash64 -- FNV-1a over the key followed by the MurmurHash3
+ * finalizer, so that every output bit depends on every input bit
+****************************************************************/
+uint64_t hash64(const char *key, int keylen) {
+	uint64_t hash = 14695981039346656037ULL;
+	for(int i = 0; i < keylen; i++) {
+		hash ^= (unsigned char)key[i];
+		hash *= 1099511628211ULL;
+	}
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ULL;
+	hash ^= hash >> 33;
+	return hash;
 }
 
 /****************************************************************
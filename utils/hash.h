@@ -41,3 +41,10 @@ void *hremove(hashtable_t *htp,
 	      const char *key, 
 	      int32_t keylen);
 
+/* hash32 -- the 32-bit hash that picks a key's bucket */
+uint32_t hash32(const char *key, int keylen);
+
+/* hash64 -- a 64-bit hash of keylen bytes at key, for fingerprints
+ * and filters that need more bits than a bucket index
+ */
+uint64_t hash64(const char *key, int keylen);
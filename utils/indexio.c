@@ -29,29 +29,13 @@
 #include "webpage.h"
 #include "hash.h"
 #include "queue.h"
+#include "log.h"
+#include "indexio.h"
 
 
 /****************************************************************
  * Define macro, structs, globals and helper functions
 ****************************************************************/
-#define eprintf(format, ...) do {                 \
-    if (verbose)                                  \
-        fprintf(stderr, format, ##__VA_ARGS__);   \
-} while(0)
-#define verbose 1
-
-// Associates a list of crawled documents with each crawled word
-typedef struct {
-    char *word;         // The indexed word
-    queue_t *doclist;   // List of associated documents
-} word_t;
-
-// This struct defines doclist elements
-typedef struct {
-    int id;             // Id of the crawled page
-    int freq;           // Frequency of word in page
-} doc_t;
-
 // Global file output
 FILE *outputf;
 
@@ -68,8 +52,15 @@ void pdoc(void *p){
     fprintf(outputf, "%d %d ", doc->id, doc->freq);
 }
 
+static bool anydoc(void *p, const void *s) {
+    return true;
+}
+
 void pword(void *p){
     word_t *word = (word_t*)p;
+
+    // Words left without documents by an index update are dropped
+    if(qsearch(word->doclist, &anydoc, word) == NULL) return;
     fprintf(outputf, "%s ", word->word);
     qapply(word->doclist, &pdoc);
     fprintf(outputf, "\n");
@@ -92,12 +83,12 @@ int32_t indexsave(hashtable_t* htp, char* dirname, char* indexnm) {
 
     // Add some safety  signature
     if(outputf == NULL) {
-        eprintf("Failed to open file %s: error %d\n", filename,
+        logmsg(LOG_ERROR, "Failed to open file %s: error %d\n", filename,
                     errno);
         return -1;
     }
     if(access(filename, W_OK) != 0) {
-        eprintf("Failed to access file %s: error %d\n", filename,
+        logmsg(LOG_ERROR, "Failed to access file %s: error %d\n", filename,
                     errno);
         return -1;
     }
@@ -124,12 +115,12 @@ hashtable_t* indexload(char* dirname, char* indexnm) {
 
     // Add some safety signatures
     if(inputf == NULL) {
-        eprintf("Failed to open file %s: error %d\n", filename,
+        logmsg(LOG_ERROR, "Failed to open file %s: error %d\n", filename,
                     errno);
         return NULL;
     }
     if(access(filename, R_OK) != 0) {
-        eprintf("Failed to access file %s: error %d\n", filename,
+        logmsg(LOG_ERROR, "Failed to access file %s: error %d\n", filename,
                     errno);
         return NULL;
     }
@@ -148,10 +139,7 @@ hashtable_t* indexload(char* dirname, char* indexnm) {
         int id, freq;
         while(fscanf(inputf, "%d %d", &id, &freq) == 2) {
             // Put doc_id and word frequency into struct
-            doc_t *doc = (doc_t*)malloc(sizeof(doc_t));
-            doc->id = id;
-            doc->freq = freq;
-            qput(w->doclist, doc);
+            indexdoc(w, id, freq, NULL);
         }
 
         // Insert word_t into hashtable
@@ -161,3 +149,87 @@ hashtable_t* indexload(char* dirname, char* indexnm) {
     fclose(inputf);
     return h;
 }
+
+
+/****************************************************************
+ * indexmatch - Matches an index entry to a word
+****************************************************************/
+bool indexmatch(void *elementp, const void *keyp) {
+    return !strcmp(((word_t*)elementp)->word, (const char*)keyp);
+}
+
+
+/****************************************************************
+ * indexword - Gets the entry of a word, adding it if it is new
+ * \param htp       Index table (hashtable_t)
+ * \param word      The word (char *)
+ * 
+ * \return          The entry, or NULL if out of memory
+****************************************************************/
+word_t *indexword(hashtable_t *htp, const char *word) {
+    if(htp == NULL || word == NULL) return NULL;
+    word_t *w = (word_t*)hsearch(htp, &indexmatch, word, strlen(word));
+    if(w != NULL) return w;
+
+    if(!(w = (word_t*)malloc(sizeof(word_t)))) return NULL;
+    w->word = (char*)malloc(strlen(word) + 1);
+    w->doclist = qopen();
+    if(w->word == NULL || w->doclist == NULL) {
+        free(w->word);
+        qclose(w->doclist);
+        free(w);
+        return NULL;
+    }
+    strcpy(w->word, word);
+    hput(htp, w, w->word, strlen(w->word));
+    return w;
+}
+
+
+/****************************************************************
+ * indexdoc - Adds a document to the end of a word's doclist
+ * \param w         The entry of the word (word_t)
+ * \param id        Id of the page
+ * \param freq      Frequency of the word in the page
+ * \param pos       The freq positions of the word, or NULL
+ * 
+ * \return          The document, or NULL if out of memory
+****************************************************************/
+doc_t *indexdoc(word_t *w, int id, int freq, const int *pos) {
+    if(w == NULL) return NULL;
+    doc_t *d = (doc_t*)malloc(sizeof(doc_t));
+    if(d == NULL) return NULL;
+    d->id = id;
+    d->freq = freq;
+    d->pos = NULL;
+    if(pos != NULL && freq > 0) {
+        if(!(d->pos = (int*)malloc(freq * sizeof(int)))) {
+            free(d);
+            return NULL;
+        }
+        memcpy(d->pos, pos, freq * sizeof(int));
+    }
+    qput(w->doclist, d);
+    return d;
+}
+
+
+/****************************************************************
+ * indexclose - Frees an index and everything in it
+****************************************************************/
+static void freepos(void *p) {
+    free(((doc_t*)p)->pos);
+}
+
+static void freeword(void *p) {
+    word_t *w = (word_t*)p;
+    free(w->word);
+    qapply(w->doclist, &freepos);
+    qclose(w->doclist);
+}
+
+void indexclose(hashtable_t *htp) {
+    if(htp == NULL) return;
+    happly(htp, &freeword);
+    hclose(htp);
+}
@@ -16,13 +16,20 @@
  * positive integer designating a document, <counti> is a 
  * positive integer designating the number of occurrences of 
  * <word> in <docIDi>; each entry should be placed on the line 
- * separated by a space. 
+ * separated by a space. Positions of the words are not in the
+ * index file; documents are loaded without them, for posload()
+ * (posio.h) to fill in.
+ *
+ * An index is a hash table of word_t, keyed by the word, each with a
+ * queue of doc_t in order of id. The modules that walk an index use
+ * these structs, and build or free one with the functions below.
  * 
 ****************************************************************/
 
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <string.h>
 #include <inttypes.h>
 #include <unistd.h>
@@ -30,8 +37,35 @@
 #include "hash.h"
 #include "queue.h"
 
+// This struct associates a list of crawled documents with each crawled word
+typedef struct {
+    char *word;         // The indexed word
+    queue_t *doclist;   // List of associated documents (doc_t)
+} word_t;
+
+// This struct defines doclist elements
+typedef struct {
+    int id;             // Id of the crawled page
+    int freq;           // Frequency of word in page
+    int *pos;           // Positions of the word in page, or NULL
+} doc_t;
+
 // Loads index from file
 hashtable_t* indexload(char* dirname, char* indexnm);
 
 // Saves index to file
 int32_t indexsave(hashtable_t* htp, char* dirname, char* indexnm);
+
+// Matches an index entry to a word, for hsearch()
+bool indexmatch(void *elementp, const void *keyp);
+
+// Gets the entry of a word, added with an empty doclist if it is new;
+// NULL if out of memory
+word_t *indexword(hashtable_t *htp, const char *word);
+
+// Adds a document to the end of a doclist, with a copy of its freq
+// positions if pos is not NULL; NULL if out of memory
+doc_t *indexdoc(word_t *w, int id, int freq, const int *pos);
+
+// Frees an index, with its words, doclists and positions
+void indexclose(hashtable_t *htp);
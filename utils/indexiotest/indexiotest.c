@@ -21,23 +21,6 @@
 } while(0)
 #define verbose 1
 
-// Associates a list of crawled documents with each crawled word
-typedef struct {
-    char *word;         // The indexed word
-    queue_t *doclist;   // List of associated documents
-} word_t;
-
-// This struct defines doclist elements
-typedef struct {
-    int id;             // Id of the crawled page
-    int freq;           // Frequency of word in page
-} doc_t;
-
-// Frees queue and word in hashtable
-void freeWord(void* word) {free(((word_t*)word)->word); }
-void freeDoc(void *word) {word_t *w = ((word_t*)word); 
-                            qclose(w->doclist); }
-
 
 /****************************************************************
  * Simple difference comparison
@@ -51,8 +34,6 @@ int main() {
     indexsave(index, ".", "indextest2.file");
 
     // Cleanup
-    happly(index, freeWord);
-    happly(index, freeDoc);
-    hclose(index);
+    indexclose(index);
     return 0;
 }
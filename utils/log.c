@@ -0,0 +1,520 @@
+/****************************************************************
+ * file   log.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   December 1, 2021
+ *
+ * Implementation of leveled logging with deferred formatting. Each
+ * thread appends records, a format and its captured arguments, to
+ * its own single-producer ring; a flusher thread formats them.
+ *
+****************************************************************/
+
+#define _POSIX_C_SOURCE 200809L     // nanosleep
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<stdarg.h>
+#include<stddef.h>
+#include<string.h>
+#include<strings.h>
+#include<time.h>
+#include<pthread.h>
+#include<stdatomic.h>
+#include"log.h"
+
+
+/****************************************************************
+ * Define log data structure
+****************************************************************/
+#define __RINGBYTES (64 << 10)      // Ring of each logging thread
+#define __MAXRECORD 2048            // Largest record; longer strings are cut
+#define __MAXSPEC 32                // Longest rewritten conversion spec
+#define __FLUSHMS 10                // Milliseconds between flushes
+
+typedef struct ring {
+    _Atomic size_t head;            // Bytes ever written, by the owner
+    _Atomic size_t tail;            // Bytes ever read, by the flusher
+    struct ring *next;
+    char buf[__RINGBYTES];
+} ring_t;
+
+// A record is this header followed by the captured arguments: integers
+// widened to long long, doubles, long doubles, pointers and strings
+// with their NUL, back to back and unaligned
+typedef struct record {
+    uint32_t len;                   // Of header and arguments
+    uint16_t level;
+    uint16_t nargs;                 // Conversions captured, in order
+    const char *format;
+} record_t;
+
+// A conversion spec, as parsed from a format
+typedef struct spec {
+    char flags[8];
+    bool width, precision;          // Given at all
+    bool wstar, pstar;              // Given as '*', taken from the arguments
+    int w, p;
+    char length;                    // 'H' for hh, 'q' for ll, or as written
+    char conv;
+} spec_t;
+
+static atomic_int level = -1;       // -1 until set up
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static FILE *out = NULL;
+static ring_t *rings = NULL;        // Every ring made, guarded by lock
+static pthread_t flusher;
+static bool running = false;        // Flusher started and not stopped
+static bool stop = false;
+static atomic_bool direct = false;  // Format at the call instead
+static atomic_int dropped = 0;
+
+static _Thread_local ring_t *myring = NULL;
+
+
+/****************************************************************
+ * Private helper function: parse a level name or number
+****************************************************************/
+static int parselevel(const char *s) {
+    static const char *names[] = {"error", "warn", "info", "debug"};
+    for(int i = 0; i <= LOG_DEBUG; i++) {
+        if(!strcasecmp(s, names[i])) return i;
+    }
+    if(s[0] >= '0' && s[0] <= '0' + LOG_DEBUG && s[1] == '\0') return s[0] - '0';
+    return -1;
+}
+
+
+/****************************************************************
+ * Private helper function: parse the next conversion spec of a
+ * format, after its '%'
+ * returns the character after the spec
+****************************************************************/
+static const char *parsespec(const char *f, spec_t *s) {
+    memset(s, 0, sizeof(*s));
+    int n = 0;
+    while(*f && strchr("-+ #0'", *f) && n < (int)sizeof(s->flags) - 1) {
+        s->flags[n++] = *f++;
+    }
+    if(*f == '*') {
+        s->width = s->wstar = true;
+        f++;
+    }
+    else if(*f >= '0' && *f <= '9') {
+        s->width = true;
+        s->w = strtol(f, (char**)&f, 10);
+    }
+    if(*f == '.') {
+        s->precision = true;
+        if(*++f == '*') {
+            s->pstar = true;
+            f++;
+        }
+        else {
+            s->p = strtol(f, (char**)&f, 10);
+        }
+    }
+    if(*f == 'h' || *f == 'l') {
+        s->length = *f++;
+        if(*f == s->length) {
+            s->length = *f == 'h' ? 'H' : 'q';
+            f++;
+        }
+    }
+    else if(*f && strchr("jztL", *f)) {
+        s->length = *f++;
+    }
+    s->conv = *f;
+    return *f ? f + 1 : f;
+}
+
+
+/****************************************************************
+ * Private helper function: append n bytes to a record, if they fit
+****************************************************************/
+static bool put(char *rec, size_t *len, const void *src, size_t n) {
+    if(*len + n > __MAXRECORD) return false;
+    memcpy(rec + *len, src, n);
+    *len += n;
+    return true;
+}
+
+
+/****************************************************************
+ * Private helper function: capture the arguments of a format into
+ * a record, which must hold __MAXRECORD bytes
+ * returns the length of the record
+****************************************************************/
+static size_t capture(char *rec, int lvl, const char *format, va_list ap) {
+
+    size_t len = sizeof(record_t);
+    int nargs = 0;
+    bool fits = true;
+    for(const char *f = format; fits && (f = strchr(f, '%')) != NULL; ) {
+        if(f[1] == '%') {
+            f += 2;
+            continue;
+        }
+        spec_t s;
+        f = parsespec(f + 1, &s);
+        int w = s.wstar ? va_arg(ap, int) : 0;
+        int p = s.pstar ? va_arg(ap, int) : s.p;
+        fits = (!s.wstar || put(rec, &len, &w, sizeof(w))) &&
+               (!s.pstar || put(rec, &len, &p, sizeof(p)));
+
+        switch(s.conv) {
+        case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c': {
+            bool sign = s.conv == 'd' || s.conv == 'i';
+            long long v;
+            if(s.length == 'l') {
+                v = sign ? va_arg(ap, long) : (long long)va_arg(ap, unsigned long);
+            }
+            else if(s.length == 'q') v = va_arg(ap, long long);
+            else if(s.length == 'j') v = (long long)va_arg(ap, intmax_t);
+            else if(s.length == 'z') v = (long long)va_arg(ap, size_t);
+            else if(s.length == 't') v = (long long)va_arg(ap, ptrdiff_t);
+            else v = sign ? va_arg(ap, int) : (long long)va_arg(ap, unsigned);
+            // Narrow as printf() would, since the value is printed as ll
+            if(s.length == 'H') v = sign ? (signed char)v : (unsigned char)v;
+            if(s.length == 'h') v = sign ? (short)v : (unsigned short)v;
+            fits = fits && put(rec, &len, &v, sizeof(v));
+            break;
+        }
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+            if(s.length == 'L') {
+                long double v = va_arg(ap, long double);
+                fits = fits && put(rec, &len, &v, sizeof(v));
+            }
+            else {
+                double v = va_arg(ap, double);
+                fits = fits && put(rec, &len, &v, sizeof(v));
+            }
+            break;
+        case 'p': {
+            void *v = va_arg(ap, void*);
+            fits = fits && put(rec, &len, &v, sizeof(v));
+            break;
+        }
+        case 's': {
+            // Copy no more than the precision, and cut what does not fit
+            const char *v = va_arg(ap, const char*);
+            if(v == NULL) v = "(null)";
+            size_t n = s.precision && p >= 0 ? strnlen(v, p) : strlen(v);
+            if(fits && len + n + 1 > __MAXRECORD) n = __MAXRECORD - len - 1;
+            fits = fits && len + 1 <= __MAXRECORD;
+            if(fits) {
+                memcpy(rec + len, v, n);
+                rec[len + n] = '\0';
+                len += n + 1;
+            }
+            break;
+        }
+        default:                    // %n and unknown conversions end the message
+            fits = false;
+            break;
+        }
+        if(fits) nargs++;
+    }
+
+    record_t h = {len, lvl, nargs, format};
+    memcpy(rec, &h, sizeof(h));
+    return len;
+}
+
+
+/****************************************************************
+ * Private helper function: format a record to out, printing the
+ * format up to the first conversion not captured
+****************************************************************/
+static void render(const char *rec) {
+
+    record_t h;
+    memcpy(&h, rec, sizeof(h));
+    const char *a = rec + sizeof(h);
+    const char *f = h.format;
+    for(int i = 0; ; i++) {
+        // Copy the text up to the next conversion, unescaping "%%"
+        const char *pct;
+        while((pct = strchr(f, '%')) != NULL && pct[1] == '%') {
+            fwrite(f, 1, pct + 1 - f, out);
+            f = pct + 2;
+        }
+        if(pct == NULL) {
+            fputs(f, out);
+            return;
+        }
+        fwrite(f, 1, pct - f, out);
+        if(i == h.nargs) return;
+
+        spec_t s;
+        f = parsespec(pct + 1, &s);
+        int w = s.w, p = s.p;
+        if(s.wstar) {
+            memcpy(&w, a, sizeof(w));
+            a += sizeof(w);
+        }
+        if(s.pstar) {
+            memcpy(&p, a, sizeof(p));
+            a += sizeof(p);
+        }
+
+        // Rebuild the spec with the width and precision filled in, and
+        // the length of the captured value
+        char spec[__MAXSPEC];
+        int n = snprintf(spec, sizeof(spec), "%%%s", s.flags);
+        if(s.width) n += snprintf(spec + n, sizeof(spec) - n, "%d", w);
+        if(s.precision) n += snprintf(spec + n, sizeof(spec) - n, ".%d", p);
+        bool integer = strchr("diuoxX", s.conv) != NULL;
+        snprintf(spec + n, sizeof(spec) - n, "%s%c",
+                 integer ? "ll" : s.length == 'L' ? "L" : "", s.conv);
+
+        switch(s.conv) {
+        case 's':
+            fprintf(out, spec, a);
+            a += strlen(a) + 1;
+            break;
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+            if(s.length == 'L') {
+                long double v;
+                memcpy(&v, a, sizeof(v));
+                a += sizeof(v);
+                fprintf(out, spec, v);
+            }
+            else {
+                double v;
+                memcpy(&v, a, sizeof(v));
+                a += sizeof(v);
+                fprintf(out, spec, v);
+            }
+            break;
+        case 'p': {
+            void *v;
+            memcpy(&v, a, sizeof(v));
+            a += sizeof(v);
+            fprintf(out, spec, v);
+            break;
+        }
+        default: {
+            long long v;
+            memcpy(&v, a, sizeof(v));
+            a += sizeof(v);
+            if(s.conv == 'c') fprintf(out, spec, (int)v);
+            else fprintf(out, spec, v);
+            break;
+        }
+        }
+    }
+}
+
+
+/****************************************************************
+ * Private helper functions: copy bytes into and out of a ring at
+ * a position, wrapping around its end
+****************************************************************/
+static void ringput(ring_t *r, size_t pos, const char *src, size_t n) {
+    size_t off = pos % __RINGBYTES;
+    size_t first = n < __RINGBYTES - off ? n : __RINGBYTES - off;
+    memcpy(r->buf + off, src, first);
+    memcpy(r->buf, src + first, n - first);
+}
+
+static void ringget(const ring_t *r, size_t pos, char *dst, size_t n) {
+    size_t off = pos % __RINGBYTES;
+    size_t first = n < __RINGBYTES - off ? n : __RINGBYTES - off;
+    memcpy(dst, r->buf + off, first);
+    memcpy(dst + first, r->buf, n - first);
+}
+
+
+/****************************************************************
+ * Private helper function: format every record in the rings. The
+ * caller holds lock, so there is one reader at a time.
+****************************************************************/
+static void drain(void) {
+    char rec[__MAXRECORD];
+    for(ring_t *r = rings; r != NULL; r = r->next) {
+        size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+        size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+        while(tail < head) {
+            record_t h;
+            ringget(r, tail, (char*)&h, sizeof(h));
+            ringget(r, tail, rec, h.len);
+            render(rec);
+            tail += h.len;
+            atomic_store_explicit(&r->tail, tail, memory_order_release);
+        }
+    }
+    int n = atomic_exchange(&dropped, 0);
+    if(n > 0) fprintf(out, "Warning: dropped %d log messages\n", n);
+    fflush(out);
+}
+
+
+/****************************************************************
+ * Private helper function: flusher thread. Formats what was logged
+ * every __FLUSHMS milliseconds, or sooner when woken.
+****************************************************************/
+static void *flush(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&lock);
+    while(!stop) {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += __FLUSHMS * 1000000L;
+        if(until.tv_nsec >= 1000000000L) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&wake, &lock, &until);
+        drain();
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+
+/****************************************************************
+ * Private helper function: set up the module on first use
+****************************************************************/
+static void setup(void) {
+    const char *env = getenv("TSE_LOG");
+    int lvl = env ? parselevel(env) : -1;
+    int unset = -1;
+    atomic_compare_exchange_strong(&level, &unset, lvl >= 0 ? lvl : LOG_INFO);
+
+    pthread_mutex_lock(&lock);
+    if(out == NULL) out = stdout;
+    running = pthread_create(&flusher, NULL, flush, NULL) == 0;
+    atomic_store(&direct, !running);
+    pthread_mutex_unlock(&lock);
+    atexit(logclose);
+}
+
+
+/****************************************************************
+ * loginit -- choose where messages go
+****************************************************************/
+void loginit(FILE *fp) {
+    pthread_once(&once, setup);
+    pthread_mutex_lock(&lock);
+    drain();
+    out = fp ? fp : stdout;
+    pthread_mutex_unlock(&lock);
+}
+
+
+/****************************************************************
+ * logsetlevel, logenabled -- set and check the level
+****************************************************************/
+void logsetlevel(int lvl) {
+    pthread_once(&once, setup);
+    atomic_store(&level, lvl);
+}
+
+bool logenabled(int lvl) {
+    int cur = atomic_load_explicit(&level, memory_order_relaxed);
+    if(cur < 0) {
+        pthread_once(&once, setup);
+        cur = atomic_load(&level);
+    }
+    return lvl <= cur;
+}
+
+
+/****************************************************************
+ * Private helper function: the ring of the calling thread, made
+ * on its first message
+****************************************************************/
+static ring_t *getring(void) {
+    if(myring != NULL) return myring;
+    ring_t *r = (ring_t*)malloc(sizeof(ring_t));
+    if(r == NULL) return NULL;
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    pthread_mutex_lock(&lock);
+    r->next = rings;
+    rings = r;
+    pthread_mutex_unlock(&lock);
+    return myring = r;
+}
+
+
+/****************************************************************
+ * logmsg -- capture a message into the thread's ring
+****************************************************************/
+void logmsg(int lvl, const char *format, ...) {
+
+    if(format == NULL || !logenabled(lvl)) return;
+    char rec[__MAXRECORD];
+    va_list ap;
+    va_start(ap, format);
+    size_t len = capture(rec, lvl, format, ap);
+    va_end(ap);
+
+    ring_t *r = atomic_load(&direct) ? NULL : getring();
+    if(r == NULL) {
+        pthread_mutex_lock(&lock);
+        render(rec);
+        fflush(out);
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+
+    // Only this thread moves head; wait for the flusher to move tail
+    // if the ring is full, unless the message can be dropped
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    size_t used;
+    while((used = head - atomic_load_explicit(&r->tail, memory_order_acquire))
+          + len > __RINGBYTES) {
+        if(lvl >= LOG_INFO) {
+            atomic_fetch_add(&dropped, 1);
+            return;
+        }
+        pthread_cond_signal(&wake);
+        nanosleep(&(struct timespec){0, 100000}, NULL);
+    }
+    ringput(r, head, rec, len);
+    atomic_store_explicit(&r->head, head + len, memory_order_release);
+
+    // Wake the flusher early once the ring is half full
+    if(used < __RINGBYTES / 2 && used + len >= __RINGBYTES / 2) {
+        pthread_cond_signal(&wake);
+    }
+}
+
+
+/****************************************************************
+ * logflush -- format everything logged so far
+****************************************************************/
+void logflush(void) {
+    pthread_once(&once, setup);
+    pthread_mutex_lock(&lock);
+    drain();
+    pthread_mutex_unlock(&lock);
+}
+
+
+/****************************************************************
+ * logclose -- stop the flusher after a last drain; messages logged
+ * afterwards are formatted as they are logged
+****************************************************************/
+void logclose(void) {
+    if(atomic_load(&direct)) return;
+    pthread_mutex_lock(&lock);
+    bool join = running;
+    if(running) {
+        stop = true;
+        running = false;
+        pthread_cond_signal(&wake);
+    }
+    pthread_mutex_unlock(&lock);
+    if(join) pthread_join(flusher, NULL);
+
+    pthread_mutex_lock(&lock);
+    atomic_store(&direct, true);
+    if(out != NULL) drain();
+    pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,52 @@
+#pragma once
+/*
+ * log.h -- leveled, asynchronous logging
+ *
+ * logmsg() does not format its message. It copies the arguments, as
+ * binary values, into a ring buffer of the calling thread (strings
+ * are copied too, so they may be freed right away) and returns; a
+ * background thread formats the messages and writes them out. Each
+ * thread has its own ring with a single reader, so logging takes no
+ * locks. A thread that fills its ring drops info and debug messages
+ * and waits for room for warnings and errors.
+ *
+ * Messages of one thread come out in order; messages of different
+ * threads may interleave differently than they were logged. The
+ * format must be a string literal. Conversions are as in printf(),
+ * except %n.
+ *
+ * The level is read from the TSE_LOG environment variable (error,
+ * warn, info or debug; info if unset) when the first message is
+ * logged, and can be changed at any time with logsetlevel().
+ * Messages are written to stdout unless loginit() says otherwise;
+ * whatever is left is flushed at exit.
+ */
+#include <stdio.h>
+#include <stdbool.h>
+
+/* the levels, most severe first */
+#define LOG_ERROR 0
+#define LOG_WARN 1
+#define LOG_INFO 2
+#define LOG_DEBUG 3
+
+/* loginit -- send messages to out, from the next one on; the level
+ * is also read from TSE_LOG if this is the first call into the module
+ */
+void loginit(FILE *out);
+
+/* logsetlevel -- log only messages at level or more severe */
+void logsetlevel(int level);
+
+/* logenabled -- whether messages at level are logged */
+bool logenabled(int level);
+
+/* logmsg -- log a message at a level, formatted later as printf() would */
+void logmsg(int level, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/* logflush -- wait until every message logged so far is written out */
+void logflush(void);
+
+/* logclose -- flush and stop the background thread; called at exit */
+void logclose(void);
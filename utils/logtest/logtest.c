@@ -0,0 +1,187 @@
+/****************************************************************
+ * file   logtest.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   December 1, 2021
+ *
+ * Tests that the log.h module formats captured arguments as printf
+ * would, filters by level, keeps each thread's messages in order,
+ * accounts for dropped messages, and times a message
+ *
+****************************************************************/
+
+#define _POSIX_C_SOURCE 200809L     // open_memstream, clock_gettime
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include<time.h>
+#include<pthread.h>
+#include"log.h"
+
+/****************************************************************
+ * Define macro, globals and helper functions
+****************************************************************/
+#define eprintf(format, ...) do {                 \
+    if (verbose)                                  \
+        fprintf(stderr, format, ##__VA_ARGS__);   \
+} while(0)
+#define verbose 1
+
+#define __THREADS 8
+#define __MESSAGES 10000            // Logged by each thread
+#define __FLOOD 200000              // Info messages logged in a burst
+#define __TIMED 1000000
+#define __BURST 500                // Messages timed between flushes
+#define __URL "http://example.com/page.html"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+/****************************************************************
+ * Private helper function: thread that logs numbered warnings,
+ * which are never dropped
+****************************************************************/
+static void *worker(void *arg) {
+    int t = *(int*)arg;
+    for(int i = 0; i < __MESSAGES; i++) {
+        logmsg(LOG_WARN, "thread %d message %d\n", t, i);
+    }
+    return NULL;
+}
+
+
+int main(void) {
+
+    int errors = 0;
+    char *log = NULL;
+    size_t len = 0;
+    FILE *fp = open_memstream(&log, &len);
+    loginit(fp);
+    logsetlevel(LOG_INFO);
+
+    // Every kind of conversion comes out as printf() would print it
+    char want[1024], word[] = "before";
+    int n = 0;
+    long long big = -1234567890123LL;
+    void *ptr = &n;
+#define CASE(format, ...) do {                                          \
+        logmsg(LOG_INFO, format, __VA_ARGS__);                          \
+        n += snprintf(want + n, sizeof(want) - n, format, __VA_ARGS__); \
+    } while(0)
+    CASE("%d %i %u %x %X %o|\n", -42, 7, 3000000000u, 255, 255, 8);
+    CASE("%ld %lld %zu %hhd %hu %05d\n", -5L, big, sizeof(big), (char)300,
+         70000 & 0xffff, 42);
+    CASE("%5.2f|%-8s|%8s|%e|%g|%Lf\n", 3.14159, "left", "right", 1e-9, 0.5,
+         (long double)2.5);
+    CASE("%.*s|%*d|%-*d|%c|%%|%.3s\n", 3, "abcdef", 6, 17, 4, 9, 'x', "truncated");
+    CASE("%p %s\n", ptr, word);
+#undef CASE
+    strcpy(word, "after");          // The string was copied when logged
+    logmsg(LOG_DEBUG, "%s\n", "filtered");
+    logflush();
+    if(strcmp(log, want)) {
+        eprintf("logged:\n%sexpected:\n%s", log, want);
+        errors++;
+    }
+
+    // Levels can be changed at run time
+    logsetlevel(LOG_WARN);
+    if(logenabled(LOG_INFO) || !logenabled(LOG_WARN) || !logenabled(LOG_ERROR)) {
+        eprintf("%s\n", "wrong levels enabled");
+        errors++;
+    }
+    size_t before = len;
+    logmsg(LOG_INFO, "%s\n", "filtered");
+    logflush();
+    if(len != before) {
+        eprintf("%s\n", "info message logged at warn level");
+        errors++;
+    }
+
+    // Each thread's messages come out complete and in order
+    fclose(fp);
+    free(log);
+    fp = open_memstream(&log, &len);
+    loginit(fp);
+    pthread_t threads[__THREADS];
+    int ids[__THREADS], next[__THREADS] = {0};
+    for(int i = 0; i < __THREADS; i++) {
+        ids[i] = i;
+        pthread_create(&threads[i], NULL, worker, &ids[i]);
+    }
+    for(int i = 0; i < __THREADS; i++) pthread_join(threads[i], NULL);
+    logflush();
+    for(char *line = log; line < log + len; line = strchr(line, '\n') + 1) {
+        int t, i;
+        if(sscanf(line, "thread %d message %d", &t, &i) != 2 || t < 0 ||
+           t >= __THREADS || i != next[t]++) {
+            eprintf("%s\n", "messages out of order");
+            errors++;
+            break;
+        }
+    }
+    for(int i = 0; i < __THREADS; i++) {
+        if(next[i] != __MESSAGES) {
+            eprintf("thread %d logged %d messages\n", i, next[i]);
+            errors++;
+        }
+    }
+
+    // A burst of info messages may be cut short, but is counted
+    fclose(fp);
+    free(log);
+    fp = open_memstream(&log, &len);
+    loginit(fp);
+    logsetlevel(LOG_INFO);
+    for(int i = 0; i < __FLOOD; i++) logmsg(LOG_INFO, "flood %d\n", i);
+    logflush();
+    int logged = 0, dropped = 0;
+    for(char *line = log; line < log + len; line = strchr(line, '\n') + 1) {
+        int d;
+        if(!strncmp(line, "flood", 5)) logged++;
+        else if(sscanf(line, "Warning: dropped %d", &d) == 1) dropped += d;
+    }
+    eprintf("%d of %d messages dropped in a burst\n", dropped, __FLOOD);
+    if(logged + dropped != __FLOOD) {
+        eprintf("%d logged and %d dropped\n", logged, dropped);
+        errors++;
+    }
+    fclose(fp);
+    free(log);
+
+    // Cost of a message to the caller, in bursts the ring holds, against
+    // formatting it with fprintf()
+    fp = fopen("/dev/null", "w");
+    loginit(fp);
+    double logged_ns = 0;
+    for(int i = 0; i < __TIMED; i += __BURST) {
+        double start = now();
+        for(int j = i; j < i + __BURST; j++) {
+            logmsg(LOG_INFO, "Level %d -- Scanning %s\n", j, __URL);
+        }
+        logged_ns += now() - start;
+        logflush();
+    }
+    logged_ns /= __TIMED;
+    double start = now();
+    for(int i = 0; i < __TIMED; i++) {
+        fprintf(fp, "Level %d -- Scanning %s\n", i, __URL);
+    }
+    eprintf("%.1f ns per message, %.1f ns per fprintf\n", logged_ns,
+            (now() - start) / __TIMED);
+    logclose();
+    fclose(fp);
+
+    if(errors) {
+        eprintf("%d errors\n", errors);
+        exit(EXIT_FAILURE);
+    }
+    eprintf("%s passed\n", "log");
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,429 @@
+/****************************************************************
+ * file   metrics.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   November 30, 2021
+ *
+ * Implementation of per-thread counters and log-linear latency
+ * histograms, summed up into JSON snapshots by mtdump() or by a
+ * background dumper thread.
+ *
+****************************************************************/
+
+#define _POSIX_C_SOURCE 200809L     // clock_gettime, open_memstream
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<inttypes.h>
+#include<string.h>
+#include<time.h>
+#include<pthread.h>
+#include<stdatomic.h>
+#include<unistd.h>
+#include<sys/socket.h>
+#include<sys/un.h>
+#include"metrics.h"
+
+
+/****************************************************************
+ * Define metrics data structure
+****************************************************************/
+#define __MAXCOUNTERS 32
+#define __MAXHISTOGRAMS 16
+#define __MAXGAUGES 16
+#define __MAXSHARDS 256             // Most threads that update metrics
+#define __MAXNAME 32
+#define __SUBBITS 4                 // 16 buckets per power of two
+#define __SUB (1 << __SUBBITS)
+#define __BUCKETS ((64 - __SUBBITS + 1) * __SUB)
+
+// Only the owning thread writes to a shard, so updates are a relaxed
+// load and store; the atomics only keep the dumper's reads whole
+#define __BUMP(a, n) atomic_store_explicit(&(a), \
+    atomic_load_explicit(&(a), memory_order_relaxed) + (n), memory_order_relaxed)
+
+typedef struct histogram {
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum;
+    _Atomic uint64_t max;
+    _Atomic uint64_t buckets[__BUCKETS];
+} hist_t;
+
+typedef struct shard {
+    pthread_t owner;
+    int nhistograms;                // Histograms registered when created
+    _Atomic uint64_t counters[__MAXCOUNTERS];
+    hist_t hists[];
+} shard_t;
+
+typedef struct gauge {
+    char name[__MAXNAME];
+    long (*fn)(void);
+} gauge_t;
+
+typedef struct metrics {
+    uint64_t serial;                // Tells apart metrics at the same address
+    uint64_t start;                 // mtnow() at mtopen()
+    char counters[__MAXCOUNTERS][__MAXNAME];
+    char histograms[__MAXHISTOGRAMS][__MAXNAME];
+    gauge_t gauges[__MAXGAUGES];
+    int ncounters, nhistograms, ngauges;
+
+    shard_t *shards[__MAXSHARDS];
+    atomic_int nshards;
+    pthread_mutex_t lock;           // Held while adding a shard
+
+    // Background dumper
+    bool dumping;
+    bool stop;
+    char *dest;
+    int intervalms;
+    pthread_t dumper;
+    pthread_cond_t wake;
+} mt_t;
+
+static atomic_ullong serials = 0;
+
+// The shard of the current thread, for the metrics it last updated
+static _Thread_local uint64_t myserial = 0;
+static _Thread_local shard_t *myshard = NULL;
+
+
+/****************************************************************
+ * mtnow -- a monotonic clock, in nanoseconds
+****************************************************************/
+uint64_t mtnow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/****************************************************************
+ * mtopen -- open an empty set of metrics
+****************************************************************/
+metrics_t *mtopen(void) {
+
+    mt_t *m;
+    if(!(m = (mt_t*)calloc(1, sizeof(mt_t)))) {
+        printf("Error: malloc failed allocating metrics\n");
+        return NULL;
+    }
+    m->serial = atomic_fetch_add(&serials, 1) + 1;
+    m->start = mtnow();
+    pthread_mutex_init(&m->lock, NULL);
+    pthread_cond_init(&m->wake, NULL);
+    return (metrics_t*)m;
+}
+
+
+/****************************************************************
+ * Private helper function: register a name in a table
+****************************************************************/
+static int addname(char table[][__MAXNAME], int *n, int max, const char *name) {
+    if(*n == max || name == NULL) return -1;
+    snprintf(table[*n], __MAXNAME, "%s", name);
+    return (*n)++;
+}
+
+
+/****************************************************************
+ * mtcounter, mthistogram, mtgauge -- register a metric
+****************************************************************/
+int mtcounter(metrics_t *mp, const char *name) {
+    if(mp == NULL) return -1;
+    mt_t *m = (mt_t*)mp;
+    return addname(m->counters, &m->ncounters, __MAXCOUNTERS, name);
+}
+
+int mthistogram(metrics_t *mp, const char *name) {
+    if(mp == NULL) return -1;
+    mt_t *m = (mt_t*)mp;
+    return addname(m->histograms, &m->nhistograms, __MAXHISTOGRAMS, name);
+}
+
+int32_t mtgauge(metrics_t *mp, const char *name, long (*fn)(void)) {
+    if(mp == NULL || name == NULL || fn == NULL) return 1;
+    mt_t *m = (mt_t*)mp;
+    if(m->ngauges == __MAXGAUGES) return 1;
+    snprintf(m->gauges[m->ngauges].name, __MAXNAME, "%s", name);
+    m->gauges[m->ngauges++].fn = fn;
+    return 0;
+}
+
+
+/****************************************************************
+ * Private helper function: the shard of the calling thread, found
+ * or added on its first update; NULL if there are too many threads
+****************************************************************/
+static shard_t *shard(mt_t *m) {
+
+    if(myserial == m->serial) return myshard;
+
+    pthread_mutex_lock(&m->lock);
+    shard_t *s = NULL;
+    int n = atomic_load(&m->nshards);
+    for(int i = 0; i < n && s == NULL; i++) {
+        if(pthread_equal(m->shards[i]->owner, pthread_self())) s = m->shards[i];
+    }
+    if(s == NULL && n < __MAXSHARDS) {
+        s = (shard_t*)calloc(1, sizeof(shard_t) + m->nhistograms * sizeof(hist_t));
+        if(s != NULL) {
+            s->owner = pthread_self();
+            s->nhistograms = m->nhistograms;
+            m->shards[n] = s;
+            atomic_store(&m->nshards, n + 1);
+        }
+    }
+    pthread_mutex_unlock(&m->lock);
+
+    myserial = m->serial;
+    myshard = s;
+    return s;
+}
+
+
+/****************************************************************
+ * Private helper functions: the bucket of a value, and the largest
+ * value in a bucket. Values below __SUB have a bucket each; above,
+ * each power of two is split into __SUB buckets.
+****************************************************************/
+static int bucket(uint64_t v) {
+    if(v < __SUB) return v;
+    int shift = 63 - __builtin_clzll(v) - __SUBBITS;
+    return (shift + 1) * __SUB + (int)((v >> shift) - __SUB);
+}
+
+static uint64_t bucketmax(int b) {
+    if(b < __SUB) return b;
+    int shift = b / __SUB - 1;
+    return ((uint64_t)(__SUB + b % __SUB + 1) << shift) - 1;
+}
+
+
+/****************************************************************
+ * mtadd -- add n to a counter
+****************************************************************/
+void mtadd(metrics_t *mp, int counter, long n) {
+    if(mp == NULL || counter < 0 || counter >= __MAXCOUNTERS) return;
+    shard_t *s = shard((mt_t*)mp);
+    if(s != NULL) __BUMP(s->counters[counter], n);
+}
+
+
+/****************************************************************
+ * mtrecord -- record a latency in a histogram
+****************************************************************/
+void mtrecord(metrics_t *mp, int histogram, uint64_t ns) {
+    if(mp == NULL || histogram < 0) return;
+    shard_t *s = shard((mt_t*)mp);
+    if(s == NULL || histogram >= s->nhistograms) return;
+    hist_t *h = &s->hists[histogram];
+    __BUMP(h->count, 1);
+    __BUMP(h->sum, ns);
+    __BUMP(h->buckets[bucket(ns)], 1);
+    if(ns > atomic_load_explicit(&h->max, memory_order_relaxed)) {
+        atomic_store_explicit(&h->max, ns, memory_order_relaxed);
+    }
+}
+
+
+/****************************************************************
+ * mtsince -- record the time since start
+****************************************************************/
+uint64_t mtsince(metrics_t *mp, int histogram, uint64_t start) {
+    if(mp == NULL) return 0;
+    uint64_t now = mtnow();
+    mtrecord(mp, histogram, now - start);
+    return now;
+}
+
+
+/****************************************************************
+ * Private helper function: the value below which a fraction q of
+ * the recorded values fall
+****************************************************************/
+static uint64_t percentile(const uint64_t *buckets, uint64_t count,
+                           uint64_t max, double q) {
+    uint64_t rank = (uint64_t)(q * count + 0.5), seen = 0;
+    if(rank < 1) rank = 1;
+    for(int b = 0; b < __BUCKETS; b++) {
+        if((seen += buckets[b]) >= rank) {
+            uint64_t v = bucketmax(b);
+            return v < max ? v : max;
+        }
+    }
+    return max;
+}
+
+
+/****************************************************************
+ * mtdump -- sum up the shards and write a snapshot line
+****************************************************************/
+int32_t mtdump(metrics_t *mp, FILE *fp) {
+
+    if(mp == NULL || fp == NULL) return 1;
+    mt_t *m = (mt_t*)mp;
+    int nshards = atomic_load(&m->nshards);
+
+    fprintf(fp, "{\"time\":%" PRIu64 ",\"counters\":{",
+            (mtnow() - m->start) / 1000000);
+    for(int c = 0; c < m->ncounters; c++) {
+        uint64_t total = 0;
+        for(int i = 0; i < nshards; i++) {
+            total += atomic_load_explicit(&m->shards[i]->counters[c],
+                                          memory_order_relaxed);
+        }
+        fprintf(fp, "%s\"%s\":%" PRIu64, c ? "," : "", m->counters[c], total);
+    }
+
+    fprintf(fp, "},\"gauges\":{");
+    for(int g = 0; g < m->ngauges; g++) {
+        fprintf(fp, "%s\"%s\":%ld", g ? "," : "", m->gauges[g].name,
+                m->gauges[g].fn());
+    }
+
+    fprintf(fp, "},\"histograms\":{");
+    uint64_t buckets[__BUCKETS];
+    for(int h = 0; h < m->nhistograms; h++) {
+        uint64_t count = 0, sum = 0, max = 0;
+        memset(buckets, 0, sizeof(buckets));
+        for(int i = 0; i < nshards; i++) {
+            if(h >= m->shards[i]->nhistograms) continue;
+            hist_t *hp = &m->shards[i]->hists[h];
+            count += atomic_load_explicit(&hp->count, memory_order_relaxed);
+            sum += atomic_load_explicit(&hp->sum, memory_order_relaxed);
+            uint64_t hmax = atomic_load_explicit(&hp->max, memory_order_relaxed);
+            if(hmax > max) max = hmax;
+            for(int b = 0; b < __BUCKETS; b++) {
+                buckets[b] += atomic_load_explicit(&hp->buckets[b],
+                                                   memory_order_relaxed);
+            }
+        }
+        fprintf(fp, "%s\"%s\":{\"count\":%" PRIu64 ",\"mean\":%" PRIu64
+                ",\"p50\":%" PRIu64 ",\"p90\":%" PRIu64 ",\"p99\":%" PRIu64
+                ",\"max\":%" PRIu64 "}", h ? "," : "", m->histograms[h], count,
+                count ? sum / count : 0, percentile(buckets, count, max, 0.5),
+                percentile(buckets, count, max, 0.9),
+                percentile(buckets, count, max, 0.99), max);
+    }
+    fprintf(fp, "}}\n");
+    return ferror(fp) ? 1 : 0;
+}
+
+
+/****************************************************************
+ * Private helper function: send a snapshot as one datagram to a
+ * Unix socket, dropping it if nobody listens
+****************************************************************/
+static void sendsnapshot(mt_t *m, int sock, const struct sockaddr_un *addr) {
+    char *buf = NULL;
+    size_t len = 0;
+    FILE *fp = open_memstream(&buf, &len);
+    if(fp == NULL) return;
+    mtdump(m, fp);
+    fclose(fp);
+    sendto(sock, buf, len, MSG_DONTWAIT, (const struct sockaddr*)addr,
+           sizeof(*addr));
+    free(buf);
+}
+
+
+/****************************************************************
+ * Private helper function: dumper thread. Dumps a snapshot every
+ * interval, and a last one when told to stop.
+****************************************************************/
+static void *dumper(void *arg) {
+
+    mt_t *m = (mt_t*)arg;
+    FILE *fp = NULL;
+    int sock = -1;
+    struct sockaddr_un addr = {0};
+    if(!strncmp(m->dest, "unix:", 5)) {
+        addr.sun_family = AF_UNIX;
+        snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", m->dest + 5);
+        sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+    }
+    else {
+        fp = fopen(m->dest, "a");
+    }
+    if(fp == NULL && sock < 0) {
+        printf("Error: failed to open metrics destination %s\n", m->dest);
+    }
+
+    pthread_mutex_lock(&m->lock);
+    bool last = false;
+    while(!last) {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_sec += m->intervalms / 1000;
+        until.tv_nsec += (m->intervalms % 1000) * 1000000L;
+        if(until.tv_nsec >= 1000000000L) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+        while(!m->stop && pthread_cond_timedwait(&m->wake, &m->lock, &until) == 0)
+            ;
+        last = m->stop;
+
+        // Shards may be added while the snapshot is taken
+        pthread_mutex_unlock(&m->lock);
+        if(fp != NULL) {
+            mtdump(m, fp);
+            fflush(fp);
+        }
+        if(sock >= 0) sendsnapshot(m, sock, &addr);
+        pthread_mutex_lock(&m->lock);
+    }
+    pthread_mutex_unlock(&m->lock);
+
+    if(fp != NULL) fclose(fp);
+    if(sock >= 0) close(sock);
+    return NULL;
+}
+
+
+/****************************************************************
+ * mtstart -- start the background dumper
+****************************************************************/
+int32_t mtstart(metrics_t *mp, const char *dest, int intervalms) {
+
+    if(mp == NULL || dest == NULL || intervalms < 1) return 1;
+    mt_t *m = (mt_t*)mp;
+    if(m->dumping) return 1;
+    if(!(m->dest = (char*)malloc(strlen(dest) + 1))) return 1;
+    strcpy(m->dest, dest);
+    m->intervalms = intervalms;
+    m->stop = false;
+    if(pthread_create(&m->dumper, NULL, dumper, m) != 0) {
+        free(m->dest);
+        m->dest = NULL;
+        return 1;
+    }
+    m->dumping = true;
+    return 0;
+}
+
+
+/****************************************************************
+ * mtclose -- stop the dumper, after its last snapshot, and free
+ * the metrics
+****************************************************************/
+void mtclose(metrics_t *mp) {
+
+    if(mp == NULL) return;
+    mt_t *m = (mt_t*)mp;
+    if(m->dumping) {
+        pthread_mutex_lock(&m->lock);
+        m->stop = true;
+        pthread_cond_signal(&m->wake);
+        pthread_mutex_unlock(&m->lock);
+        pthread_join(m->dumper, NULL);
+    }
+    for(int i = 0; i < atomic_load(&m->nshards); i++) free(m->shards[i]);
+    pthread_mutex_destroy(&m->lock);
+    pthread_cond_destroy(&m->wake);
+    free(m->dest);
+    free(m);
+}
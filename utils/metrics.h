@@ -0,0 +1,71 @@
+#pragma once
+/*
+ * metrics.h -- cheap counters, latency histograms and gauges
+ *
+ * Counters and histograms are registered by name before the threads
+ * that update them start. Every thread updates its own copy of them,
+ * with plain stores and no locks; the copies are only summed up when
+ * a snapshot is taken. Histograms are log-linear, like HdrHistogram:
+ * 16 buckets per power of two, so percentiles are within 1/16 of the
+ * true value. Gauges are functions sampled at snapshot time.
+ *
+ * A snapshot is one line of JSON:
+ *   {"time":<ms since mtopen>,
+ *    "counters":{"<name>":<n>,...},
+ *    "gauges":{"<name>":<n>,...},
+ *    "histograms":{"<name>":{"count":<n>,"mean":<ns>,"p50":<ns>,
+ *                            "p90":<ns>,"p99":<ns>,"max":<ns>},...}}
+ *
+ * Every function may be passed a NULL metrics_t, and then does
+ * nothing; so metrics can be turned off without changing callers.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* the metrics representation is hidden from users of the module */
+typedef void metrics_t;
+
+/* mtopen -- open an empty set of metrics */
+metrics_t *mtopen(void);
+
+/* mtclose -- stop any dumper and free the metrics */
+void mtclose(metrics_t *m);
+
+/* mtcounter, mthistogram -- register a counter or a histogram
+ * returns its handle for mtadd() or mtrecord(); -1 if there are too many
+ */
+int mtcounter(metrics_t *m, const char *name);
+int mthistogram(metrics_t *m, const char *name);
+
+/* mtgauge -- register a gauge, read by calling fn() at snapshot time
+ * returns 0 if successful; nonzero otherwise
+ */
+int32_t mtgauge(metrics_t *m, const char *name, long (*fn)(void));
+
+/* mtadd -- add n to a counter */
+void mtadd(metrics_t *m, int counter, long n);
+
+/* mtrecord -- record a latency, in nanoseconds, in a histogram */
+void mtrecord(metrics_t *m, int histogram, uint64_t ns);
+
+/* mtnow -- a monotonic clock, in nanoseconds */
+uint64_t mtnow(void);
+
+/* mtsince -- record the time since start, as given by mtnow(), in a
+ * histogram; returns the current time, so that calls can be chained
+ */
+uint64_t mtsince(metrics_t *m, int histogram, uint64_t start);
+
+/* mtdump -- write a snapshot line to fp
+ * returns 0 if successful; nonzero otherwise
+ */
+int32_t mtdump(metrics_t *m, FILE *fp);
+
+/* mtstart -- dump a snapshot every intervalms milliseconds, and once
+ * more when the metrics are closed, from a background thread. dest is
+ * a file to append to, or "unix:<path>" for a Unix datagram socket
+ * that a collector listens on; snapshots nobody receives are dropped.
+ * returns 0 if successful; nonzero otherwise
+ */
+int32_t mtstart(metrics_t *m, const char *dest, int intervalms);
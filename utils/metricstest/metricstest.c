@@ -0,0 +1,188 @@
+/****************************************************************
+ * file   metricstest.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   November 30, 2021
+ * 
+ * Tests that the metrics.h module adds up per-thread counters and
+ * histograms correctly, dumps snapshots to a file and a Unix socket,
+ * and times an update
+ * 
+****************************************************************/
+
+#define _POSIX_C_SOURCE 200809L     // nanosleep
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include<time.h>
+#include<pthread.h>
+#include<unistd.h>
+#include<sys/socket.h>
+#include<sys/un.h>
+#include"metrics.h"
+
+/****************************************************************
+ * Define macro, globals and helper functions
+****************************************************************/
+#define eprintf(format, ...) do {                 \
+    if (verbose)                                  \
+        fprintf(stderr, format, ##__VA_ARGS__);   \
+} while(0)
+#define verbose 1
+
+#define __THREADS 8
+#define __VALUES 100000             // Each thread records 1..__VALUES
+#define __TIMED 10000000
+#define __SNAPSHOT "metricstest.jsonl"
+#define __SOCKET "metricstest.sock"
+
+metrics_t *m;
+int counter, histogram;
+
+static long answer(void) {
+    return 42;
+}
+
+
+/****************************************************************
+ * Private helper function: thread that counts and records
+****************************************************************/
+static void *worker(void *arg) {
+    for(uint64_t v = 1; v <= __VALUES; v++) {
+        mtadd(m, counter, 1);
+        mtrecord(m, histogram, v);
+    }
+    return NULL;
+}
+
+
+/****************************************************************
+ * Private helper function: the number after "key": in a snapshot
+****************************************************************/
+static long field(const char *snapshot, const char *key) {
+    char pattern[64];
+    sprintf(pattern, "\"%s\":", key);
+    const char *p = strstr(snapshot, pattern);
+    return p ? atol(p + strlen(pattern)) : -1;
+}
+
+
+/****************************************************************
+ * Private helper function: check a percentile is within 1/16 above
+ * its true value
+****************************************************************/
+static int near(const char *snapshot, const char *key, long want) {
+    long got = field(snapshot, key);
+    if(got < want || got > want + want / 16) {
+        eprintf("%s is %ld, expected about %ld\n", key, got, want);
+        return 1;
+    }
+    return 0;
+}
+
+
+int main(void) {
+
+    int errors = 0;
+
+    // Calls without metrics do nothing
+    mtadd(NULL, 0, 1);
+    mtrecord(NULL, 0, 1);
+    mtclose(NULL);
+
+    // Totals over all threads
+    m = mtopen();
+    counter = mtcounter(m, "things");
+    histogram = mthistogram(m, "latency");
+    mtgauge(m, "answer", answer);
+    pthread_t threads[__THREADS];
+    for(int i = 0; i < __THREADS; i++) pthread_create(&threads[i], NULL, worker, NULL);
+    for(int i = 0; i < __THREADS; i++) pthread_join(threads[i], NULL);
+
+    char *snapshot = NULL;
+    size_t len = 0;
+    FILE *fp = open_memstream(&snapshot, &len);
+    mtdump(m, fp);
+    fclose(fp);
+    eprintf("%s", snapshot);
+    if(field(snapshot, "things") != (long)__THREADS * __VALUES ||
+       field(snapshot, "count") != (long)__THREADS * __VALUES ||
+       field(snapshot, "max") != __VALUES || field(snapshot, "answer") != 42) {
+        eprintf("%s\n", "wrong totals");
+        errors++;
+    }
+    errors += near(snapshot, "mean", __VALUES / 2);
+    errors += near(snapshot, "p50", __VALUES / 2);
+    errors += near(snapshot, "p90", __VALUES * 9 / 10);
+    errors += near(snapshot, "p99", __VALUES * 99 / 100);
+    free(snapshot);
+
+    // Cost of an update
+    uint64_t start = mtnow();
+    for(int i = 0; i < __TIMED; i++) {
+        mtadd(m, counter, 1);
+        mtrecord(m, histogram, i);
+    }
+    eprintf("%.1f ns per counter and histogram update\n",
+            (double)(mtnow() - start) / __TIMED);
+    mtclose(m);
+
+    // Periodic snapshots to a file and to a socket
+    remove(__SNAPSHOT);
+    unlink(__SOCKET);
+    int sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, __SOCKET);
+    if(sock < 0 || bind(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        eprintf("%s\n", "can't bind socket");
+        errors++;
+    }
+
+    m = mtopen();
+    counter = mtcounter(m, "things");
+    metrics_t *m2 = mtopen();
+    int counter2 = mtcounter(m2, "things");
+    mtstart(m, __SNAPSHOT, 10);
+    mtstart(m2, "unix:" __SOCKET, 10);
+    mtadd(m, counter, 7);
+    mtadd(m2, counter2, 9);
+    struct timespec wait = {0, 55 * 1000000L};
+    nanosleep(&wait, NULL);
+    mtclose(m);
+    mtclose(m2);
+
+    int lines = 0;
+    char line[1024];
+    fp = fopen(__SNAPSHOT, "r");
+    while(fp && fgets(line, sizeof(line), fp)) {
+        if(line[0] != '{' || field(line, "things") != 7) {
+            eprintf("bad snapshot %s", line);
+            errors++;
+        }
+        lines++;
+    }
+    if(fp) fclose(fp);
+    if(lines < 3) {
+        eprintf("only %d snapshots\n", lines);
+        errors++;
+    }
+    remove(__SNAPSHOT);
+
+    ssize_t n = recv(sock, line, sizeof(line) - 1, MSG_DONTWAIT);
+    if(n <= 0 || (line[n] = '\0', field(line, "things") != 9)) {
+        eprintf("%s\n", "no snapshot on the socket");
+        errors++;
+    }
+    close(sock);
+    unlink(__SOCKET);
+
+    if(errors) {
+        eprintf("%d errors\n", errors);
+        exit(EXIT_FAILURE);
+    }
+    eprintf("%s passed\n", "metrics");
+    exit(EXIT_SUCCESS);
+}
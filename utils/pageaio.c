@@ -0,0 +1,664 @@
+/****************************************************************
+ * file   pageaio.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   November 22, 2021
+ *
+ * Batched page file I/O. The io_uring backend talks to the kernel
+ * directly through io_uring_setup/io_uring_enter, so it does not
+ * need liburing. A batch is cut into chunks of qdepth pages and
+ * every chunk runs in three rounds: open all files, read or write
+ * (and fsync) all files, close all files. Each round is a single
+ * io_uring_enter() call.
+ *
+****************************************************************/
+
+#define _DEFAULT_SOURCE         // MAP_POPULATE
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include<limits.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/types.h>
+#include<sys/stat.h>
+#include<sys/mman.h>
+#include<sys/uio.h>
+#include<sys/syscall.h>
+#include"pageio.h"
+#include"tpool.h"
+#include"pageaio.h"
+#include"log.h"
+
+#ifdef __linux__
+#include<linux/io_uring.h>
+#endif
+
+// IORING_OP_OPENAT/CLOSE/READ/WRITE are enum values; they arrived in
+// the same kernel (5.6) as this feature flag
+#if defined(__NR_io_uring_setup) && defined(IORING_FEAT_RW_CUR_POS)
+#define HAVE_URING 1
+#else
+#define HAVE_URING 0
+#endif
+
+
+/****************************************************************
+ * Define macro, structs, globals and helper functions
+****************************************************************/
+// Pages up to this size go through registered buffers
+static const size_t buf_size = 64 * 1024;
+
+// Workers in the fallback pool
+#define __MAXTHREADS 8
+
+#if HAVE_URING
+typedef struct uring {
+    int fd;
+    unsigned sq_entries;
+    unsigned *sqhead, *sqtail, *sqmask, *sqarray;
+    unsigned *cqhead, *cqtail, *cqmask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sqring, *cqring;
+    size_t sqsz, cqsz, sqesz;
+    unsigned tail;              // Local copy of the sq tail
+    unsigned queued;            // Entries queued since the last run
+} uring_t;
+#endif
+
+typedef struct pageaio {
+    int backend;                // PA_AUTO (io_uring) or PA_THREADS
+    int qdepth;                 // Pages per chunk
+    char **bufs;                // qdepth buffers of buf_size bytes
+    bool registered;            // bufs are registered with the ring
+    tpool_t *pool;              // Fallback workers
+#if HAVE_URING
+    uring_t ring;
+#endif
+} pa_t;
+
+// One page of a batch, shared by both backends
+typedef struct pagejob {
+    char path[PATH_MAX];        // Page file name
+    int id;                     // Page id
+    char *dirnm;                // Page directory
+    int fd;                     // Open file or -1
+    char *buf;                  // Page file image
+    size_t len;                 // Bytes used in buf
+    bool owned;                 // buf was malloc()ed for this job
+    int fixed;                  // Registered buffer index or -1
+    bool sync;                  // fsync() before closing
+    int32_t res;                // Result of the last read/write/open
+    int32_t aux;                // First failure of a fsync or close
+    webpage_t *page;            // Page being saved or loaded
+} pagejob_t;
+
+
+/****************************************************************
+ * Private helper functions: blocking I/O shared by the thread
+ * pool backend and by the io_uring backend's short transfers
+****************************************************************/
+static int32_t writeall(int fd, const char *buf, size_t len, size_t done) {
+    while(done < len) {
+        ssize_t w = write(fd, buf + done, len - done);
+        if(w < 0 && errno == EINTR) continue;
+        if(w <= 0) return -1;
+        done += w;
+    }
+    return 0;
+}
+
+static int32_t readall(int fd, char *buf, size_t len, size_t done) {
+    while(done < len) {
+        ssize_t r = pread(fd, buf + done, len - done, done);
+        if(r < 0 && errno == EINTR) continue;
+        if(r < 0) return -1;
+        if(r == 0) break;
+        done += r;
+    }
+    return (int32_t)done;
+}
+
+static void jobsave(void *arg) {
+    pagejob_t *j = (pagejob_t*)arg;
+    j->res = -1;
+    int fd = open(j->path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if(fd < 0) return;
+    if(writeall(fd, j->buf, j->len, 0) == 0 && (!j->sync || fsync(fd) == 0)) {
+        j->res = 0;
+    }
+    if(close(fd) != 0) j->res = -1;
+}
+
+static void jobload(void *arg) {
+    pagejob_t *j = (pagejob_t*)arg;
+    j->page = pageload(j->id, j->dirnm);
+}
+
+static void jobfree(pagejob_t *j) {
+    if(j->owned) free(j->buf);
+    j->buf = NULL;
+    j->owned = false;
+}
+
+
+#if HAVE_URING
+/****************************************************************
+ * Private helper functions: a minimal io_uring
+****************************************************************/
+static int uring_open(uring_t *u, unsigned entries) {
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(u, 0, sizeof(uring_t));
+    u->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if(u->fd < 0) return -1;
+
+    // Map the submission and completion rings and the sqe array
+    u->sqsz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cqsz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if(single) {
+        if(u->cqsz > u->sqsz) u->sqsz = u->cqsz;
+        u->cqsz = u->sqsz;
+    }
+    u->sqring = mmap(NULL, u->sqsz, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    if(u->sqring == MAP_FAILED) goto fail;
+    if(single) {
+        u->cqring = u->sqring;
+    }
+    else {
+        u->cqring = mmap(NULL, u->cqsz, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+        if(u->cqring == MAP_FAILED) goto fail;
+    }
+    u->sqesz = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqesz, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if(u->sqes == MAP_FAILED) goto fail;
+
+    char *sq = (char*)u->sqring;
+    char *cq = (char*)u->cqring;
+    u->sq_entries = p.sq_entries;
+    u->sqhead  = (unsigned*)(sq + p.sq_off.head);
+    u->sqtail  = (unsigned*)(sq + p.sq_off.tail);
+    u->sqmask  = (unsigned*)(sq + p.sq_off.ring_mask);
+    u->sqarray = (unsigned*)(sq + p.sq_off.array);
+    u->cqhead  = (unsigned*)(cq + p.cq_off.head);
+    u->cqtail  = (unsigned*)(cq + p.cq_off.tail);
+    u->cqmask  = (unsigned*)(cq + p.cq_off.ring_mask);
+    u->cqes    = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    u->tail = *u->sqtail;
+    return 0;
+
+ fail:
+    if(u->sqring && u->sqring != MAP_FAILED) munmap(u->sqring, u->sqsz);
+    if(!single && u->cqring && u->cqring != MAP_FAILED) {
+        munmap(u->cqring, u->cqsz);
+    }
+    close(u->fd);
+    u->fd = -1;
+    return -1;
+}
+
+static void uring_close(uring_t *u) {
+    if(u->fd < 0) return;
+    munmap(u->sqes, u->sqesz);
+    if(u->cqring != u->sqring) munmap(u->cqring, u->cqsz);
+    munmap(u->sqring, u->sqsz);
+    close(u->fd);
+    u->fd = -1;
+}
+
+// Queue a zeroed sqe tagged with data; the caller fills in the rest
+static struct io_uring_sqe *uring_sqe(uring_t *u, uint64_t data) {
+    unsigned head = __atomic_load_n(u->sqhead, __ATOMIC_ACQUIRE);
+    if(u->tail - head >= u->sq_entries) return NULL;
+    unsigned idx = u->tail & *u->sqmask;
+    struct io_uring_sqe *sqe = &u->sqes[idx];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->user_data = data;
+    u->sqarray[idx] = idx;
+    u->tail++;
+    u->queued++;
+    return sqe;
+}
+
+// Submit everything queued and wait for all of it to complete. An
+// sqe tagged 2*i reports into jobs[i].res; one tagged 2*i+1 (fsync
+// or close) only records a failure in jobs[i].aux
+static int uring_run(uring_t *u, pagejob_t *jobs) {
+
+    unsigned want = u->queued;
+    unsigned submit = u->queued;
+    unsigned got = 0;
+    u->queued = 0;
+    __atomic_store_n(u->sqtail, u->tail, __ATOMIC_RELEASE);
+
+    while(got < want) {
+        int r = syscall(__NR_io_uring_enter, u->fd, submit, 1,
+                        IORING_ENTER_GETEVENTS, NULL, 0);
+        if(r < 0) {
+            if(errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+            return -1;
+        }
+        submit -= (unsigned)r < submit ? (unsigned)r : submit;
+
+        // Reap completions
+        unsigned head = *u->cqhead;
+        unsigned tail = __atomic_load_n(u->cqtail, __ATOMIC_ACQUIRE);
+        while(head != tail) {
+            struct io_uring_cqe *cqe = &u->cqes[head & *u->cqmask];
+            pagejob_t *j = &jobs[cqe->user_data / 2];
+            if(cqe->user_data % 2 == 0) j->res = cqe->res;
+            else if(cqe->res < 0 && j->aux == 0) j->aux = cqe->res;
+            head++;
+            got++;
+        }
+        __atomic_store_n(u->cqhead, head, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+
+// Register the page buffers so small transfers skip page pinning
+static bool uring_register(uring_t *u, char **bufs, int n) {
+    struct iovec *iov = (struct iovec*)calloc(n, sizeof(struct iovec));
+    if(iov == NULL) return false;
+    for(int i = 0; i < n; i++) {
+        iov[i].iov_base = bufs[i];
+        iov[i].iov_len = buf_size;
+    }
+    int r = syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_BUFFERS,
+                    iov, n);
+    free(iov);
+    return r == 0;
+}
+
+// Open every job's file; files opened by a run that failed are kept,
+// to be closed by uring_abort()
+static int uring_openall(pa_t *pa, pagejob_t *jobs, int n, int flags) {
+    for(int i = 0; i < n; i++) {
+        struct io_uring_sqe *sqe = uring_sqe(&pa->ring, 2 * i);
+        if(sqe == NULL) return -1;
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uint64_t)(uintptr_t)jobs[i].path;
+        sqe->open_flags = flags;
+        sqe->len = 0666;
+    }
+    int r = uring_run(&pa->ring, jobs);
+    for(int i = 0; i < n; i++) jobs[i].fd = jobs[i].res >= 0 ? jobs[i].res : -1;
+    return r;
+}
+
+// Close every open file; after a run that failed, which files are
+// still open is unknown, and none is closed again
+static int uring_closeall(pa_t *pa, pagejob_t *jobs, int n) {
+    bool any = false;
+    int r = 0;
+    for(int i = 0; i < n && r == 0; i++) {
+        if(jobs[i].fd < 0) continue;
+        struct io_uring_sqe *sqe = uring_sqe(&pa->ring, 2 * i + 1);
+        if(sqe == NULL) { r = -1; break; }
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = jobs[i].fd;
+        any = true;
+    }
+    if(any && uring_run(&pa->ring, jobs) != 0) r = -1;
+    for(int i = 0; i < n; i++) jobs[i].fd = -1;
+    return r;
+}
+
+// Queue a read or write of job j, through its registered buffer if
+// it has one
+static int uring_rw(pa_t *pa, pagejob_t *j, int i, bool write) {
+    struct io_uring_sqe *sqe = uring_sqe(&pa->ring, 2 * i);
+    if(sqe == NULL) return -1;
+    if(j->fixed >= 0) {
+        sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+        sqe->buf_index = j->fixed;
+    }
+    else {
+        sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+    }
+    sqe->fd = j->fd;
+    sqe->addr = (uint64_t)(uintptr_t)j->buf;
+    sqe->len = j->len;
+    sqe->off = 0;
+    if(write && j->sync) {
+        // The fsync only runs once the write has completed
+        sqe->flags |= IOSQE_IO_LINK;
+        sqe = uring_sqe(&pa->ring, 2 * i + 1);
+        if(sqe == NULL) return -1;
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->fd = j->fd;
+    }
+    return 0;
+}
+
+// Both return -1 if a round failed, leaving the chunk to uring_abort()
+static int uring_save(pa_t *pa, pagejob_t *jobs, int n) {
+
+    if(uring_openall(pa, jobs, n, O_WRONLY | O_CREAT | O_TRUNC) != 0) return -1;
+    for(int i = 0; i < n; i++) {
+        if(jobs[i].fd >= 0 && uring_rw(pa, &jobs[i], i, true) != 0) return -1;
+    }
+    if(uring_run(&pa->ring, jobs) != 0) return -1;
+
+    // Finish short writes the slow way
+    for(int i = 0; i < n; i++) {
+        pagejob_t *j = &jobs[i];
+        if(j->fd < 0) { j->res = -1; continue; }
+        if(j->res >= 0 && (size_t)j->res < j->len) {
+            // A short write cancels the linked fsync
+            j->aux = 0;
+            j->res = writeall(j->fd, j->buf, j->len, j->res);
+            if(j->res == 0 && j->sync && fsync(j->fd) != 0) j->res = -1;
+        }
+        else {
+            j->res = (j->res >= 0) ? 0 : -1;
+        }
+    }
+
+    if(uring_closeall(pa, jobs, n) != 0) return -1;
+    for(int i = 0; i < n; i++) {
+        if(jobs[i].aux < 0) jobs[i].res = -1;
+    }
+    return 0;
+}
+
+static int uring_load(pa_t *pa, pagejob_t *jobs, int n) {
+
+    if(uring_openall(pa, jobs, n, O_RDONLY) != 0) return -1;
+
+    // Size the reads; the inode is hot after the open
+    for(int i = 0; i < n; i++) {
+        pagejob_t *j = &jobs[i];
+        struct stat fst;
+        if(j->fd < 0 || fstat(j->fd, &fst) != 0 || fst.st_size <= 0) {
+            j->len = 0;
+            continue;
+        }
+        j->len = (size_t)fst.st_size;
+        if(j->len > buf_size) {
+            j->buf = (char*)malloc(j->len);
+            j->owned = true;
+            j->fixed = -1;
+            if(j->buf == NULL) { j->len = 0; continue; }
+        }
+        if(uring_rw(pa, j, i, false) != 0) return -1;
+    }
+    if(uring_run(&pa->ring, jobs) != 0) return -1;
+
+    for(int i = 0; i < n; i++) {
+        pagejob_t *j = &jobs[i];
+        if(j->len == 0 || j->res < 0) continue;
+        int32_t got = j->res;
+        if((size_t)got < j->len) got = readall(j->fd, j->buf, j->len, got);
+
+        pageview_t view;
+        memset(&view, 0, sizeof(pageview_t));
+        if(got > 0 && pageview_parse(j->buf, got, &view) == 0) {
+            j->page = pageview_copy(&view);
+        }
+    }
+    return uring_closeall(pa, jobs, n);
+}
+
+// Give up on a ring that failed: the whole chunk fails, and later
+// chunks go through a pool of threads, as if io_uring was missing. If
+// no pool can be started either, the context is left without a
+// backend (pa->pool is NULL) and every later request fails.
+static void uring_abort(pa_t *pa, pagejob_t *jobs, int n) {
+    logmsg(LOG_ERROR, "Error: io_uring failed, falling back to threads\n");
+    uring_close(&pa->ring);
+    for(int i = 0; i < n; i++) {
+        if(jobs[i].fd >= 0) close(jobs[i].fd);
+        jobs[i].fd = -1;
+        jobs[i].res = -1;
+        webpage_delete(jobs[i].page);
+        jobs[i].page = NULL;
+    }
+    pa->backend = PA_THREADS;
+    pa->pool = tpopen(pa->qdepth < __MAXTHREADS ? pa->qdepth : __MAXTHREADS);
+    if(pa->pool == NULL) {
+        logmsg(LOG_ERROR, "Error: failed to start page I/O threads\n");
+    }
+}
+#endif
+
+
+/****************************************************************
+ * Private helper function: set up the jobs of one chunk
+****************************************************************/
+static void jobinit(pa_t *pa, pagejob_t *j, int i, int id, char *dirnm) {
+    memset(j, 0, sizeof(pagejob_t));
+    snprintf(j->path, PATH_MAX, "%s/%d", dirnm, id);
+    j->id = id;
+    j->dirnm = dirnm;
+    j->fd = -1;
+    j->fixed = -1;
+    j->res = -1;
+    if(pa->bufs != NULL) {
+        j->buf = pa->bufs[i];
+        j->len = buf_size;
+        if(pa->registered) j->fixed = i;
+    }
+}
+
+
+/****************************************************************
+ * Private helper function: whether the context still has a backend
+****************************************************************/
+static bool alive(pa_t *pa) {
+    return pa->backend != PA_THREADS || pa->pool != NULL;
+}
+
+
+/****************************************************************
+ * paopen -- open a context keeping up to qdepth requests in flight
+****************************************************************/
+pageaio_t *paopen(int qdepth, int backend) {
+
+    if(qdepth < 1) return NULL;
+    pa_t *pa;
+    if(!(pa = (pa_t*)calloc(1, sizeof(pa_t)))) {
+        logmsg(LOG_ERROR, "Error: malloc failed allocating page aio\n");
+        return NULL;
+    }
+    pa->qdepth = qdepth;
+    pa->backend = PA_THREADS;
+
+#if HAVE_URING
+    // Two entries per page: a write and its linked fsync
+    pa->ring.fd = -1;
+    if(backend == PA_AUTO && uring_open(&pa->ring, 2 * qdepth) == 0) {
+        pa->backend = PA_AUTO;
+        pa->bufs = (char**)calloc(qdepth, sizeof(char*));
+        for(int i = 0; pa->bufs && i < qdepth; i++) {
+            pa->bufs[i] = (char*)malloc(buf_size);
+            if(pa->bufs[i] == NULL) {
+                paclose(pa);
+                return NULL;
+            }
+        }
+        if(pa->bufs == NULL) {
+            paclose(pa);
+            return NULL;
+        }
+        pa->registered = uring_register(&pa->ring, pa->bufs, qdepth);
+        logmsg(LOG_DEBUG, "pageaio: io_uring, %d entries, buffers %s\n",
+               2 * qdepth, pa->registered ? "registered" : "unregistered");
+        return (pageaio_t*)pa;
+    }
+#endif
+
+    // Fall back to a small pool of blocking workers
+    pa->pool = tpopen(qdepth < __MAXTHREADS ? qdepth : __MAXTHREADS);
+    if(pa->pool == NULL) {
+        paclose(pa);
+        return NULL;
+    }
+    logmsg(LOG_DEBUG, "pageaio: %d threads\n", tpsize(pa->pool));
+    return (pageaio_t*)pa;
+}
+
+
+/****************************************************************
+ * pabackend -- name of the backend in use
+****************************************************************/
+const char *pabackend(pageaio_t *pageaio) {
+    if(pageaio == NULL) return NULL;
+    return ((pa_t*)pageaio)->backend == PA_AUTO ? "io_uring" : "threads";
+}
+
+
+/****************************************************************
+ * pasave -- save a batch of pages
+****************************************************************/
+int32_t pasave(pageaio_t *pageaio, webpage_t **pages, int *ids, int n,
+               char *dirnm, bool sync, int32_t *status) {
+
+    if(pageaio == NULL || pages == NULL || ids == NULL || dirnm == NULL) {
+        return n;
+    }
+    pa_t *pa = (pa_t*)pageaio;
+    pagejob_t *jobs = (pagejob_t*)malloc(pa->qdepth * sizeof(pagejob_t));
+    if(jobs == NULL || !alive(pa)) {
+        for(int i = 0; status != NULL && i < n; i++) status[i] = -1;
+        free(jobs);
+        return n;
+    }
+
+    int32_t failed = 0;
+    for(int base = 0; base < n; base += pa->qdepth) {
+        int m = (n - base < pa->qdepth) ? n - base : pa->qdepth;
+
+        // Encode the chunk, into a spare buffer where the page fits
+        for(int i = 0; i < m; i++) {
+            pagejob_t *j = &jobs[i];
+            jobinit(pa, j, i, ids[base + i], dirnm);
+            j->sync = sync;
+            size_t need = pageencode(pages[base + i], j->buf, j->len);
+            if(j->buf == NULL || need > j->len) {
+                j->buf = (char*)malloc(need);
+                j->owned = true;
+                j->fixed = -1;
+                if(j->buf != NULL) pageencode(pages[base + i], j->buf, need);
+            }
+            j->len = need;
+        }
+
+#if HAVE_URING
+        if(pa->backend == PA_AUTO) {
+            if(uring_save(pa, jobs, m) != 0) uring_abort(pa, jobs, m);
+        }
+        else
+#endif
+        {
+            // A job that never ran keeps res at -1
+            for(int i = 0; i < m; i++) {
+                if(tpsubmit(pa->pool, jobsave, &jobs[i]) != 0) jobs[i].res = -1;
+            }
+            tpwait(pa->pool);
+        }
+
+        for(int i = 0; i < m; i++) {
+            if(jobs[i].buf == NULL) jobs[i].res = -1;
+            if(jobs[i].res != 0) {
+                logmsg(LOG_WARN, "Error: failed to save %s\n", jobs[i].path);
+                failed++;
+            }
+            if(status != NULL) status[base + i] = jobs[i].res;
+            jobfree(&jobs[i]);
+        }
+    }
+
+    free(jobs);
+    return failed;
+}
+
+
+/****************************************************************
+ * paload -- load a batch of pages
+****************************************************************/
+int32_t paload(pageaio_t *pageaio, int *ids, int n, char *dirnm,
+               webpage_t **pages) {
+
+    if(pageaio == NULL || ids == NULL || dirnm == NULL || pages == NULL) {
+        return 0;
+    }
+    pa_t *pa = (pa_t*)pageaio;
+    pagejob_t *jobs = (pagejob_t*)malloc(pa->qdepth * sizeof(pagejob_t));
+    if(jobs == NULL || !alive(pa)) {
+        for(int i = 0; i < n; i++) pages[i] = NULL;
+        free(jobs);
+        return -1;
+    }
+
+    int32_t loaded = 0;
+    for(int base = 0; base < n && loaded >= 0; base += pa->qdepth) {
+        int m = (n - base < pa->qdepth) ? n - base : pa->qdepth;
+        for(int i = 0; i < m; i++) {
+            jobinit(pa, &jobs[i], i, ids[base + i], dirnm);
+        }
+
+#if HAVE_URING
+        if(pa->backend == PA_AUTO) {
+            if(uring_load(pa, jobs, m) != 0) uring_abort(pa, jobs, m);
+        }
+        else
+#endif
+        {
+            // A job that never ran keeps no page
+            for(int i = 0; i < m; i++) {
+                if(tpsubmit(pa->pool, jobload, &jobs[i]) != 0) {
+                    logmsg(LOG_WARN, "Error: failed to load %s\n", jobs[i].path);
+                }
+            }
+            tpwait(pa->pool);
+        }
+
+        for(int i = 0; i < m; i++) {
+            pages[base + i] = jobs[i].page;
+            if(jobs[i].page != NULL) loaded++;
+            jobfree(&jobs[i]);
+        }
+
+        // Without a backend, the rest of the batch cannot be loaded
+        if(!alive(pa)) {
+            for(int i = 0; i < n; i++) {
+                if(i < base + m) webpage_delete(pages[i]);
+                pages[i] = NULL;
+            }
+            loaded = -1;
+        }
+    }
+
+    free(jobs);
+    return loaded;
+}
+
+
+/****************************************************************
+ * paclose -- free a context
+****************************************************************/
+void paclose(pageaio_t *pageaio) {
+
+    if(pageaio == NULL) return;
+    pa_t *pa = (pa_t*)pageaio;
+#if HAVE_URING
+    if(pa->backend == PA_AUTO) uring_close(&pa->ring);
+#endif
+    tpclose(pa->pool);
+    if(pa->bufs != NULL) {
+        for(int i = 0; i < pa->qdepth; i++) free(pa->bufs[i]);
+        free(pa->bufs);
+    }
+    free(pa);
+}
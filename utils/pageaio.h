@@ -0,0 +1,55 @@
+#pragma once
+/*
+ * pageaio.h --- batched saving and loading of crawler page files
+ *
+ * A pageaio context saves or loads many numbered page files (in the
+ * pagesave format) at once, keeping up to qdepth requests in flight.
+ * On Linux it drives an io_uring: opens, reads/writes, fsyncs and
+ * closes for a whole batch are each submitted with one system call,
+ * using buffers registered with the kernel for pages that fit. When
+ * io_uring is unavailable it falls back to a small fixed pool of
+ * threads doing ordinary blocking I/O, so there is never a thread per
+ * outstanding request.
+ *
+ * A context is not thread safe; use one per thread.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include "webpage.h"
+
+/* backend selection for paopen() */
+#define PA_AUTO    0            /* io_uring if available, else threads */
+#define PA_THREADS 1            /* always use the thread pool */
+
+/* the context representation is hidden from users of the module */
+typedef void pageaio_t;
+
+/* paopen -- open a context keeping up to qdepth requests in flight
+ * returns NULL on failure
+ */
+pageaio_t *paopen(int qdepth, int backend);
+
+/* pabackend -- name of the backend in use: "io_uring" or "threads" */
+const char *pabackend(pageaio_t *pa);
+
+/* pasave -- save pages[i] as file ids[i] in directory dirnm for i in
+ * [0, n); with sync, every file is fsync()ed before it is closed.
+ * status may be NULL; otherwise status[i] is set to 0 on success.
+ * returns the number of pages that failed to save; all n if the
+ * context has lost its backend (an io_uring failed and no threads
+ * could be started in its place)
+ */
+int32_t pasave(pageaio_t *pa, webpage_t **pages, int *ids, int n,
+               char *dirnm, bool sync, int32_t *status);
+
+/* paload -- load files ids[i] from directory dirnm into new pages
+ * pages[i] for i in [0, n); pages[i] is NULL if the file is missing
+ * or malformed. The caller owns the pages.
+ * returns the number of pages loaded, or -1 with every pages[i] NULL
+ * if the context has lost its backend
+ */
+int32_t paload(pageaio_t *pa, int *ids, int n, char *dirnm,
+               webpage_t **pages);
+
+/* paclose -- free a context */
+void paclose(pageaio_t *pa);
@@ -0,0 +1,117 @@
+/****************************************************************
+ * file   pageaiotest.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   November 22, 2021
+ * 
+ * Tests if the pageaio.h module loads the same crawled pages as
+ * pageload(), and saves pages that load back unchanged, with both
+ * the io_uring and the thread pool backends
+ * 
+****************************************************************/
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<sys/types.h>
+#include<sys/stat.h>
+#include"pageio.h"
+#include"pageaio.h"
+#include"webpage.h"
+
+/****************************************************************
+ * Define macro, globals and helper functions
+****************************************************************/
+#define eprintf(format, ...) do {                 \
+    if (verbose)                                  \
+        fprintf(stderr, format, ##__VA_ARGS__);   \
+} while(0)
+#define verbose 1
+
+#define __BATCH 64
+#define __BIG (100 * 1024)            // Larger than a registered buffer
+
+static bool same(webpage_t *a, webpage_t *b) {
+    return a != NULL && b != NULL &&
+           !strcmp(webpage_getURL(a), webpage_getURL(b)) &&
+           webpage_getDepth(a) == webpage_getDepth(b) &&
+           !strcmp(webpage_getHTML(a), webpage_getHTML(b));
+}
+
+
+/****************************************************************
+ * A page of its own, some too big for the registered buffers
+****************************************************************/
+static webpage_t *mkpage(int i) {
+    char url[64];
+    sprintf(url, "http://example.org/page%d.html", i);
+    size_t len = (i % 8 == 0) ? __BIG : 100 + 37 * i;
+    char *html = (char*)malloc(len + 1);
+    for(size_t k = 0; k < len; k++) html[k] = 'a' + (i + k) % 26;
+    html[len] = '\0';
+    return webpage_new(url, i % 5, html);
+}
+
+
+/****************************************************************
+ * Load a batch (including ids past the end) from the crawled pages,
+ * then save a batch of new pages with fsync and load it back
+****************************************************************/
+static int run(int backend) {
+
+    pageaio_t *pa = paopen(8, backend);
+    if(pa == NULL) {
+        eprintf("paopen failed for backend %d\n", backend);
+        return 1;
+    }
+
+    int ids[__BATCH];
+    webpage_t *pages[__BATCH], *back[__BATCH];
+    for(int i = 0; i < __BATCH; i++) ids[i] = i + 1;
+
+    int diffs = 0;
+    int loaded = paload(pa, ids, __BATCH, "../../pages", pages);
+    for(int i = 0; i < __BATCH; i++) {
+        webpage_t *p = pageload(ids[i], "../../pages");
+        if((p == NULL) != (pages[i] == NULL) || (p && !same(p, pages[i]))) {
+            eprintf("%s load diff: %d\n", pabackend(pa), ids[i]);
+            diffs++;
+        }
+        webpage_delete(p);
+        webpage_delete(pages[i]);
+    }
+    if(loaded <= 0) {
+        eprintf("%s: no pages loaded from %s\n", pabackend(pa), "../../pages");
+        diffs++;
+    }
+
+    mkdir("saved", 0777);
+    int32_t status[__BATCH];
+    for(int i = 0; i < __BATCH; i++) pages[i] = mkpage(ids[i]);
+    diffs += pasave(pa, pages, ids, __BATCH, "saved", true, status);
+    int reloaded = paload(pa, ids, __BATCH, "saved", back);
+    for(int i = 0; i < __BATCH; i++) {
+        webpage_t *p = pageload(ids[i], "saved");
+        if(status[i] != 0 || !same(pages[i], back[i]) || !same(p, back[i])) {
+            eprintf("%s save diff: %d\n", pabackend(pa), ids[i]);
+            diffs++;
+        }
+        webpage_delete(p);
+        webpage_delete(back[i]);
+        webpage_delete(pages[i]);
+    }
+    if(reloaded != __BATCH) {
+        eprintf("%s: loaded back %d of %d\n", pabackend(pa), reloaded, __BATCH);
+        diffs++;
+    }
+
+    eprintf("%s: loaded %d, saved %d, diffs %d\n", pabackend(pa), loaded,
+            reloaded, diffs);
+    paclose(pa);
+    return diffs;
+}
+
+
+int main(){
+    int diffs = run(PA_AUTO) + run(PA_THREADS);
+    return diffs != 0;
+}
@@ -7,6 +7,8 @@
  * 
 ****************************************************************/
 
+#define _DEFAULT_SOURCE         // madvise
+
 #include<stdio.h>
 #include<math.h>
 #include<stdlib.h>
@@ -14,23 +16,22 @@
 #include<stdint.h>
 #include<string.h>
 #include"pageio.h"
+#include"log.h"
 #include<sys/types.h>
 #include<sys/stat.h>
 #include<unistd.h>
 #include<errno.h>
+#include<fcntl.h>
+#include<sys/mman.h>
 
 
 /****************************************************************
  * Define macro, globals and helper functions
 ****************************************************************/
-#define eprintf(format, ...) do {                 \
-    if (verbose)                                  \
-        fprintf(stderr, format, ##__VA_ARGS__);   \
-} while(0)
-#define verbose 0
+static struct stat st = {0};
 
-struct stat st = {0};
-const int url_len = 128;
+// Pages at least this large are mmap()ed rather than read()
+static const size_t map_min = 64 * 1024;
 
 
 /****************************************************************
@@ -60,8 +61,8 @@ int32_t pagesave(webpage_t *pagep, int id, char *dirname) {
     // Make page file
     FILE *outputf = fopen(filename, "w");
     if(outputf == NULL) {
-        eprintf("Error: create page file failed for %s\n", filename);
-        eprintf("Error %d \n", errno);
+        logmsg(LOG_WARN, "Error: create page file failed for %s: error %d\n",
+               filename, errno);
         return -1;
     }
     fprintf(outputf, "%s\n%d\n%d\n%s\n", url, depth, len, html);
@@ -74,43 +75,214 @@ int32_t pagesave(webpage_t *pagep, int id, char *dirname) {
 
 
 /****************************************************************
- * Pageload - loads a html page to local directory
+ * Private helper function: parse a non-negative decimal integer
+ * terminated by a newline out of [p, end).
+ * \param p         Start of the number
+ * \param end       End of the buffer
+ * \param out       Parsed value
+ * 
+ * \return          Position after the newline or NULL on error
+****************************************************************/
+static const char *scanline(const char *p, const char *end, int *out) {
+    long x = 0;
+    bool neg = false;
+    const char *s;
+
+    if(p < end && *p == '-') { neg = true; p++; }
+    for(s = p; p < end && *p >= '0' && *p <= '9'; p++) {
+        x = x * 10 + (*p - '0');
+        if(x > INT32_MAX) return NULL;
+    }
+    if(p == s || p >= end || *p != '\n') return NULL;
+
+    *out = neg ? (int)-x : (int)x;
+    return p + 1;
+}
+
+
+/****************************************************************
+ * Pageview_parse - parses a page file image already in memory
+ * \param buf       The contents of the page file
+ * \param size      The number of bytes in buf
+ * \param view      The view whose spans are to be filled in
+ * 
+ * \return          0 if sucess and non-zero if otherwise
+****************************************************************/
+int32_t pageview_parse(const char *buf, size_t size, pageview_t *view) {
+
+    if(buf == NULL || view == NULL) return -1;
+
+    // Header: <url>\n<depth>\n<html-length>\n
+    const char *p = buf;
+    const char *end = buf + size;
+    const char *nl = memchr(p, '\n', size);
+    int depth, len;
+    if(nl == NULL || nl == p ||
+       (p = scanline(nl + 1, end, &depth)) == NULL ||
+       (p = scanline(p, end, &len)) == NULL || len < 0) {
+        return -1;
+    }
+
+    view->url = buf;
+    view->urllen = nl - buf;
+    view->depth = depth;
+    view->html = p;
+
+    // A truncated file yields whatever html is present
+    view->htmllen = ((size_t)(end - p) < (size_t)len) ? (size_t)(end - p) 
+                                                      : (size_t)len;
+    return 0;
+}
+
+
+/****************************************************************
+ * Pageload_view - maps a saved page into a borrowed view. Pages
+ * smaller than map_min are read with a single read(); larger
+ * pages are mmap()ed so that the html is never copied.
  * \param id        The assigned id of the page
- * \param dirname   The directory to store the page in
+ * \param dirname   The directory the page is stored in
+ * \param view      The view to be filled in
  * 
- * \return          page if sucess and NULL if otherwise
+ * \return          0 if sucess and non-zero if otherwise
 ****************************************************************/
-webpage_t *pageload(int id, char *dirnm) {
-    
+int32_t pageload_view(int id, char *dirnm, pageview_t *view) {
+
+    if(dirnm == NULL || view == NULL) return -1;
+    memset(view, 0, sizeof(pageview_t));
+
     // Populate filename
     char *filename = malloc(sizeof(char)*strlen(dirnm) + sizeof(char) * 16);
     sprintf(filename, "%s/%d", dirnm, id);
 
-    if(access(filename, R_OK) == 0) {
-        // If file is accessable
-        FILE *inputf = fopen(filename, "r");
-        int depth, len;
-        char url[url_len];
+    int fd = open(filename, O_RDONLY);
+    free(filename);
+    if(fd < 0) return -1;
 
-        // Read file
-        fscanf(inputf, "%s\n%d\n%d\n", url, &depth, &len);
-        char *html = malloc(sizeof(char)*(len + 1));
+    struct stat fst;
+    if(fstat(fd, &fst) != 0 || fst.st_size <= 0) {
+        close(fd);
+        return -1;
+    }
+    size_t size = (size_t)fst.st_size;
 
-        for(int i = 0; i < len; i++) {
-            char buffer = fgetc(inputf);
-            if(buffer == EOF) break;
-            html[i] = buffer;
+    // Pull the whole file in with one call
+    void *base;
+    if(size >= map_min) {
+        base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(base == MAP_FAILED) {
+            close(fd);
+            return -1;
+        }
+        madvise(base, size, MADV_SEQUENTIAL);
+        view->mapped = true;
+    }
+    else {
+        base = malloc(size);
+        ssize_t got = base ? read(fd, base, size) : -1;
+        if(got <= 0) {
+            free(base);
+            close(fd);
+            return -1;
         }
-        html[len] = '\0';
-        
-        // Cleanup
-        webpage_t *newpage = webpage_new(url, depth, html);
-        free(filename);
-        fclose(inputf);
-        return newpage;
+        size = (size_t)got;
+        view->mapped = false;
     }
+    close(fd);
+    view->base = base;
+    view->size = size;
 
-    // Cleanup
-    free(filename);
-    return NULL;
-}
\ No newline at end of file
+    if(pageview_parse((const char*)base, size, view) != 0) {
+        logmsg(LOG_WARN, "Error: malformed page file %d\n", id);
+        pageview_release(view);
+        return -1;
+    }
+    return 0;
+}
+
+
+/****************************************************************
+ * Pageview_release - releases the buffer behind a view
+ * \param view      The view to be released
+****************************************************************/
+void pageview_release(pageview_t *view) {
+    if(view == NULL || view->base == NULL) return;
+    if(view->mapped) munmap(view->base, view->size);
+    else free(view->base);
+    memset(view, 0, sizeof(pageview_t));
+}
+
+
+/****************************************************************
+ * Pageview_copy - creates a page owning copies of a view's spans
+ * \param view      The view to be copied
+ * 
+ * \return          page if sucess and NULL if otherwise
+****************************************************************/
+webpage_t *pageview_copy(const pageview_t *view) {
+
+    if(view == NULL || view->url == NULL) return NULL;
+    char *url = malloc(sizeof(char)*(view->urllen + 1));
+    char *html = malloc(sizeof(char)*(view->htmllen + 1));
+    if(url == NULL || html == NULL) {
+        free(url); free(html);
+        return NULL;
+    }
+    memcpy(url, view->url, view->urllen);
+    url[view->urllen] = '\0';
+    memcpy(html, view->html, view->htmllen);
+    html[view->htmllen] = '\0';
+
+    webpage_t *newpage = webpage_new(url, view->depth, html);
+    free(url);
+    return newpage;
+}
+
+
+/****************************************************************
+ * Pageencode - writes the page file image of a page into buf
+ * \param pagep     The page to be encoded
+ * \param buf       Output buffer, may be NULL if size is 0
+ * \param size      Size of the output buffer
+ * 
+ * \return          Size of the image; nothing is written if that
+ *                  is larger than size
+****************************************************************/
+size_t pageencode(webpage_t *pagep, char *buf, size_t size) {
+
+    char* html  = webpage_getHTML(pagep);
+    int   len   = webpage_getHTMLlen(pagep);
+    char* url   = webpage_getURL(pagep);
+    int   depth = webpage_getDepth(pagep);
+    if(url == NULL) return 0;
+    if(html == NULL) html = "";
+
+    char header[32];
+    size_t urllen = strlen(url);
+    size_t hdrlen = sprintf(header, "\n%d\n%d\n", depth, len);
+    size_t htmllen = strlen(html);
+    size_t total = urllen + hdrlen + htmllen + 1;
+    if(buf == NULL || total > size) return total;
+
+    memcpy(buf, url, urllen);
+    memcpy(buf + urllen, header, hdrlen);
+    memcpy(buf + urllen + hdrlen, html, htmllen);
+    buf[total - 1] = '\n';
+    return total;
+}
+
+
+/****************************************************************
+ * Pageload - loads a html page to local directory
+ * \param id        The assigned id of the page
+ * \param dirname   The directory to store the page in
+ * 
+ * \return          page if sucess and NULL if otherwise
+****************************************************************/
+webpage_t *pageload(int id, char *dirnm) {
+
+    pageview_t view;
+    if(pageload_view(id, dirnm, &view) != 0) return NULL;
+    webpage_t *newpage = pageview_copy(&view);
+    pageview_release(&view);
+    return newpage;
+}
@@ -16,8 +16,25 @@
 #include <string.h>
 #include <inttypes.h>
 #include <unistd.h>
+#include <stddef.h>
 #include "webpage.h"
 
+/*
+ * pageview_t -- a borrowed, read-only view of a saved page file. The
+ * url and html spans point straight into the loaded file and are NOT
+ * null-terminated; they stay valid until pageview_release() is called.
+ */
+typedef struct pageview {
+  const char *url;          // start of the url
+  size_t urllen;            // length of the url
+  int depth;                // depth of crawl
+  const char *html;         // start of the html
+  size_t htmllen;           // length of the html
+  void *base;               // buffer or mapping backing the spans
+  size_t size;              // size of the buffer or mapping
+  bool mapped;              // true if base is an mmap()ed region
+} pageview_t;
+
 /*
  * pagesave -- save the page in filename id in directory dirnm
  *
@@ -38,3 +55,44 @@ int32_t pagesave(webpage_t *pagep, int id, char *dirnm);
  * returns: non-NULL for success; NULL otherwise
  */
 webpage_t *pageload(int id, char *dirnm);
+
+/*
+ * pageload_view -- maps the numbered filename <id> in directory <dirnm>
+ * into view without copying the url or the html. The file is read in
+ * a single read() (small pages) or mmap() (large pages); urls of any
+ * length are supported.
+ *
+ * returns: 0 for success; nonzero otherwise
+ */
+int32_t pageload_view(int id, char *dirnm, pageview_t *view);
+
+/*
+ * pageview_release -- releases the storage borrowed by a view filled
+ * in by pageload_view(); the spans must not be used afterwards
+ */
+void pageview_release(pageview_t *view);
+
+/*
+ * pageview_parse -- fills in the spans of view from a page file image
+ * already in memory; the spans point into buf and view->base is left
+ * untouched
+ *
+ * returns: 0 for success; nonzero otherwise
+ */
+int32_t pageview_parse(const char *buf, size_t size, pageview_t *view);
+
+/*
+ * pageview_copy -- creates a new webpage owning copies of the url and
+ * html of a view
+ *
+ * returns: non-NULL for success; NULL otherwise
+ */
+webpage_t *pageview_copy(const pageview_t *view);
+
+/*
+ * pageencode -- writes the page file image of pagep (the format used
+ * by pagesave) into buf if it fits in size bytes
+ *
+ * returns: the size of the image, whether or not it was written
+ */
+size_t pageencode(webpage_t *pagep, char *buf, size_t size);
@@ -46,6 +46,22 @@ int main(){
     eprintf("dep diff: %d\n", (depth1 - depth2));
     eprintf("len diff: %d\n", (len1 - len2));
     eprintf("pge diff: %d\n", strcmp(HTML1, HTML2));
+
+    // Compare the borrowed view against the copied page
+    pageview_t view;
+    if(pageload_view(1, ".", &view) != 0) {
+        eprintf("view failed for page %d\n", 1);
+        webpage_delete(original);
+        webpage_delete(saved);
+        return 1;
+    }
+    eprintf("view url diff: %d\n", 
+            (int)(view.urllen != strlen(URL2)) || 
+            strncmp(view.url, URL2, view.urllen));
+    eprintf("view dep diff: %d\n", (view.depth - depth2));
+    eprintf("view len diff: %d\n", (int)view.htmllen - len2);
+    eprintf("view pge diff: %d\n", memcmp(view.html, HTML2, view.htmllen));
+    pageview_release(&view);
     
     webpage_delete(original);
     webpage_delete(saved);
@@ -0,0 +1,212 @@
+/****************************************************************
+ * file   pagepipe.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   November 20, 2021
+ *
+ * Read-ahead page source. Reader threads claim runs of page ids in
+ * order and load them into ring slot (id % depth); the consumer
+ * takes them out in id order. Readers never run more than depth
+ * pages ahead of the consumer, so memory stays bounded. Each reader
+ * loads its run through a pageaio context, so with io_uring a
+ * single reader keeps a whole run of reads in flight.
+ *
+****************************************************************/
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include<limits.h>
+#include<pthread.h>
+#include"pageio.h"
+#include"pageaio.h"
+#include"pagepipe.h"
+
+
+/****************************************************************
+ * Define pipe data structure
+****************************************************************/
+typedef struct pagepipe {
+    char *dirnm;                // Page directory
+    webpage_t **ring;           // Loaded pages, slot (id % depth)
+    int depth;                  // Number of ring slots
+    int batch;                  // Most ids a reader loads at once
+    int next;                   // Next id to be claimed by a reader
+    int head;                   // Next id to be handed to the consumer
+    int last;                   // First id that failed to load
+    bool stop;                  // Set by ppclose()
+    pthread_mutex_t lock;
+    pthread_cond_t filled;      // A slot was filled or last moved
+    pthread_cond_t freed;       // The consumer took a page
+    pthread_t *readers;
+    int nreaders;
+    int alive;                  // Readers still running
+} pp_t;
+
+
+/****************************************************************
+ * Private helper function: reader thread. Claims the next run of
+ * ids that fits in the free ring slots, loads the whole run with
+ * one batched pageaio request without holding the lock, and
+ * publishes the pages to the consumer.
+****************************************************************/
+static void *reader(void *arg) {
+
+    pp_t *pp = (pp_t*)arg;
+    pageaio_t *pa = paopen(pp->batch, PA_AUTO);
+    int *ids = (int*)malloc(pp->batch * sizeof(int));
+    webpage_t **pages = (webpage_t**)malloc(pp->batch * sizeof(webpage_t*));
+
+    pthread_mutex_lock(&pp->lock);
+    while(!pp->stop && pp->next < pp->last && pa && ids && pages) {
+
+        // Wait for room in the ring
+        int room = pp->depth - (pp->next - pp->head);
+        if(room <= 0) {
+            pthread_cond_wait(&pp->freed, &pp->lock);
+            continue;
+        }
+
+        int n = room < pp->batch ? room : pp->batch;
+        for(int i = 0; i < n; i++) ids[i] = pp->next++;
+        pthread_mutex_unlock(&pp->lock);
+        paload(pa, ids, n, pp->dirnm, pages);
+        pthread_mutex_lock(&pp->lock);
+
+        for(int i = 0; i < n; i++) {
+            int id = ids[i];
+            if(pages[i] == NULL) {
+                // End of the page directory
+                if(id < pp->last) pp->last = id;
+            }
+            else if(pp->stop || id >= pp->last) {
+                webpage_delete(pages[i]);
+            }
+            else {
+                pp->ring[id % pp->depth] = pages[i];
+            }
+        }
+        pthread_cond_broadcast(&pp->filled);
+    }
+
+    // If no reader could start, end the stream where it stands
+    if(--pp->alive == 0 && pp->next < pp->last) pp->last = pp->next;
+
+    // Wake up anyone still waiting on this reader
+    pthread_cond_broadcast(&pp->filled);
+    pthread_cond_broadcast(&pp->freed);
+    pthread_mutex_unlock(&pp->lock);
+    paclose(pa);
+    free(ids);
+    free(pages);
+    return NULL;
+}
+
+
+/****************************************************************
+ * ppopen -- start prefetching pages from dirnm at firstid
+****************************************************************/
+pagepipe_t *ppopen(char *dirnm, int firstid, int depth, int nreaders) {
+
+    if(dirnm == NULL || depth < 1 || nreaders < 1) return NULL;
+
+    pp_t *pp;
+    if(!(pp = (pp_t*)calloc(1, sizeof(pp_t)))) {
+        printf("Error: malloc failed allocating page pipe\n");
+        return NULL;
+    }
+    pp->dirnm = (char*)malloc(strlen(dirnm) + 1);
+    pp->ring = (webpage_t**)calloc(depth, sizeof(webpage_t*));
+    pp->readers = (pthread_t*)calloc(nreaders, sizeof(pthread_t));
+    if(pp->dirnm == NULL || pp->ring == NULL || pp->readers == NULL) {
+        printf("Error: malloc failed allocating page pipe\n");
+        free(pp->dirnm); free(pp->ring); free(pp->readers); free(pp);
+        return NULL;
+    }
+    strcpy(pp->dirnm, dirnm);
+    pp->depth = depth;
+    pp->batch = (depth / nreaders > 0) ? depth / nreaders : 1;
+    pp->next = firstid;
+    pp->head = firstid;
+    pp->last = INT_MAX;
+    pp->stop = false;
+    pthread_mutex_init(&pp->lock, NULL);
+    pthread_cond_init(&pp->filled, NULL);
+    pthread_cond_init(&pp->freed, NULL);
+    pp->alive = nreaders;
+
+    // Start the readers
+    for(int i = 0; i < nreaders; i++) {
+        if(pthread_create(&pp->readers[i], NULL, reader, pp) != 0) {
+            break;
+        }
+        pp->nreaders++;
+    }
+    pthread_mutex_lock(&pp->lock);
+    pp->alive -= nreaders - pp->nreaders;
+    pthread_mutex_unlock(&pp->lock);
+    if(pp->nreaders == 0) {
+        ppclose(pp);
+        return NULL;
+    }
+
+    return (pagepipe_t*)pp;
+}
+
+
+/****************************************************************
+ * ppget -- get the next page in id order
+****************************************************************/
+webpage_t *ppget(pagepipe_t *pipe, int *id) {
+
+    if(pipe == NULL) return NULL;
+    pp_t *pp = (pp_t*)pipe;
+
+    pthread_mutex_lock(&pp->lock);
+    while(pp->head < pp->last && pp->ring[pp->head % pp->depth] == NULL) {
+        pthread_cond_wait(&pp->filled, &pp->lock);
+    }
+    if(pp->head >= pp->last) {
+        pthread_mutex_unlock(&pp->lock);
+        return NULL;
+    }
+
+    int slot = pp->head % pp->depth;
+    webpage_t *page = pp->ring[slot];
+    pp->ring[slot] = NULL;
+    if(id != NULL) *id = pp->head;
+    pp->head++;
+    pthread_cond_broadcast(&pp->freed);
+    pthread_mutex_unlock(&pp->lock);
+    return page;
+}
+
+
+/****************************************************************
+ * ppclose -- stop the readers and free unconsumed pages
+****************************************************************/
+void ppclose(pagepipe_t *pipe) {
+
+    if(pipe == NULL) return;
+    pp_t *pp = (pp_t*)pipe;
+
+    pthread_mutex_lock(&pp->lock);
+    pp->stop = true;
+    pthread_cond_broadcast(&pp->freed);
+    pthread_mutex_unlock(&pp->lock);
+    for(int i = 0; i < pp->nreaders; i++) {
+        pthread_join(pp->readers[i], NULL);
+    }
+
+    for(int i = 0; i < pp->depth; i++) {
+        webpage_delete(pp->ring[i]);
+    }
+    pthread_mutex_destroy(&pp->lock);
+    pthread_cond_destroy(&pp->filled);
+    pthread_cond_destroy(&pp->freed);
+    free(pp->readers);
+    free(pp->ring);
+    free(pp->dirnm);
+    free(pp);
+}
@@ -0,0 +1,31 @@
+#pragma once
+/*
+ * pagepipe.h -- a read-ahead page source for the indexer
+ *
+ * Reader threads prefetch the numbered page files firstid,
+ * firstid+1, ... from a page directory into a bounded ring while the
+ * caller consumes them in id order. The stream ends at the first id
+ * that cannot be loaded, exactly like a pageload() loop would.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include "webpage.h"
+
+/* the pipe representation is hidden from users of the module */
+typedef void pagepipe_t;
+
+/* ppopen -- start prefetching pages from dirnm beginning at firstid;
+ * at most depth pages are held at once and nreaders threads load
+ * pages concurrently
+ * returns NULL on failure
+ */
+pagepipe_t *ppopen(char *dirnm, int firstid, int depth, int nreaders);
+
+/* ppget -- get the next page in id order, blocking until it has been
+ * loaded; the page id is stored in *id. The caller owns the page.
+ * returns NULL once the end of the page directory is reached
+ */
+webpage_t *ppget(pagepipe_t *pp, int *id);
+
+/* ppclose -- stop the readers and free any pages not yet consumed */
+void ppclose(pagepipe_t *pp);
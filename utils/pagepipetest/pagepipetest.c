@@ -0,0 +1,77 @@
+/****************************************************************
+ * file   pagepipetest.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   November 20, 2021
+ * 
+ * Tests if the pagepipe.h module hands back the same pages, in the
+ * same order, as a plain pageload() loop
+ * 
+****************************************************************/
+
+#include<stdio.h>
+#include<string.h>
+#include"pageio.h"
+#include"pagepipe.h"
+#include"webpage.h"
+
+/****************************************************************
+ * Define macro, globals and helper functions
+****************************************************************/
+#define eprintf(format, ...) do {                 \
+    if (verbose)                                  \
+        fprintf(stderr, format, ##__VA_ARGS__);   \
+} while(0)
+#define verbose 1
+
+
+/****************************************************************
+ * Compare every page, with a ring smaller than the page count
+****************************************************************/
+int main(){
+
+    pagepipe_t *pipe = ppopen("../../pages", 1, 4, 3);
+    if(pipe == NULL) {
+        eprintf("failed to open pipe on %s\n", "../../pages");
+        return 1;
+    }
+
+    int id, expect = 1, diffs = 0;
+    webpage_t *piped;
+    while((piped = ppget(pipe, &id)) != NULL) {
+        webpage_t *loaded = pageload(expect, "../../pages");
+        if(id != expect || loaded == NULL ||
+           strcmp(webpage_getURL(piped), webpage_getURL(loaded)) ||
+           strcmp(webpage_getHTML(piped), webpage_getHTML(loaded))) {
+            eprintf("page diff: %d\n", id);
+            diffs++;
+        }
+        webpage_delete(loaded);
+        webpage_delete(piped);
+        expect++;
+    }
+    ppclose(pipe);
+
+    // The stream must end exactly where pageload() runs out, and an
+    // empty or missing page directory proves nothing
+    webpage_t *after = pageload(expect, "../../pages");
+    eprintf("pages: %d\n", expect - 1);
+    eprintf("end diff: %d\n", after != NULL);
+    eprintf("page diffs: %d\n", diffs);
+    diffs += after != NULL;
+    webpage_delete(after);
+    if(expect - 1 == 0) {
+        eprintf("no pages in %s\n", "../../pages");
+        diffs++;
+    }
+
+    // Closing a pipe before draining it must not leak or hang
+    pipe = ppopen("../../pages", 1, 4, 2);
+    if(pipe == NULL) {
+        eprintf("failed to reopen pipe on %s\n", "../../pages");
+        return 1;
+    }
+    webpage_delete(ppget(pipe, &id));
+    ppclose(pipe);
+
+    return diffs != 0;
+}
@@ -0,0 +1,223 @@
+/****************************************************************
+ * file   posio.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   December 8, 2021
+ *
+ * Implementation of saving and loading the positions of the words
+ * of an index, delta coded.
+ *
+****************************************************************/
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include"hash.h"
+#include"queue.h"
+#include"indexio.h"
+#include"log.h"
+#include"posio.h"
+
+
+/****************************************************************
+ * Define macro, structs, globals and helper functions
+****************************************************************/
+#define __SUFFIX ".pos"
+#define __MAGIC "tsepos 1"
+#define __MAXWORD 128
+
+// File saved to, and documents of the word being loaded; saving and
+// loading are not thread safe
+static FILE *posf;
+static doc_t **docs;
+static int ndocs, cap;
+
+static void pospath(char *path, size_t size, char *dirname, char *indexnm) {
+    snprintf(path, size, "%s/%s%s", dirname, indexnm, __SUFFIX);
+}
+
+
+/****************************************************************
+ * Private helper functions: numbers 7 bits a byte, in memory and
+ * in files
+****************************************************************/
+static int putvar(unsigned int x, unsigned char *out) {
+    int n = 0;
+    for(; x >= 0x80; x >>= 7) out[n++] = (unsigned char)(x | 0x80);
+    out[n++] = (unsigned char)x;
+    return n;
+}
+
+static void writevar(unsigned int x, FILE *f) {
+    unsigned char buf[5];
+    fwrite(buf, 1, putvar(x, buf), f);
+}
+
+static int readvar(FILE *f) {
+    unsigned int x = 0;
+    for(int shift = 0; shift < 35; shift += 7) {
+        int c = getc(f);
+        if(c == EOF) return -1;
+        x |= (unsigned int)(c & 0x7f) << shift;
+        if(!(c & 0x80)) return (int)x;
+    }
+    return -1;
+}
+
+
+/****************************************************************
+ * posencode, posdecode -- see posio.h
+****************************************************************/
+int posencode(const int *pos, int n, unsigned char *out) {
+    int len = 0, prev = 0;
+    for(int i = 0; i < n; i++) {
+        len += putvar((unsigned int)(pos[i] - prev), out + len);
+        prev = pos[i];
+    }
+    return len;
+}
+
+int posdecode(const unsigned char *in, int n, int *out) {
+    int len = 0, prev = 0;
+    for(int i = 0; i < n; i++) {
+        unsigned int x = 0;
+        int shift = 0;
+        do {
+            x |= (unsigned int)(in[len] & 0x7f) << shift;
+            shift += 7;
+        } while(in[len++] & 0x80);
+        out[i] = prev += (int)x;
+    }
+    return len;
+}
+
+
+/****************************************************************
+ * possave -- one record a word, gaps written as they are coded
+****************************************************************/
+static void savedoc(void *p) {
+    doc_t *d = (doc_t*)p;
+    int n = d->pos != NULL ? d->freq : 0;
+    writevar(d->id, posf);
+    writevar(n, posf);
+    for(int i = 0; i < n; i++) writevar(d->pos[i] - (i > 0 ? d->pos[i - 1] : 0), posf);
+}
+
+static void countdoc(void *p) {
+    ndocs++;
+}
+
+static void saveword(void *p) {
+    word_t *w = (word_t*)p;
+    ndocs = 0;
+    qapply(w->doclist, countdoc);
+    if(ndocs == 0) return;
+    fprintf(posf, "%s\n", w->word);
+    writevar(ndocs, posf);
+    qapply(w->doclist, savedoc);
+}
+
+int32_t possave(hashtable_t *index, char *dirname, char *indexnm) {
+
+    if(index == NULL) return -1;
+    char path[512];
+    pospath(path, sizeof(path), dirname, indexnm);
+    if((posf = fopen(path, "wb")) == NULL) {
+        logmsg(LOG_ERROR, "Error: failed to write %s\n", path);
+        return -1;
+    }
+    fprintf(posf, "%s\n", __MAGIC);
+    happly(index, saveword);
+    int error = fclose(posf) == 0 ? 0 : -1;
+    posf = NULL;
+    return error;
+}
+
+
+/****************************************************************
+ * Private helper functions: the documents of a word, by id
+****************************************************************/
+static void adddoc(void *p) {
+    if(ndocs == cap) {
+        cap = cap ? 2 * cap : 64;
+        docs = (doc_t**)realloc(docs, cap * sizeof(doc_t*));
+    }
+    docs[ndocs++] = (doc_t*)p;
+}
+
+static int cmpdoc(const void *a, const void *b) {
+    return (*(doc_t* const*)a)->id - (*(doc_t* const*)b)->id;
+}
+
+static doc_t *finddoc(int id) {
+    int lo = 0, hi = ndocs;
+    while(lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if(docs[mid]->id < id) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < ndocs && docs[lo]->id == id ? docs[lo] : NULL;
+}
+
+
+/****************************************************************
+ * posload -- reads every record, and keeps those matching the
+ * documents of the index
+****************************************************************/
+int32_t posload(hashtable_t *index, char *dirname, char *indexnm) {
+
+    if(index == NULL) return -1;
+    char path[512], word[__MAXWORD];
+    pospath(path, sizeof(path), dirname, indexnm);
+    FILE *f = fopen(path, "rb");
+    if(f == NULL) return -1;
+    if(fgets(word, sizeof(word), f) == NULL || strcmp(word, __MAGIC "\n")) {
+        logmsg(LOG_ERROR, "Error: %s is not a positions file\n", path);
+        fclose(f);
+        return -1;
+    }
+
+    int32_t loaded = 0;
+    bool truncated = false;
+    while(!truncated && fscanf(f, "%127s", word) == 1 && getc(f) == '\n') {
+        word_t *w = (word_t*)hsearch(index, indexmatch, word, strlen(word));
+        ndocs = 0;
+        if(w != NULL) {
+            qapply(w->doclist, adddoc);
+            qsort(docs, ndocs, sizeof(doc_t*), cmpdoc);
+        }
+
+        int n = readvar(f);
+        for(int i = 0; i < n && !truncated; i++) {
+            int id = readvar(f), count = readvar(f);
+            if(id < 0 || count < 0) {
+                truncated = true;
+                break;
+            }
+            int *pos = (int*)malloc((count > 0 ? count : 1) * sizeof(int));
+            for(int j = 0, prev = 0; j < count; j++) {
+                int gap = readvar(f);
+                if(gap < 0) truncated = true;
+                pos[j] = prev += gap;
+            }
+
+            doc_t *d = finddoc(id);
+            if(truncated || d == NULL || count == 0 || d->freq != count) {
+                free(pos);
+                continue;
+            }
+            free(d->pos);
+            d->pos = pos;
+            loaded++;
+        }
+        truncated = truncated || n < 0;
+    }
+    if(truncated) logmsg(LOG_WARN, "Warning: %s is truncated\n", path);
+
+    fclose(f);
+    free(docs);
+    docs = NULL;
+    ndocs = cap = 0;
+    return loaded;
+}
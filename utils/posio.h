@@ -0,0 +1,49 @@
+#pragma once
+/*
+ * posio.h -- saving and loading the positions of words
+ *
+ * The index only says how many times a word is in a document; for
+ * phrases, the indexer also records where. The position of a word
+ * is its number among the words of the page, counting the words too
+ * short to be indexed, so that words next to each other in the page
+ * have consecutive positions.
+ *
+ * possave() writes them next to the index, to <indexnm>.pos. For
+ * every word, in the order of the index, the file has the word and a
+ * newline, then the number of its documents, and for each one its
+ * id, its number of occurrences and the gaps between them, the first
+ * from position 0. Numbers are delta coded the same way in memory
+ * (see posencode()): 7 bits a byte, low bits first, the high bit of
+ * every byte but the last set, so most gaps take a byte.
+ *
+ * Documents of the index are expected to be as indexload() makes
+ * them, with a pointer to freq positions, or NULL, after the id and
+ * the frequency.
+ */
+#include <stdint.h>
+#include "hash.h"
+
+/* possave -- saves the positions of an index to dirname/indexnm.pos;
+ * documents without positions are saved without any
+ * returns 0 if success and non-zero otherwise
+ */
+int32_t possave(hashtable_t *index, char *dirname, char *indexnm);
+
+/* posload -- reads dirname/indexnm.pos into the documents of an
+ * index; documents whose number of occurrences changed since are
+ * left without positions
+ * returns the number of documents given positions, or -1 if there is
+ * no file
+ */
+int32_t posload(hashtable_t *index, char *dirname, char *indexnm);
+
+/* posencode -- delta codes n increasing positions into out, which
+ * must have room for 5 bytes a position
+ * returns the number of bytes written
+ */
+int posencode(const int *pos, int n, unsigned char *out);
+
+/* posdecode -- decodes n positions from in into out
+ * returns the number of bytes read
+ */
+int posdecode(const unsigned char *in, int n, int *out);
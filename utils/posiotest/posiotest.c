@@ -0,0 +1,120 @@
+/****************************************************************
+ * file   posiotest.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   December 8, 2021
+ *
+ * Tests that the posio.h module codes positions so they decode to
+ * themselves, and that positions saved with an index are loaded back
+ * into the documents they belong to, but not into documents whose
+ * number of occurrences changed
+ *
+****************************************************************/
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include"hash.h"
+#include"queue.h"
+#include"indexio.h"
+#include"posio.h"
+
+/****************************************************************
+ * Define macro, globals and helper functions
+****************************************************************/
+#define eprintf(format, ...) do {                 \
+    if (verbose)                                  \
+        fprintf(stderr, format, ##__VA_ARGS__);   \
+} while(0)
+#define verbose 1
+
+#define __INDEX "posiotest.index"
+
+static bool idmatch(void *elementp, const void *keyp) {
+    return ((doc_t*)elementp)->id == *(const int*)keyp;
+}
+
+// Adds a word found in the documents ids, at the positions given for
+// each one, or without positions if withpos is false
+static void addword(hashtable_t *h, const char *word, int n, int *ids,
+                    int *freqs, int **pos, bool withpos) {
+    word_t *w = indexword(h, word);
+    for(int i = 0; i < n; i++) indexdoc(w, ids[i], freqs[i], withpos ? pos[i] : NULL);
+}
+
+static hashtable_t *mkindex(bool withpos, int catfreq) {
+    hashtable_t *h = hopen(16);
+    addword(h, "cat", 2, (int[]){1, 3}, (int[]){2, catfreq},
+            (int*[]){(int[]){0, 7}, (int[]){300, 100000}}, withpos);
+    addword(h, "hat", 1, (int[]){3}, (int[]){1}, (int*[]){(int[]){301}}, withpos);
+    return h;
+}
+
+// Checks the positions of a word in a document
+static int haspos(hashtable_t *h, const char *word, int id, int n, int *want) {
+    word_t *w = (word_t*)hsearch(h, indexmatch, word, strlen(word));
+    doc_t *d = (doc_t*)qsearch(w->doclist, idmatch, &id);
+    if(n == 0 ? d->pos != NULL : d->pos == NULL || memcmp(d->pos, want, n * sizeof(int))) {
+        eprintf("positions of %s in %d not loaded as expected\n", word, id);
+        return 1;
+    }
+    return 0;
+}
+
+
+int main(void) {
+
+    int errors = 0;
+
+    // Gaps of every length of code
+    int pos[] = {0, 1, 127, 128, 16511, 16512, 2113663, 2113664, 300000000};
+    int n = sizeof(pos) / sizeof(pos[0]), got[sizeof(pos) / sizeof(pos[0])];
+    unsigned char buf[5 * sizeof(pos) / sizeof(pos[0])];
+    int len = posencode(pos, n, buf);
+    if(len != 1 + 1 + 1 + 1 + 2 + 1 + 3 + 1 + 5 || posdecode(buf, n, got) != len ||
+       memcmp(pos, got, sizeof(pos))) {
+        eprintf("%s\n", "positions do not decode to themselves");
+        errors++;
+    }
+
+    hashtable_t *h = mkindex(true, 2);
+    if(possave(h, ".", __INDEX) != 0) {
+        eprintf("%s\n", "possave failed");
+        errors++;
+    }
+    indexclose(h);
+
+    // Loaded into the same documents
+    h = mkindex(false, 2);
+    if(posload(h, ".", __INDEX) != 3) {
+        eprintf("%s\n", "posload did not load every document");
+        errors++;
+    }
+    errors += haspos(h, "cat", 1, 2, (int[]){0, 7});
+    errors += haspos(h, "cat", 3, 2, (int[]){300, 100000});
+    errors += haspos(h, "hat", 3, 1, (int[]){301});
+    indexclose(h);
+
+    // A document that changed is left without positions
+    h = mkindex(false, 3);
+    if(posload(h, ".", __INDEX) != 2) {
+        eprintf("%s\n", "posload loaded a document that changed");
+        errors++;
+    }
+    errors += haspos(h, "cat", 3, 0, NULL);
+    errors += haspos(h, "hat", 3, 1, (int[]){301});
+    if(posload(h, ".", "missing.index") != -1) {
+        eprintf("%s\n", "posload loaded a missing file");
+        errors++;
+    }
+    indexclose(h);
+    remove(__INDEX ".pos");
+
+    if(errors) {
+        eprintf("%d errors\n", errors);
+        exit(EXIT_FAILURE);
+    }
+    eprintf("%s passed\n", "posio");
+    exit(EXIT_SUCCESS);
+}
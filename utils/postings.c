@@ -0,0 +1,455 @@
+/****************************************************************
+ * file   postings.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   December 6, 2021
+ *
+ * Implementation of posting lists as arrays, built from the
+ * doclists of an index, and of their block maxima and the statistics
+ * of their words.
+ *
+****************************************************************/
+
+#define _POSIX_C_SOURCE 200809L     // st_mtim
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include<sys/stat.h>
+#include"hash.h"
+#include"queue.h"
+#include"indexio.h"
+#include"log.h"
+#include"rank.h"
+#include"posio.h"
+#include"tier.h"
+#include"postings.h"
+
+
+/****************************************************************
+ * Define postings data structure
+****************************************************************/
+#define __SUFFIX ".bmw"
+#define __DFSUFFIX ".df"
+#define __MAXWORD 128
+
+typedef struct postings {
+    hashtable_t *lists;             // plist_t by word
+    int nlists;
+    uint64_t gen;
+} pl_t;
+
+// Document frequency of a word across the collection
+typedef struct {
+    char *word;
+    int df;
+} df_t;
+
+// State of the happly() walks over an index; opening and saving
+// postings is not thread safe
+static struct {
+    pl_t *pl;
+    ranker_t *rk;
+    ranker_t *models[2];            // BM25 and TF-IDF, for plsave()
+    FILE *f;
+    int n, cap;
+    doc_t *docs;                    // The doclist being copied
+    hashtable_t *dfs;               // df_t by word, if saved
+    hashtable_t *hot;               // Words of the hot tier
+    hashtable_t **shards;           // Of the collection, for plsavedf()
+    int nshards;
+    long cf;                        // Occurrences of the word saved
+} walk;
+
+static bool wordmatch(void *elementp, const void *keyp) {
+    return !strcmp(((plist_t*)elementp)->word, (const char*)keyp);
+}
+
+static void freelist(void *p) {
+    plist_t *l = (plist_t*)p;
+    free(l->word);
+    free(l->ids);
+    free(l->tfs);
+    free(l->w);
+    free(l->bmax);
+    free(l->pos);
+    free(l->poff);
+}
+
+static bool dfmatch(void *elementp, const void *keyp) {
+    return !strcmp(((df_t*)elementp)->word, (const char*)keyp);
+}
+
+static void freedf(void *p) {
+    free(((df_t*)p)->word);
+}
+
+static void bmwpath(char *path, size_t size, char *dirname, char *indexnm) {
+    snprintf(path, size, "%s/%s%s", dirname, indexnm, __SUFFIX);
+}
+
+
+/****************************************************************
+ * Private helper functions: copy the postings of a word into
+ * walk.docs, in increasing order of id and without those of no
+ * occurrence
+****************************************************************/
+static void copydoc(void *p) {
+    doc_t *d = (doc_t*)p;
+    if(d->freq < 1) return;
+    if(walk.n == walk.cap) {
+        walk.cap = walk.cap ? 2 * walk.cap : 1024;
+        walk.docs = (doc_t*)realloc(walk.docs, walk.cap * sizeof(doc_t));
+    }
+    walk.docs[walk.n++] = *d;
+}
+
+static int cmpid(const void *a, const void *b) {
+    return ((const doc_t*)a)->id - ((const doc_t*)b)->id;
+}
+
+static void collect(word_t *w) {
+    walk.n = 0;
+    qapply(w->doclist, copydoc);
+    for(int i = 1; i < walk.n; i++) {
+        if(walk.docs[i].id < walk.docs[i - 1].id) {
+            qsort(walk.docs, walk.n, sizeof(doc_t), cmpid);
+            break;
+        }
+    }
+}
+
+// The largest weight of every block, and of the list
+static float blockmax(int n, float *w, float *bmax) {
+    float wmax = 0;
+    for(int b = 0; b * PL_BLOCK < n; b++) {
+        bmax[b] = 0;
+        for(int i = b * PL_BLOCK; i < n && i < (b + 1) * PL_BLOCK; i++) {
+            if(w[i] > bmax[b]) bmax[b] = w[i];
+        }
+        if(bmax[b] > wmax) wmax = bmax[b];
+    }
+    return wmax;
+}
+
+
+/****************************************************************
+ * plsave -- one line per word, with the block maxima of both
+ * models side by side
+****************************************************************/
+static void saveword(void *p) {
+    collect((word_t*)p);
+    if(walk.n == 0) return;
+    int nblocks = (walk.n + PL_BLOCK - 1) / PL_BLOCK;
+    float *w = (float*)malloc(walk.n * sizeof(float));
+    float *bmax[2];
+    for(int m = 0; m < 2; m++) {
+        bmax[m] = (float*)malloc(nblocks * sizeof(float));
+        for(int i = 0; i < walk.n; i++) {
+            w[i] = rkweight(walk.models[m], walk.docs[i].id, walk.docs[i].freq);
+        }
+        blockmax(walk.n, w, bmax[m]);
+    }
+    fprintf(walk.f, "%s %d", ((word_t*)p)->word, nblocks);
+    for(int b = 0; b < nblocks; b++) {
+        fprintf(walk.f, " %.9g %.9g", bmax[0][b], bmax[1][b]);
+    }
+    fputc('\n', walk.f);
+    free(w);
+    free(bmax[0]);
+    free(bmax[1]);
+}
+
+int32_t plsave(hashtable_t *index, char *dirname, char *indexnm) {
+
+    if(index == NULL) return -1;
+    walk.models[0] = rkopen(RK_BM25, dirname, indexnm);
+    walk.models[1] = rkopen(RK_TFIDF, dirname, indexnm);
+    char path[512];
+    bmwpath(path, sizeof(path), dirname, indexnm);
+    walk.f = walk.models[0] && walk.models[1] ? fopen(path, "w") : NULL;
+    int error = 0;
+    if(walk.f == NULL) {
+        logmsg(LOG_ERROR, "Error: failed to write %s\n", path);
+        error = -1;
+    }
+    else {
+        fprintf(walk.f, "%d\n", PL_BLOCK);
+        happly(index, saveword);
+        error = fclose(walk.f) == 0 ? 0 : -1;
+    }
+    rkclose(walk.models[0]);
+    rkclose(walk.models[1]);
+    free(walk.docs);
+    memset(&walk, 0, sizeof(walk));
+    return error;
+}
+
+
+/****************************************************************
+ * plsavedf -- the df of a word is the sum of the lengths of its
+ * doclists in every shard, and its cf the sum of their frequencies
+****************************************************************/
+static void countdoc(void *p) {
+    if(((doc_t*)p)->freq < 1) return;
+    walk.n++;
+    walk.cf += ((doc_t*)p)->freq;
+}
+
+static void savedf(void *p) {
+    word_t *w = (word_t*)p;
+    walk.n = 0;
+    walk.cf = 0;
+    for(int i = 0; i < walk.nshards; i++) {
+        word_t *x = (word_t*)hsearch(walk.shards[i], indexmatch, w->word, strlen(w->word));
+        if(x != NULL) qapply(x->doclist, countdoc);
+    }
+    if(walk.n > 0) fprintf(walk.f, "%s %d %ld\n", w->word, walk.n, walk.cf);
+}
+
+int32_t plsavedf(hashtable_t **shards, int n, char *dirname, char **names) {
+
+    int error = 0;
+    walk.shards = shards;
+    walk.nshards = n;
+    for(int i = 0; i < n && error == 0; i++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s%s", dirname, names[i], __DFSUFFIX);
+        if(shards[i] == NULL || (walk.f = fopen(path, "w")) == NULL) {
+            logmsg(LOG_ERROR, "Error: failed to write %s\n", path);
+            error = -1;
+            break;
+        }
+        happly(shards[i], savedf);
+        error = fclose(walk.f) == 0 ? 0 : -1;
+    }
+    memset(&walk, 0, sizeof(walk));
+    return error;
+}
+
+
+/****************************************************************
+ * Private helper function: read the document frequencies saved with
+ * an index, if they were
+ * \return          a table of df_t by word, or NULL
+****************************************************************/
+static hashtable_t *loaddf(char *dirname, char *indexnm) {
+    char path[512], word[__MAXWORD];
+    snprintf(path, sizeof(path), "%s/%s%s", dirname, indexnm, __DFSUFFIX);
+    FILE *f = fopen(path, "r");
+    if(f == NULL) return NULL;
+
+    hashtable_t *dfs = hopen(4096);
+    int df;
+    while(dfs != NULL && fscanf(f, "%127s %d%*[^\n]", word, &df) == 2) {
+        df_t *d = (df_t*)malloc(sizeof(df_t));
+        d->word = (char*)malloc(strlen(word) + 1);
+        strcpy(d->word, word);
+        d->df = df;
+        hput(dfs, d, d->word, strlen(d->word));
+    }
+    fclose(f);
+    return dfs;
+}
+
+
+/****************************************************************
+ * Private helper functions: make the posting list of a word, weigh
+ * its postings and code their positions, if they all have some.
+ * The block maxima are left to plopen().
+****************************************************************/
+static void encodepos(plist_t *l) {
+    size_t size = 0;
+    for(int i = 0; i < l->n; i++) {
+        if(walk.docs[i].pos == NULL) return;
+        size += 5 * (size_t)l->tfs[i];
+    }
+    l->pos = (unsigned char*)malloc(size);
+    l->poff = (int*)malloc((l->n + 1) * sizeof(int));
+    l->poff[0] = 0;
+    for(int i = 0; i < l->n; i++) {
+        l->poff[i + 1] = l->poff[i] + posencode(walk.docs[i].pos, l->tfs[i],
+                                                l->pos + l->poff[i]);
+    }
+    l->pos = (unsigned char*)realloc(l->pos, l->poff[l->n] + 1);
+}
+
+static void openword(void *p) {
+    word_t *w = (word_t*)p;
+    collect(w);
+    if(walk.n == 0) return;
+
+    plist_t *l = (plist_t*)calloc(1, sizeof(plist_t));
+    l->word = (char*)malloc(strlen(w->word) + 1);
+    strcpy(l->word, w->word);
+    l->n = walk.n;
+    l->ids = (int*)malloc(l->n * sizeof(int));
+    l->tfs = (int*)malloc(l->n * sizeof(int));
+    l->w = (float*)malloc(l->n * sizeof(float));
+    df_t *df = walk.dfs != NULL ? (df_t*)hsearch(walk.dfs, dfmatch, w->word,
+                                                  strlen(w->word)) : NULL;
+    l->c = rkterm(walk.rk, df != NULL ? df->df : l->n);
+    for(int i = 0; i < l->n; i++) {
+        l->ids[i] = walk.docs[i].id;
+        l->tfs[i] = walk.docs[i].freq;
+        l->w[i] = rkweight(walk.rk, l->ids[i], l->tfs[i]);
+    }
+    l->nblocks = (l->n + PL_BLOCK - 1) / PL_BLOCK;
+    l->bmax = (float*)malloc(l->nblocks * sizeof(float));
+    l->wmax = -1;                   // Not known yet
+    l->hot = tihas(walk.hot, l->word);
+    encodepos(l);
+    hput(walk.pl->lists, l, l->word, strlen(l->word));
+    walk.pl->nlists++;
+}
+
+static void fillmax(void *p) {
+    plist_t *l = (plist_t*)p;
+    if(l->wmax < 0) l->wmax = blockmax(l->n, l->w, l->bmax);
+}
+
+
+/****************************************************************
+ * Private helper function: read the block maxima of a model from
+ * the .bmw file into the lists they match
+ * \return          the number of lists they were read for, or -1
+ *                  if there is no usable file
+****************************************************************/
+static int loadmax(pl_t *pl, int model, char *dirname, char *indexnm) {
+
+    if(model != RK_BM25 && model != RK_TFIDF) return -1;
+    char path[512], word[__MAXWORD];
+    bmwpath(path, sizeof(path), dirname, indexnm);
+    FILE *f = fopen(path, "r");
+    int block;
+    if(f == NULL || fscanf(f, "%d", &block) != 1 || block != PL_BLOCK) {
+        if(f) fclose(f);
+        return -1;
+    }
+
+    int loaded = 0, nblocks;
+    float m[2];
+    while(fscanf(f, "%127s %d", word, &nblocks) == 2) {
+        plist_t *l = (plist_t*)hsearch(pl->lists, wordmatch, word, strlen(word));
+        if(l != NULL && l->nblocks != nblocks) l = NULL;   // Stale
+        if(l != NULL) l->wmax = 0;
+        for(int b = 0; b < nblocks; b++) {
+            if(fscanf(f, "%f %f", &m[0], &m[1]) != 2) break;
+            if(l == NULL) continue;
+            l->bmax[b] = m[model == RK_TFIDF];
+            if(l->bmax[b] > l->wmax) l->wmax = l->bmax[b];
+        }
+        if(l != NULL) loaded++;
+    }
+    fclose(f);
+    return loaded;
+}
+
+
+/****************************************************************
+ * Private helper function: the generation of postings, a hash of
+ * the model and of the inode, size and time of the files they are
+ * opened from. The indexer rewrites files in place, so the inode
+ * stays; the time is taken to the nanosecond, so that an update that
+ * keeps the sizes is told apart even within the same second. An index
+ * that is not in a file gets a generation of its own.
+****************************************************************/
+static uint64_t fingerprint(int model, char *dirname, char *indexnm) {
+    static const char *suffixes[] = {"", ".docs", ".pos", __DFSUFFIX, ".hot"};
+    static uint64_t opened = 0;
+    uint64_t id[2 + 4 * 5] = {(uint64_t)model, 0};
+    for(int i = 0; i < 5; i++) {
+        char path[512];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s%s", dirname, indexnm, suffixes[i]);
+        if(stat(path, &st) != 0) {
+            if(i == 0) id[1] = ++opened;
+            continue;
+        }
+        id[2 + 4 * i] = (uint64_t)st.st_ino;
+        id[3 + 4 * i] = (uint64_t)st.st_size;
+        id[4 + 4 * i] = (uint64_t)st.st_mtim.tv_sec;
+        id[5 + 4 * i] = (uint64_t)st.st_mtim.tv_nsec;
+    }
+    return hash64((const char*)id, sizeof(id));
+}
+
+
+/****************************************************************
+ * plopen -- see postings.h
+****************************************************************/
+postings_t *plopen(hashtable_t *index, hashtable_t *hot, ranker_t *rk, int model,
+                   char *dirname, char *indexnm) {
+
+    if(index == NULL || rk == NULL) return NULL;
+    pl_t *pl = (pl_t*)malloc(sizeof(pl_t));
+    if(pl == NULL || (pl->lists = hopen(4096)) == NULL) {
+        logmsg(LOG_ERROR, "Error: malloc failed allocating postings\n");
+        free(pl);
+        return NULL;
+    }
+    pl->nlists = 0;
+    walk.pl = pl;
+    walk.rk = rk;
+    walk.hot = hot;
+    walk.dfs = loaddf(dirname, indexnm);
+    happly(index, openword);
+    free(walk.docs);
+    if(walk.dfs != NULL) {
+        happly(walk.dfs, freedf);
+        hclose(walk.dfs);
+    }
+    memset(&walk, 0, sizeof(walk));
+
+    // Lists the file has nothing for, e.g. after an update of the
+    // index without one, get their maxima computed
+    int loaded = loadmax(pl, model, dirname, indexnm);
+    if(loaded < pl->nlists && model != RK_LEGACY) {
+        logmsg(LOG_WARN, "Warning: block maxima of %d words missing from "
+               "%s/%s%s; computing them\n", pl->nlists - (loaded < 0 ? 0 : loaded),
+               dirname, indexnm, __SUFFIX);
+    }
+    happly(pl->lists, fillmax);
+    pl->gen = fingerprint(model, dirname, indexnm);
+    return (postings_t*)pl;
+}
+
+
+/****************************************************************
+ * plclose -- free every list, then the table
+****************************************************************/
+void plclose(postings_t *plp) {
+    if(plp == NULL) return;
+    pl_t *pl = (pl_t*)plp;
+    happly(pl->lists, freelist);
+    hclose(pl->lists);
+    free(pl);
+}
+
+
+/****************************************************************
+ * plfind -- look the word up
+****************************************************************/
+plist_t *plfind(postings_t *plp, const char *word) {
+    pl_t *pl = (pl_t*)plp;
+    return (plist_t*)hsearch(pl->lists, wordmatch, word, strlen(word));
+}
+
+
+/****************************************************************
+ * plpos -- see postings.h
+****************************************************************/
+int plpos(plist_t *l, int i, int *pos) {
+    if(l->pos == NULL) return -1;
+    posdecode(l->pos + l->poff[i], l->tfs[i], pos);
+    return l->tfs[i];
+}
+
+
+/****************************************************************
+ * plgen -- see postings.h
+****************************************************************/
+uint64_t plgen(postings_t *plp) {
+    return plp != NULL ? ((pl_t*)plp)->gen : 0;
+}
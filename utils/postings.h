@@ -0,0 +1,106 @@
+#pragma once
+/*
+ * postings.h -- posting lists as arrays, for scoring queries
+ *
+ * The querier scores with posting lists rather than the queues of
+ * the index: for every word, the ids of its documents in increasing
+ * order, the number of times it occurs in each, and the weight of
+ * each posting under the ranking model (see rank.h), so that the
+ * score of a posting is c * w[i] with c the constant of the word.
+ *
+ * Postings are grouped in blocks of PL_BLOCK. For dynamic pruning,
+ * every list has the largest weight of each block and of the whole
+ * list: no document in a block can score more than c times its
+ * maximum. The indexer computes them with plsave() for every model
+ * and saves them next to the index, in <indexnm>.bmw, as
+ *
+ * <word> <blocks> <bm25 max 1> <tfidf max 1> ... <bm25 max n> <tfidf max n>
+ *
+ * after a first line with PL_BLOCK.
+ *
+ * The indexer also saves the statistics of every word across the
+ * collection with plsavedf(), to <indexnm>.df, as
+ *
+ * <word> <documents it is in> <occurrences>
+ *
+ * plopen() weighs words with the first when the file is there, so
+ * that the scores of a shard of a collection (see rksaveshards())
+ * are those of a single index of it.
+ *
+ * When the index has positions (see posio.h), each list also keeps
+ * the positions of its postings, delta coded, and plpos() decodes
+ * those of a posting when a phrase needs them.
+ *
+ * Once opened, the postings are read only and can be shared between
+ * threads.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include "hash.h"
+#include "rank.h"
+
+#define PL_BLOCK 64
+
+/* a posting list */
+typedef struct plist {
+    char *word;
+    int n;                  // Postings, i.e. documents with the word
+    int *ids;               // Increasing
+    int *tfs;
+    float *w;               // Weight of each posting
+    double c;               // Constant of the word
+    int nblocks;
+    float *bmax;            // Largest weight of each block
+    float wmax;             // Largest weight of the list
+    unsigned char *pos;     // Positions of the postings, or NULL
+    int *poff;              // Where those of each posting start
+    bool hot;               // In the hot tier of the index (see tier.h)
+} plist_t;
+
+/* the postings representation is hidden from users of the module */
+typedef void postings_t;
+
+/* plsave -- computes the block maxima of an index, as indexload()
+ * returns it, under every model and saves them to
+ * dirname/indexnm.bmw; the statistics of rksave() must be saved
+ * first
+ * returns 0 if success and non-zero otherwise
+ */
+int32_t plsave(hashtable_t *index, char *dirname, char *indexnm);
+
+/* plsavedf -- saves to dirname/names[i].df the statistics of the
+ * words of each of n shards, across all of them, as indexload()
+ * returns them; an index that is not sharded is one shard
+ * returns 0 if success and non-zero otherwise
+ */
+int32_t plsavedf(hashtable_t **shards, int n, char *dirname, char **names);
+
+/* plopen -- turns the doclists of an index into posting lists
+ * weighted with a ranker, and loads their block maxima from
+ * dirname/indexnm.bmw; they are computed if the file is missing.
+ * Lists get positions if posload() gave every document of the word
+ * some, and are hot if their word is in hot, a set of words which may
+ * be NULL. The index is left as it was.
+ * returns NULL on failure
+ */
+postings_t *plopen(hashtable_t *index, hashtable_t *hot, ranker_t *rk, int model,
+                   char *dirname, char *indexnm);
+
+/* plclose -- free the postings */
+void plclose(postings_t *pl);
+
+/* plfind -- the posting list of a word, or NULL if it is in no
+ * document
+ */
+plist_t *plfind(postings_t *pl, const char *word);
+
+/* plgen -- the generation of the postings: postings opened from the
+ * same files, unchanged, with the same model have the same one
+ */
+uint64_t plgen(postings_t *pl);
+
+/* plpos -- decodes the positions of the i-th posting of a list into
+ * pos, which must have room for tfs[i] of them
+ * returns the number of positions, or -1 if the list has none
+ */
+int plpos(plist_t *l, int i, int *pos);
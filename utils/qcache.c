@@ -0,0 +1,307 @@
+/****************************************************************
+ * file   qcache.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   December 10, 2021
+ *
+ * Implementation of a cache of query results under a memory budget,
+ * evicting with ARC, counted in bytes.
+ *
+****************************************************************/
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include<pthread.h>
+#include"hash.h"
+#include"bloom.h"
+#include"qcache.h"
+
+
+/****************************************************************
+ * Define cache data structures
+****************************************************************/
+// Lists: entries seen once and seen again, and the keys evicted
+// from each
+#define __T1 0
+#define __T2 1
+#define __B1 2
+#define __B2 3
+
+#define __BUCKETS 4096              // Bytes of budget per bucket
+#define __SEENBYTES 256             // Bytes of budget per doorkeeper byte
+#define __SEENHASHES 4
+
+typedef struct entry {
+    char *key;
+    void *val;                      // NULL once evicted
+    size_t len;
+    size_t size;                    // Bytes counted against the budget
+    int list;
+    struct entry *prev, *next;      // Towards the most, least recent
+} entry_t;
+
+typedef struct {
+    entry_t *mru, *lru;
+    size_t bytes;
+} list_t;
+
+typedef struct qcache {
+    pthread_mutex_t lock;
+    hashtable_t *table;             // Entries of the four lists
+    uint32_t nbuckets;
+    list_t lists[4];
+    size_t budget;
+    size_t p;                       // Bytes T1 aims for
+    uint64_t gen;
+    bloom_t *seen;                  // Doorkeeper, and its size
+    size_t seenbytes;
+    size_t nseen;                   // Keys since it was last emptied
+    long hits, misses;
+} qc_t;
+
+static bool keymatch(void *elementp, const void *keyp) {
+    return !strcmp(((entry_t*)elementp)->key, (const char*)keyp);
+}
+
+
+/****************************************************************
+ * Private helper functions: move entries between lists, and drop
+ * them
+****************************************************************/
+static void detach(qc_t *qc, entry_t *e) {
+    list_t *l = &qc->lists[e->list];
+    if(e->prev != NULL) e->prev->next = e->next;
+    else l->mru = e->next;
+    if(e->next != NULL) e->next->prev = e->prev;
+    else l->lru = e->prev;
+    l->bytes -= e->size;
+}
+
+static void push(qc_t *qc, entry_t *e, int list) {
+    list_t *l = &qc->lists[list];
+    e->list = list;
+    e->prev = NULL;
+    e->next = l->mru;
+    if(l->mru != NULL) l->mru->prev = e;
+    else l->lru = e;
+    l->mru = e;
+    l->bytes += e->size;
+}
+
+static void drop(qc_t *qc, entry_t *e) {
+    detach(qc, e);
+    hremove(qc->table, keymatch, e->key, strlen(e->key));
+    free(e->key);
+    free(e->val);
+    free(e);
+}
+
+// Evicts the value of an entry; its key is remembered in a ghost list
+static void evict(qc_t *qc, entry_t *e, int ghost) {
+    detach(qc, e);
+    free(e->val);
+    e->val = NULL;
+    e->len = 0;
+    push(qc, e, ghost);
+}
+
+static void clear(qc_t *qc) {
+    for(int i = 0; i < 4; i++) {
+        for(entry_t *e = qc->lists[i].mru; e != NULL; e = e->next) {
+            free(e->key);
+            free(e->val);
+        }
+        qc->lists[i].mru = qc->lists[i].lru = NULL;
+        qc->lists[i].bytes = 0;
+    }
+    hclose(qc->table);              // Frees the entries
+    qc->table = hopen(qc->nbuckets);
+    qc->p = 0;
+}
+
+// Empties the doorkeeper before it fills up with false positives
+static void clearseen(qc_t *qc) {
+    bfclose(qc->seen);
+    qc->seen = bfopen(qc->seenbytes, __SEENHASHES);
+    qc->nseen = 0;
+}
+
+// Another generation empties the cache
+static void adopt(qc_t *qc, uint64_t gen) {
+    if(gen == qc->gen) return;
+    clear(qc);
+    clearseen(qc);
+    qc->gen = gen;
+}
+
+
+/****************************************************************
+ * Private helper function: evict from T1 or T2, whichever is over
+ * its share, until size more bytes fit; then forget the oldest
+ * ghosts until the lists hold at most twice the budget
+ * \param inb2      the entry coming in was a ghost of T2
+****************************************************************/
+static void makeroom(qc_t *qc, size_t size, bool inb2) {
+    list_t *t1 = &qc->lists[__T1], *t2 = &qc->lists[__T2];
+    list_t *b1 = &qc->lists[__B1], *b2 = &qc->lists[__B2];
+    while(t1->bytes + t2->bytes + size > qc->budget && (t1->lru || t2->lru)) {
+        if(t1->lru != NULL && (t2->lru == NULL || t1->bytes > qc->p ||
+                               (inb2 && t1->bytes == qc->p))) {
+            evict(qc, t1->lru, __B1);
+        }
+        else evict(qc, t2->lru, __B2);
+    }
+    while(b1->lru != NULL && t1->bytes + b1->bytes > qc->budget) drop(qc, b1->lru);
+    while(t1->bytes + t2->bytes + b1->bytes + b2->bytes > 2 * qc->budget) {
+        drop(qc, b2->lru != NULL ? b2->lru : b1->lru);
+    }
+}
+
+
+/****************************************************************
+ * qcopen, qcclose -- see qcache.h
+****************************************************************/
+qcache_t *qcopen(size_t budget) {
+    qc_t *qc = (qc_t*)calloc(1, sizeof(qc_t));
+    if(qc == NULL) return NULL;
+    size_t nbuckets = budget / __BUCKETS;
+    qc->nbuckets = nbuckets < 64 ? 64 : nbuckets > 65536 ? 65536 : (uint32_t)nbuckets;
+    qc->seenbytes = budget / __SEENBYTES < 1024 ? 1024 : budget / __SEENBYTES;
+    qc->table = hopen(qc->nbuckets);
+    qc->seen = bfopen(qc->seenbytes, __SEENHASHES);
+    if(qc->table == NULL || qc->seen == NULL) {
+        hclose(qc->table);
+        bfclose(qc->seen);
+        free(qc);
+        return NULL;
+    }
+    qc->budget = budget;
+    pthread_mutex_init(&qc->lock, NULL);
+    return (qcache_t*)qc;
+}
+
+void qcclose(qcache_t *qcp) {
+    qc_t *qc = (qc_t*)qcp;
+    if(qc == NULL) return;
+    clear(qc);
+    hclose(qc->table);
+    bfclose(qc->seen);
+    pthread_mutex_destroy(&qc->lock);
+    free(qc);
+}
+
+
+/****************************************************************
+ * qcget -- a hit moves to the front of T2
+****************************************************************/
+void *qcget(qcache_t *qcp, uint64_t gen, const char *key, size_t *len) {
+    qc_t *qc = (qc_t*)qcp;
+    if(qc == NULL || key == NULL) return NULL;
+
+    void *val = NULL;
+    pthread_mutex_lock(&qc->lock);
+    adopt(qc, gen);
+    entry_t *e = (entry_t*)hsearch(qc->table, keymatch, key, strlen(key));
+    if(e != NULL && e->val != NULL) {
+        detach(qc, e);
+        push(qc, e, __T2);
+        if((val = malloc(e->len + 1)) != NULL) {
+            memcpy(val, e->val, e->len);
+            *len = e->len;
+        }
+    }
+    if(val != NULL) qc->hits++;
+    else qc->misses++;
+    pthread_mutex_unlock(&qc->lock);
+    return val;
+}
+
+
+/****************************************************************
+ * qcput -- a new key goes to T1. A key still remembered in B1 means
+ * T1 should be larger, one in B2 that T2 should, by as much more as
+ * the other ghost list is longer; either goes to T2.
+****************************************************************/
+void qcput(qcache_t *qcp, uint64_t gen, const char *key, const void *val,
+           size_t len) {
+    qc_t *qc = (qc_t*)qcp;
+    if(qc == NULL || key == NULL) return;
+    size_t keylen = strlen(key), size = len + keylen + 1 + sizeof(entry_t);
+    if(size > qc->budget) return;
+
+    void *copy = malloc(len + 1);
+    if(copy == NULL) return;
+    memcpy(copy, val, len);
+
+    pthread_mutex_lock(&qc->lock);
+    adopt(qc, gen);
+    entry_t *e = (entry_t*)hsearch(qc->table, keymatch, key, keylen);
+    if(e != NULL && e->val != NULL) {
+        free(copy);                 // Put by another thread meanwhile
+    }
+    else if(e != NULL) {
+        list_t *b1 = &qc->lists[__B1], *b2 = &qc->lists[__B2];
+        bool inb2 = e->list == __B2;
+        if(!inb2) {
+            size_t delta = b2->bytes > b1->bytes ? b2->bytes / b1->bytes * size : size;
+            qc->p = qc->p + delta < qc->budget ? qc->p + delta : qc->budget;
+        }
+        else {
+            size_t delta = b1->bytes > b2->bytes ? b1->bytes / b2->bytes * size : size;
+            qc->p = qc->p > delta ? qc->p - delta : 0;
+        }
+        detach(qc, e);
+        makeroom(qc, size, inb2);
+        e->val = copy;
+        e->len = len;
+        e->size = size;
+        push(qc, e, __T2);
+    }
+    else if((e = (entry_t*)malloc(sizeof(entry_t))) != NULL &&
+            (e->key = (char*)malloc(keylen + 1)) != NULL) {
+        makeroom(qc, size, false);
+        strcpy(e->key, key);
+        e->val = copy;
+        e->len = len;
+        e->size = size;
+        hput(qc->table, e, e->key, keylen);
+        push(qc, e, __T1);
+    }
+    else {
+        free(e);
+        free(copy);
+    }
+    pthread_mutex_unlock(&qc->lock);
+}
+
+
+/****************************************************************
+ * qcseen -- the doorkeeper is emptied once it holds about a key per
+ * byte, past which false positives grow quickly
+****************************************************************/
+bool qcseen(qcache_t *qcp, uint64_t gen, const char *key) {
+    qc_t *qc = (qc_t*)qcp;
+    if(qc == NULL || key == NULL) return false;
+    pthread_mutex_lock(&qc->lock);
+    adopt(qc, gen);
+    if(qc->nseen++ >= qc->seenbytes) clearseen(qc);
+    bool seen = bfadd(qc->seen, key, strlen(key));
+    pthread_mutex_unlock(&qc->lock);
+    return seen;
+}
+
+
+/****************************************************************
+ * qcstats -- see qcache.h
+****************************************************************/
+void qcstats(qcache_t *qcp, long *hits, long *misses, size_t *bytes) {
+    qc_t *qc = (qc_t*)qcp;
+    if(qc == NULL) return;
+    pthread_mutex_lock(&qc->lock);
+    *hits = qc->hits;
+    *misses = qc->misses;
+    *bytes = qc->lists[__T1].bytes + qc->lists[__T2].bytes;
+    pthread_mutex_unlock(&qc->lock);
+}
@@ -0,0 +1,61 @@
+#pragma once
+/*
+ * qcache.h -- a cache of query results, with ARC eviction
+ *
+ * Values are byte strings copied in and out under string keys, such
+ * as the normal form of a query (see qpstring()). The cache holds at
+ * most a budget of bytes, counting keys, values and bookkeeping, and
+ * evicts with ARC (Megiddo and Modha): entries seen once and entries
+ * seen again are kept in two LRU lists, and the keys of the entries
+ * each list evicted are remembered a while longer, so that a key
+ * coming back tells which list should have been given more room. The
+ * split moves towards it, so a burst of queries asked once does not
+ * push out the queries asked all the time. Sizes are in bytes rather
+ * than entries, as results vary a lot in length.
+ *
+ * Every value belongs to a generation of the index, as plgen() gives
+ * it. The first call with another generation empties the cache, so
+ * results never outlive the index they were computed on.
+ *
+ * qcseen() is a doorkeeper, as in TinyLFU: it tells whether a key was
+ * asked about before, for values only worth computing and caching
+ * when they are asked for again.
+ *
+ * All functions are thread safe.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* the cache representation is hidden from users of the module */
+typedef void qcache_t;
+
+/* qcopen -- open an empty cache of budget bytes
+ * returns NULL on failure
+ */
+qcache_t *qcopen(size_t budget);
+
+/* qcclose -- free a cache */
+void qcclose(qcache_t *qc);
+
+/* qcget -- a copy of the value cached under key, to be freed, and its
+ * length in *len
+ * returns NULL if none is cached for generation gen
+ */
+void *qcget(qcache_t *qc, uint64_t gen, const char *key, size_t *len);
+
+/* qcput -- cache a copy of len bytes at val under key, for generation
+ * gen; values larger than the budget are not cached
+ */
+void qcput(qcache_t *qc, uint64_t gen, const char *key, const void *val,
+           size_t len);
+
+/* qcseen -- note that key was asked about in generation gen
+ * returns true if it may have been before, false if it was not
+ */
+bool qcseen(qcache_t *qc, uint64_t gen, const char *key);
+
+/* qcstats -- lookups that found a value and that did not, and bytes
+ * used, since the cache was opened
+ */
+void qcstats(qcache_t *qc, long *hits, long *misses, size_t *bytes);
@@ -0,0 +1,116 @@
+/****************************************************************
+ * file   qcachetest.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   December 10, 2021
+ *
+ * Tests that the qcache.h module gives back what was put in it, keeps
+ * to its budget, keeps values asked for again through a scan of
+ * values asked for once, and empties itself for another generation
+ *
+****************************************************************/
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include"qcache.h"
+
+/****************************************************************
+ * Define macro, globals and helper functions
+****************************************************************/
+#define eprintf(format, ...) do {                 \
+    if (verbose)                                  \
+        fprintf(stderr, format, ##__VA_ARGS__);   \
+} while(0)
+#define verbose 1
+
+#define __BUDGET 4096
+#define __VALUE 1000                // About a quarter of the budget
+
+static char value[__VALUE];
+
+// Checks that key is cached with the value, or is not
+static int cached(qcache_t *qc, uint64_t gen, const char *key, bool want) {
+    size_t len = 0;
+    char *val = (char*)qcget(qc, gen, key, &len);
+    bool found = val != NULL && len == __VALUE && !memcmp(val, value, len);
+    free(val);
+    if(found != want) {
+        eprintf("%s %s\n", key, want ? "not cached" : "still cached");
+        return 1;
+    }
+    return 0;
+}
+
+
+int main(void) {
+
+    int errors = 0;
+    for(int i = 0; i < __VALUE; i++) value[i] = (char)i;
+
+    qcache_t *qc = qcopen(__BUDGET);
+    if(qc == NULL) {
+        eprintf("%s\n", "qcopen failed");
+        exit(EXIT_FAILURE);
+    }
+
+    // Given back, and counted
+    qcput(qc, 1, "a", value, __VALUE);
+    errors += cached(qc, 1, "a", true);
+    errors += cached(qc, 1, "b", false);
+    long hits, misses;
+    size_t bytes;
+    qcstats(qc, &hits, &misses, &bytes);
+    if(hits != 1 || misses != 1 || bytes <= __VALUE) {
+        eprintf("stats %ld hits, %ld misses, %zu bytes\n", hits, misses, bytes);
+        errors++;
+    }
+
+    // "a" was asked for again; the ones put once make room for others
+    char key[16];
+    for(int i = 0; i < 20; i++) {
+        sprintf(key, "scan%d", i);
+        qcput(qc, 1, key, value, __VALUE);
+        qcstats(qc, &hits, &misses, &bytes);
+        if(bytes > __BUDGET) {
+            eprintf("%zu bytes over the budget\n", bytes);
+            errors++;
+        }
+    }
+    errors += cached(qc, 1, "a", true);
+    errors += cached(qc, 1, "scan0", false);
+    errors += cached(qc, 1, "scan19", true);
+
+    // Too large for the budget
+    char *large = (char*)calloc(2 * __BUDGET, 1);
+    qcput(qc, 1, "large", large, 2 * __BUDGET);
+    free(large);
+    size_t len;
+    if(qcget(qc, 1, "large", &len) != NULL) {
+        eprintf("%s\n", "a value larger than the budget was cached");
+        errors++;
+    }
+
+    // Another generation empties the cache
+    errors += cached(qc, 2, "a", false);
+    errors += cached(qc, 1, "scan19", false);
+
+    // The doorkeeper
+    if(qcseen(qc, 1, "once") || !qcseen(qc, 1, "once")) {
+        eprintf("%s\n", "qcseen did not remember a key");
+        errors++;
+    }
+    if(qcseen(qc, 2, "once")) {
+        eprintf("%s\n", "qcseen remembered a key of another generation");
+        errors++;
+    }
+    qcclose(qc);
+
+    if(errors) {
+        eprintf("%d errors\n", errors);
+        exit(EXIT_FAILURE);
+    }
+    eprintf("%s passed\n", "qcache");
+    exit(EXIT_SUCCESS);
+}
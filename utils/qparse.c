@@ -0,0 +1,521 @@
+/****************************************************************
+ * file   qparse.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   December 7, 2021
+ *
+ * Implementation of a recursive descent parser for queries, of
+ * their planning, and of their compiling into iterators.
+ *
+****************************************************************/
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include<ctype.h>
+#include"postings.h"
+#include"topk.h"
+#include"qcache.h"
+#include"qparse.h"
+
+
+/****************************************************************
+ * Define parser data structures
+****************************************************************/
+#define __MAXWORD 128
+#define __MAXDEPTH 32               // Of parentheses
+#define __MAXQUERY 1024             // Normal form compared
+#define __SCANRATIO 4               // Of lengths stepped through
+#define __MINWORD 3                 // Shorter words are not indexed
+
+// Tokens
+#define __END 0
+#define __WORD 1
+#define __AND 2
+#define __OR 3
+#define __NOT 4
+#define __QUOTE 5
+#define __OPEN 6
+#define __CLOSE 7
+#define __BAD 8
+#define __NEAR 9
+
+typedef struct {
+    const char *p;                  // Next character
+    int tok;                        // Current token
+    char word[__MAXWORD];           // Its text, in lower case
+    int k;                          // Distance of a NEAR
+    int depth;
+} parser_t;
+
+
+/****************************************************************
+ * Private helper function: read the next token. Keywords are
+ * words too, for phrases; "near" is one when a slash and a
+ * distance follow.
+****************************************************************/
+static void lex(parser_t *ps) {
+    while(*ps->p == ' ' || *ps->p == '\t' || *ps->p == '\n') ps->p++;
+    ps->word[0] = '\0';
+    char c = *ps->p;
+    if(c == '\0') {
+        ps->tok = __END;
+        return;
+    }
+    if(!isalpha((unsigned char)c)) {
+        ps->tok = c == '"' ? __QUOTE : c == '(' ? __OPEN : c == ')' ? __CLOSE : __BAD;
+        if(ps->tok != __BAD) ps->p++;
+        return;
+    }
+
+    int len = 0;
+    for(; isalpha((unsigned char)*ps->p); ps->p++) {
+        if(len == __MAXWORD - 1) {
+            ps->tok = __BAD;
+            return;
+        }
+        ps->word[len++] = tolower((unsigned char)*ps->p);
+    }
+    ps->word[len] = '\0';
+    if(!strcmp(ps->word, "near") && *ps->p == '/') {
+        char *end;
+        long k = strtol(ps->p + 1, &end, 10);
+        ps->tok = isdigit((unsigned char)ps->p[1]) && k < __MAXWORD ? __NEAR : __BAD;
+        ps->k = (int)k;
+        ps->p = end;
+        return;
+    }
+    ps->tok = !strcmp(ps->word, "and") ? __AND :
+              !strcmp(ps->word, "or") ? __OR :
+              !strcmp(ps->word, "not") ? __NOT : __WORD;
+}
+
+
+/****************************************************************
+ * Private helper functions: make nodes
+****************************************************************/
+static qnode_t *mknode(int type) {
+    qnode_t *q = (qnode_t*)calloc(1, sizeof(qnode_t));
+    q->type = type;
+    return q;
+}
+
+static qnode_t *mkword(const char *word) {
+    qnode_t *q = mknode(QP_WORD);
+    q->word = (char*)malloc(strlen(word) + 1);
+    strcpy(q->word, word);
+    return q;
+}
+
+static void addkid(qnode_t *q, qnode_t *kid) {
+    q->kids = (qnode_t**)realloc(q->kids, (q->n + 1) * sizeof(qnode_t*));
+    q->kids[q->n++] = kid;
+}
+
+// Replaces a node of one child with the child
+static qnode_t *lift(qnode_t *q) {
+    if(q->type == QP_NOT || q->n != 1) return q;
+    qnode_t *kid = q->kids[0];
+    free(q->kids);
+    *q = *kid;
+    free(kid);
+    return q;
+}
+
+
+/****************************************************************
+ * Private helper functions: one for each rule of the grammar. They
+ * return NULL when the input does not follow it.
+****************************************************************/
+static qnode_t *pquery(parser_t *ps);
+
+static qnode_t *pprimary(parser_t *ps) {
+    qnode_t *q = NULL;
+    if(ps->tok == __WORD) {
+        q = mkword(ps->word);
+        lex(ps);
+    }
+    else if(ps->tok == __QUOTE) {
+        q = mknode(QP_PHRASE);
+        lex(ps);
+        while(ps->tok >= __WORD && ps->tok <= __NOT) {
+            addkid(q, mkword(ps->word));
+            lex(ps);
+        }
+        if(ps->tok != __QUOTE || q->n == 0) {
+            qpfree(q);
+            return NULL;
+        }
+        lex(ps);
+        lift(q);
+    }
+    else if(ps->tok == __OPEN && ps->depth < __MAXDEPTH) {
+        ps->depth++;
+        lex(ps);
+        q = pquery(ps);
+        ps->depth--;
+        if(q != NULL && ps->tok != __CLOSE) {
+            qpfree(q);
+            return NULL;
+        }
+        lex(ps);
+    }
+    return q;
+}
+
+// A chain of NEARs is the AND of the NEARs of each pair of words
+static qnode_t *pnear(parser_t *ps) {
+    qnode_t *left = pprimary(ps);
+    if(left == NULL || ps->tok != __NEAR) return left;
+    if(left->type != QP_WORD) {
+        qpfree(left);
+        return NULL;
+    }
+
+    qnode_t *q = mknode(QP_AND);
+    while(ps->tok == __NEAR) {
+        qnode_t *near = mknode(QP_NEAR);
+        near->k = ps->k;
+        addkid(near, left);
+        addkid(q, near);
+        lex(ps);
+        if(ps->tok != __WORD) {
+            qpfree(q);
+            return NULL;
+        }
+        addkid(near, mkword(ps->word));
+        left = mkword(ps->word);
+        lex(ps);
+    }
+    qpfree(left);
+    return lift(q);
+}
+
+static qnode_t *punary(parser_t *ps) {
+    if(ps->tok != __NOT) return pnear(ps);
+    lex(ps);
+    qnode_t *kid = pnear(ps);
+    if(kid == NULL) return NULL;
+    qnode_t *q = mknode(QP_NOT);
+    addkid(q, kid);
+    return q;
+}
+
+static qnode_t *pand(parser_t *ps) {
+    qnode_t *q = mknode(QP_AND);
+    bool positive = false;
+    while(true) {
+        qnode_t *kid = punary(ps);
+        if(kid == NULL) {
+            qpfree(q);
+            return NULL;
+        }
+        if(kid->type != QP_NOT) positive = true;
+        addkid(q, kid);
+        if(ps->tok == __AND) lex(ps);
+        else if(ps->tok != __WORD && ps->tok != __NOT && ps->tok != __QUOTE &&
+                ps->tok != __OPEN) break;
+    }
+    if(!positive) {
+        qpfree(q);
+        return NULL;
+    }
+    return lift(q);
+}
+
+static qnode_t *pquery(parser_t *ps) {
+    qnode_t *q = mknode(QP_OR);
+    while(true) {
+        qnode_t *kid = pand(ps);
+        if(kid == NULL) {
+            qpfree(q);
+            return NULL;
+        }
+        addkid(q, kid);
+        if(ps->tok != __OR) break;
+        lex(ps);
+    }
+    return lift(q);
+}
+
+
+/****************************************************************
+ * qpparse -- the whole input must be a query
+****************************************************************/
+qnode_t *qpparse(const char *input) {
+    parser_t ps = {input, __END, "", 0};
+    lex(&ps);
+    if(ps.tok == __END) return NULL;
+    qnode_t *q = pquery(&ps);
+    if(q != NULL && ps.tok != __END) {
+        qpfree(q);
+        return NULL;
+    }
+    return q;
+}
+
+
+/****************************************************************
+ * qpstring -- see qparse.h
+****************************************************************/
+static int append(char *buf, size_t size, int len, const char *s) {
+    if((size_t)len < size) snprintf(buf + len, size - len, "%s", s);
+    return len + strlen(s);
+}
+
+static int tostring(qnode_t *q, char *buf, size_t size, int len, bool nested) {
+    if(q->type == QP_WORD) return append(buf, size, len, q->word);
+    if(q->type == QP_NOT) {
+        len = append(buf, size, len, "not ");
+        return tostring(q->kids[0], buf, size, len, true);
+    }
+
+    char sep[32];
+    snprintf(sep, sizeof(sep), "%s", q->type == QP_AND ? " and " :
+             q->type == QP_OR ? " or " : " ");
+    if(q->type == QP_NEAR) snprintf(sep, sizeof(sep), " near/%d ", q->k);
+    bool quote = q->type == QP_PHRASE, group = nested && !quote && q->type != QP_NEAR;
+    const char *open = quote ? "\"" : group ? "(" : "";
+    const char *close = quote ? "\"" : group ? ")" : "";
+    len = append(buf, size, len, open);
+    for(int i = 0; i < q->n; i++) {
+        if(i > 0) len = append(buf, size, len, sep);
+        len = tostring(q->kids[i], buf, size, len, true);
+    }
+    return append(buf, size, len, close);
+}
+
+int qpstring(qnode_t *q, char *buf, size_t size) {
+    if(size > 0) buf[0] = '\0';
+    return tostring(q, buf, size, 0, false);
+}
+
+
+/****************************************************************
+ * Private helper functions: rewriting ANDs and ORs
+****************************************************************/
+// Moves the children of children of the same type up
+static void flatten(qnode_t *q) {
+    for(int i = 0; i < q->n; i++) {
+        qnode_t *kid = q->kids[i];
+        if(kid->type != q->type) continue;
+        int m = kid->n;
+        q->kids = (qnode_t**)realloc(q->kids, (q->n + m - 1) * sizeof(qnode_t*));
+        memmove(&q->kids[i + m], &q->kids[i + 1], (q->n - i - 1) * sizeof(qnode_t*));
+        memcpy(&q->kids[i], kid->kids, m * sizeof(qnode_t*));
+        q->n += m - 1;
+        free(kid->kids);
+        free(kid);
+        i += m - 1;
+    }
+}
+
+static bool same(qnode_t *a, qnode_t *b) {
+    char x[__MAXQUERY], y[__MAXQUERY];
+    if(a->type != b->type || a->df != b->df) return false;
+    if(qpstring(a, x, sizeof(x)) >= (int)sizeof(x)) return false;
+    qpstring(b, y, sizeof(y));
+    return !strcmp(x, y);
+}
+
+// Removes the i-th child
+static void dropkid(qnode_t *q, int i) {
+    qpfree(q->kids[i]);
+    memmove(&q->kids[i], &q->kids[i + 1], (q->n - i - 1) * sizeof(qnode_t*));
+    q->n--;
+}
+
+// A word of the hot tier, such as a stopword
+static bool hotword(qnode_t *q, postings_t *pl) {
+    plist_t *l = q->type == QP_WORD ? plfind(pl, q->word) : NULL;
+    return l != NULL && l->hot;
+}
+
+// Words first, rarest first, and the NOTs last; the normal form
+// breaks ties so that equal queries are planned alike
+static int cmpkid(const void *a, const void *b) {
+    qnode_t *x = *(qnode_t* const*)a, *y = *(qnode_t* const*)b;
+    bool xnot = x->type == QP_NOT, ynot = y->type == QP_NOT;
+    if(xnot != ynot) return xnot ? 1 : -1;
+    if(x->df != y->df) return x->df < y->df ? -1 : 1;
+    char xs[__MAXQUERY], ys[__MAXQUERY];
+    qpstring(x, xs, sizeof(xs));
+    qpstring(y, ys, sizeof(ys));
+    return strcmp(xs, ys);
+}
+
+
+/****************************************************************
+ * qpplan -- bottom up; df is the length of the posting list of a
+ * word, and otherwise a bound on the documents matched
+****************************************************************/
+static void plan(qnode_t *q, postings_t *pl) {
+
+    if(q->type == QP_WORD) {
+        plist_t *l = plfind(pl, q->word);
+        q->df = l != NULL ? l->n : 0;
+        return;
+    }
+    for(int i = 0; i < q->n; i++) plan(q->kids[i], pl);
+    if(q->type == QP_AND || q->type == QP_OR) flatten(q);
+
+    if(q->type == QP_NOT) {
+        q->df = q->kids[0]->df;
+    }
+    else if(q->type == QP_OR) {
+        q->df = 0;
+        for(int i = 0; i < q->n; i++) q->df += q->kids[i]->df;
+    }
+    else if(q->type == QP_PHRASE || q->type == QP_NEAR) {
+        q->df = -1;
+        for(int i = 0; i < q->n; i++) {
+            if(q->type == QP_PHRASE && strlen(q->kids[i]->word) < __MINWORD) continue;
+            if(q->df < 0 || q->kids[i]->df < q->df) q->df = q->kids[i]->df;
+        }
+        if(q->df < 0) q->df = 0;
+    }
+    else {
+        // Hot words are dropped when another conjunct narrows the AND
+        // down, as they would barely filter it
+        bool narrowed = false;
+        for(int i = 0; i < q->n && !narrowed; i++) {
+            narrowed = q->kids[i]->type != QP_NOT && !hotword(q->kids[i], pl);
+        }
+        for(int i = 0; i < q->n && narrowed; i++) {
+            if(hotword(q->kids[i], pl)) dropkid(q, i--);
+        }
+
+        // Repeated conjuncts, and NOTs of nothing, are dropped
+        for(int i = 0; i < q->n; i++) {
+            bool drop = q->kids[i]->type == QP_NOT && q->kids[i]->df == 0;
+            for(int j = 0; j < i && !drop; j++) drop = same(q->kids[i], q->kids[j]);
+            if(drop) dropkid(q, i--);
+        }
+        qsort(q->kids, q->n, sizeof(qnode_t*), cmpkid);
+        q->df = q->kids[0]->df;
+        int last = 0;
+        while(last + 1 < q->n && q->kids[last + 1]->type != QP_NOT) last++;
+        q->scan = q->df > 0 && q->kids[last]->df <= (long)q->df * __SCANRATIO;
+        lift(q);
+    }
+}
+
+qnode_t *qpplan(qnode_t *q, postings_t *pl) {
+    if(q != NULL && pl != NULL) plan(q, pl);
+    return q;
+}
+
+
+/****************************************************************
+ * qpcompile -- see qparse.h
+****************************************************************/
+// Words too short to be indexed only hold their place in a phrase
+static it_t *compilepos(qnode_t *q, postings_t *pl, bool min) {
+    plist_t **ls = (plist_t**)malloc(q->n * sizeof(plist_t*));
+    int *offs = (int*)malloc(q->n * sizeof(int));
+    int n = 0;
+    for(int i = 0; i < q->n; i++) {
+        if(q->type == QP_PHRASE && strlen(q->kids[i]->word) < __MINWORD) continue;
+        ls[n] = plfind(pl, q->kids[i]->word);
+        offs[n++] = i;
+    }
+
+    it_t *it;
+    if(n == 1) it = itterm(ls[0]);
+    else if(q->type == QP_NEAR) it = itnear(ls[0], ls[1], q->k, min);
+    else it = itphrase(ls, offs, n, min);
+    free(ls);
+    free(offs);
+    return it;
+}
+
+static it_t *compile(qnode_t *q, postings_t *pl, bool min, bool scan, qcache_t *qc);
+
+// An AND asked for before is intersected to its end and cached; it is
+// then walked from the cache. Scores for min differ from the others.
+static it_t *compilecached(qnode_t *q, postings_t *pl, bool min, qcache_t *qc) {
+    // Prefixed so that it is not the normal form of any query
+    char key[__MAXQUERY];
+    key[0] = '&';
+    key[1] = min ? 'm' : 's';
+    if(qpstring(q, key + 2, sizeof(key) - 2) >= (int)sizeof(key) - 2) {
+        return compile(q, pl, min, false, NULL);
+    }
+
+    size_t len;
+    uint64_t gen = plgen(pl);
+    hit_t *hits = (hit_t*)qcget(qc, gen, key, &len);
+    if(hits != NULL && len == 0) {
+        free(hits);
+        return NULL;
+    }
+    if(hits != NULL) return itlist(hits, len / sizeof(hit_t));
+
+    it_t *it = compile(q, pl, min, false, NULL);
+    if(!qcseen(qc, gen, key)) return it;
+    int n = itdrain(it, &hits);
+    qcput(qc, gen, key, hits, n * sizeof(hit_t));
+    if(n > 0) return itlist(hits, n);
+    free(hits);
+    return NULL;
+}
+
+static it_t *compile(qnode_t *q, postings_t *pl, bool min, bool scan, qcache_t *qc) {
+
+    if(q->df == 0) return NULL;
+    if(q->type == QP_WORD) {
+        plist_t *l = plfind(pl, q->word);
+        return scan ? itscan(l) : itterm(l);
+    }
+    if(q->type == QP_NOT) return NULL;
+    if(q->type == QP_PHRASE || q->type == QP_NEAR) return compilepos(q, pl, min);
+    if(q->type == QP_AND && qc != NULL) return compilecached(q, pl, min, qc);
+
+    it_t **its = (it_t**)malloc(q->n * sizeof(it_t*));
+    int n = 0;
+    bool empty = false;
+    for(int i = 0; i < q->n && !empty; i++) {
+        if(q->kids[i]->type == QP_NOT) continue;
+        it_t *it = compile(q->kids[i], pl, min, q->type == QP_AND && q->scan, qc);
+        if(it != NULL) its[n++] = it;
+        else empty = q->type != QP_OR;
+    }
+
+    it_t *it = NULL;
+    if(empty || n == 0) {
+        for(int i = 0; i < n; i++) itclose(its[i]);
+    }
+    else if(n == 1) {
+        it = its[0];
+    }
+    else {
+        it = q->type == QP_OR ? itor(its, n) : itand(its, n, min);
+    }
+    free(its);
+
+    // Documents of the NOTs are skipped
+    for(int i = 0; i < q->n && it != NULL; i++) {
+        if(q->kids[i]->type != QP_NOT) continue;
+        it_t *neg = compile(q->kids[i]->kids[0], pl, min, false, qc);
+        if(neg != NULL) it = itnot(it, neg);
+    }
+    return it;
+}
+
+it_t *qpcompile(qnode_t *q, postings_t *pl, bool min, qcache_t *qc) {
+    if(q == NULL || pl == NULL) return NULL;
+    return compile(q, pl, min, false, qc);
+}
+
+
+/****************************************************************
+ * qpfree -- free the children, then the node
+****************************************************************/
+void qpfree(qnode_t *q) {
+    if(q == NULL) return;
+    for(int i = 0; i < q->n; i++) qpfree(q->kids[i]);
+    free(q->kids);
+    free(q->word);
+    free(q);
+}
@@ -0,0 +1,88 @@
+#pragma once
+/*
+ * qparse.h -- parsing, planning and compiling queries
+ *
+ * A query is parsed into a tree of words, ANDs, ORs, phrases, NEARs
+ * and NOTs, with the grammar
+ *
+ *   query   := and { "or" and }
+ *   and     := unary { ["and"] unary }
+ *   unary   := ["not"] near
+ *   near    := primary | word "near/"k word { "near/"k word }
+ *   primary := word | '"' word { word } '"' | '(' query ')'
+ *
+ * Words are made of letters and are matched in lower case, as are
+ * the keywords. NEAR binds tightest, then AND, then OR, and words
+ * next to each other are ANDed. An AND needs a word that is not under
+ * a NOT. A phrase matches the documents with its words one after the
+ * other, words too short to be indexed only holding their place, and
+ * a near/k b those with a and b at most k positions apart; a chain
+ * a near/j b near/k c is the AND of a near/j b and b near/k c. Without
+ * positions in the index, both match on their words alone.
+ *
+ * qpplan() rewrites a tree with the document frequencies of its
+ * words: nested ANDs and ORs are flattened, a word repeated in an AND
+ * is kept once, the conjuncts of an AND are put rarest first so the
+ * intersection starts from the shortest list, and the parts of the
+ * query no document can match are marked. Words of hot lists, such
+ * as stopwords (see tier.h), are left out of an AND that has other
+ * conjuncts to narrow it down. It also chooses how each AND is
+ * intersected: by galloping through the longer lists when the lists
+ * differ a lot in length, by stepping through them otherwise.
+ * qpcompile() turns a planned tree into iterators (see topk.h), so
+ * the documents are streamed from the posting lists and no
+ * intermediate list is built; except for the ANDs asked for more
+ * than once, whose documents are kept in a cache if one is given.
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include "postings.h"
+#include "topk.h"
+#include "qcache.h"
+
+/* node types */
+#define QP_WORD 0
+#define QP_AND 1
+#define QP_OR 2
+#define QP_PHRASE 3
+#define QP_NOT 4
+#define QP_NEAR 5
+
+typedef struct qnode qnode_t;
+struct qnode {
+    int type;
+    char *word;             // QP_WORD
+    int n;                  // Children of the other types
+    qnode_t **kids;
+    int df;                 // Estimated documents, set by qpplan()
+    bool scan;              // QP_AND: step through the lists
+    int k;                  // QP_NEAR: largest distance
+};
+
+/* qpparse -- parse a line of input
+ * returns the tree of the query, or NULL if it is invalid or empty
+ */
+qnode_t *qpparse(const char *input);
+
+/* qpplan -- plan a query against the posting lists, in place
+ * returns the query
+ */
+qnode_t *qpplan(qnode_t *q, postings_t *pl);
+
+/* qpcompile -- an iterator over the documents matching a planned
+ * query, scored with the sum of the scores of its words, or with the
+ * smallest of the scores of the words of an AND if min is true. The
+ * second time an AND is compiled with the cache qc, its documents
+ * are put in the cache, and read from it after; qc may be NULL.
+ * returns NULL if no document matches
+ */
+it_t *qpcompile(qnode_t *q, postings_t *pl, bool min, qcache_t *qc);
+
+/* qpstring -- write a query in a normal form, with every AND, OR and
+ * NOT of more than a word in parentheses, to buf, as snprintf does
+ * returns the length of the normal form
+ */
+int qpstring(qnode_t *q, char *buf, size_t size);
+
+/* qpfree -- free a query */
+void qpfree(qnode_t *q);
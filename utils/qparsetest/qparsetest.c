@@ -0,0 +1,239 @@
+/****************************************************************
+ * file   qparsetest.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   December 7, 2021
+ *
+ * Tests that the qparse.h module parses valid queries to the trees
+ * expected and rejects the others, that planning flattens, dedupes
+ * and orders conjuncts, leaving out hot words where others narrow an
+ * AND down, and that compiled queries, phrases and NEARs among them,
+ * match the right documents, from the cache too
+ *
+****************************************************************/
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include"hash.h"
+#include"queue.h"
+#include"indexio.h"
+#include"rank.h"
+#include"postings.h"
+#include"topk.h"
+#include"qcache.h"
+#include"qparse.h"
+
+/****************************************************************
+ * Define macro, globals and helper functions
+****************************************************************/
+#define eprintf(format, ...) do {                 \
+    if (verbose)                                  \
+        fprintf(stderr, format, ##__VA_ARGS__);   \
+} while(0)
+#define verbose 1
+
+// Adds a word found in documents lo to hi, freq times, but 3 times
+// in document three
+static void addword(hashtable_t *h, const char *word, int lo, int hi, int freq,
+                    int three) {
+    word_t *w = indexword(h, word);
+    for(int id = lo; id <= hi; id++) indexdoc(w, id, id == three ? 3 : freq, NULL);
+}
+
+// Adds a word at the positions given for each document, as in
+// "1:0 2:0,5", document 1 at 0 and document 2 at 0 and 5
+static void addpos(hashtable_t *h, const char *word, const char *docs) {
+    word_t *w = indexword(h, word);
+    for(char *p = (char*)docs; *p != '\0'; ) {
+        int id = (int)strtol(p, &p, 10), pos[16], n = 0;
+        do {
+            pos[n++] = (int)strtol(p + 1, &p, 10);
+        } while(*p == ',');
+        indexdoc(w, id, n, pos);
+    }
+}
+
+// Checks the normal form of a query, or that it is invalid
+static int parses(const char *input, const char *want, postings_t *pl) {
+    qnode_t *q = qpparse(input);
+    char got[256] = "(invalid)";
+    if(q != NULL) qpstring(qpplan(q, pl), got, sizeof(got));
+    qpfree(q);
+    if(strcmp(got, want ? want : "(invalid)")) {
+        eprintf("'%s' is %s, expected %s\n", input, got, want ? want : "invalid");
+        return 1;
+    }
+    return 0;
+}
+
+// Cache ANDs are compiled with, if any
+static qcache_t *cache = NULL;
+
+// Checks the documents a query matches, and their smallest ranks
+static int matches(const char *input, const char *want, postings_t *pl) {
+    qnode_t *q = qpplan(qpparse(input), pl);
+    it_t *it = qpcompile(q, pl, true, cache);
+    char got[256] = "";
+    int len = 0;
+    for(; it != NULL && it->doc != IT_END; it->next(it, it->doc + 1)) {
+        len += snprintf(got + len, sizeof(got) - len, "%s%d:%g", len ? " " : "",
+                        it->doc, it->score(it));
+    }
+    itclose(it);
+    qpfree(q);
+    if(strcmp(got, want)) {
+        eprintf("'%s' matches '%s', expected '%s'\n", input, got, want);
+        return 1;
+    }
+    return 0;
+}
+
+
+int main(void) {
+
+    int errors = 0;
+
+    // aaa is in 1-10, bbb in 2-4 and ccc in 5-12; ddd only in 7
+    hashtable_t *h = hopen(16);
+    addword(h, "aaa", 1, 10, 1, 4);
+    addword(h, "bbb", 2, 4, 2, 0);
+    addword(h, "ccc", 5, 12, 1, 6);
+    addword(h, "ddd", 7, 7, 1, 0);
+    ranker_t *rk = rkopen(RK_LEGACY, ".", "none");
+    postings_t *pl = plopen(h, NULL, rk, RK_LEGACY, ".", "none");
+    if(pl == NULL) {
+        eprintf("%s\n", "plopen failed");
+        exit(EXIT_FAILURE);
+    }
+
+    // Syntax, keywords and precedence
+    errors += parses("aaa", "aaa", pl);
+    errors += parses("  AAA\n", "aaa", pl);
+    errors += parses("aaa bbb or ccc", "(bbb and aaa) or ccc", pl);
+    errors += parses("ccc and (bbb or aaa)", "ccc and (bbb or aaa)", pl);
+    errors += parses("\"Big cat\" not aaa", "\"big cat\" and not aaa", pl);
+    errors += parses("\"to be or not\"", "\"to be or not\"", pl);
+    errors += parses("\"aaa\"", "aaa", pl);
+    errors += parses("(((aaa)))", "aaa", pl);
+    errors += parses("", NULL, pl);
+    errors += parses(" \t\n", NULL, pl);
+    errors += parses("not aaa", NULL, pl);
+    errors += parses("not not aaa", NULL, pl);
+    errors += parses("aaa or not bbb", NULL, pl);
+    errors += parses("and aaa", NULL, pl);
+    errors += parses("aaa or", NULL, pl);
+    errors += parses("aaa and or bbb", NULL, pl);
+    errors += parses("aaa 19", NULL, pl);
+    errors += parses("aaa!", NULL, pl);
+    errors += parses("(aaa", NULL, pl);
+    errors += parses("aaa)", NULL, pl);
+    errors += parses("()", NULL, pl);
+    errors += parses("\"\"", NULL, pl);
+    errors += parses("\"aaa", NULL, pl);
+    errors += parses("aaa NEAR/2 bbb", "aaa near/2 bbb", pl);
+    errors += parses("aaa near/1 bbb near/3 ccc",
+                     "aaa near/1 bbb and bbb near/3 ccc", pl);
+    errors += parses("ddd or aaa near/0 ccc", "ddd or aaa near/0 ccc", pl);
+    errors += parses("aaa near bbb", "near and bbb and aaa", pl);
+    errors += parses("near/2 aaa", NULL, pl);
+    errors += parses("aaa near/2", NULL, pl);
+    errors += parses("aaa near/x bbb", NULL, pl);
+    errors += parses("aaa near/2 (bbb)", NULL, pl);
+    errors += parses("\"aaa bbb\" near/2 ccc", NULL, pl);
+
+    // Planning: rarest first, repeats and NOTs of nothing dropped
+    errors += parses("aaa and bbb and aaa", "bbb and aaa", pl);
+    errors += parses("aaa not ccc bbb", "bbb and aaa and not ccc", pl);
+    errors += parses("(aaa and bbb) and bbb", "bbb and aaa", pl);
+    errors += parses("(aaa or bbb) or ccc", "aaa or bbb or ccc", pl);
+    errors += parses("aaa and not zzz", "aaa", pl);
+    errors += parses("aaa or aaa", "aaa or aaa", pl);
+
+    qnode_t *q = qpplan(qpparse("aaa and bbb"), pl);
+    if(!q->scan) {
+        eprintf("%s\n", "lists of similar length should be stepped through");
+        errors++;
+    }
+    qpfree(q);
+    q = qpplan(qpparse("aaa and ddd"), pl);
+    if(q->scan || q->df != 1) {
+        eprintf("%s\n", "lists of different length should be galloped through");
+        errors++;
+    }
+    qpfree(q);
+
+    // Documents matched, with the legacy ranks: without a cache, then
+    // with one, the first time an AND is asked for, the second, when
+    // it is cached, and the third, when it is read from the cache
+    cache = NULL;
+    for(int i = 0; i < 4; i++) {
+        errors += matches("aaa and bbb", "2:1 3:1 4:2", pl);
+        errors += matches("aaa and not bbb", "1:1 5:1 6:1 7:1 8:1 9:1 10:1", pl);
+        errors += matches("bbb or ccc", "2:2 3:2 4:2 5:1 6:3 7:1 8:1 9:1 10:1 11:1 12:1", pl);
+        errors += matches("(bbb or ccc) and not aaa", "11:1 12:1", pl);
+        errors += matches("\"aaa bbb\"", "2:1 3:1 4:2", pl);
+        errors += matches("bbb and (aaa or ccc)", "2:1 3:1 4:2", pl);
+        errors += matches("ccc and (aaa or ddd)", "5:1 6:1 7:1 8:1 9:1 10:1", pl);
+        errors += matches("aaa and zzz", "", pl);
+        errors += matches("zzz or ddd", "7:1", pl);
+        if(cache == NULL) cache = qcopen(1 << 16);
+    }
+    long hits, misses;
+    size_t bytes;
+    qcstats(cache, &hits, &misses, &bytes);
+    if(hits == 0) {
+        eprintf("%s\n", "no AND was read from the cache");
+        errors++;
+    }
+    qcclose(cache);
+    cache = NULL;
+    plclose(pl);
+
+    // With aaa a stopword, in the hot tier
+    hashtable_t *hot = hopen(4);
+    char *stop = (char*)malloc(4);
+    strcpy(stop, "aaa");
+    hput(hot, stop, stop, strlen(stop));
+    pl = plopen(h, hot, rk, RK_LEGACY, ".", "none");
+    errors += parses("aaa and bbb", "bbb", pl);
+    errors += parses("aaa ccc not bbb", "ccc and not bbb", pl);
+    errors += parses("aaa and not bbb", "aaa and not bbb", pl);
+    errors += parses("aaa or bbb", "aaa or bbb", pl);
+    errors += parses("\"aaa bbb\"", "\"aaa bbb\"", pl);
+    errors += matches("aaa and bbb", "2:2 3:2 4:2", pl);
+    errors += matches("\"aaa bbb\"", "2:1 3:1 4:2", pl);
+    plclose(pl);
+    hclose(hot);
+    indexclose(h);
+
+    // With positions: "red fox jumps" is in 1, "red a fox" in 2 and
+    // "fox red" in 3
+    h = hopen(16);
+    addpos(h, "red", "1:0 2:0,5 3:1");
+    addpos(h, "fox", "1:1 2:2 3:0 4:2");
+    addpos(h, "jumps", "1:2 2:6 3:4");
+    pl = plopen(h, NULL, rk, RK_LEGACY, ".", "none");
+    errors += matches("\"red fox\"", "1:1", pl);
+    errors += matches("\"red fox jumps\"", "1:1", pl);
+    errors += matches("\"red a fox\"", "2:1", pl);
+    errors += matches("\"the red\" or \"fox of\"", "1:1 2:1 3:1 4:1", pl);
+    errors += matches("\"fox red\" and jumps", "3:1", pl);
+    errors += matches("\"fox jumps\" or \"red red\"", "1:1", pl);
+    errors += matches("red near/1 fox", "1:1 3:1", pl);
+    errors += matches("fox near/2 red", "1:1 2:1 3:1", pl);
+    errors += matches("red near/2 fox near/1 jumps", "1:1", pl);
+    errors += matches("red near/9 fox and not \"red fox\"", "2:1 3:1", pl);
+    errors += matches("red near/2 zzz", "", pl);
+    plclose(pl);
+    rkclose(rk);
+    indexclose(h);
+
+    if(errors) {
+        eprintf("%d errors\n", errors);
+        exit(EXIT_FAILURE);
+    }
+    eprintf("%s passed\n", "qparse");
+    exit(EXIT_SUCCESS);
+}
@@ -237,7 +237,7 @@ void qconcat(queue_t *q1p, queue_t *q2p) {
     }
     else if (q1->front == NULL && q2->front != NULL) {
         q1->front = q2->front;
-        q1->front = q2->front;
+        q1->back = q2->back;
         free(q2);
     }
     else {
@@ -0,0 +1,288 @@
+/****************************************************************
+ * file   rank.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   December 5, 2021
+ *
+ * Implementation of BM25 and TF-IDF scoring over document
+ * statistics saved next to the index. The statistics file has a
+ * line with the number of documents and the sum of their lengths,
+ * then one line per document:
+ *
+ * <docID> <length> <norm>
+ *
+ * where <length> is the number of words indexed from the document
+ * and <norm> the Euclidean length of its (1 + ln tf) term weights.
+ * The file of a shard only lists its documents, but its first line
+ * is that of the whole collection.
+ *
+****************************************************************/
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<inttypes.h>
+#include<string.h>
+#include<math.h>
+#include"hash.h"
+#include"queue.h"
+#include"indexio.h"
+#include"log.h"
+#include"rank.h"
+
+
+/****************************************************************
+ * Define ranker data structure
+****************************************************************/
+#define __SUFFIX ".docs"
+
+typedef struct ranker {
+    int model;
+    int ndocs;
+    int maxid;
+    double avglen;
+    float *norm;                    // Per document, by id; see rkweight
+} rk_t;
+
+// Statistics being gathered by rksave()
+static struct {
+    int maxid;
+    int64_t *len;
+    double *sq;
+} acc;
+
+static void statpath(char *path, size_t size, char *dirname, char *indexnm) {
+    snprintf(path, size, "%s/%s%s", dirname, indexnm, __SUFFIX);
+}
+
+
+/****************************************************************
+ * rkmodel -- look the name up
+****************************************************************/
+int rkmodel(const char *name) {
+    if(!strcmp(name, "legacy")) return RK_LEGACY;
+    if(!strcmp(name, "bm25")) return RK_BM25;
+    if(!strcmp(name, "tfidf")) return RK_TFIDF;
+    return -1;
+}
+
+
+/****************************************************************
+ * Private helper functions: add the postings of a word to the
+ * statistics of their documents, growing the arrays to fit
+****************************************************************/
+static void accdoc(void *p) {
+    doc_t *d = (doc_t*)p;
+    if(d->id < 1 || d->freq < 1) return;
+    if(d->id > acc.maxid) {
+        int max = acc.maxid ? acc.maxid : 1024;
+        while(max < d->id) max *= 2;
+        acc.len = (int64_t*)realloc(acc.len, (max + 1) * sizeof(int64_t));
+        acc.sq = (double*)realloc(acc.sq, (max + 1) * sizeof(double));
+        memset(acc.len + acc.maxid + 1, 0, (max - acc.maxid) * sizeof(int64_t));
+        memset(acc.sq + acc.maxid + 1, 0, (max - acc.maxid) * sizeof(double));
+        acc.maxid = max;
+    }
+    double w = 1 + log(d->freq);
+    acc.len[d->id] += d->freq;
+    acc.sq[d->id] += w * w;
+}
+
+static void accword(void *p) {
+    qapply(((word_t*)p)->doclist, accdoc);
+}
+
+
+/****************************************************************
+ * Private helper functions: gather the statistics of an index into
+ * acc, adding up the number of documents and their lengths, and
+ * write those of its documents under a first line of totals
+****************************************************************/
+static void gather(hashtable_t *index, int *ndocs, int64_t *total) {
+    memset(&acc, 0, sizeof(acc));
+    happly(index, accword);
+    for(int id = 1; id <= acc.maxid; id++) {
+        if(acc.len[id] > 0) {
+            (*ndocs)++;
+            *total += acc.len[id];
+        }
+    }
+}
+
+static int32_t writestats(char *dirname, char *indexnm, int ndocs, int64_t total) {
+    char path[512];
+    statpath(path, sizeof(path), dirname, indexnm);
+    FILE *f = fopen(path, "w");
+    if(f == NULL) {
+        logmsg(LOG_ERROR, "Error: failed to open %s\n", path);
+        return -1;
+    }
+    fprintf(f, "%d %" PRId64 "\n", ndocs, total);
+    for(int id = 1; id <= acc.maxid; id++) {
+        if(acc.len[id] > 0) {
+            fprintf(f, "%d %" PRId64 " %.6f\n", id, acc.len[id], sqrt(acc.sq[id]));
+        }
+    }
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+static void release(void) {
+    free(acc.len);
+    free(acc.sq);
+    memset(&acc, 0, sizeof(acc));
+}
+
+
+/****************************************************************
+ * rksave -- gather the statistics over every posting, then write
+ * the documents that have any
+****************************************************************/
+int32_t rksave(hashtable_t *index, char *dirname, char *indexnm) {
+
+    if(index == NULL) return -1;
+    int ndocs = 0;
+    int64_t total = 0;
+    gather(index, &ndocs, &total);
+    int32_t error = writestats(dirname, indexnm, ndocs, total);
+    release();
+    return error;
+}
+
+
+/****************************************************************
+ * rksaveshards -- the totals of the collection first, then the
+ * statistics of each shard under them
+****************************************************************/
+int32_t rksaveshards(hashtable_t **shards, int n, char *dirname, char **names) {
+
+    int ndocs = 0;
+    int64_t total = 0;
+    for(int i = 0; i < n; i++) {
+        if(shards[i] == NULL) return -1;
+        gather(shards[i], &ndocs, &total);
+        release();
+    }
+
+    int32_t error = 0;
+    for(int i = 0; i < n && error == 0; i++) {
+        int shardocs = 0;
+        int64_t shardtotal = 0;
+        gather(shards[i], &shardocs, &shardtotal);
+        error = writestats(dirname, names[i], ndocs, total);
+        release();
+    }
+    return error;
+}
+
+
+/****************************************************************
+ * rkopen -- read the statistics and precompute the per-document
+ * part of the weight: the BM25 length normalization, or the
+ * inverse of the TF-IDF vector length
+****************************************************************/
+ranker_t *rkopen(int model, char *dirname, char *indexnm) {
+
+    if(model != RK_LEGACY && model != RK_BM25 && model != RK_TFIDF) return NULL;
+    rk_t *rk = (rk_t*)calloc(1, sizeof(rk_t));
+    if(rk == NULL) {
+        logmsg(LOG_ERROR, "Error: malloc failed allocating ranker\n");
+        return NULL;
+    }
+    rk->model = model;
+    if(model == RK_LEGACY) return (ranker_t*)rk;
+
+    char path[512];
+    statpath(path, sizeof(path), dirname, indexnm);
+    FILE *f = fopen(path, "r");
+    int64_t total;
+    if(f == NULL || fscanf(f, "%d %" SCNd64, &rk->ndocs, &total) != 2 ||
+       rk->ndocs < 1) {
+        logmsg(LOG_ERROR, "Error: no document statistics in %s\n", path);
+        if(f) fclose(f);
+        free(rk);
+        return NULL;
+    }
+    rk->avglen = (double)total / rk->ndocs;
+
+    // Documents missing from the file count as of average length
+    int id, cap = 0;
+    int64_t len;
+    double norm;
+    while(fscanf(f, "%d %" SCNd64 " %lf", &id, &len, &norm) == 3) {
+        if(id < 1) continue;
+        if(id >= cap) {
+            int newcap = cap ? cap : 1024;
+            while(newcap <= id) newcap *= 2;
+            rk->norm = (float*)realloc(rk->norm, newcap * sizeof(float));
+            for(int i = cap; i < newcap; i++) {
+                rk->norm[i] = model == RK_BM25 ? RK_K1 : 1;
+            }
+            cap = newcap;
+        }
+        if(id > rk->maxid) rk->maxid = id;
+        if(model == RK_BM25) {
+            rk->norm[id] = RK_K1 * (1 - RK_B + RK_B * len / rk->avglen);
+        }
+        else {
+            rk->norm[id] = norm > 0 ? 1 / norm : 1;
+        }
+    }
+    fclose(f);
+    return (ranker_t*)rk;
+}
+
+
+/****************************************************************
+ * rkclose -- free a ranker
+****************************************************************/
+void rkclose(ranker_t *rkp) {
+    if(rkp == NULL) return;
+    free(((rk_t*)rkp)->norm);
+    free(rkp);
+}
+
+
+/****************************************************************
+ * rkdocs -- the number of documents
+****************************************************************/
+int rkdocs(ranker_t *rkp) {
+    return ((rk_t*)rkp)->ndocs;
+}
+
+
+/****************************************************************
+ * rkterm -- the inverse document frequency, times k1 + 1 for BM25
+ * so that a weight of at most 1 is left per posting. Both forms
+ * stay positive for terms in every document.
+****************************************************************/
+double rkterm(ranker_t *rkp, int df) {
+    rk_t *rk = (rk_t*)rkp;
+    if(df < 1) return 0;
+    switch(rk->model) {
+    case RK_BM25:
+        return (RK_K1 + 1) * log(1 + (rk->ndocs - df + 0.5) / (df + 0.5));
+    case RK_TFIDF:
+        return log(1 + (double)rk->ndocs / df);
+    default:
+        return 1;
+    }
+}
+
+
+/****************************************************************
+ * rkweight -- see rank.h
+****************************************************************/
+double rkweight(ranker_t *rkp, int id, int tf) {
+    rk_t *rk = (rk_t*)rkp;
+    if(tf < 1) return 0;
+    float norm = id >= 1 && id <= rk->maxid ? rk->norm[id] :
+                 rk->model == RK_BM25 ? RK_K1 : 1;
+    switch(rk->model) {
+    case RK_BM25:
+        return tf / (tf + norm);
+    case RK_TFIDF:
+        return (1 + log(tf)) * norm;
+    default:
+        return tf;
+    }
+}
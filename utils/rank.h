@@ -0,0 +1,71 @@
+#pragma once
+/*
+ * rank.h -- relevance ranking with BM25 and TF-IDF
+ *
+ * Both models need statistics of the whole collection that the
+ * index does not hold: the number of documents, the length of each
+ * one and, for TF-IDF, the length of its term-weight vector. The
+ * indexer computes them when it saves an index and rksave() writes
+ * them next to it, to <indexnm>.docs; the querier loads them with
+ * rkopen(). Shards of a collection each get the statistics of their
+ * documents, but the number and average length of those of the whole
+ * collection, so that they score them as a single index would.
+ *
+ * The score of a document for a query term is rkterm(), a constant
+ * of the term computed once per query, times rkweight(), which only
+ * depends on the posting: for BM25 tf / (tf + norm), with the length
+ * normalization norm of the document precomputed, and for TF-IDF
+ * (1 + ln tf) / |d|. So scoring is a multiply-add per posting.
+ *
+ * RK_LEGACY is the original ranking of the querier, the smallest
+ * frequency across the words of an AND and the sum across an OR; it
+ * needs no statistics.
+ */
+#include <stdint.h>
+#include "hash.h"
+
+#define RK_LEGACY 0
+#define RK_BM25 1
+#define RK_TFIDF 2
+
+/* BM25 parameters */
+#define RK_K1 1.2
+#define RK_B 0.75
+
+/* the ranker representation is hidden from users of the module */
+typedef void ranker_t;
+
+/* rkmodel -- the model called name: "legacy", "bm25" or "tfidf"
+ * returns -1 if there is no such model
+ */
+int rkmodel(const char *name);
+
+/* rksave -- computes the statistics of an index, as indexload()
+ * returns it, and saves them to dirname/indexnm.docs
+ * returns 0 if success and non-zero otherwise
+ */
+int32_t rksave(hashtable_t *index, char *dirname, char *indexnm);
+
+/* rksaveshards -- the same for the n shards of a collection, each
+ * saved to dirname/names[i].docs with the totals of the collection
+ * returns 0 if success and non-zero otherwise
+ */
+int32_t rksaveshards(hashtable_t **shards, int n, char *dirname, char **names);
+
+/* rkopen -- loads the statistics of the index dirname/indexnm for
+ * a model
+ * returns NULL if they cannot be read
+ */
+ranker_t *rkopen(int model, char *dirname, char *indexnm);
+
+/* rkclose -- free a ranker */
+void rkclose(ranker_t *rk);
+
+/* rkdocs -- the number of documents in the collection */
+int rkdocs(ranker_t *rk);
+
+/* rkterm -- the constant of a term found in df documents */
+double rkterm(ranker_t *rk, int df);
+
+/* rkweight -- the weight of a term found tf times in document id */
+double rkweight(ranker_t *rk, int id, int tf);
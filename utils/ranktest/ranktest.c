@@ -0,0 +1,155 @@
+/****************************************************************
+ * file   ranktest.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   December 5, 2021
+ *
+ * Tests that the rank.h module saves and loads the document
+ * statistics of an index, and of its shards, and that BM25 and
+ * TF-IDF favour rare terms, frequent terms and short documents
+ *
+****************************************************************/
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include<math.h>
+#include"hash.h"
+#include"queue.h"
+#include"indexio.h"
+#include"rank.h"
+
+/****************************************************************
+ * Define macro, globals and helper functions
+****************************************************************/
+#define eprintf(format, ...) do {                 \
+    if (verbose)                                  \
+        fprintf(stderr, format, ##__VA_ARGS__);   \
+} while(0)
+#define verbose 1
+
+#define __INDEX "ranktest.index"
+
+// Adds a word found freq times in each of the documents ids
+static void addword(hashtable_t *h, const char *word, int n, int *ids,
+                    int *freqs) {
+    word_t *w = indexword(h, word);
+    for(int i = 0; i < n; i++) indexdoc(w, ids[i], freqs[i], NULL);
+}
+
+static bool near(double a, double b) {
+    return fabs(a - b) < 1e-4;
+}
+
+
+int main(void) {
+
+    int errors = 0;
+
+    // Document 1 is short, document 2 long; "rare" is only in 1
+    hashtable_t *h = hopen(16);
+    addword(h, "common", 3, (int[]){1, 2, 3}, (int[]){1, 1, 1});
+    addword(h, "rare", 1, (int[]){1}, (int[]){3});
+    addword(h, "filler", 2, (int[]){2, 3}, (int[]){50, 4});
+    if(rksave(h, ".", __INDEX) != 0) {
+        eprintf("%s\n", "rksave failed");
+        errors++;
+    }
+    indexclose(h);
+
+    if(rkmodel("bm25") != RK_BM25 || rkmodel("tfidf") != RK_TFIDF ||
+       rkmodel("legacy") != RK_LEGACY || rkmodel("pagerank") != -1) {
+        eprintf("%s\n", "models misnamed");
+        errors++;
+    }
+    if(rkopen(RK_BM25, ".", "missing.index") != NULL) {
+        eprintf("%s\n", "opened missing statistics");
+        errors++;
+    }
+
+    // BM25: rare terms, more occurrences and shorter documents win
+    ranker_t *rk = rkopen(RK_BM25, ".", __INDEX);
+    if(rk == NULL || rkdocs(rk) != 3) {
+        eprintf("%s\n", "bm25 statistics not loaded");
+        exit(EXIT_FAILURE);
+    }
+    if(!(rkterm(rk, 1) > rkterm(rk, 2) && rkterm(rk, 2) > rkterm(rk, 3) &&
+         rkterm(rk, 3) > 0)) {
+        eprintf("bm25 idf not decreasing: %f %f %f\n", rkterm(rk, 1),
+                rkterm(rk, 2), rkterm(rk, 3));
+        errors++;
+    }
+    if(!(rkweight(rk, 1, 3) > rkweight(rk, 1, 1) && rkweight(rk, 1, 100) < 1)) {
+        eprintf("%s\n", "bm25 tf saturation wrong");
+        errors++;
+    }
+    if(!(rkweight(rk, 1, 1) > rkweight(rk, 2, 1))) {
+        eprintf("%s\n", "bm25 does not favour short documents");
+        errors++;
+    }
+
+    // Lengths 4, 51 and 5 average 20
+    double want = 1 / (1 + RK_K1 * (1 - RK_B + RK_B * 4 / 20.0));
+    if(!near(rkweight(rk, 1, 1), want)) {
+        eprintf("bm25 weight %f, expected %f\n", rkweight(rk, 1, 1), want);
+        errors++;
+    }
+    rkclose(rk);
+
+    // TF-IDF: weights are normalized by the document vector length
+    rk = rkopen(RK_TFIDF, ".", __INDEX);
+    if(rk == NULL) {
+        eprintf("%s\n", "tfidf statistics not loaded");
+        exit(EXIT_FAILURE);
+    }
+    want = (1 + log(3)) / sqrt(1 + (1 + log(3)) * (1 + log(3)));
+    if(!near(rkweight(rk, 1, 3), want) || !near(rkterm(rk, 1), log(4))) {
+        eprintf("tfidf weight %f, expected %f\n", rkweight(rk, 1, 3), want);
+        errors++;
+    }
+    if(!(rkweight(rk, 3, 1) > rkweight(rk, 2, 1))) {
+        eprintf("%s\n", "tfidf does not favour short documents");
+        errors++;
+    }
+    rkclose(rk);
+    remove(__INDEX ".docs");
+
+    // Shards weigh their documents as the whole collection does
+    hashtable_t *shards[2] = {hopen(16), hopen(16)};
+    addword(shards[0], "common", 2, (int[]){1, 3}, (int[]){1, 1});
+    addword(shards[0], "rare", 1, (int[]){1}, (int[]){3});
+    addword(shards[0], "filler", 1, (int[]){3}, (int[]){4});
+    addword(shards[1], "common", 1, (int[]){2}, (int[]){1});
+    addword(shards[1], "filler", 1, (int[]){2}, (int[]){50});
+    if(rksaveshards(shards, 2, ".", (char*[]){__INDEX ".0", __INDEX ".1"}) != 0) {
+        eprintf("%s\n", "rksaveshards failed");
+        errors++;
+    }
+    for(int i = 0; i < 2; i++) {
+        indexclose(shards[i]);
+    }
+    rk = rkopen(RK_BM25, ".", __INDEX ".0");
+    want = 1 / (1 + RK_K1 * (1 - RK_B + RK_B * 4 / 20.0));
+    if(rk == NULL || rkdocs(rk) != 3 || !near(rkweight(rk, 1, 1), want)) {
+        eprintf("%s\n", "shard statistics not those of the collection");
+        errors++;
+    }
+    rkclose(rk);
+    rk = rkopen(RK_TFIDF, ".", __INDEX ".1");
+    want = 1 / sqrt(1 + (1 + log(50)) * (1 + log(50)));
+    if(rk == NULL || !near(rkweight(rk, 2, 1), want) || !near(rkterm(rk, 1), log(4))) {
+        eprintf("%s\n", "shard weights not those of the collection");
+        errors++;
+    }
+    rkclose(rk);
+    remove(__INDEX ".0.docs");
+    remove(__INDEX ".1.docs");
+
+    if(errors) {
+        eprintf("%d errors\n", errors);
+        exit(EXIT_FAILURE);
+    }
+    eprintf("%s passed\n", "rank");
+    exit(EXIT_SUCCESS);
+}
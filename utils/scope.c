@@ -0,0 +1,224 @@
+/****************************************************************
+ * file   scope.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   November 29, 2021
+ *
+ * Implementation of crawl scope rules compiled into tries. The
+ * nodes of all three tries live in one array and refer to each
+ * other by index; each node keeps its children as a list.
+ *
+****************************************************************/
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include<ctype.h>
+#include"webpage.h"
+#include"scope.h"
+
+
+/****************************************************************
+ * Define scope data structure
+****************************************************************/
+#define __KINDS 3
+#define __ALLOW 1                   // An allow rule ends at this node
+#define __DENY 2                    // A deny rule ends at this node
+#define __MAXLINE 1024
+
+typedef struct node {
+    int child;                      // First child, 0 if none
+    int sibling;                    // Next child of the parent, 0 if none
+    unsigned char c;                // Character leading to this node
+    unsigned char rules;            // __ALLOW and/or __DENY
+} node_t;
+
+typedef struct scope {
+    node_t *nodes;                  // Node 0 is unused, so 0 means none
+    int count;
+    int capacity;
+    int roots[__KINDS];
+} sc_t;
+
+
+/****************************************************************
+ * Private helper function: add a node, returning its index or 0
+ * if out of memory
+****************************************************************/
+static int newnode(sc_t *sc, unsigned char c) {
+    if(sc->count == sc->capacity) {
+        int capacity = 2 * sc->capacity;
+        node_t *nodes = (node_t*)realloc(sc->nodes, capacity * sizeof(node_t));
+        if(nodes == NULL) return 0;
+        sc->nodes = nodes;
+        sc->capacity = capacity;
+    }
+    sc->nodes[sc->count] = (node_t){0, 0, c, 0};
+    return sc->count++;
+}
+
+
+/****************************************************************
+ * Private helper function: the child of a node along c, or 0
+****************************************************************/
+static int child(const sc_t *sc, int n, unsigned char c) {
+    for(n = sc->nodes[n].child; n != 0; n = sc->nodes[n].sibling) {
+        if(sc->nodes[n].c == c) return n;
+    }
+    return 0;
+}
+
+
+/****************************************************************
+ * scopen -- open an empty scope
+****************************************************************/
+scope_t *scopen(void) {
+
+    sc_t *sc;
+    if(!(sc = (sc_t*)calloc(1, sizeof(sc_t)))) {
+        printf("Error: malloc failed allocating scope\n");
+        return NULL;
+    }
+    sc->capacity = 64;
+    if(!(sc->nodes = (node_t*)malloc(sc->capacity * sizeof(node_t)))) {
+        printf("Error: malloc failed allocating scope\n");
+        free(sc);
+        return NULL;
+    }
+    sc->count = 1;
+    for(int k = 0; k < __KINDS; k++) sc->roots[k] = newnode(sc, 0);
+    return (scope_t*)sc;
+}
+
+
+/****************************************************************
+ * scclose -- free a scope
+****************************************************************/
+void scclose(scope_t *scp) {
+    if(scp == NULL) return;
+    sc_t *sc = (sc_t*)scp;
+    free(sc->nodes);
+    free(sc);
+}
+
+
+/****************************************************************
+ * scadd -- add a rule. Host patterns are lowercased and stored
+ * reversed, without a leading "*." or "."; prefixes are normalized
+ * when they are valid URLs.
+****************************************************************/
+int32_t scadd(scope_t *scp, bool allow, int kind, const char *pattern) {
+
+    if(scp == NULL || pattern == NULL || kind < 0 || kind >= __KINDS) return 1;
+    sc_t *sc = (sc_t*)scp;
+
+    int len = strlen(pattern);
+    char buf[len + 1];
+    if(kind == SC_PREFIX) {
+        if(CanonicalizeURL(pattern, buf, len + 1, NULL) < 0) strcpy(buf, pattern);
+    }
+    else if(kind == SC_HOST) {
+        if(!strncmp(pattern, "*.", 2)) pattern += 2;
+        else if(*pattern == '.') pattern++;
+        len = strlen(pattern);
+        for(int i = 0; i < len; i++) buf[i] = tolower(pattern[len - 1 - i]);
+        buf[len] = '\0';
+    }
+    else {
+        strcpy(buf, pattern);
+    }
+    if(buf[0] == '\0') return 1;
+
+    int n = sc->roots[kind];
+    for(char *c = buf; *c; c++) {
+        int next = child(sc, n, *c);
+        if(next == 0) {
+            if((next = newnode(sc, *c)) == 0) {
+                printf("Error: malloc failed growing scope\n");
+                return 1;
+            }
+            sc->nodes[next].sibling = sc->nodes[n].child;
+            sc->nodes[n].child = next;
+        }
+        n = next;
+    }
+    sc->nodes[n].rules |= allow ? __ALLOW : __DENY;
+    return 0;
+}
+
+
+/****************************************************************
+ * scload -- read the rules of a scope file
+****************************************************************/
+scope_t *scload(const char *path) {
+
+    FILE *fp = fopen(path, "r");
+    if(fp == NULL) {
+        printf("Error: failed to open scope file %s\n", path);
+        return NULL;
+    }
+    scope_t *sc = scopen();
+    char line[__MAXLINE], action[__MAXLINE], kind[__MAXLINE], pattern[__MAXLINE];
+    for(int lineno = 1; sc != NULL && fgets(line, sizeof(line), fp); lineno++) {
+        int n = sscanf(line, "%s %s %s", action, kind, pattern);
+        if(n <= 0 || action[0] == '#') continue;
+
+        int k = !strcmp(kind, "prefix") ? SC_PREFIX :
+                !strcmp(kind, "host") ? SC_HOST :
+                !strcmp(kind, "path") ? SC_PATH : -1;
+        bool allow = !strcmp(action, "allow");
+        if(n != 3 || k < 0 || (!allow && strcmp(action, "deny")) ||
+           scadd(sc, allow, k, pattern) != 0) {
+            printf("Error: bad rule on line %d of %s\n", lineno, path);
+            scclose(sc);
+            sc = NULL;
+        }
+    }
+    fclose(fp);
+    return sc;
+}
+
+
+/****************************************************************
+ * Private helper function: walk a trie along n characters from s,
+ * stepping by step, and collect the rules of the nodes passed. With
+ * labels, only rules ending at a '.' or at the end count.
+****************************************************************/
+static int walk(const sc_t *sc, int kind, const char *s, int n, int step,
+                bool labels) {
+    int rules = 0, node = sc->roots[kind];
+    for(int i = 0; i < n; i++, s += step) {
+        if((node = child(sc, node, *s)) == 0) break;
+        if(!labels || i + 1 == n || s[step] == '.') rules |= sc->nodes[node].rules;
+    }
+    return rules;
+}
+
+
+/****************************************************************
+ * sccheck -- normalize url and check it against each trie
+****************************************************************/
+bool sccheck(scope_t *scp, char *url) {
+
+    if(scp == NULL || url == NULL) return false;
+    sc_t *sc = (sc_t*)scp;
+
+    urlspans_t s;
+    int len = CanonicalizeURL(url, url, strlen(url) + 1, &s);
+    if(len < 0) return false;
+
+    // Hosts are matched without their port, from the last character
+    const char *host = url + s.host;
+    const char *port = memchr(host, ':', s.hostlen);
+    int hostlen = port ? port - host : s.hostlen;
+
+    int rules = walk(sc, SC_PREFIX, url, len, 1, false);
+    if(!strncmp(url, "http://", 7) || !strncmp(url, "https://", 8)) {
+        if(hostlen > 0) {
+            rules |= walk(sc, SC_HOST, host + hostlen - 1, hostlen, -1, true);
+        }
+        rules |= walk(sc, SC_PATH, url + s.path, s.pathlen, 1, false);
+    }
+    return (rules & __ALLOW) && !(rules & __DENY);
+}
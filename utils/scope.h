@@ -0,0 +1,57 @@
+#pragma once
+/*
+ * scope.h -- which URLs a crawl may follow
+ *
+ * A scope is a set of allow and deny rules of three kinds:
+ *   SC_PREFIX  the normalized URL starts with the pattern
+ *   SC_HOST    the host is the pattern or a subdomain of it
+ *   SC_PATH    the path starts with the pattern, on any host
+ * Host and path rules only apply to http and https URLs. A URL is
+ * in scope if it matches an allow rule and no deny rule.
+ *
+ * The rules of each kind are compiled into a trie (host rules are
+ * stored reversed), so checking a URL walks each trie once along the
+ * URL, its host or its path, no matter how many rules there are. A
+ * scope can be checked from several threads at once once it is
+ * filled, but must not be changed then.
+ *
+ * A scope file holds one rule per line, "allow|deny <kind> <pattern>"
+ * with kind one of prefix, host or path; blank lines and lines
+ * starting with '#' are ignored. For example:
+ *
+ *   allow prefix https://thayer.github.io/engs50
+ *   allow host   dartmouth.edu
+ *   deny  path   /cgi-bin/
+ */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* the kinds of rules */
+#define SC_PREFIX 0
+#define SC_HOST 1
+#define SC_PATH 2
+
+/* the scope representation is hidden from users of the module */
+typedef void scope_t;
+
+/* scopen -- open an empty scope, which allows nothing */
+scope_t *scopen(void);
+
+/* scclose -- free a scope */
+void scclose(scope_t *sc);
+
+/* scadd -- add a rule of a given kind; allow or deny
+ * returns 0 if successful; nonzero otherwise
+ */
+int32_t scadd(scope_t *sc, bool allow, int kind, const char *pattern);
+
+/* scload -- open a scope with the rules in a scope file
+ * returns NULL if the file can't be read or has a bad line
+ */
+scope_t *scload(const char *path);
+
+/* sccheck -- normalize url in place, as NormalizeURL() does, and
+ * check it against the rules
+ * returns true if url is valid and in scope
+ */
+bool sccheck(scope_t *sc, char *url);
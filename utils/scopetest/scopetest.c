@@ -0,0 +1,131 @@
+/****************************************************************
+ * file   scopetest.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   November 29, 2021
+ * 
+ * Tests that the scope.h module follows its allow and deny rules,
+ * and agrees with IsInternalURL() when given INTERNAL_URL_PREFIX
+ * 
+****************************************************************/
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<string.h>
+#include"webpage.h"
+#include"scope.h"
+
+/****************************************************************
+ * Define macro, globals and helper functions
+****************************************************************/
+#define eprintf(format, ...) do {                 \
+    if (verbose)                                  \
+        fprintf(stderr, format, ##__VA_ARGS__);   \
+} while(0)
+#define verbose 1
+
+#define __MAXLINE 1024
+#define __RULES 10000
+
+typedef struct testcase {
+    const char *url;
+    bool inscope;
+} testcase_t;
+
+// Checked against scopetest.rules
+testcase_t cases[] = {
+    {"https://thayer.github.io/engs50/", true},
+    {"HTTPS://Thayer.GitHub.io/engs50/Labs/../index.html", true},
+    {"https://thayer.github.io/engs50/private/notes.html", false},
+    {"https://thayer.github.io/engs50/x/../private/", false},
+    {"https://thayer.github.io/engs60/", false},
+    {"https://thayer.github.io/engs50/logo.png", false},
+    {"http://www.dartmouth.edu/", true},
+    {"http://dartmouth.edu", true},
+    {"http://home.CS.Dartmouth.EDU:8080/~cs50/", true},
+    {"http://notdartmouth.edu/", false},
+    {"http://dartmouth.edu.evil.com/", false},
+    {"http://ads.dartmouth.edu/", false},
+    {"http://x.ads.dartmouth.edu/", false},
+    {"http://www.dartmouth.edu/cgi-bin/search.php", false},
+    {"https://thayer.github.io/engs50/cgi-bin/", true},
+    {"mailto:someone@dartmouth.edu", false},
+    {"not a url", false},
+};
+
+
+/****************************************************************
+ * Private helper function: check one URL against a scope
+****************************************************************/
+static int check(scope_t *sc, const char *url, bool inscope) {
+    char buf[__MAXLINE];
+    strcpy(buf, url);
+    if(sccheck(sc, buf) != inscope) {
+        eprintf("%s should be %s\n", url, inscope ? "in scope" : "out of scope");
+        return 1;
+    }
+    return 0;
+}
+
+
+int main(void) {
+
+    int errors = 0;
+
+    // The rules in the scope file
+    scope_t *sc = scload("scopetest.rules");
+    if(sc == NULL) {
+        eprintf("%s\n", "Error: can't load scopetest.rules");
+        exit(EXIT_FAILURE);
+    }
+    for(int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        errors += check(sc, cases[i].url, cases[i].inscope);
+    }
+
+    // Many rules don't change the outcome
+    char pattern[64];
+    for(int i = 0; i < __RULES; i++) {
+        sprintf(pattern, "host%d.example.org", i);
+        scadd(sc, true, SC_HOST, pattern);
+        sprintf(pattern, "/deny%d/", i);
+        scadd(sc, false, SC_PATH, pattern);
+    }
+    for(int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        errors += check(sc, cases[i].url, cases[i].inscope);
+    }
+    errors += check(sc, "http://a.host42.example.org/", true);
+    errors += check(sc, "http://host4.example.org/deny4/", false);
+    errors += check(sc, "http://host10000.example.org/", false);
+    scclose(sc);
+
+    // A bad rule is refused
+    FILE *fp = fopen("bad.rules", "w");
+    fprintf(fp, "allow prefix http://a.com/\nallow domain a.com\n");
+    fclose(fp);
+    if((sc = scload("bad.rules")) != NULL) {
+        eprintf("%s\n", "bad.rules loaded");
+        scclose(sc);
+        errors++;
+    }
+    remove("bad.rules");
+
+    // The default scope is IsInternalURL()
+    sc = scopen();
+    scadd(sc, true, SC_PREFIX, INTERNAL_URL_PREFIX);
+    FILE *links = fopen("../urltest/links.txt", "r");
+    char url[__MAXLINE], copy[__MAXLINE];
+    while(links != NULL && fgets(url, sizeof(url), links)) {
+        url[strcspn(url, "\n")] = '\0';
+        strcpy(copy, url);
+        errors += check(sc, url, IsInternalURL(copy));
+    }
+    if(links) fclose(links);
+    scclose(sc);
+
+    if(errors) {
+        eprintf("%d errors\n", errors);
+        exit(EXIT_FAILURE);
+    }
+    eprintf("%s passed\n", "scope");
+    exit(EXIT_SUCCESS);
+}
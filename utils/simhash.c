@@ -0,0 +1,200 @@
+/****************************************************************
+ * file   simhash.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   November 28, 2021
+ *
+ * Implementation of SimHash fingerprints over word shingles and of
+ * a banded index for finding fingerprints a few bits apart.
+ *
+****************************************************************/
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include<ctype.h>
+#include"hash.h"
+#include"webpage.h"
+#include"simhash.h"
+
+
+/****************************************************************
+ * Define index data structure
+****************************************************************/
+#define __BANDS 4
+#define __BANDBITS 16
+#define __SHINGLE 3
+
+typedef struct entry {
+    uint64_t fp;
+    int id;
+} entry_t;
+
+typedef struct bucket {
+    entry_t *entries;
+    int count;
+    int capacity;
+} bucket_t;
+
+typedef struct simindex {
+    bucket_t *bands[__BANDS];   // 2^16 buckets per band
+} si_t;
+
+
+/****************************************************************
+ * Private helper function: the MurmurHash3 finalizer, to combine
+ * word hashes into a shingle hash
+****************************************************************/
+static uint64_t mix64(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+
+/****************************************************************
+ * simhash -- every shingle votes +1 or -1 on each bit by its own
+ * hash; the fingerprint keeps the bits that won
+****************************************************************/
+uint64_t simhash(webpage_t *page) {
+
+    int votes[64] = {0};
+    uint64_t words[__SHINGLE] = {0};
+    int nwords = 0, nshingles = 0, pos = 0;
+    char *word = NULL;
+
+    while((pos = webpage_getNextWord(page, pos, &word)) > 0) {
+        for(char *c = word; *c; c++) *c = tolower(*c);
+        memmove(words, words + 1, (__SHINGLE - 1) * sizeof(uint64_t));
+        words[__SHINGLE - 1] = hash64(word, strlen(word));
+        free(word);
+        if(++nwords < __SHINGLE) continue;
+
+        uint64_t h = 0;
+        for(int i = 0; i < __SHINGLE; i++) h = mix64(h ^ words[i]);
+        for(int b = 0; b < 64; b++) votes[b] += (h >> b & 1) ? 1 : -1;
+        nshingles++;
+    }
+
+    // Pages too short for a shingle vote with their words
+    if(nshingles == 0 && nwords > 0) {
+        for(int i = __SHINGLE - nwords; i < __SHINGLE; i++) {
+            for(int b = 0; b < 64; b++) votes[b] += (words[i] >> b & 1) ? 1 : -1;
+        }
+    }
+    if(nwords == 0) return 0;
+
+    uint64_t fp = 0;
+    for(int b = 0; b < 64; b++) {
+        if(votes[b] > 0) fp |= 1ULL << b;
+    }
+    return fp;
+}
+
+
+/****************************************************************
+ * shdistance -- the number of bits in which two fingerprints differ
+****************************************************************/
+int shdistance(uint64_t a, uint64_t b) {
+    uint64_t x = a ^ b;
+    int n = 0;
+    for(; x; n++) x &= x - 1;
+    return n;
+}
+
+
+/****************************************************************
+ * Private helper function: the value of band b of a fingerprint
+****************************************************************/
+static int band(uint64_t fp, int b) {
+    return (fp >> (b * __BANDBITS)) & ((1 << __BANDBITS) - 1);
+}
+
+
+/****************************************************************
+ * shopen -- open an empty fingerprint index
+****************************************************************/
+simindex_t *shopen(void) {
+
+    si_t *si;
+    if(!(si = (si_t*)calloc(1, sizeof(si_t)))) {
+        printf("Error: malloc failed allocating fingerprint index\n");
+        return NULL;
+    }
+    for(int b = 0; b < __BANDS; b++) {
+        si->bands[b] = (bucket_t*)calloc(1 << __BANDBITS, sizeof(bucket_t));
+        if(si->bands[b] == NULL) {
+            printf("Error: malloc failed allocating fingerprint index\n");
+            shclose(si);
+            return NULL;
+        }
+    }
+    return (simindex_t*)si;
+}
+
+
+/****************************************************************
+ * shclose -- free an index
+****************************************************************/
+void shclose(simindex_t *sip) {
+
+    if(sip == NULL) return;
+    si_t *si = (si_t*)sip;
+    for(int b = 0; b < __BANDS; b++) {
+        if(si->bands[b] == NULL) continue;
+        for(int i = 0; i < (1 << __BANDBITS); i++) {
+            free(si->bands[b][i].entries);
+        }
+        free(si->bands[b]);
+    }
+    free(si);
+}
+
+
+/****************************************************************
+ * shadd -- file a fingerprint under each of its bands
+****************************************************************/
+int32_t shadd(simindex_t *sip, uint64_t fp, int id) {
+
+    if(sip == NULL) return 1;
+    si_t *si = (si_t*)sip;
+    for(int b = 0; b < __BANDS; b++) {
+        bucket_t *bk = &si->bands[b][band(fp, b)];
+        if(bk->count == bk->capacity) {
+            int capacity = bk->capacity ? 2 * bk->capacity : 4;
+            entry_t *entries = (entry_t*)realloc(bk->entries,
+                                                 capacity * sizeof(entry_t));
+            if(entries == NULL) {
+                printf("Error: malloc failed growing fingerprint index\n");
+                return 1;
+            }
+            bk->entries = entries;
+            bk->capacity = capacity;
+        }
+        bk->entries[bk->count++] = (entry_t){fp, id};
+    }
+    return 0;
+}
+
+
+/****************************************************************
+ * shfind -- probe the bucket of each band for a close fingerprint
+****************************************************************/
+int shfind(simindex_t *sip, uint64_t fp, int maxdist) {
+
+    if(sip == NULL) return 0;
+    si_t *si = (si_t*)sip;
+    for(int b = 0; b < __BANDS; b++) {
+        bucket_t *bk = &si->bands[b][band(fp, b)];
+        for(int i = 0; i < bk->count; i++) {
+            if(shdistance(fp, bk->entries[i].fp) <= maxdist) {
+                return bk->entries[i].id;
+            }
+        }
+    }
+    return 0;
+}
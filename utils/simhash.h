@@ -0,0 +1,50 @@
+#pragma once
+/*
+ * simhash.h -- near-duplicate detection with SimHash fingerprints
+ *
+ * simhash() turns the words of a page, as returned by
+ * webpage_getNextWord(), into a 64-bit fingerprint such that pages
+ * sharing most of their text get fingerprints that differ in only a
+ * few bits. The features are overlapping 3-word shingles, so pages
+ * made of the same words in a different order still differ.
+ *
+ * A simindex holds the fingerprints of the pages kept so far and
+ * answers "is there one within maxdist bits of this?". It splits the
+ * fingerprint into 4 bands of 16 bits and files every fingerprint
+ * under each band; two fingerprints within 3 bits agree on at least
+ * one band, so a lookup only compares against the fingerprints in 4
+ * buckets. A simindex is not thread safe.
+ */
+#include <stdint.h>
+#include "webpage.h"
+
+/* the maximum distance shfind() is exact for */
+#define SH_MAXDIST 3
+
+/* simhash -- the SimHash fingerprint of the words of a page
+ * returns 0 if the page has no words
+ */
+uint64_t simhash(webpage_t *page);
+
+/* shdistance -- the number of bits in which two fingerprints differ */
+int shdistance(uint64_t a, uint64_t b);
+
+/* the index representation is hidden from users of the module */
+typedef void simindex_t;
+
+/* shopen -- open an empty fingerprint index */
+simindex_t *shopen(void);
+
+/* shclose -- free an index */
+void shclose(simindex_t *si);
+
+/* shadd -- file fingerprint fp of page id
+ * returns 0 if successful; nonzero otherwise
+ */
+int32_t shadd(simindex_t *si, uint64_t fp, int id);
+
+/* shfind -- find a page whose fingerprint is within maxdist bits of
+ * fp (maxdist at most SH_MAXDIST)
+ * returns its id, or 0 if there is none
+ */
+int shfind(simindex_t *si, uint64_t fp, int maxdist);
@@ -0,0 +1,143 @@
+/****************************************************************
+ * file   simhashtest.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   November 28, 2021
+ * 
+ * Tests that the simhash.h module gives near-identical pages close
+ * fingerprints and unrelated pages distant ones, and that the
+ * banded index finds every fingerprint within SH_MAXDIST bits
+ * 
+****************************************************************/
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include"webpage.h"
+#include"simhash.h"
+
+/****************************************************************
+ * Define macro, globals and helper functions
+****************************************************************/
+#define eprintf(format, ...) do {                 \
+    if (verbose)                                  \
+        fprintf(stderr, format, ##__VA_ARGS__);   \
+} while(0)
+#define verbose 1
+
+#define __WORDS 1000
+#define __SEEDS 20
+#define __VOCAB 50
+#define __PAGES 2000
+
+
+/****************************************************************
+ * Random 64-bit numbers (xorshift), so runs are repeatable
+****************************************************************/
+static uint64_t state = 88172645463325252ULL;
+static uint64_t rnd(void) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+
+/****************************************************************
+ * Make a page of random words from a small vocabulary; if edit is
+ * set, word number edit is replaced
+****************************************************************/
+static webpage_t *mkpage(uint64_t seed, int edit) {
+    char *html = (char*)malloc(__WORDS * 16 + 64);
+    uint64_t saved = state;
+    state = seed;
+    int len = sprintf(html, "<html><body>\n");
+    for(int i = 0; i < __WORDS; i++) {
+        int w = rnd() % __VOCAB;
+        if(i == edit) w = __VOCAB;
+        len += sprintf(html + len, "%sword%c%c ", i % 20 ? "" : "<p>",
+                       'a' + w % 26, 'a' + w / 26);
+    }
+    sprintf(html + len, "\n</body></html>\n");
+    state = saved;
+    return webpage_new("http://example.org/", 0, html);
+}
+
+
+int main(void) {
+
+    int errors = 0;
+
+    // Near-identical pages are close, bar the odd unlucky vote;
+    // unrelated pages never are
+    int missed = 0;
+    for(int seed = 1; seed <= __SEEDS; seed++) {
+        webpage_t *a = mkpage(seed, -1);
+        webpage_t *a1 = mkpage(seed, __WORDS / 2);
+        webpage_t *b = mkpage(seed + __SEEDS, -1);
+        uint64_t fa = simhash(a), fa1 = simhash(a1), fb = simhash(b);
+        if(shdistance(fa, fa1) > SH_MAXDIST) {
+            eprintf("page %d: near-duplicate %d bits apart\n", seed,
+                    shdistance(fa, fa1));
+            missed++;
+        }
+        if(shdistance(fa, fb) <= SH_MAXDIST) {
+            eprintf("page %d: unrelated page %d bits apart\n", seed,
+                    shdistance(fa, fb));
+            errors++;
+        }
+        if(simhash(a) != fa) {
+            eprintf("page %d: simhash is not deterministic\n", seed);
+            errors++;
+        }
+        webpage_delete(a);
+        webpage_delete(a1);
+        webpage_delete(b);
+    }
+    if(missed > __SEEDS / 10) errors++;
+    // A page without words has no fingerprint
+    char *html = (char*)malloc(32);
+    strcpy(html, "<html><body></body></html>\n");
+    webpage_t *empty = webpage_new("http://example.org/", 0, html);
+    if(simhash(empty) != 0) {
+        eprintf("%s\n", "empty page has a fingerprint");
+        errors++;
+    }
+    webpage_delete(empty);
+
+    // Every fingerprint within SH_MAXDIST bits is found
+    simindex_t *si = shopen();
+    uint64_t fps[__PAGES];
+    for(int i = 0; i < __PAGES; i++) {
+        fps[i] = rnd();
+        shadd(si, fps[i], i + 1);
+    }
+    for(int i = 0; i < __PAGES; i++) {
+        uint64_t probe = fps[i];
+        for(int k = 0; k < SH_MAXDIST; k++) probe ^= 1ULL << (rnd() % 64);
+        int id = shfind(si, probe, SH_MAXDIST);
+        if(id == 0 || shdistance(probe, fps[id - 1]) > SH_MAXDIST) {
+            eprintf("fingerprint %d not found\n", i + 1);
+            errors++;
+        }
+    }
+
+    // Random fingerprints are not
+    int found = 0;
+    for(int i = 0; i < __PAGES; i++) {
+        if(shfind(si, rnd(), SH_MAXDIST)) found++;
+    }
+    if(found > 0) {
+        eprintf("%d random fingerprints matched\n", found);
+        errors++;
+    }
+    shclose(si);
+
+    if(errors) {
+        eprintf("%d errors\n", errors);
+        exit(EXIT_FAILURE);
+    }
+    eprintf("%s passed\n", "simhash");
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,261 @@
+/****************************************************************
+ * file   tier.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   December 11, 2021
+ *
+ * Implementation of the hot tier of an index: stopword lists, and
+ * moving the words of the tier out of the index and back.
+ *
+****************************************************************/
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include<ctype.h>
+#include<errno.h>
+#include<unistd.h>
+#include"hash.h"
+#include"queue.h"
+#include"indexio.h"
+#include"log.h"
+#include"tier.h"
+
+
+/****************************************************************
+ * Define macro, structs, globals and helper functions
+****************************************************************/
+#define __SUFFIX ".hot"
+#define __MAXWORD 128
+
+// State of the happly() walks over an index; splitting and merging
+// are not thread safe
+static struct {
+    word_t **words;                 // Of the shard being split
+    int nwords, cap;
+    int count;                      // Documents of a doclist
+    int maxid;
+    unsigned char *seen;            // Ids of the documents, by id
+    hashtable_t *index;             // Merged into, by tiload()
+    hashtable_t *set;               // Its words
+} walk;
+
+static bool strmatch(void *elementp, const void *keyp) {
+    return !strcmp((const char*)elementp, (const char*)keyp);
+}
+
+static void tipath(char *path, size_t size, char *indexnm) {
+    snprintf(path, size, "%s%s", indexnm, __SUFFIX);
+}
+
+static void addword(hashtable_t *set, const char *word) {
+    if(tihas(set, word)) return;
+    char *s = (char*)malloc(strlen(word) + 1);
+    strcpy(s, word);
+    hput(set, s, s, strlen(s));
+}
+
+
+/****************************************************************
+ * tistops -- see tier.h
+****************************************************************/
+hashtable_t *tistops(char *path) {
+    FILE *f = fopen(path, "r");
+    if(f == NULL) {
+        logmsg(LOG_ERROR, "Error: cannot read stopwords %s\n", path);
+        return NULL;
+    }
+
+    hashtable_t *set = hopen(256);
+    char word[__MAXWORD];
+    while(set != NULL && fscanf(f, "%127s", word) == 1) {
+        if(word[0] == '#') {
+            int c;
+            while((c = fgetc(f)) != EOF && c != '\n');
+            continue;
+        }
+        for(char *c = word; *c; c++) *c = tolower((unsigned char)*c);
+        addword(set, word);
+    }
+    fclose(f);
+    return set;
+}
+
+
+/****************************************************************
+ * tihas -- see tier.h
+****************************************************************/
+bool tihas(hashtable_t *words, const char *word) {
+    return words != NULL && hsearch(words, strmatch, word, strlen(word)) != NULL;
+}
+
+
+/****************************************************************
+ * Private helper functions: count the documents of a doclist, and
+ * those of a collection, which may have ids missing
+****************************************************************/
+static void countdoc(void *p) {
+    if(((doc_t*)p)->freq > 0) walk.count++;
+}
+
+static void maxdoc(void *p) {
+    if(((doc_t*)p)->id > walk.maxid) walk.maxid = ((doc_t*)p)->id;
+}
+
+static void seedoc(void *p) {
+    if(((doc_t*)p)->freq > 0 && ((doc_t*)p)->id >= 0) walk.seen[((doc_t*)p)->id] = 1;
+}
+
+static void maxword(void *p) {
+    qapply(((word_t*)p)->doclist, maxdoc);
+}
+
+static void seeword(void *p) {
+    qapply(((word_t*)p)->doclist, seedoc);
+}
+
+static int countdocs(hashtable_t **indexes, int n) {
+    walk.maxid = 0;
+    for(int i = 0; i < n; i++) happly(indexes[i], maxword);
+    walk.seen = (unsigned char*)calloc(walk.maxid + 1, 1);
+    for(int i = 0; i < n; i++) happly(indexes[i], seeword);
+    int ndocs = 0;
+    for(int id = 0; id <= walk.maxid; id++) ndocs += walk.seen[id];
+    free(walk.seen);
+    return ndocs;
+}
+
+static void listword(void *p) {
+    if(walk.nwords == walk.cap) {
+        walk.cap = walk.cap ? 2 * walk.cap : 1024;
+        walk.words = (word_t**)realloc(walk.words, walk.cap * sizeof(word_t*));
+    }
+    walk.words[walk.nwords++] = (word_t*)p;
+}
+
+
+/****************************************************************
+ * tisplit -- the df of a word is the sum of the lengths of its
+ * doclists in every shard, so each shard makes the same words hot.
+ * The common words are found before any is moved, and words are
+ * listed first, as a table cannot change while walked.
+****************************************************************/
+static void listwords(hashtable_t *index) {
+    walk.nwords = 0;
+    happly(index, listword);
+}
+
+int tisplit(hashtable_t **indexes, hashtable_t **hots, int n,
+            hashtable_t *stops, double share) {
+
+    hashtable_t *common = hopen(256);
+    double maxdf = share < 1 ? share * countdocs(indexes, n) : -1;
+    for(int i = 0; i < n && maxdf >= 0; i++) {
+        listwords(indexes[i]);
+        for(int k = 0; k < walk.nwords; k++) {
+            word_t *w = walk.words[k];
+            if(tihas(common, w->word)) continue;
+            // Counted in full from the first shard the word is in
+            walk.count = 0;
+            for(int j = i; j < n; j++) {
+                word_t *x = j == i ? w : (word_t*)hsearch(indexes[j], indexmatch,
+                                                         w->word, strlen(w->word));
+                if(x != NULL) qapply(x->doclist, countdoc);
+            }
+            if(walk.count > maxdf) addword(common, w->word);
+        }
+    }
+
+    int moved = 0;
+    for(int i = 0; i < n; i++) {
+        hots[i] = hopen(256);
+        listwords(indexes[i]);
+        for(int k = 0; k < walk.nwords; k++) {
+            word_t *w = walk.words[k];
+            if(!tihas(stops, w->word) && !tihas(common, w->word)) continue;
+            hremove(indexes[i], indexmatch, w->word, strlen(w->word));
+            hput(hots[i], w, w->word, strlen(w->word));
+            moved++;
+        }
+    }
+    hclose(common);
+    free(walk.words);
+    memset(&walk, 0, sizeof(walk));
+    return moved;
+}
+
+
+/****************************************************************
+ * tisave -- see tier.h
+****************************************************************/
+static void anyword(void *p) {
+    walk.count++;
+}
+
+int32_t tisave(hashtable_t *hot, char *dirname, char *indexnm) {
+    char name[512];
+    tipath(name, sizeof(name), indexnm);
+    walk.count = 0;
+    if(hot != NULL) happly(hot, anyword);
+    if(walk.count > 0) {
+        walk.count = 0;
+        return indexsave(hot, dirname, name);
+    }
+
+    // An index saved without a tier leaves none of an earlier one
+    char path[640];
+    snprintf(path, sizeof(path), "%s/%s", dirname, name);
+    if(remove(path) != 0 && errno != ENOENT) {
+        logmsg(LOG_ERROR, "Error: failed to remove %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+
+/****************************************************************
+ * tiload -- a word also in the index, after an update went wrong,
+ * keeps the postings of the index
+****************************************************************/
+static void merge(word_t *w) {
+    if(hsearch(walk.index, indexmatch, w->word, strlen(w->word)) == NULL) {
+        addword(walk.set, w->word);
+        hput(walk.index, w, w->word, strlen(w->word));
+        return;
+    }
+    doc_t *d;
+    while((d = (doc_t*)qget(w->doclist)) != NULL) {
+        free(d->pos);
+        free(d);
+    }
+    qclose(w->doclist);
+    free(w->word);
+    free(w);
+}
+
+hashtable_t *tiload(hashtable_t *index, char *dirname, char *indexnm) {
+    char name[512], path[640];
+    tipath(name, sizeof(name), indexnm);
+    snprintf(path, sizeof(path), "%s/%s", dirname, name);
+    if(index == NULL || access(path, R_OK) != 0) return NULL;
+
+    hashtable_t *hot = indexload(dirname, name);
+    if(hot == NULL) return NULL;
+
+    // The words are taken out of the table first, so that closing it
+    // frees none of them
+    walk.index = index;
+    walk.set = hopen(256);
+    listwords(hot);
+    for(int k = 0; k < walk.nwords; k++) {
+        word_t *w = walk.words[k];
+        hremove(hot, indexmatch, w->word, strlen(w->word));
+        merge(w);
+    }
+    hclose(hot);
+    hashtable_t *set = walk.set;
+    free(walk.words);
+    memset(&walk, 0, sizeof(walk));
+    return set;
+}
@@ -0,0 +1,50 @@
+#pragma once
+/*
+ * tier.h -- the hot tier of an index: stopwords and common words
+ *
+ * Words such as "the" and "and" are in most pages, and their posting
+ * lists are the longest of the index while they tell pages apart the
+ * least. The indexer can move them out of the index file into a hot
+ * tier of their own, <indexnm>.hot, in the format of indexsave(): the
+ * words of a stopword list, and the words in more than a share of
+ * the documents. The other files of the index, its statistics, block
+ * maxima and positions, still cover every word.
+ *
+ * A querier merges the hot tier back into the index it loads with
+ * tiload(), and is given the set of its words, so that it can leave
+ * them out where the other words of a query already narrow it down.
+ *
+ * Sets of words are hash tables of strings, freed with hclose().
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include "hash.h"
+
+/* tistops -- reads a stopword list: words separated by white space,
+ * in any case, lines starting with # left out
+ * returns the set of its words, or NULL if it cannot be read
+ */
+hashtable_t *tistops(char *path);
+
+/* tihas -- whether a set of words, which may be NULL, has a word */
+bool tihas(hashtable_t *words, const char *word);
+
+/* tisplit -- moves the hot words of the n shards of an index, as
+ * indexload() makes them, into hots[i], a new table for each: the
+ * words of stops, which may be NULL, and those in more than share of
+ * the documents of all shards
+ * returns the number of words moved, over all shards
+ */
+int tisplit(hashtable_t **indexes, hashtable_t **hots, int n,
+            hashtable_t *stops, double share);
+
+/* tisave -- saves a hot tier to dirname/indexnm.hot, or removes that
+ * file if hot has no words
+ * returns 0 if success and non-zero otherwise
+ */
+int32_t tisave(hashtable_t *hot, char *dirname, char *indexnm);
+
+/* tiload -- merges the hot tier of dirname/indexnm into its index
+ * returns the set of the words of the tier, or NULL if it has none
+ */
+hashtable_t *tiload(hashtable_t *index, char *dirname, char *indexnm);
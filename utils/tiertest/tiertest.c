@@ -0,0 +1,128 @@
+/****************************************************************
+ * file   tiertest.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   December 11, 2021
+ *
+ * Tests that the tier.h module reads stopword lists, moves the same
+ * stopwords and common words out of every shard of an index, saves
+ * them apart and merges them back
+ *
+****************************************************************/
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include<unistd.h>
+#include"hash.h"
+#include"queue.h"
+#include"indexio.h"
+#include"tier.h"
+
+/****************************************************************
+ * Define macro, globals and helper functions
+****************************************************************/
+#define eprintf(format, ...) do {                 \
+    if (verbose)                                  \
+        fprintf(stderr, format, ##__VA_ARGS__);   \
+} while(0)
+#define verbose 1
+
+#define __INDEX "tiertest.index"
+#define __STOPS "tiertest.stops"
+
+// Adds a word found once in the documents lo to hi
+static void addword(hashtable_t *h, const char *word, int lo, int hi) {
+    word_t *w = indexword(h, word);
+    for(int id = lo; id <= hi; id++) indexdoc(w, id, 1, NULL);
+}
+
+// Checks whether an index has a word
+static int has(hashtable_t *h, const char *word, bool want, const char *what) {
+    if((hsearch(h, indexmatch, word, strlen(word)) != NULL) != want) {
+        eprintf("%s %s %s\n", what, want ? "misses" : "has", word);
+        return 1;
+    }
+    return 0;
+}
+
+
+int main(void) {
+
+    int errors = 0;
+
+    FILE *f = fopen(__STOPS, "w");
+    fprintf(f, "# common words\nThe and\n  for\n");
+    fclose(f);
+    hashtable_t *stops = tistops(__STOPS);
+    if(stops == NULL || !tihas(stops, "the") || !tihas(stops, "and") ||
+       !tihas(stops, "for") || tihas(stops, "common") || tihas(NULL, "the")) {
+        eprintf("%s\n", "stopwords not read as expected");
+        errors++;
+    }
+    if(tistops("missing.stops") != NULL) {
+        eprintf("%s\n", "read a missing stopword list");
+        errors++;
+    }
+
+    // Two shards of documents 1-4 and 5-10: "the" is a stopword,
+    // "many" in 7 of the 10 documents, "some" in 4 and "cat" in 2
+    hashtable_t *shards[2] = {hopen(16), hopen(16)};
+    addword(shards[0], "the", 1, 2);
+    addword(shards[0], "many", 1, 4);
+    addword(shards[0], "cat", 1, 2);
+    addword(shards[1], "many", 5, 7);
+    addword(shards[1], "some", 5, 8);
+    hashtable_t *hots[2];
+    if(tisplit(shards, hots, 2, stops, 0.5) != 3) {
+        eprintf("%s\n", "tisplit did not move three lists");
+        errors++;
+    }
+    errors += has(hots[0], "the", true, "hot tier");
+    errors += has(hots[0], "many", true, "hot tier");
+    errors += has(hots[1], "many", true, "hot tier");
+    errors += has(shards[0], "many", false, "index");
+    errors += has(shards[0], "cat", true, "index");
+    errors += has(shards[1], "some", true, "index");
+
+    // Saved apart, and merged back into the index
+    if(tisave(hots[0], ".", __INDEX) != 0 || access(__INDEX ".hot", R_OK) != 0) {
+        eprintf("%s\n", "tisave did not save the tier");
+        errors++;
+    }
+    hashtable_t *words = tiload(shards[0], ".", __INDEX);
+    if(words == NULL || !tihas(words, "the") || !tihas(words, "many") ||
+       tihas(words, "cat")) {
+        eprintf("%s\n", "tiload did not give the words of the tier");
+        errors++;
+    }
+    errors += has(shards[0], "many", true, "merged index");
+    errors += has(shards[0], "the", true, "merged index");
+    hclose(words);
+
+    // No tier at all, with no stopwords and every word under the share
+    for(int i = 0; i < 2; i++) indexclose(hots[i]);
+    if(tisplit(shards, hots, 2, NULL, 1) != 0) {
+        eprintf("%s\n", "tisplit moved words with no stopwords");
+        errors++;
+    }
+    if(tisave(hots[0], ".", __INDEX) != 0 || access(__INDEX ".hot", F_OK) == 0 ||
+       tiload(shards[0], ".", __INDEX) != NULL) {
+        eprintf("%s\n", "an empty tier left a file");
+        errors++;
+    }
+    for(int i = 0; i < 2; i++) {
+        indexclose(hots[i]);
+        indexclose(shards[i]);
+    }
+    hclose(stops);
+    remove(__STOPS);
+
+    if(errors) {
+        eprintf("%d errors\n", errors);
+        exit(EXIT_FAILURE);
+    }
+    eprintf("%s passed\n", "tier");
+    exit(EXIT_SUCCESS);
+}
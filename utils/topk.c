@@ -0,0 +1,709 @@
+/****************************************************************
+ * file   topk.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   December 6, 2021
+ *
+ * Implementation of posting list iterators and of Block-Max WAND
+ * (Ding and Suel, SIGIR 2011) over them.
+ *
+****************************************************************/
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include<math.h>
+#include"postings.h"
+#include"topk.h"
+
+
+/****************************************************************
+ * Define iterator data structures
+****************************************************************/
+// Scores are summed in different orders for bounds and documents,
+// so a bound is only trusted to be below a score by this margin
+#define __ABOVE(bound, theta) ((bound) * (1 + 1e-9) > (theta))
+
+typedef struct term {
+    it_t it;
+    plist_t *l;
+    int i;                          // Current posting
+    int b;                          // Block of the last bound
+    bool scan;                      // Step rather than gallop
+} term_t;
+
+// Ands and ors
+typedef struct and {
+    it_t it;
+    it_t **its;
+    int n;
+    bool min;
+} and_t;
+
+typedef struct not {
+    it_t it;
+    it_t *pos;
+    it_t *neg;
+} not_t;
+
+typedef struct phrase {
+    it_t it;
+    it_t *and;                      // Of the words
+    term_t **terms;                 // In the order of the phrase
+    int *offs;                      // Place of each word in the phrase
+    int n;
+    int near;                       // Largest distance, or -1
+    int **pos;                      // Positions of each word
+    int *cnt;
+    int *cap;
+} phrase_t;
+
+typedef struct list {
+    it_t it;
+    hit_t *hits;
+    int n;
+    int i;                          // Current hit
+    int b;                          // Block bound() was last asked
+    double *bmax;                   // Largest score of each block
+} list_t;
+
+
+/****************************************************************
+ * Term iterator: gallop to the target, then search the last step,
+ * or step to it
+****************************************************************/
+static int termnext(it_t *it, int target) {
+    term_t *t = (term_t*)it;
+    plist_t *l = t->l;
+    if(it->doc >= target) return it->doc;
+    if(t->scan) {
+        while(t->i < l->n && l->ids[t->i] < target) t->i++;
+        return it->doc = t->i < l->n ? l->ids[t->i] : IT_END;
+    }
+
+    int lo = t->i, step = 1;
+    while(lo + step < l->n && l->ids[lo + step] < target) {
+        lo += step;
+        step *= 2;
+    }
+    int hi = lo + step < l->n ? lo + step : l->n;
+    while(lo < hi) {                // First posting >= target in (lo, hi]
+        int mid = lo + (hi - lo) / 2;
+        if(l->ids[mid] < target) lo = mid + 1;
+        else hi = mid;
+    }
+    t->i = lo;
+    return it->doc = t->i < l->n ? l->ids[t->i] : IT_END;
+}
+
+static double termscore(it_t *it) {
+    term_t *t = (term_t*)it;
+    return t->l->c * t->l->w[t->i];
+}
+
+static int lastid(plist_t *l, int b) {
+    int i = (b + 1) * PL_BLOCK - 1;
+    return l->ids[i < l->n ? i : l->n - 1];
+}
+
+static double termbound(it_t *it, int target, int *last) {
+    term_t *t = (term_t*)it;
+    plist_t *l = t->l;
+    if(it->doc == IT_END) {
+        *last = IT_END;
+        return 0;
+    }
+
+    // Blocks before the current posting are done with; the block
+    // pointer only goes back if an earlier target is asked for
+    int cur = t->i / PL_BLOCK;
+    if(t->b < cur || (t->b > cur && target <= lastid(l, t->b - 1))) t->b = cur;
+    while(t->b < l->nblocks && lastid(l, t->b) < target) t->b++;
+    if(t->b == l->nblocks) {
+        *last = IT_END;
+        return 0;
+    }
+    *last = lastid(l, t->b);
+    return l->c * l->bmax[t->b];
+}
+
+static void termclose(it_t *it) {
+    free(it);
+}
+
+it_t *itterm(plist_t *l) {
+    term_t *t = (term_t*)malloc(sizeof(term_t));
+    if(t == NULL) return NULL;
+    t->l = l;
+    t->i = 0;
+    t->b = 0;
+    t->scan = false;
+    t->it.doc = l->n > 0 ? l->ids[0] : IT_END;
+    t->it.max = l->c * l->wmax;
+    t->it.next = termnext;
+    t->it.score = termscore;
+    t->it.bound = termbound;
+    t->it.close = termclose;
+    return (it_t*)t;
+}
+
+it_t *itscan(plist_t *l) {
+    term_t *t = (term_t*)itterm(l);
+    if(t != NULL) t->scan = true;
+    return (it_t*)t;
+}
+
+
+/****************************************************************
+ * And iterator: leapfrog the iterators to a document they all
+ * have. They are best given the shortest first. A bound on the
+ * smallest score is the smallest bound.
+****************************************************************/
+static int andnext(it_t *it, int target) {
+    and_t *a = (and_t*)it;
+    if(it->doc >= target) return it->doc;
+    int d = target;
+    for(int i = 0; i < a->n; ) {
+        int x = a->its[i]->next(a->its[i], d);
+        if(x == IT_END) return it->doc = IT_END;
+        if(x > d) {
+            d = x;
+            i = i == 0 ? 1 : 0;     // The others must catch up
+        }
+        else i++;
+    }
+    return it->doc = d;
+}
+
+static double combine(and_t *a, double s, double x, int i) {
+    if(!a->min) return s + x;
+    return i == 0 || x < s ? x : s;
+}
+
+static double andscore(it_t *it) {
+    and_t *a = (and_t*)it;
+    double s = 0;
+    for(int i = 0; i < a->n; i++) {
+        s = combine(a, s, a->its[i]->score(a->its[i]), i);
+    }
+    return s;
+}
+
+static double andbound(it_t *it, int target, int *last) {
+    and_t *a = (and_t*)it;
+    double s = 0;
+    *last = IT_END;
+    for(int i = 0; i < a->n; i++) {
+        int l;
+        s = combine(a, s, a->its[i]->bound(a->its[i], target, &l), i);
+        if(l < *last) *last = l;
+    }
+    return s;
+}
+
+static void andclose(it_t *it) {
+    and_t *a = (and_t*)it;
+    for(int i = 0; i < a->n; i++) itclose(a->its[i]);
+    free(a->its);
+    free(a);
+}
+
+static and_t *mkand(it_t **its, int n, bool min) {
+    and_t *a = (and_t*)malloc(sizeof(and_t));
+    if(a == NULL) return NULL;
+    a->its = (it_t**)malloc(n * sizeof(it_t*));
+    memcpy(a->its, its, n * sizeof(it_t*));
+    a->n = n;
+    a->min = min;
+    a->it.doc = -1;
+    a->it.max = 0;
+    for(int i = 0; i < n; i++) a->it.max = combine(a, a->it.max, its[i]->max, i);
+    a->it.close = andclose;
+    return a;
+}
+
+it_t *itand(it_t **its, int n, bool min) {
+    and_t *a = mkand(its, n, min);
+    if(a == NULL) return NULL;
+    a->it.next = andnext;
+    a->it.score = andscore;
+    a->it.bound = andbound;
+    andnext((it_t*)a, 0);
+    return (it_t*)a;
+}
+
+
+/****************************************************************
+ * Or iterator: the first document of any iterator, scored by those
+ * that are on it
+****************************************************************/
+static int ornext(it_t *it, int target) {
+    and_t *a = (and_t*)it;
+    if(it->doc >= target) return it->doc;
+    int d = IT_END;
+    for(int i = 0; i < a->n; i++) {
+        int x = a->its[i]->next(a->its[i], target);
+        if(x < d) d = x;
+    }
+    return it->doc = d;
+}
+
+static double orscore(it_t *it) {
+    and_t *a = (and_t*)it;
+    double s = 0;
+    for(int i = 0; i < a->n; i++) {
+        if(a->its[i]->doc == it->doc) s += a->its[i]->score(a->its[i]);
+    }
+    return s;
+}
+
+static double orbound(it_t *it, int target, int *last) {
+    and_t *a = (and_t*)it;
+    double s = 0;
+    *last = IT_END;
+    for(int i = 0; i < a->n; i++) {
+        int l;
+        s += a->its[i]->bound(a->its[i], target, &l);
+        if(l < *last) *last = l;
+    }
+    return s;
+}
+
+it_t *itor(it_t **its, int n) {
+    and_t *a = mkand(its, n, false);
+    if(a == NULL) return NULL;
+    a->it.next = ornext;
+    a->it.score = orscore;
+    a->it.bound = orbound;
+    ornext((it_t*)a, 0);
+    return (it_t*)a;
+}
+
+
+/****************************************************************
+ * Not iterator: skip the documents the other iterator is on
+****************************************************************/
+static int notnext(it_t *it, int target) {
+    not_t *x = (not_t*)it;
+    if(it->doc >= target) return it->doc;
+    int d = x->pos->next(x->pos, target);
+    while(d != IT_END && x->neg->next(x->neg, d) == d) {
+        d = x->pos->next(x->pos, d + 1);
+    }
+    return it->doc = d;
+}
+
+static double notscore(it_t *it) {
+    not_t *x = (not_t*)it;
+    return x->pos->score(x->pos);
+}
+
+static double notbound(it_t *it, int target, int *last) {
+    not_t *x = (not_t*)it;
+    return x->pos->bound(x->pos, target, last);
+}
+
+static void notclose(it_t *it) {
+    not_t *x = (not_t*)it;
+    itclose(x->pos);
+    itclose(x->neg);
+    free(x);
+}
+
+it_t *itnot(it_t *it, it_t *neg) {
+    not_t *x = (not_t*)malloc(sizeof(not_t));
+    if(x == NULL) return NULL;
+    x->pos = it;
+    x->neg = neg;
+    x->it.doc = -1;
+    x->it.max = it->max;
+    x->it.next = notnext;
+    x->it.score = notscore;
+    x->it.bound = notbound;
+    x->it.close = notclose;
+    notnext((it_t*)x, 0);
+    return (it_t*)x;
+}
+
+
+/****************************************************************
+ * Phrase iterator: the documents of the and of the words, once the
+ * positions of the words there are found to match. Positions are
+ * only decoded for the documents that have all the words.
+****************************************************************/
+static bool found(int *pos, int n, int x) {
+    int lo = 0, hi = n;
+    while(lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if(pos[mid] < x) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < n && pos[lo] == x;
+}
+
+static bool placed(phrase_t *ph) {
+    int *cnt = ph->cnt;
+    for(int j = 0; j < ph->n; j++) {
+        term_t *t = ph->terms[j];
+        int tf = t->l->tfs[t->i];
+        if(tf > ph->cap[j]) {
+            ph->pos[j] = (int*)realloc(ph->pos[j], tf * sizeof(int));
+            ph->cap[j] = tf;
+        }
+        if((cnt[j] = plpos(t->l, t->i, ph->pos[j])) < 0) return true;
+    }
+
+    // Within near of each other
+    if(ph->near >= 0) {
+        for(int a = 0, b = 0; a < cnt[0] && b < cnt[1]; ) {
+            int d = ph->pos[0][a] - ph->pos[1][b];
+            if(d <= ph->near && d >= -ph->near) return true;
+            if(d < 0) a++;
+            else b++;
+        }
+        return false;
+    }
+
+    // Every word where the first puts it
+    for(int a = 0; a < cnt[0]; a++) {
+        int start = ph->pos[0][a] - ph->offs[0];
+        int j = 1;
+        while(j < ph->n && found(ph->pos[j], cnt[j], start + ph->offs[j])) j++;
+        if(j == ph->n) return true;
+    }
+    return false;
+}
+
+static int phrasenext(it_t *it, int target) {
+    phrase_t *ph = (phrase_t*)it;
+    if(it->doc >= target) return it->doc;
+    int d = ph->and->next(ph->and, target);
+    while(d != IT_END && !placed(ph)) d = ph->and->next(ph->and, d + 1);
+    return it->doc = d;
+}
+
+static double phrasescore(it_t *it) {
+    phrase_t *ph = (phrase_t*)it;
+    return ph->and->score(ph->and);
+}
+
+static double phrasebound(it_t *it, int target, int *last) {
+    phrase_t *ph = (phrase_t*)it;
+    return ph->and->bound(ph->and, target, last);
+}
+
+static void phraseclose(it_t *it) {
+    phrase_t *ph = (phrase_t*)it;
+    itclose(ph->and);
+    for(int j = 0; j < ph->n; j++) free(ph->pos[j]);
+    free(ph->pos);
+    free(ph->cnt);
+    free(ph->cap);
+    free(ph->terms);
+    free(ph->offs);
+    free(ph);
+}
+
+static int cmplen(const void *a, const void *b) {
+    return (*(term_t* const*)a)->l->n - (*(term_t* const*)b)->l->n;
+}
+
+static it_t *mkphrase(plist_t **ls, const int *offs, int n, int near, bool min) {
+    phrase_t *ph = (phrase_t*)malloc(sizeof(phrase_t));
+    if(ph == NULL) return NULL;
+    ph->n = n;
+    ph->near = near;
+    ph->terms = (term_t**)malloc(n * sizeof(term_t*));
+    ph->offs = (int*)malloc(n * sizeof(int));
+    ph->pos = (int**)calloc(n, sizeof(int*));
+    ph->cnt = (int*)calloc(n, sizeof(int));
+    ph->cap = (int*)calloc(n, sizeof(int));
+    for(int j = 0; j < n; j++) {
+        ph->terms[j] = (term_t*)itterm(ls[j]);
+        ph->offs[j] = offs != NULL ? offs[j] : j;
+    }
+
+    // The and intersects from the shortest list
+    it_t **its = (it_t**)malloc(n * sizeof(it_t*));
+    memcpy(its, ph->terms, n * sizeof(it_t*));
+    qsort(its, n, sizeof(it_t*), cmplen);
+    ph->and = itand(its, n, min);
+    free(its);
+
+    ph->it.doc = -1;
+    ph->it.max = ph->and->max;
+    ph->it.next = phrasenext;
+    ph->it.score = phrasescore;
+    ph->it.bound = phrasebound;
+    ph->it.close = phraseclose;
+    phrasenext((it_t*)ph, 0);
+    return (it_t*)ph;
+}
+
+it_t *itphrase(plist_t **ls, const int *offs, int n, bool min) {
+    return mkphrase(ls, offs, n, -1, min);
+}
+
+it_t *itnear(plist_t *a, plist_t *b, int k, bool min) {
+    plist_t *ls[2] = {a, b};
+    return mkphrase(ls, NULL, 2, k, min);
+}
+
+
+/****************************************************************
+ * List iterator: the hits of an iterator walked before, galloped
+ * through as a term iterator gallops through its postings
+****************************************************************/
+static int listnext(it_t *it, int target) {
+    list_t *l = (list_t*)it;
+    if(it->doc >= target) return it->doc;
+    int lo = l->i, step = 1;
+    while(lo + step < l->n && l->hits[lo + step].id < target) {
+        lo += step;
+        step *= 2;
+    }
+    int hi = lo + step < l->n ? lo + step : l->n;
+    while(lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if(l->hits[mid].id < target) lo = mid + 1;
+        else hi = mid;
+    }
+    l->i = lo;
+    return it->doc = l->i < l->n ? l->hits[l->i].id : IT_END;
+}
+
+static double listscore(it_t *it) {
+    list_t *l = (list_t*)it;
+    return l->hits[l->i].score;
+}
+
+static int lasthit(list_t *l, int b) {
+    int i = (b + 1) * PL_BLOCK - 1;
+    return l->hits[i < l->n ? i : l->n - 1].id;
+}
+
+static double listbound(it_t *it, int target, int *last) {
+    list_t *l = (list_t*)it;
+    int nblocks = (l->n + PL_BLOCK - 1) / PL_BLOCK;
+    if(it->doc == IT_END) {
+        *last = IT_END;
+        return 0;
+    }
+    int cur = l->i / PL_BLOCK;
+    if(l->b < cur || (l->b > cur && target <= lasthit(l, l->b - 1))) l->b = cur;
+    while(l->b < nblocks && lasthit(l, l->b) < target) l->b++;
+    if(l->b == nblocks) {
+        *last = IT_END;
+        return 0;
+    }
+    *last = lasthit(l, l->b);
+    return l->bmax[l->b];
+}
+
+static void listclose(it_t *it) {
+    list_t *l = (list_t*)it;
+    free(l->hits);
+    free(l->bmax);
+    free(l);
+}
+
+it_t *itlist(hit_t *hits, int n) {
+    list_t *l = (list_t*)malloc(sizeof(list_t));
+    if(l == NULL) return NULL;
+    int nblocks = (n + PL_BLOCK - 1) / PL_BLOCK;
+    l->hits = hits;
+    l->n = n;
+    l->i = 0;
+    l->b = 0;
+    l->bmax = (double*)calloc(nblocks > 0 ? nblocks : 1, sizeof(double));
+    l->it.max = 0;
+    for(int i = 0; i < n; i++) {
+        double *m = &l->bmax[i / PL_BLOCK];
+        if(i % PL_BLOCK == 0 || hits[i].score > *m) *m = hits[i].score;
+        if(hits[i].score > l->it.max) l->it.max = hits[i].score;
+    }
+    l->it.doc = n > 0 ? hits[0].id : IT_END;
+    l->it.next = listnext;
+    l->it.score = listscore;
+    l->it.bound = listbound;
+    l->it.close = listclose;
+    return (it_t*)l;
+}
+
+int itdrain(it_t *it, hit_t **hits) {
+    int n = 0, cap = 64;
+    *hits = (hit_t*)malloc(cap * sizeof(hit_t));
+    for(; it != NULL && it->doc != IT_END; it->next(it, it->doc + 1)) {
+        if(n == cap) *hits = (hit_t*)realloc(*hits, (cap *= 2) * sizeof(hit_t));
+        (*hits)[n].id = it->doc;
+        (*hits)[n++].score = it->score(it);
+    }
+    itclose(it);
+    return n;
+}
+
+
+/****************************************************************
+ * itclose -- free an iterator
+****************************************************************/
+void itclose(it_t *it) {
+    if(it != NULL) it->close(it);
+}
+
+
+/****************************************************************
+ * Private helper functions: the top k are a heap with the worst
+ * hit on top, the lowest score and the highest id between equal
+ * scores
+****************************************************************/
+static bool worse(hit_t *a, hit_t *b) {
+    return a->score < b->score || (a->score == b->score && a->id > b->id);
+}
+
+static void siftdown(hit_t *h, int n, int i) {
+    while(true) {
+        int w = i, l = 2 * i + 1, r = l + 1;
+        if(l < n && worse(&h[l], &h[w])) w = l;
+        if(r < n && worse(&h[r], &h[w])) w = r;
+        if(w == i) return;
+        hit_t tmp = h[i];
+        h[i] = h[w];
+        h[w] = tmp;
+        i = w;
+    }
+}
+
+static void siftup(hit_t *h, int i) {
+    while(i > 0 && worse(&h[i], &h[(i - 1) / 2])) {
+        hit_t tmp = h[i];
+        h[i] = h[(i - 1) / 2];
+        h[(i - 1) / 2] = tmp;
+        i = (i - 1) / 2;
+    }
+}
+
+static int cmphit(const void *a, const void *b) {
+    const hit_t *x = (const hit_t*)a, *y = (const hit_t*)b;
+    if(x->score != y->score) return x->score < y->score ? 1 : -1;
+    return x->id - y->id;
+}
+
+
+/****************************************************************
+ * tktopk, tkrange -- Block-Max WAND. The iterators are kept sorted
+ * by current document. The pivot is the first document at which the
+ * largest scores of the iterators up to it add up to more than the
+ * threshold; no document before it can enter the top k. If the
+ * block bounds of the iterators at the pivot do not either, the
+ * whole range their blocks cover is skipped. A range starts with
+ * the iterators moved to lo, and ends at the first pivot past it.
+****************************************************************/
+int tktopk(it_t **its, int n, int k, hit_t **hits, long *scored) {
+    return tkrange(its, n, k, 0, IT_END, hits, scored);
+}
+
+int tkrange(it_t **its, int n, int k, int lo, int hi, hit_t **hits, long *scored) {
+
+    int cap = k > 0 ? k : 64, nhits = 0;
+    hit_t *h = (hit_t*)malloc(cap * sizeof(hit_t));
+    it_t **order = (it_t**)malloc((n > 0 ? n : 1) * sizeof(it_t*));
+    memcpy(order, its, n * sizeof(it_t*));
+    double theta = -INFINITY;       // To beat, once there are k hits
+    long count = 0;
+    for(int i = 0; i < n; i++) {
+        if(its[i]->doc < lo) its[i]->next(its[i], lo);
+    }
+
+    while(true) {
+        for(int i = 1; i < n; i++) {
+            it_t *x = order[i];
+            int j = i;
+            for(; j > 0 && order[j - 1]->doc > x->doc; j--) order[j] = order[j - 1];
+            order[j] = x;
+        }
+
+        // Find the pivot, and take in every iterator on it
+        double ub = 0;
+        int p = -1;
+        for(int i = 0; i < n && order[i]->doc != IT_END; i++) {
+            ub += order[i]->max;
+            if(__ABOVE(ub, theta)) {
+                p = i;
+                break;
+            }
+        }
+        if(p < 0 || order[p]->doc >= hi) break;
+        int d = order[p]->doc;
+        while(p + 1 < n && order[p + 1]->doc == d) p++;
+
+        // Skip the blocks that cannot make it
+        if(theta > -INFINITY) {
+            double bub = 0;
+            int last = IT_END;
+            for(int i = 0; i <= p; i++) {
+                int l;
+                bub += order[i]->bound(order[i], d, &l);
+                if(l < last) last = l;
+            }
+            if(!__ABOVE(bub, theta)) {
+                int skip = last == IT_END ? IT_END : last + 1;
+                if(p + 1 < n && order[p + 1]->doc < skip) skip = order[p + 1]->doc;
+                for(int i = 0; i <= p; i++) order[i]->next(order[i], skip);
+                continue;
+            }
+        }
+
+        if(order[0]->doc != d) {
+            for(int i = 0; i < p; i++) order[i]->next(order[i], d);
+            continue;
+        }
+
+        // Score the pivot, summing in the order the iterators came
+        double s = 0;
+        for(int i = 0; i < n; i++) {
+            if(its[i]->doc == d) s += its[i]->score(its[i]);
+        }
+        count++;
+        if(k == 0 || nhits < k) {
+            if(nhits == cap) h = (hit_t*)realloc(h, (cap *= 2) * sizeof(hit_t));
+            h[nhits] = (hit_t){d, s};
+            if(k > 0) siftup(h, nhits);
+            nhits++;
+            if(k > 0 && nhits == k) theta = h[0].score;
+        }
+        else if(s > h[0].score) {
+            h[0] = (hit_t){d, s};
+            siftdown(h, nhits, 0);
+            theta = h[0].score;
+        }
+        for(int i = 0; i < n; i++) {
+            if(its[i]->doc == d) its[i]->next(its[i], d + 1);
+        }
+    }
+
+    qsort(h, nhits, sizeof(hit_t), cmphit);
+    free(order);
+    if(scored != NULL) *scored += count;
+    *hits = h;
+    return nhits;
+}
+
+
+/****************************************************************
+ * tkmerge -- the ranges are disjoint, so the top k of all of them
+ * are among the top k of each
+****************************************************************/
+int tkmerge(hit_t **parts, int *counts, int n, int k, hit_t **hits) {
+    int total = 0;
+    for(int i = 0; i < n; i++) total += counts[i];
+    hit_t *h = (hit_t*)malloc((total > 0 ? total : 1) * sizeof(hit_t));
+    for(int i = 0, at = 0; i < n; i++) {
+        if(counts[i] > 0) memcpy(h + at, parts[i], counts[i] * sizeof(hit_t));
+        at += counts[i];
+        free(parts[i]);
+    }
+    qsort(h, total, sizeof(hit_t), cmphit);
+    *hits = h;
+    return k > 0 && total > k ? k : total;
+}
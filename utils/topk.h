@@ -0,0 +1,128 @@
+#pragma once
+/*
+ * topk.h -- top-k retrieval with Block-Max WAND
+ *
+ * An iterator walks the documents that match part of a query, in
+ * increasing order of id, without materializing them. Besides its
+ * current document and that document's score, it knows the largest
+ * score any of its documents can have, and a bound() on the scores
+ * of the documents up to the end of the posting blocks around a
+ * target. itterm() and itscan() walk a posting list, itand() the
+ * documents all of its iterators have, itor() the documents any of
+ * them has, and itnot() the documents of an iterator another does
+ * not have. itphrase() and itnear() walk the documents that have
+ * words in the right places. itdrain() materializes the documents
+ * of an iterator, for itlist() to walk them again later.
+ *
+ * tktopk() finds the k best documents of the OR of a set of
+ * iterators, scored with the sum of the scores of the iterators
+ * that have them. Following Block-Max WAND, it keeps the score a
+ * document must beat to enter the top k, and skips the documents,
+ * and whole blocks of them, whose bounds cannot beat it, so most
+ * postings of common words are never scored. tkrange() does the same
+ * over a range of ids, so that disjoint ranges can be searched by
+ * different threads, each with iterators of its own, and tkmerge()
+ * merges the top k of each into the top k of all.
+ *
+ * Iterators are not thread safe; the posting lists they walk can be
+ * shared.
+ */
+#include <limits.h>
+#include <stdbool.h>
+#include "postings.h"
+
+/* the id of no document, past the end of every iterator */
+#define IT_END INT_MAX
+
+typedef struct it it_t;
+struct it {
+    int doc;                                    // Current, or IT_END
+    double max;                                 // Largest score
+    int (*next)(it_t *it, int target);          // To the first doc >= target
+    double (*score)(it_t *it);                  // Of the current doc
+    double (*bound)(it_t *it, int target, int *last);
+    void (*close)(it_t *it);
+};
+
+/* a document found and its score */
+typedef struct hit {
+    int id;
+    double score;
+} hit_t;
+
+/* itterm -- an iterator over a posting list, scoring c * w, that
+ * gallops to the documents it is asked for
+ */
+it_t *itterm(plist_t *l);
+
+/* itscan -- the same, stepping through the postings instead, which
+ * is faster when the lists intersected are of similar lengths
+ */
+it_t *itscan(plist_t *l);
+
+/* itand -- an iterator over the documents all of n iterators have,
+ * scored with the sum of their scores, or the smallest if min is
+ * true. It is fastest with the shortest first. It takes the
+ * iterators over, and closes them when it is closed; so do itor()
+ * and itnot().
+ */
+it_t *itand(it_t **its, int n, bool min);
+
+/* itor -- an iterator over the documents any of n iterators has,
+ * scored with the sum of the scores of those that have them
+ */
+it_t *itor(it_t **its, int n);
+
+/* itnot -- an iterator over the documents of it that neg does not
+ * have, scored as it scores them
+ */
+it_t *itnot(it_t *it, it_t *neg);
+
+/* itphrase -- an iterator over the documents that have the n words
+ * of the lists with the i-th at offs[i] from the start of the
+ * phrase, scored as itand() scores them. Positions are only decoded
+ * for the documents that have all the words, and when the lists have
+ * none, documents match on the words alone.
+ */
+it_t *itphrase(plist_t **ls, const int *offs, int n, bool min);
+
+/* itnear -- the same for two words at most k positions apart, in
+ * either order
+ */
+it_t *itnear(plist_t *a, plist_t *b, int k, bool min);
+
+/* itdrain -- walk an iterator to its end, then close it
+ * returns the number of documents, put with their scores in a new
+ * array in *hits, by increasing id
+ */
+int itdrain(it_t *it, hit_t **hits);
+
+/* itlist -- an iterator over n hits by increasing id, as itdrain()
+ * gives them, scored with their scores and bounded per block of
+ * PL_BLOCK hits; it takes the hits over, and frees them when closed
+ */
+it_t *itlist(hit_t *hits, int n);
+
+/* itclose -- free an iterator */
+void itclose(it_t *it);
+
+/* tktopk -- the k best documents of the OR of n iterators, or all
+ * of them if k is 0, by decreasing score and increasing id between
+ * equal scores. The iterators are left exhausted. If scored is not
+ * NULL, the number of documents scored is added to it.
+ * returns the number of hits, put in a new array in *hits
+ */
+int tktopk(it_t **its, int n, int k, hit_t **hits, long *scored);
+
+/* tkrange -- the same for the documents with lo <= id < hi only; the
+ * iterators are left somewhere past the last of them
+ */
+int tkrange(it_t **its, int n, int k, int lo, int hi, hit_t **hits,
+            long *scored);
+
+/* tkmerge -- the k best hits, or all of them if k is 0, of the hits
+ * tkrange() found in n disjoint ranges, counts[i] in parts[i]; it
+ * takes the parts over and frees them
+ * returns the number of hits, put in a new array in *hits
+ */
+int tkmerge(hit_t **parts, int *counts, int n, int k, hit_t **hits);
@@ -0,0 +1,255 @@
+/****************************************************************
+ * file   topktest.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   December 6, 2021
+ *
+ * Tests that the block maxima saved by the postings.h module match
+ * the postings, and that Block-Max WAND in topk.h finds the same
+ * top k as scoring every document, while scoring fewer of them, and
+ * the same when ranges of documents are searched apart and merged,
+ * and that postings opened from rewritten files are of a new
+ * generation
+ *
+****************************************************************/
+
+#define _POSIX_C_SOURCE 200809L     // utimensat
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include<math.h>
+#include<fcntl.h>
+#include<sys/stat.h>
+#include"hash.h"
+#include"queue.h"
+#include"indexio.h"
+#include"rank.h"
+#include"postings.h"
+#include"topk.h"
+#include"zipf.h"
+
+/****************************************************************
+ * Define macro, globals and helper functions
+****************************************************************/
+#define eprintf(format, ...) do {                 \
+    if (verbose)                                  \
+        fprintf(stderr, format, ##__VA_ARGS__);   \
+} while(0)
+#define verbose 1
+
+#define __INDEX "topktest.index"
+#define __DOCS 5000
+#define __VOCAB 300
+#define __QUERIES 200
+
+// An index of documents of Zipf distributed words and lengths
+static hashtable_t *mkindex(void) {
+    hashtable_t *h = hopen(__VOCAB);
+    word_t *words[__VOCAB];
+    char buf[32];
+    for(int r = 0; r < __VOCAB; r++) {
+        zfword(r, buf, sizeof(buf));
+        words[r] = indexword(h, buf);
+    }
+
+    zipf_t *zf = zfopen(__VOCAB, 1.0, 42);
+    int freq[__VOCAB];
+    for(int id = 1; id <= __DOCS; id++) {
+        memset(freq, 0, sizeof(freq));
+        int len = 5 + (int)(zfrand(zf) % 200);
+        for(int i = 0; i < len; i++) freq[zfnext(zf)]++;
+        for(int r = 0; r < __VOCAB; r++) {
+            if(freq[r] > 0) indexdoc(words[r], id, freq[r], NULL);
+        }
+    }
+    zfclose(zf);
+    return h;
+}
+
+static plist_t *word(postings_t *pl, int rank) {
+    char buf[32];
+    zfword(rank, buf, sizeof(buf));
+    return plfind(pl, buf);
+}
+
+// Checks the block maxima bound every posting, and one reaches each
+static int checkmax(postings_t *pl) {
+    int errors = 0;
+    for(int r = 0; r < __VOCAB; r++) {
+        plist_t *l = word(pl, r);
+        if(l == NULL) continue;
+        for(int b = 0; b < l->nblocks; b++) {
+            bool reached = false;
+            for(int i = b * PL_BLOCK; i < l->n && i < (b + 1) * PL_BLOCK; i++) {
+                if(l->w[i] > l->bmax[b]) errors++;
+                if(l->w[i] == l->bmax[b]) reached = true;
+            }
+            if(!reached) errors++;
+        }
+    }
+    return errors;
+}
+
+// Makes the iterators of a random query: 'or' of 1 to 4 clauses of
+// 1 or 2 words each, frequent words more often than rare ones
+static int mkquery(postings_t *pl, zipf_t *zf, it_t **its) {
+    int n = 0, nclauses = 1 + (int)(zfrand(zf) % 4);
+    for(int c = 0; c < nclauses; c++) {
+        plist_t *a = word(pl, zfnext(zf)), *b = word(pl, zfnext(zf));
+        if(a == NULL || b == NULL) continue;
+        if(zfrand(zf) % 3 == 0 && a != b) {
+            it_t *both[2] = {itterm(a), itterm(b)};
+            its[n++] = itand(both, 2, false);
+        }
+        else its[n++] = itterm(a);
+    }
+    return n;
+}
+
+
+int main(void) {
+
+    int errors = 0;
+
+    hashtable_t *h = mkindex();
+    if(rksave(h, ".", __INDEX) != 0 || plsave(h, ".", __INDEX) != 0) {
+        eprintf("%s\n", "saving statistics failed");
+        exit(EXIT_FAILURE);
+    }
+    ranker_t *rk = rkopen(RK_BM25, ".", __INDEX);
+    postings_t *pl = plopen(h, NULL, rk, RK_BM25, ".", __INDEX);
+    if(pl == NULL) {
+        eprintf("%s\n", "plopen failed");
+        exit(EXIT_FAILURE);
+    }
+
+    // Maxima read from the file are the ones computed
+    if(checkmax(pl) != 0) {
+        eprintf("%d block maxima wrong\n", checkmax(pl));
+        errors++;
+    }
+    if(word(pl, 0) == NULL || word(pl, 0)->nblocks < 10) {
+        eprintf("%s\n", "frequent words should span many blocks");
+        errors++;
+    }
+
+    // Top k of random queries, with and without pruning
+    zipf_t *zf = zfopen(__VOCAB, 0.8, 7);
+    long pruned = 0, all = 0;
+    it_t *its[4];
+    for(int q = 0; q < __QUERIES; q++) {
+        int k = q % 2 ? 10 : 1 + (int)(zfrand(zf) % 100);
+        uint64_t state = zfrand(zf);
+        zipf_t *qz = zfopen(__VOCAB, 0.8, state);
+        int n = mkquery(pl, qz, its);
+        zfclose(qz);
+        hit_t *fast, *slow;
+        int nfast = tktopk(its, n, k, &fast, &pruned);
+        for(int i = 0; i < n; i++) itclose(its[i]);
+
+        qz = zfopen(__VOCAB, 0.8, state);
+        n = mkquery(pl, qz, its);
+        zfclose(qz);
+        int nslow = tktopk(its, n, 0, &slow, &all);
+        for(int i = 0; i < n; i++) itclose(its[i]);
+
+        // In three ranges, each with iterators of its own
+        hit_t *parts[3], *ranged;
+        int counts[3], bounds[4] = {0, __DOCS / 3, __DOCS / 2, IT_END};
+        for(int r = 0; r < 3; r++) {
+            qz = zfopen(__VOCAB, 0.8, state);
+            n = mkquery(pl, qz, its);
+            zfclose(qz);
+            counts[r] = tkrange(its, n, k, bounds[r], bounds[r + 1], &parts[r], NULL);
+            for(int i = 0; i < n; i++) itclose(its[i]);
+        }
+        int nranged = tkmerge(parts, counts, 3, k, &ranged);
+        bool same = nranged == nfast;
+        for(int i = 0; same && i < nfast; i++) {
+            same = ranged[i].id == fast[i].id && ranged[i].score == fast[i].score;
+        }
+        if(!same) {
+            eprintf("query %d: ranges merged differ from the top k\n", q);
+            errors++;
+        }
+        free(ranged);
+
+        if(nfast != (nslow < k ? nslow : k)) {
+            eprintf("query %d: %d hits, expected %d\n", q, nfast, nslow);
+            errors++;
+        }
+        for(int i = 0; i < nfast && i < nslow; i++) {
+            if(fast[i].id != slow[i].id || fast[i].score != slow[i].score) {
+                eprintf("query %d: hit %d is %d, expected %d\n", q, i,
+                        fast[i].id, slow[i].id);
+                errors++;
+                break;
+            }
+        }
+        for(int i = 1; i < nslow; i++) {
+            if(slow[i].score > slow[i - 1].score) {
+                eprintf("query %d: hits out of order\n", q);
+                errors++;
+                break;
+            }
+        }
+        free(fast);
+        free(slow);
+    }
+    zfclose(zf);
+    eprintf("scored %ld documents with pruning, %ld without\n", pruned, all);
+    if(pruned * 2 > all) {
+        eprintf("%s\n", "pruning scored too many documents");
+        errors++;
+    }
+
+    // An 'and' only has documents all its words are in
+    plist_t *a = word(pl, 3), *b = word(pl, 40);
+    it_t *both[2] = {itterm(a), itterm(b)};
+    it_t *it = itand(both, 2, false);
+    int i = 0, j = 0;
+    for(; it->doc != IT_END; it->next(it, it->doc + 1)) {
+        while(i < a->n && a->ids[i] < it->doc) i++;
+        while(j < b->n && b->ids[j] < it->doc) j++;
+        if(i == a->n || j == b->n || a->ids[i] != it->doc || b->ids[j] != it->doc) {
+            eprintf("and returned %d, in neither list\n", it->doc);
+            errors++;
+            break;
+        }
+    }
+    itclose(it);
+
+    // A file rewritten at the same size, within the same second, makes
+    // a new generation; the same files make the same one
+    uint64_t gens[3];
+    for(int g = 0; g < 3; g++) {
+        struct timespec t[2] = {{1000000000, g / 2}, {1000000000, g / 2}};
+        FILE *f = fopen(__INDEX, "w");
+        fprintf(f, "word %d\n", g / 2);
+        fclose(f);
+        utimensat(AT_FDCWD, __INDEX, t, 0);
+        postings_t *gl = plopen(h, NULL, rk, RK_BM25, ".", __INDEX);
+        gens[g] = plgen(gl);
+        plclose(gl);
+    }
+    if(gens[0] != gens[1] || gens[1] == gens[2]) {
+        eprintf("%s\n", "plgen missed a rewritten index");
+        errors++;
+    }
+
+    plclose(pl);
+    rkclose(rk);
+    indexclose(h);
+    remove(__INDEX);
+    remove(__INDEX ".docs");
+    remove(__INDEX ".bmw");
+
+    if(errors) {
+        eprintf("%d errors\n", errors);
+        exit(EXIT_FAILURE);
+    }
+    eprintf("%s passed\n", "topk");
+    exit(EXIT_SUCCESS);
+}
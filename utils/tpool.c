@@ -0,0 +1,175 @@
+/****************************************************************
+ * file   tpool.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   November 22, 2021
+ *
+ * Implementation of a fixed-size thread pool. Pending tasks are
+ * kept in a queue_t guarded by the pool lock.
+ *
+****************************************************************/
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<pthread.h>
+#include"queue.h"
+#include"tpool.h"
+
+
+/****************************************************************
+ * Define pool data structure
+****************************************************************/
+typedef struct task {
+    void (*fn)(void *arg);
+    void *arg;
+} task_t;
+
+typedef struct tpool {
+    queue_t *tasks;             // Tasks not yet picked up
+    int pending;                // Tasks queued or running
+    bool stop;                  // Set by tpclose()
+    pthread_mutex_t lock;
+    pthread_cond_t work;        // A task was queued or stop was set
+    pthread_cond_t done;        // pending dropped to zero
+    pthread_t *threads;
+    int nthreads;
+} tp_t;
+
+
+/****************************************************************
+ * Private helper function: worker loop
+****************************************************************/
+static void *worker(void *arg) {
+
+    tp_t *tp = (tp_t*)arg;
+    pthread_mutex_lock(&tp->lock);
+    while(true) {
+        task_t *t = (task_t*)qget(tp->tasks);
+        if(t == NULL) {
+            if(tp->stop) break;
+            pthread_cond_wait(&tp->work, &tp->lock);
+            continue;
+        }
+
+        pthread_mutex_unlock(&tp->lock);
+        t->fn(t->arg);
+        free(t);
+        pthread_mutex_lock(&tp->lock);
+
+        if(--tp->pending == 0) pthread_cond_broadcast(&tp->done);
+    }
+    pthread_mutex_unlock(&tp->lock);
+    return NULL;
+}
+
+
+/****************************************************************
+ * tpopen -- start a pool of nthreads workers
+****************************************************************/
+tpool_t *tpopen(int nthreads) {
+
+    if(nthreads < 1) return NULL;
+
+    tp_t *tp;
+    if(!(tp = (tp_t*)calloc(1, sizeof(tp_t)))) {
+        printf("Error: malloc failed allocating thread pool\n");
+        return NULL;
+    }
+    tp->tasks = qopen();
+    tp->threads = (pthread_t*)calloc(nthreads, sizeof(pthread_t));
+    if(tp->tasks == NULL || tp->threads == NULL) {
+        printf("Error: malloc failed allocating thread pool\n");
+        qclose(tp->tasks); free(tp->threads); free(tp);
+        return NULL;
+    }
+    pthread_mutex_init(&tp->lock, NULL);
+    pthread_cond_init(&tp->work, NULL);
+    pthread_cond_init(&tp->done, NULL);
+
+    for(int i = 0; i < nthreads; i++) {
+        if(pthread_create(&tp->threads[i], NULL, worker, tp) != 0) break;
+        tp->nthreads++;
+    }
+    if(tp->nthreads == 0) {
+        tpclose(tp);
+        return NULL;
+    }
+
+    return (tpool_t*)tp;
+}
+
+
+/****************************************************************
+ * tpsubmit -- queue fn(arg) to be run by a worker
+****************************************************************/
+int32_t tpsubmit(tpool_t *pool, void (*fn)(void *arg), void *arg) {
+
+    if(pool == NULL || fn == NULL) return 1;
+    tp_t *tp = (tp_t*)pool;
+
+    task_t *t;
+    if(!(t = (task_t*)malloc(sizeof(task_t)))) {
+        printf("Error: malloc failed allocating task\n");
+        return 1;
+    }
+    t->fn = fn;
+    t->arg = arg;
+
+    pthread_mutex_lock(&tp->lock);
+    if(tp->stop || qput(tp->tasks, t) != 0) {
+        pthread_mutex_unlock(&tp->lock);
+        free(t);
+        return 1;
+    }
+    tp->pending++;
+    pthread_cond_signal(&tp->work);
+    pthread_mutex_unlock(&tp->lock);
+    return 0;
+}
+
+
+/****************************************************************
+ * tpwait -- block until every submitted task has finished
+****************************************************************/
+void tpwait(tpool_t *pool) {
+
+    if(pool == NULL) return;
+    tp_t *tp = (tp_t*)pool;
+    pthread_mutex_lock(&tp->lock);
+    while(tp->pending > 0) pthread_cond_wait(&tp->done, &tp->lock);
+    pthread_mutex_unlock(&tp->lock);
+}
+
+
+/****************************************************************
+ * tpsize -- the number of workers in the pool
+****************************************************************/
+int tpsize(tpool_t *pool) {
+    return pool ? ((tp_t*)pool)->nthreads : 0;
+}
+
+
+/****************************************************************
+ * tpclose -- drain the queue, stop the workers, free the pool
+****************************************************************/
+void tpclose(tpool_t *pool) {
+
+    if(pool == NULL) return;
+    tp_t *tp = (tp_t*)pool;
+
+    pthread_mutex_lock(&tp->lock);
+    tp->stop = true;
+    pthread_cond_broadcast(&tp->work);
+    pthread_mutex_unlock(&tp->lock);
+    for(int i = 0; i < tp->nthreads; i++) {
+        pthread_join(tp->threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&tp->lock);
+    pthread_cond_destroy(&tp->work);
+    pthread_cond_destroy(&tp->done);
+    qclose(tp->tasks);
+    free(tp->threads);
+    free(tp);
+}
@@ -0,0 +1,33 @@
+#pragma once
+/*
+ * tpool.h -- a fixed-size pool of worker threads
+ *
+ * Tasks are queued in submission order and run by whichever worker is
+ * free; the number of threads never grows with the number of tasks.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* the pool representation is hidden from users of the module */
+typedef void tpool_t;
+
+/* tpopen -- start a pool of nthreads workers
+ * returns NULL on failure
+ */
+tpool_t *tpopen(int nthreads);
+
+/* tpsubmit -- queue fn(arg) to be run by a worker
+ * returns 0 if successful; nonzero otherwise
+ */
+int32_t tpsubmit(tpool_t *tp, void (*fn)(void *arg), void *arg);
+
+/* tpwait -- block until every task submitted so far has finished */
+void tpwait(tpool_t *tp);
+
+/* tpsize -- the number of workers in the pool */
+int tpsize(tpool_t *tp);
+
+/* tpclose -- finish the queued tasks, stop the workers and free the
+ * pool
+ */
+void tpclose(tpool_t *tp);
@@ -0,0 +1,207 @@
+/****************************************************************
+ * file   urltest.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   November 29, 2021
+ *
+ * Tests that CanonicalizeURL() and NormalizeURL() give the expected
+ * result for every link in links.txt, and times them over that
+ * corpus, or over the links of the pages in a crawl directory
+ *
+ * usage: urltest [pagedir]
+ *
+****************************************************************/
+
+#define _POSIX_C_SOURCE 200809L     // clock_gettime
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<string.h>
+#include<ctype.h>
+#include<time.h>
+#include"webpage.h"
+#include"pageio.h"
+
+/****************************************************************
+ * Define macro, globals and helper functions
+****************************************************************/
+#define eprintf(format, ...) do {                 \
+    if (verbose)                                  \
+        fprintf(stderr, format, ##__VA_ARGS__);   \
+} while(0)
+#define verbose 1
+
+#define __MAXLINE 1024
+#define __MAXLINKS 100000
+#define __ROUNDS 200
+
+char *links[__MAXLINKS];
+int nlinks = 0;
+
+
+/****************************************************************
+ * Private helper function: read one line without its newline
+****************************************************************/
+static bool readline(FILE *fp, char *line) {
+    if(fgets(line, __MAXLINE, fp) == NULL) return false;
+    line[strcspn(line, "\n")] = '\0';
+    return true;
+}
+
+
+/****************************************************************
+ * Private helper function: keep a copy of a link for the benchmark
+****************************************************************/
+static void addlink(const char *url) {
+    if(nlinks == __MAXLINKS) return;
+    links[nlinks] = (char*)malloc(strlen(url) + 1);
+    strcpy(links[nlinks++], url);
+}
+
+
+/****************************************************************
+ * Private helper function: check one link against the result in
+ * links.expected, "<I|N|-> <url>": internal, external or invalid
+ * followed by the normalized url (the link itself if invalid)
+****************************************************************/
+static int check(const char *url, const char *expected) {
+
+    int errors = 0;
+    char out[__MAXLINE], inplace[__MAXLINE];
+    bool valid = expected[0] != '-';
+    const char *want = expected + 2;
+
+    // Into a separate buffer, with spans
+    urlspans_t s;
+    strcpy(out, "untouched");
+    int len = CanonicalizeURL(url, out, sizeof(out), &s);
+    if(valid != (len >= 0) || (valid && strcmp(out, want) != 0) ||
+       (!valid && strcmp(out, "untouched") != 0)) {
+        eprintf("CanonicalizeURL(%s) gave %s, expected %s\n", url,
+                len >= 0 ? out : "-", expected);
+        errors++;
+    }
+    else if(valid && len != (int)strlen(want)) {
+        eprintf("CanonicalizeURL(%s) returned length %d\n", url, len);
+        errors++;
+    }
+    else if(valid) {
+        // The host is lowercase and the path is what follows it, up
+        // to any query or fragment
+        const char *path = out + s.path;
+        bool ok = s.host + s.hostlen <= s.path && s.path + s.pathlen <= len &&
+            (s.pathlen == 0 || *path == '/') &&
+            (path[s.pathlen] == '\0' || path[s.pathlen] == '?' ||
+             path[s.pathlen] == '#') &&
+            memchr(out + s.host, '/', s.hostlen) == NULL;
+        for(int i = 0; i < s.hostlen; i++) {
+            ok = ok && out[s.host + i] == tolower(out[s.host + i]);
+        }
+        if(!ok) {
+            eprintf("CanonicalizeURL(%s) gave host %.*s and path %.*s\n", url,
+                    s.hostlen, out + s.host, s.pathlen, out + s.path);
+            errors++;
+        }
+    }
+
+    // In place, leaving invalid links alone
+    strcpy(inplace, url);
+    if(NormalizeURL(inplace) != valid || strcmp(inplace, valid ? want : url)) {
+        eprintf("NormalizeURL(%s) gave %s\n", url, inplace);
+        errors++;
+    }
+    strcpy(inplace, url);
+    if(IsInternalURL(inplace) != (expected[0] == 'I')) {
+        eprintf("IsInternalURL(%s) is wrong\n", url);
+        errors++;
+    }
+    return errors;
+}
+
+
+/****************************************************************
+ * Private helper function: nanoseconds per link of NormalizeURL()
+ * on a copy of each link, as the crawler does, or of
+ * CanonicalizeURL() into a separate buffer
+****************************************************************/
+static double timeit(bool inplace) {
+    struct timespec t0, t1;
+    char buf[__MAXLINE];
+    urlspans_t s;
+    long valid = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(int r = 0; r < __ROUNDS; r++) {
+        for(int i = 0; i < nlinks; i++) {
+            if(inplace) {
+                strcpy(buf, links[i]);
+                valid += NormalizeURL(buf);
+            }
+            else {
+                valid += CanonicalizeURL(links[i], buf, sizeof(buf), &s) >= 0;
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if(valid < 0) printf("%ld\n", valid);     // Keep the loop
+    return ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) /
+        ((double)__ROUNDS * nlinks);
+}
+
+
+int main(int argc, char *argv[]) {
+
+    FILE *in = fopen("links.txt", "r");
+    FILE *expfp = fopen("links.expected", "r");
+    if(in == NULL || expfp == NULL) {
+        eprintf("%s\n", "Error: can't open links.txt or links.expected");
+        exit(EXIT_FAILURE);
+    }
+
+    int errors = 0;
+    char url[__MAXLINE], expected[__MAXLINE];
+    while(readline(in, url)) {
+        if(!readline(expfp, expected)) {
+            eprintf("%s\n", "Error: links.expected is too short");
+            exit(EXIT_FAILURE);
+        }
+        errors += check(url, expected);
+        if(argc < 2) addlink(url);
+    }
+    fclose(in);
+    fclose(expfp);
+
+    // A buffer too small is refused without being written to
+    char small[8] = "xxxxxxx";
+    if(CanonicalizeURL("http://a.com/", small, sizeof(small), NULL) != -1 ||
+       strcmp(small, "xxxxxxx") != 0) {
+        eprintf("%s\n", "CanonicalizeURL overran its buffer");
+        errors++;
+    }
+
+    // Benchmark on the links of a crawl instead, if given one
+    if(argc >= 2) {
+        webpage_t *page;
+        for(int id = 1; (page = pageload(id, argv[1])) != NULL; id++) {
+            char *link;
+            int pos = 0;
+            while((pos = webpage_getNextURL(page, pos, &link)) > 0) {
+                addlink(link);
+                free(link);
+            }
+            webpage_delete(page);
+        }
+    }
+    if(nlinks > 0) {
+        eprintf("%d links: NormalizeURL %.1f ns/link, "
+                "CanonicalizeURL %.1f ns/link\n",
+                nlinks, timeit(true), timeit(false));
+    }
+    for(int i = 0; i < nlinks; i++) free(links[i]);
+
+    if(errors) {
+        eprintf("%d errors\n", errors);
+        exit(EXIT_FAILURE);
+    }
+    eprintf("%s passed\n", "url");
+    exit(EXIT_SUCCESS);
+}
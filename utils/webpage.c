@@ -30,6 +30,9 @@ typedef struct webpage {
   char *html;                              // html code of the page
   size_t html_len;                         // length of html code
   int depth;                               // depth of crawl
+  char *etag;                              // ETag of the last fetch, or NULL
+  long lastmod;                            // Last-Modified of the last fetch, or 0
+  bool notmodified;                        // last fetch returned 304
 } webpage_t;
 
 struct URL {
@@ -42,7 +45,6 @@ struct URL {
 };
 
 /* Private function prototypes */
-static char *RemoveDotSegments(char *input);
 static void RemoveWhitespace(char* str);
 static int ParseURL(char* str, struct URL* url);
 static char *FixupRelativeURL(char *base, char *rel, size_t len);
@@ -61,6 +63,9 @@ int   webpage_getDepth(const webpage_t *page) { return page ? page->depth : 0;
 int   webpage_getHTMLlen(const webpage_t *page) { return page ? page->html_len : 0; }
 char *webpage_getHTML(const webpage_t *page)  { return page ? page->html  : NULL; }
 char *webpage_getURL(const webpage_t *page)   { return page ? page->url   : NULL; }
+char *webpage_getETag(const webpage_t *page)  { return page ? page->etag  : NULL; }
+long  webpage_getLastModified(const webpage_t *page) { return page ? page->lastmod : 0; }
+bool  webpage_isNotModified(const webpage_t *page) { return page ? page->notmodified : false; }
 
 
 webpage_t *webpage_new(char *url, const int depth, char *html) {
@@ -74,16 +79,31 @@ webpage_t *webpage_new(char *url, const int depth, char *html) {
   page->depth = depth;
   page->html = html;
   page->html_len = html ? strlen(html) : 0;
+  page->etag = NULL;
+  page->lastmod = 0;
+  page->notmodified = false;
   return page;
 }
 
 
+void webpage_setValidators(webpage_t *page, const char *etag, long lastmod)
+{
+  if (page == NULL) {
+    return;
+  }
+  free(page->etag);
+  page->etag = etag ? checkp(strdup(etag), "page->etag") : NULL;
+  page->lastmod = lastmod;
+}
+
+
 void webpage_delete(void *data)
 {
   webpage_t *page = data;
   if (page != NULL) {
     if (page->url) free(page->url);
     if (page->html) free(page->html);
+    if (page->etag) free(page->etag);
     free(page);
   }
 }
@@ -291,105 +311,158 @@ int webpage_getNextURL(webpage_t *page, int pos, char **result) {
   return end - html;
 }
 
-/******************** NormalizeURL *******************************/
-/* Normalize the url according to RFC 3986 chapter 3
+/******************** CanonicalizeURL ****************************/
+/* Normalize the url according to RFC 3986 chapter 3, into out
+ * See "webpage.h" for full documentation.
  *
- * Assumptions:
- *     1. url has been allocated
- *     2. url is an absolute url
+ * Gives the same result as splitting the url into the parts
+ * ParseURL() finds, removing dot segments from the path and putting
+ * it back together, but every part is copied straight into out. The normalized url is never
+ * longer than url, and each step writes no further than it has
+ * read, so out may be url itself.
  *
  * Pseudocode:
  *     1. check arguments
- *     2. try to parse url
- *     3. check any file extensions
- *     4. clear the url
- *     5. remove dot segments and lowercase scheme and host
- *     6. put the url back together
+ *     2. find the end of the scheme, user info, host and path
+ *     3. check any file extension
+ *     4. copy the scheme and host, lowercased, and the user info
+ *     5. copy the path, removing . and .. segments on the way
+ *     6. copy the query and fragment
+ *
+ * The dot segment removal is adapted from the cURL library:
+ *
+ * Copyright (c) 1996 - 2014, Daniel Stenberg, <daniel@haxx.se>.
+ *
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright
+ * notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT OF THIRD PARTY RIGHTS. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+ * OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of a copyright holder shall not
+ * be used in advertising or otherwise to promote the sale, use or other dealings
+ * in this Software without prior written authorization of the copyright holder.
  */
-bool NormalizeURL(char *url) {
-  bool status = true;
-  int valid_ext;
-  struct URL tmp;                          // url struct for parsing
-  char *dot;
-  char *slash;
-
-  // initialize struct
-  tmp.scheme = NULL;
-  tmp.user = NULL;
-  tmp.host = NULL;
-  tmp.path = NULL;
-  tmp.query = NULL;
-  tmp.fragment = NULL;
+int CanonicalizeURL(const char *url, char *out, size_t outlen, urlspans_t *spans) {
+  const char *p;
+  const char *scheme_end;                  // end of scheme, : or :/ or ://
+  const char *host_beg;                    // beginning of host, after any user@
+  const char *host_end;                    // end of host, / or end of url
+  const char *path_end;                    // end of path, ? or # or end of url
+  const char *end;                         // end of url
+  char *w;                                 // write point in out
+  char *path;                              // beginning of the path in out
+
+  // test arguments
+  if (!url || !out) { return -1; }
 
-  // test url
-  if (!url) { return 0; }
-
-  // try to parse the url
-  if (!ParseURL(url, &tmp)) {
-    status = false;
-    goto cleanup;                        // sorry Dijkstra
+  // make sure absolute url, i.e., ':' must preceede any '/', '?', or '#'
+  scheme_end = url + strcspn(url, ":/?#");
+  if (*scheme_end != ':') { return -1; }
+  scheme_end++;                            // consume ':'
+  if (scheme_end[0] == '/' && scheme_end[1] == '/') {
+    scheme_end += 2;                    // consume "//"
   }
 
-  // check file extension
-  if (tmp.path) {                           // have a path
-    dot = strrchr(tmp.path, '.');
-    slash = strrchr(tmp.path, '/');
-
-    if (dot && slash && dot > slash) {    // /path/to/file.ext
-      dot++;                           // consume '.'
-
-      if (strlen(dot) > 0) {
-	// check all valid extensions
-	valid_ext = 0;
-	for (int i = 0; i < NUM_EXTS; i++) {
-	  if (!strncasecmp(dot, EXTS[i], strlen(EXTS[i]))) {
-	    valid_ext = 1; break;
-	  }
-	}
-
-	// bad extension
-	if (!valid_ext) {
-	  status = false;
-	  goto cleanup;            // sorry Dijkstra
-	}
+  // user info is anything up to an '@' before the first '/'
+  host_beg = scheme_end + strcspn(scheme_end, "@/");
+  host_beg = (*host_beg == '@') ? host_beg + 1 : scheme_end;
+  host_end = host_beg + strcspn(host_beg, "/");
+
+  // the path ends at the first '?' or '#'; one in the host or user
+  // info can't be parsed
+  path_end = scheme_end + strcspn(scheme_end, "?#");
+  if (path_end < host_end) { return -1; }
+  end = path_end + strlen(path_end);
+  if ((size_t)(end - url) >= outlen) { return -1; }
+
+  // check file extension, after the last '.' if it is past the last '/'
+  for (p = path_end; p > host_end && p[-1] != '/' && p[-1] != '.'; p--)
+    ;
+  if (p > host_end && p[-1] == '.' && p < path_end) {
+    bool valid_ext = false;
+    for (int i = 0; i < NUM_EXTS; i++) {
+      size_t ext_len = strlen(EXTS[i]);
+      if ((size_t)(path_end - p) >= ext_len && !strncasecmp(p, EXTS[i], ext_len)) {
+	valid_ext = true; break;
       }
     }
+    if (!valid_ext) { return -1; }      // bad extension
   }
 
-  // clear url
-  memset(url, '\0', strlen(url)-1);
+  // scheme, user and host keep their length, so they stay in place
+  w = out;
+  for (p = url; p < scheme_end; p++) { *w++ = tolower(*p); }
+  for (; p < host_beg; p++) { *w++ = *p; }
+  for (; p < host_end; p++) { *w++ = tolower(*p); }
 
-  // put normalized url back together
-  if (tmp.scheme) {                         // scheme
-    strcat(url, tmp.scheme);
-  }
+  // remove . and .. segments, as RFC 3986 section 5.2.4 does
+  path = w;
+  while (p < path_end) {
+    size_t n = path_end - p;
 
-  if (tmp.user) {                           // user
-    strcat(url, tmp.user);
-  }
+    // A. drop a leading "../" or "./"
+    if (n >= 2 && !strncmp(p, "./", 2)) {
+      p += 2;
+    }
+    else if (n >= 3 && !strncmp(p, "../", 3)) {
+      p += 3;
+    }
 
-  if (tmp.host) {                           // host
-    strcat(url, tmp.host);
-  }
+    // B. replace a leading "/./" or a final "/." with "/"
+    else if (n >= 3 && !strncmp(p, "/./", 3)) {
+      p += 2;
+    }
+    else if (n == 2 && !strncmp(p, "/.", 2)) {
+      p += 2;
+      *w++ = '/';
+    }
 
-  if (tmp.path) {                           // path
-    // remove . and .. segments
-    char *p = RemoveDotSegments(tmp.path);
+    // C. replace a leading "/../" or a final "/.." with "/", and
+    //    remove the last segment and its "/" from the output
+    else if (n >= 4 && !strncmp(p, "/../", 4)) {
+      p += 3;
+      while (w > path && *--w != '/')
+	;
+    }
+    else if (n == 3 && !strncmp(p, "/..", 3)) {
+      p += 3;
+      while (w > path && *--w != '/')
+	;
+      *w++ = '/';
+    }
 
-    if (p) {
-      strcat(url, p);
+    // D. drop a lone "." or ".."
+    else if ((n == 1 && *p == '.') || (n == 2 && !strncmp(p, "..", 2))) {
+      p = path_end;
+    }
 
-      free(p);
+    // E. move the first segment, with its leading "/", to the output
+    else {
+      do {
+	*w++ = *p++;
+      } while (p < path_end && *p != '/');
     }
   }
 
-  if (tmp.query) {                          // query
-    strcat(url, tmp.query);
+  if (spans) {
+    spans->host = host_beg - url;
+    spans->hostlen = host_end - host_beg;
+    spans->path = path - out;
+    spans->pathlen = w - path;
   }
 
-  if (tmp.fragment) {                       // fragment
-    strcat(url, tmp.fragment);
-  }
+  // query and fragment are copied as they are, with the '\0'
+  memmove(w, path_end, end - path_end + 1);
+  w += end - path_end;
 
 #ifdef REMOVE_SLASH
   // Remove trailing slash [DFK 2017].
@@ -398,23 +471,27 @@ bool NormalizeURL(char *url) {
   // but doing so actually prevents the crawler from following the 
   // server's implicit redirect to http://www.cs.dartmouth.edu/index.html
   // So, I've decided not to include it.
-  if (*url != '\0') {
-    char *last = url + strlen(url) - 1;
-    if (*last == '/'){
-      *last = '\0';
+  if (w > out && w[-1] == '/') {
+    *--w = '\0';
+    if (spans && spans->path + spans->pathlen > w - out) {
+      spans->pathlen--;
     }
   }
 #endif // REMOVE_SLASH
 
- cleanup:                                     // cleanup memory
-  if (tmp.scheme) { free(tmp.scheme); }
-  if (tmp.user) { free(tmp.user); }
-  if (tmp.host) { free(tmp.host); }
-  if (tmp.path) { free(tmp.path); }
-  if (tmp.query) { free(tmp.query); }
-  if (tmp.fragment) { free(tmp.fragment); }
+  return w - out;
+}
 
-  return status;
+/******************** NormalizeURL *******************************/
+/* Normalize the url according to RFC 3986 chapter 3, in place
+ *
+ * Assumptions:
+ *     1. url has been allocated
+ *     2. url is an absolute url
+ */
+bool NormalizeURL(char *url) {
+  if (!url) { return false; }
+  return CanonicalizeURL(url, url, strlen(url) + 1, NULL) >= 0;
 }
 
 /***********************************************************************
@@ -604,148 +681,6 @@ static int ParseURL(char* str, struct URL* url) {
   return 1;                                // if we got this far, good
 }
 
-/* ***************************************************************** */
-/*
- * RemoveDotSegments - removes . and .. segments from url paths
- * @input: the character buffer to cleanse
- *
- * Returns a newly allocated character buffer with . and .. segments removed
- * according to the algorithm in RFC 3986 section 5.2.4 "Remove Dot Segments".
- * See: http://www.ietf.org/rfc/rfc1738.txt
- *
- * Should have no use outside of this file, thus declared static.
- *
- * Implementation adapted for CS50 TSE Crawler from the cURL library:
- *
- * Copyright (c) 1996 - 2014, Daniel Stenberg, <daniel@haxx.se>.
- *
- * All rights reserved.
- *
- * Permission to use, copy, modify, and distribute this software for any purpose
- * with or without fee is hereby granted, provided that the above copyright
- * notice and this permission notice appear in all copies.
- *
- * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
- * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
- * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT OF THIRD PARTY RIGHTS. IN
- * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
- * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
- * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
- * OR OTHER DEALINGS IN THE SOFTWARE.
- *
- * Except as contained in this notice, the name of a copyright holder shall not
- * be used in advertising or otherwise to promote the sale, use or other dealings
- * in this Software without prior written authorization of the copyright holder.
- */
-static char *RemoveDotSegments(char *input)
-{
-  size_t in_len;                           // input length
-  size_t copy_len;                         // copy length
-  char *copy;                              // copy of input that is modified
-  char *copyptr;                           // handle for free'ing copy'
-  char *out;                               // output buffer
-  char *outptr;                            // pointer to current write point
-
-  if (!input || strlen(input) < 1)
-    return NULL;
-
-  // save lengths
-  in_len = copy_len = strlen(input);
-
-  // create output buffer
-  out = outptr = calloc(in_len + 1, sizeof(char));
-  if (!out)
-    return NULL; /* out of memory */
-
-  // copy the input buffer
-  copy = copyptr = strdup(input);
-  if (!copy) {
-    free(out);
-    return NULL;
-  }
-
-  // 2.  While the input buffer is not empty, loop as follows:
-  do {
-    // A. If the input buffer begins with a prefix of "../" or "./",
-    //    then remove that prefix from the input buffer; otherwise,
-    if (!strncmp("./", copy, 2)) {
-      copy += 2;
-      copy_len -= 2;
-    }
-    else if (!strncmp("../", copy, 3)) {
-      copy += 3;
-      copy_len -= 3;
-    }
-
-    // B. if the input buffer begins with a prefix of "/./" or "/.",
-    //    where "." is a complete path segment, then replace that
-    //    prefix with "/" in the input buffer; otherwise,
-    else if (!strncmp("/./", copy, 3)) {
-      copy += 2;
-      copy_len -= 2;
-    }
-    else if (!strcmp("/.", copy)) {
-      copy[1] = '/';
-      copy++;
-      copy_len -= 1;
-    }
-
-    // C. if the input buffer begins with a prefix of "/../" or "/..",
-    //    where ".." is a complete path segment, then replace that
-    //    prefix with "/" in the input buffer and remove the last
-    //    segment and its preceding "/" (if any) from the output
-    //    buffer; otherwise,
-    else if (!strncmp("/../", copy, 4)) {
-      copy += 3;
-      copy_len -= 3;
-
-      // remove the last segment
-      while (outptr > out) {
-	outptr--;
-	if (*outptr == '/')
-	  break;
-      }
-      *outptr = 0;
-    }
-    else if (!strcmp("/..", copy)) {
-      copy[2] = '/';
-      copy += 2;
-      copy_len -= 2;
-
-      // remove the last segment
-      while (outptr > out) {
-	outptr--;
-	if (*outptr == '/')
-	  break;
-      }
-      *outptr = 0;
-    }
-
-    // D. if the input buffer consists only of "." or "..", then remove
-    //    that from the input buffer; otherwise, */
-    else if (!strcmp(".", copy) || !strcmp("..", copy)) {
-      *copy = 0;
-    }
-
-    // E. move the first path segment in the input buffer to the end of
-    //    the output buffer, including the initial "/" character (if
-    //    any) and any subsequent characters up to, but not including,
-    //    the next "/" character or the end of the input buffer. */
-    else {
-      do {
-	*outptr++ = *copy++;
-	copy_len--;
-      } while (*copy && (*copy != '/'));
-      *outptr = '\0';
-    }
-  } while (*copy != '\0');                          // keep going
-
-  // cleanup copy
-  free(copyptr);
-
-  return out;
-}
-
 /* ***************************************************************** */
 /*
  * FixupRelativeURL - resolves a relative url to an absolute url
@@ -912,6 +847,35 @@ static size_t WriteMemoryCallback(void *contents, size_t size, size_t nmemb, voi
 }
 
 
+/* HeaderCallback - curl callback for response headers; keeps the ETag
+ *
+ * For implementation details see:
+ * http://curl.haxx.se/libcurl/c/curl_easy_setopt.html#CURLOPTHEADERFUNCTION
+ *
+ * Should have no use outside of this file, thus declared static.
+ */
+static size_t HeaderCallback(char *buffer, size_t size, size_t nitems, void *userp) {
+  size_t realsize = size * nitems;
+  char **etag = (char**) userp;
+  const size_t namelen = strlen("ETag:");
+
+  if (realsize > namelen && strncasecmp(buffer, "ETag:", namelen) == 0) {
+    const char *value = buffer + namelen;
+    size_t len = realsize - namelen;
+    while (len > 0 && isspace(*value)) {
+      value++;
+      len--;
+    }
+    while (len > 0 && isspace(value[len-1])) {
+      len--;
+    }
+    free(*etag);
+    *etag = strndup(value, len);
+  }
+  return realsize;
+}
+
+
 /* ************* webpage_fetch ******************** */
 /* see webpage.h for usage documentation.
  *
@@ -930,13 +894,19 @@ bool webpage_fetch(webpage_t *page) {
   bool status = true;		       // return value
   CURL* curl_handle;		       // curl handle
   CURLcode res;		               // curl response code
+  struct curl_slist *headers = NULL;   // extra request headers
+  char *etag = NULL;                   // ETag of the response
+  long code = 0;                       // HTTP response code
+  long filetime = -1;                  // Last-Modified of the response
 
   // check page
   if (page == NULL) { return false; }
 
   // allocate space for the html, curl will realloc as needed
+  free(page->html);
   page->html = calloc(1, sizeof(char));
   page->html_len = 0;
+  page->notmodified = false;
 
   // init curl session
   curl_handle = curl_easy_init();
@@ -959,6 +929,24 @@ bool webpage_fetch(webpage_t *page) {
   // save error messages
   curl_easy_setopt(curl_handle, CURLOPT_ERRORBUFFER, &errbuf);
 
+  // keep the validators of the response
+  curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, HeaderCallback);
+  curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, (void*)&etag);
+  curl_easy_setopt(curl_handle, CURLOPT_FILETIME, 1L);
+
+  // make the request conditional on the validators of the last fetch
+  if (page->etag != NULL) {
+    char *header = checkp(malloc(strlen(page->etag) + 32), "header");
+    sprintf(header, "If-None-Match: %s", page->etag);
+    headers = curl_slist_append(headers, header);
+    free(header);
+    curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headers);
+  }
+  if (page->lastmod > 0) {
+    curl_easy_setopt(curl_handle, CURLOPT_TIMECONDITION, (long)CURL_TIMECOND_IFMODSINCE);
+    curl_easy_setopt(curl_handle, CURLOPT_TIMEVALUE, page->lastmod);
+  }
+
   // get the page; repeat MAX_TRY times
   do {
     res = curl_easy_perform(curl_handle);
@@ -977,8 +965,25 @@ bool webpage_fetch(webpage_t *page) {
 
     status = false;                          // signal failure
   }
+  else {
+    // a 304 leaves the html empty; the caller still has the old copy
+    curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &code);
+    curl_easy_getinfo(curl_handle, CURLINFO_FILETIME, &filetime);
+    if (code == 304) {
+      page->notmodified = true;
+    }
+    else {
+      // keep the new validators for the next fetch
+      free(page->etag);
+      page->etag = etag;
+      page->lastmod = filetime > 0 ? filetime : 0;
+      etag = NULL;
+    }
+  }
 
   // cleanup curl stuff
+  free(etag);
+  curl_slist_free_all(headers);
   curl_easy_cleanup(curl_handle);
   curl_global_cleanup();
 
@@ -22,6 +22,9 @@ int   webpage_getDepth(const webpage_t *page);
 int   webpage_getHTMLlen(const webpage_t *page);
 char *webpage_getURL(const webpage_t *page);
 char *webpage_getHTML(const webpage_t *page);
+char *webpage_getETag(const webpage_t *page);
+long  webpage_getLastModified(const webpage_t *page);
+bool  webpage_isNotModified(const webpage_t *page);
 
 /**************** webpage_new ****************/
 /* Allocate and initialize a new webpage_t structure.
@@ -42,6 +45,18 @@ webpage_t *webpage_new(char *url, const int depth, char *html);
  */
 void webpage_delete(void *data);
 
+/**************** webpage_setValidators ****************/
+/* Remember what an earlier fetch of the page returned, so that the
+ * next webpage_fetch() is a conditional GET.
+ * Parameters:
+ *   etag     the ETag header of the earlier response; may be null.
+ *            The string is copied.
+ *   lastmod  its Last-Modified time in seconds since the epoch,
+ *            or 0 if unknown.
+ * Passing NULL and 0 makes the next fetch unconditional again.
+ */
+void webpage_setValidators(webpage_t *page, const char *etag, long lastmod);
+
 /***************** webpage_fetch ******************************/
 /* retrieve HTML from page->url, store into page->html
  * @page: the webpage struct containing the url to curl
@@ -57,7 +72,8 @@ void webpage_delete(void *data);
  * Assumptions:
  *     1. page has been allocated by caller
  *     2. page->url contains the url to curl
- *     3. page->html is NULL at call time
+ *     3. page->html is NULL at call time, or holds the html of an
+ *        earlier fetch, which is freed
  *
  * Usage example:
  * webpage_t* page = webpage_new("http://www.example.com", 0, NULL);
@@ -67,6 +83,13 @@ void webpage_delete(void *data);
  *     free(html);
  *     webpage_delete(page);
  * }
+ * Conditional fetches:
+ *     If the page has validators (see webpage_setValidators), the
+ *     request carries If-None-Match and If-Modified-Since. When the
+ *     server answers 304 Not Modified, the fetch succeeds with empty
+ *     html and webpage_isNotModified(page) is true. Otherwise the
+ *     ETag and Last-Modified of the response replace the validators.
+ *
  * Returns:
  *     True: success; caller must later free(webpage_getHTML(page));
  *     False: some error fetching page.
@@ -137,6 +160,38 @@ int webpage_getNextURL(webpage_t *page, int pos, char **result);
  */
 bool NormalizeURL(char *url);
 
+/***********************************************************************
+ * urlspans_t: where the host and the path are in a canonical url,
+ * as offsets and lengths. The host includes any port; the path runs
+ * up to the query or fragment and may be empty.
+ */
+typedef struct urlspans {
+  int host, hostlen;
+  int path, pathlen;
+} urlspans_t;
+
+/***********************************************************************
+ * CanonicalizeURL - normalizes a url into a caller buffer
+ * @url: absolute url to normalize
+ * @out: where to write the normalized url; may be url itself
+ * @outlen: size of out, at least strlen(url) + 1
+ * @spans: set to the host and path spans of the result; may be NULL
+ *
+ * Returns the length of the normalized url, which is the same as
+ * NormalizeURL() would leave behind; returns -1 where NormalizeURL()
+ * returns false, or if out is too small. Works in a single pass and
+ * never allocates memory. On failure out is left unchanged.
+ *
+ * Usage example:
+ * char buf[256];
+ * urlspans_t s;
+ * int len = CanonicalizeURL(link, buf, sizeof(buf), &s);
+ * if (len >= 0) {
+ *     printf("host %.*s\n", s.hostlen, buf + s.host);
+ * }
+ */
+int CanonicalizeURL(const char *url, char *out, size_t outlen, urlspans_t *spans);
+
 
 /***********************************************************************
  * IsInternalURL - 
@@ -151,7 +206,9 @@ bool NormalizeURL(char *url);
  */
 bool IsInternalURL(char *url);
 
-// All URLs beginning with this prefix are considered "internal"
-static const
-  char INTERNAL_URL_PREFIX[] = "https://thayer.github.io/engs50";
+// All URLs beginning with this prefix are considered "internal";
+// build with -DINTERNAL_URL_PREFIX='"<url>"' to crawl another site
+#ifndef INTERNAL_URL_PREFIX
+#define INTERNAL_URL_PREFIX "https://thayer.github.io/engs50"
+#endif
 
@@ -0,0 +1,136 @@
+/****************************************************************
+ * file   zipf.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   December 2, 2021
+ *
+ * Implementation of a Zipf rank generator by inverting the
+ * cumulative distribution with a binary search, over a splitmix64
+ * stream of random numbers, and of synthetic words and URLs.
+ *
+****************************************************************/
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdint.h>
+#include<string.h>
+#include<math.h>
+#include"zipf.h"
+
+
+/****************************************************************
+ * Define generator data structure
+****************************************************************/
+typedef struct zipf {
+    uint64_t state;
+    int n;
+    double *cdf;                    // cdf[k] = P(rank <= k)
+} zf_t;
+
+// Syllables are a consonant and a vowel
+static const char consonants[] = "bcdfghjklmnprstvwz";
+static const char vowels[] = "aeiou";
+#define __NCONS (sizeof(consonants) - 1)
+#define __NVOWELS (sizeof(vowels) - 1)
+#define __SYLLABLES (__NCONS * __NVOWELS)
+#define __HOSTS 8
+
+
+/****************************************************************
+ * zfopen -- sum up the probabilities of the ranks
+****************************************************************/
+zipf_t *zfopen(int n, double s, uint64_t seed) {
+
+    if(n < 1 || s < 0) return NULL;
+    zf_t *zf;
+    if(!(zf = (zf_t*)malloc(sizeof(zf_t)))) {
+        printf("Error: malloc failed allocating zipf generator\n");
+        return NULL;
+    }
+    if(!(zf->cdf = (double*)malloc(n * sizeof(double)))) {
+        printf("Error: malloc failed allocating zipf generator\n");
+        free(zf);
+        return NULL;
+    }
+    zf->n = n;
+    zf->state = seed;
+
+    double sum = 0;
+    for(int k = 0; k < n; k++) {
+        sum += pow(k + 1, -s);
+        zf->cdf[k] = sum;
+    }
+    for(int k = 0; k < n; k++) zf->cdf[k] /= sum;
+    zf->cdf[n - 1] = 1.0;
+    return (zipf_t*)zf;
+}
+
+
+/****************************************************************
+ * zfclose -- free a generator
+****************************************************************/
+void zfclose(zipf_t *zfp) {
+    if(zfp == NULL) return;
+    zf_t *zf = (zf_t*)zfp;
+    free(zf->cdf);
+    free(zf);
+}
+
+
+/****************************************************************
+ * zfrand -- splitmix64
+****************************************************************/
+uint64_t zfrand(zipf_t *zfp) {
+    zf_t *zf = (zf_t*)zfp;
+    uint64_t z = (zf->state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+
+/****************************************************************
+ * zfnext -- the first rank whose cumulative probability reaches a
+ * uniform draw in [0, 1)
+****************************************************************/
+int zfnext(zipf_t *zfp) {
+    zf_t *zf = (zf_t*)zfp;
+    double u = (zfrand(zfp) >> 11) * (1.0 / (1ULL << 53));
+    int lo = 0, hi = zf->n - 1;
+    while(lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if(zf->cdf[mid] > u) hi = mid;
+        else lo = mid + 1;
+    }
+    return lo;
+}
+
+
+/****************************************************************
+ * zfword -- rank + __SYLLABLES written in base __SYLLABLES, one
+ * syllable per digit; so every word has at least two syllables
+ * and no two ranks share one
+****************************************************************/
+int zfword(int rank, char *buf, size_t buflen) {
+    char word[32];
+    int len = sizeof(word);
+    word[--len] = '\0';
+    for(uint64_t v = (uint64_t)rank + __SYLLABLES; v > 0; v /= __SYLLABLES) {
+        int syllable = v % __SYLLABLES;
+        word[--len] = vowels[syllable % __NVOWELS];
+        word[--len] = consonants[syllable / __NVOWELS];
+    }
+    return snprintf(buf, buflen, "%s", word + len);
+}
+
+
+/****************************************************************
+ * zfurl -- a page named after the rank's word, in a directory and
+ * on a host shared with neighbouring ranks
+****************************************************************/
+int zfurl(int rank, char *buf, size_t buflen) {
+    char dir[32], page[32];
+    zfword(rank / 64, dir, sizeof(dir));
+    zfword(rank, page, sizeof(page));
+    return snprintf(buf, buflen, "http://site%d.example.org/%s/%s.html",
+                    rank % __HOSTS, dir, page);
+}
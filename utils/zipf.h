@@ -0,0 +1,40 @@
+#pragma once
+/*
+ * zipf.h -- reproducible synthetic workloads
+ *
+ * A Zipf generator draws ranks 0..n-1, rank k with probability
+ * proportional to 1/(k+1)^s, as word and URL frequencies roughly
+ * are: with s = 1 the most common tenth of 100000 keys makes up
+ * about four fifths of the draws. The same seed always gives the
+ * same sequence. A generator must not be shared between threads.
+ *
+ * zfword() and zfurl() turn a rank into a key: a lowercase word of
+ * at least four letters, or a URL on one of a few hosts. Different
+ * ranks always give different keys.
+ */
+#include <stdint.h>
+#include <stddef.h>
+
+/* the generator representation is hidden from users of the module */
+typedef void zipf_t;
+
+/* zfopen -- open a generator of ranks 0..n-1 with skew s >= 0
+ * (0 draws uniformly), seeded with seed
+ * returns NULL on failure
+ */
+zipf_t *zfopen(int n, double s, uint64_t seed);
+
+/* zfclose -- free a generator */
+void zfclose(zipf_t *zf);
+
+/* zfnext -- draw the next rank */
+int zfnext(zipf_t *zf);
+
+/* zfrand -- draw a uniform 64-bit number from the same stream */
+uint64_t zfrand(zipf_t *zf);
+
+/* zfword, zfurl -- write the key of a rank into buf, cut to fit
+ * returns the length of the key
+ */
+int zfword(int rank, char *buf, size_t buflen);
+int zfurl(int rank, char *buf, size_t buflen);
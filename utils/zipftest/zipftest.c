@@ -0,0 +1,141 @@
+/****************************************************************
+ * file   zipftest.c
+ * author Tian Xia (tian.xia.ug@dartmouth.edu)
+ * date   December 2, 2021
+ *
+ * Tests that the zipf.h module draws ranks with Zipf frequencies,
+ * repeats a sequence for the same seed, and makes distinct words
+ * and URLs
+ *
+****************************************************************/
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include<ctype.h>
+#include<math.h>
+#include"hash.h"
+#include"zipf.h"
+
+/****************************************************************
+ * Define macro, globals and helper functions
+****************************************************************/
+#define eprintf(format, ...) do {                 \
+    if (verbose)                                  \
+        fprintf(stderr, format, ##__VA_ARGS__);   \
+} while(0)
+#define verbose 1
+
+#define __RANKS 100000
+#define __DRAWS 1000000
+#define __MAXKEY 128
+
+static int counts[__RANKS];
+
+static bool streq(void *elementp, const void *keyp) {
+    return !strcmp((const char*)elementp, (const char*)keyp);
+}
+
+
+/****************************************************************
+ * Private helper function: check that the keys of all ranks are
+ * distinct
+****************************************************************/
+static int distinct(int (*key)(int, char*, size_t), const char *what) {
+    hashtable_t *h = hopen(__RANKS);
+    int errors = 0;
+    for(int r = 0; r < __RANKS && !errors; r++) {
+        char *k = (char*)malloc(__MAXKEY);
+        int len = key(r, k, __MAXKEY);
+        if(hsearch(h, streq, k, len) != NULL) {
+            eprintf("%s %s repeated at rank %d\n", what, k, r);
+            errors++;
+        }
+        hput(h, k, k, len);
+    }
+    hclose(h);
+    return errors;
+}
+
+
+int main(void) {
+
+    int errors = 0;
+
+    // Rank k comes up in proportion to 1/(k+1)
+    zipf_t *zf = zfopen(__RANKS, 1.0, 42);
+    for(int i = 0; i < __DRAWS; i++) {
+        int r = zfnext(zf);
+        if(r < 0 || r >= __RANKS) {
+            eprintf("rank %d out of range\n", r);
+            errors++;
+            break;
+        }
+        counts[r]++;
+    }
+    zfclose(zf);
+    double harmonic = 0;
+    for(int k = 1; k <= __RANKS; k++) harmonic += 1.0 / k;
+    int ranks[] = {0, 1, 9, 99};
+    for(int i = 0; i < 4; i++) {
+        int k = ranks[i];
+        double want = __DRAWS / harmonic / (k + 1);
+        if(fabs(counts[k] - want) > 5 * sqrt(want)) {
+            eprintf("rank %d drawn %d times, expected about %.0f\n", k,
+                    counts[k], want);
+            errors++;
+        }
+    }
+
+    // Without skew, every rank is as likely
+    memset(counts, 0, sizeof(counts));
+    zf = zfopen(10, 0, 7);
+    for(int i = 0; i < __DRAWS; i++) counts[zfnext(zf)]++;
+    zfclose(zf);
+    for(int k = 0; k < 10; k++) {
+        if(abs(counts[k] - __DRAWS / 10) > 2000) {
+            eprintf("rank %d drawn %d times without skew\n", k, counts[k]);
+            errors++;
+        }
+    }
+
+    // The same seed gives the same sequence
+    zipf_t *a = zfopen(1000, 1.2, 99), *b = zfopen(1000, 1.2, 99);
+    for(int i = 0; i < 1000; i++) {
+        if(zfnext(a) != zfnext(b) || zfrand(a) != zfrand(b)) {
+            eprintf("%s\n", "sequences differ for the same seed");
+            errors++;
+            break;
+        }
+    }
+    zfclose(a);
+    zfclose(b);
+    if(zfopen(0, 1, 1) != NULL || zfopen(10, -1, 1) != NULL) {
+        eprintf("%s\n", "bad arguments accepted");
+        errors++;
+    }
+
+    // Words are lowercase, four letters or more, and never repeat
+    char word[__MAXKEY];
+    for(int r = 0; r < __RANKS; r += 997) {
+        int len = zfword(r, word, sizeof(word));
+        for(int i = 0; i < len; i++) if(!islower(word[i])) len = 0;
+        if(len < 4) {
+            eprintf("bad word %s for rank %d\n", word, r);
+            errors++;
+        }
+    }
+    errors += distinct(zfword, "word");
+    errors += distinct(zfurl, "URL");
+    zfurl(12345, word, sizeof(word));
+    eprintf("rank 12345 is %s\n", word);
+
+    if(errors) {
+        eprintf("%d errors\n", errors);
+        exit(EXIT_FAILURE);
+    }
+    eprintf("%s passed\n", "zipf");
+    exit(EXIT_SUCCESS);
+}